@@ -1,14 +1,54 @@
 #ifndef APP_H
 #define APP_H
 
+#include "bootmeta.h"
+#include "burst.h"
 #include "cfgmgt.h"
+#include "dedupe.h"
 #include "error.h"
+#include "jobgraph.h"
+#include "motion.h"
+#include "telemetry.h"
 
 // Logger name for this module
 #define APP_LOG "App"
 // Current application version
 #define APP_VERSION "0.1.0"
 
+/**
+ * Index of each job of the wake cycle graph.
+ * It must follow the job declaration order in takeAndSavePicture().
+ *
+ * @see takeAndSavePicture()
+ */
+typedef enum {
+  APP_JOB_CONFIG = 0,
+  APP_JOB_CAMERA,
+  APP_JOB_WIFI,
+  APP_JOB_PICTURE,
+  APP_JOB_TIME,
+  APP_JOB_SAVE,
+  APP_JOB_UPLOAD,
+  APP_JOB_OTA
+} app_job_t;
+
+/**
+ * State of a wake cycle, shared by its jobs.
+ *
+ * @see takeAndSavePicture()
+ */
+typedef struct {
+  camera_fb_t *fb;              // Frame buffer of the taken picture. Returned early once saved on the SD card.
+  burst_t burst;                // Pictures following the first one, when camera_settings_t.burstCount > 1
+  char pictureName[20];         // Name of the uploaded picture when it could not be saved on the SD card
+  fileCounters_t fileCounters;  // File counters loaded from the SD card
+  bool duplicate;               // True when the picture is a near-duplicate kept on the SD card only
+  uint64_t pictureHash;         // Difference hash of the picture, 0 when the near-duplicate check is disabled
+  bool pictureSavedOnSd;        // True when the picture has been saved on the SD card, or queued by writePictureBehind()
+  status_code_t saveResult;     // Result of the picture saving on the SD card
+  status_code_t uploadResult;   // Result of the picture upload
+} wake_cycle_t;
+
 /**
  * @brief The application starts here.
  */
@@ -21,6 +61,61 @@ void setup();
  */
 status_code_t takeAndSavePicture();
 
+/**
+ * @brief Record the timing of the jobs which have been run in the telemetry.
+ */
+void recordJobPhases(job_t *jobs, uint8_t jobCount);
+
+/**
+ * @brief Job setting up the application configuration.
+ */
+status_code_t configJob(void *context);
+
+/**
+ * @brief Job initializing the camera.
+ */
+status_code_t cameraJob(void *context);
+
+/**
+ * @brief Job associating with the WiFi network early when it is required.
+ */
+status_code_t wifiJob(void *context);
+
+/**
+ * @brief Job taking the picture.
+ */
+status_code_t pictureJob(void *context);
+
+/**
+ * @brief Job synchronizing the time with NTP.
+ */
+status_code_t timeJob(void *context);
+
+/**
+ * @brief Job saving the picture on the SD card.
+ */
+status_code_t saveJob(void *context);
+
+/**
+ * @brief Job uploading the picture(s).
+ */
+status_code_t uploadJob(void *context);
+
+/**
+ * @brief Save the burst pictures following the first one on the SD card.
+ */
+status_code_t saveBurstPictures(wake_cycle_t *wakeCycle);
+
+/**
+ * @brief Job checking for a firmware update.
+ */
+status_code_t otaJob(void *context);
+
+/**
+ * @brief Write the pictures still queued by write-behind: the barrier before an OTA restart, the eviction and the deep sleep.
+ */
+bool flushPicturesBehind();
+
 /**
  * @brief Prepare the deep sleep and how to be waked up.
  */
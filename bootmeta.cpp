@@ -0,0 +1,139 @@
+#include "bootmeta.h"
+
+// Boot metadata in RTC memory given to initBootMetadata(), else in RAM
+static boot_metadata_t ramBootMetadata;
+static boot_metadata_t *bootMetadata = &ramBootMetadata;
+
+/**
+ * @brief Give the boot metadata in RTC memory to the module.
+ *        Without it, the catalog head is kept in RAM.
+ *
+ * @param metadata the boot metadata in RTC memory
+ */
+void initBootMetadata(boot_metadata_t *metadata) {
+  bootMetadata = metadata;
+}
+
+/**
+ * @brief Compute the CRC-32 of the boot metadata, their crc field excluded.
+ *
+ * @param metadata the boot metadata
+ *
+ * @return the CRC-32
+ */
+static uint32_t computeBootMetadataCrc(const boot_metadata_t *metadata) {
+  return crc32_le(0, (const uint8_t *)metadata, offsetof(boot_metadata_t, crc));
+}
+
+/**
+ * @brief Check the boot metadata.
+ *
+ * @return true when their magic number and their CRC are right
+ */
+static bool isBootMetadataValid() {
+  return bootMetadata->magic == BOOT_METADATA_MAGIC && bootMetadata->crc == computeBootMetadataCrc(bootMetadata);
+}
+
+/**
+ * @brief Read the catalog records of the first pictures to upload, up to the last cataloged one.
+ *
+ * @param fileCounters the file counters
+ */
+static void readCatalogHead(const fileCounters_t *fileCounters) {
+  bootMetadata->catalogLastIndex = getCatalogLastIndex();
+  bootMetadata->catalogHeadIndex = fileCounters->uploadedPictureCounter + 1;
+  if (bootMetadata->catalogLastIndex > fileCounters->uploadedPictureCounter) {
+    uint32_t count = bootMetadata->catalogLastIndex - fileCounters->uploadedPictureCounter;
+    bootMetadata->catalogHeadCount = count < CATALOG_READ_RECORDS ? count : CATALOG_READ_RECORDS;
+    readCatalogRecords(bootMetadata->catalogHeadIndex, bootMetadata->catalogHead, bootMetadata->catalogHeadCount);
+  }
+}
+
+/**
+ * @brief Set up the application configuration and, at a cold boot, read the metadata of the SD card in a single pass:
+ *        configuration snapshot, SD card strategy, counters and catalog head.
+ *
+ * The SD card is mounted once. The configuration is set up by initAppConfig(),
+ * from its snapshot when the configuration file didn't change. When the pictures are saved on the SD card,
+ * the SD card strategy is applied by loadSdStrategy() from the cached benchmark results, resolving PICTURE_STORAGE_AUTO,
+ * the counters are loaded in their RTC mirror by loadOrCreateFileCounters()
+ * and the catalog records of the first pictures to upload are read at once, as the upload would.
+ * The save and upload jobs then find everything in RTC memory, without opening any of these files again.
+ *
+ * At the next wake ups, the configuration and the counters are already in RTC memory: nothing is read.
+ * The catalog head is given to the upload of the cold boot cycle only, as the records change afterwards.
+ * The pass gates the camera job: it never measures the SD card. A card to measure, at its first mount
+ * or on demand, is measured by the save job, after the picture is taken. With PICTURE_STORAGE_AUTO,
+ * the layout is unknown until then, so the counters and the catalog head are left to the save and upload jobs.
+ * A failure of the pass is not fatal: the save job reads the metadata it needs on its own.
+ * The pass is recorded in the telemetry as the TELEMETRY_PHASE_BOOT_METADATA phase.
+ *
+ * @param appConfig the application configuration
+ *
+ * @return the initAppConfig() result
+ *
+ * @see takeBootCatalogHead()
+ */
+status_code_t loadBootMetadata(app_config_t *appConfig) {
+  bool coldBoot = !appConfig->setupConfigDone;
+  uint32_t startUs = getTelemetryTimeUs();
+  fileCounters_t fileCounters;
+
+  if (!coldBoot) {
+    if (isBootMetadataValid() && bootMetadata->catalogHeadCount) {
+      bootMetadata->catalogHeadCount = 0;
+      bootMetadata->crc = computeBootMetadataCrc(bootMetadata);
+    }
+    return initAppConfig(appConfig);
+  }
+
+  memset(bootMetadata, 0, sizeof(boot_metadata_t));
+  bootMetadata->magic = BOOT_METADATA_MAGIC;
+  status_code_t mountResult = initSdCard();
+  status_code_t result = initAppConfig(appConfig);
+  if (mountResult == IS_OK && appConfig->savePictureOnSdCard) {
+    // Not fatal: the save job calibrates the SD card, measuring it when needed
+    if (!appConfig->sdBenchmark) {
+      loadSdStrategy(appConfig->flushDeadlineMs, &(appConfig->pictureStorage));
+    }
+    if (appConfig->pictureStorage != PICTURE_STORAGE_AUTO && loadOrCreateFileCounters(&fileCounters, appConfig->pictureStorage) == IS_OK) {
+      readCatalogHead(&fileCounters);
+    }
+  }
+  bootMetadata->loadDurationUs = getTelemetryTimeUs() - startUs;
+  bootMetadata->crc = computeBootMetadataCrc(bootMetadata);
+  recordPhase(TELEMETRY_PHASE_BOOT_METADATA, startUs, mountResult);
+  logInfo(BOOT_METADATA_LOG, "Boot metadata loaded in %u us, catalog head of %u record(s) from picture %u.",
+          (unsigned int)bootMetadata->loadDurationUs, bootMetadata->catalogHeadCount, (unsigned int)bootMetadata->catalogHeadIndex);
+  return result;
+}
+
+/**
+ * @brief Take the catalog records of the first pictures to upload read by the cold boot pass, once.
+ *
+ * The records are given when firstIndex is within the catalog head, up to its end:
+ * the next ones are read from the catalog. The catalog head is dropped then,
+ * so records updated afterwards are never given.
+ *
+ * @param firstIndex the index of the first picture, from 1
+ * @param records    the array receiving the records. A missing or damaged record has a 0 index.
+ * @param count      the maximum number of records to take
+ *
+ * @return the number of records taken from firstIndex, 0 when they have to be read from the catalog
+ */
+uint8_t takeBootCatalogHead(uint32_t firstIndex, catalog_record_t *records, uint8_t count) {
+  uint8_t taken = 0;
+
+  if (!isBootMetadataValid() || !bootMetadata->catalogHeadCount) {
+    return 0;
+  }
+  uint32_t offset = firstIndex - bootMetadata->catalogHeadIndex;
+  if (firstIndex >= bootMetadata->catalogHeadIndex && offset < bootMetadata->catalogHeadCount) {
+    taken = bootMetadata->catalogHeadCount - offset;
+    taken = taken < count ? taken : count;
+    memcpy(records, &(bootMetadata->catalogHead[offset]), taken * sizeof(catalog_record_t));
+  }
+  bootMetadata->catalogHeadCount = 0;
+  bootMetadata->crc = computeBootMetadataCrc(bootMetadata);
+  return taken;
+}
@@ -0,0 +1,67 @@
+#ifndef BOOTMETA_H
+#define BOOTMETA_H
+
+#include "Arduino.h"
+#include "catalog.h"
+#include "cfgmgt.h"
+#include "error.h"
+#include "logging.h"
+#include "sd.h"
+#include "sdbench.h"
+#include "telemetry.h"
+#include "esp32/rom/crc.h"
+
+// Logger name for this module
+#define BOOT_METADATA_LOG "BootMeta"
+
+// Magic number of the boot metadata in RTC memory: "CKBT"
+#define BOOT_METADATA_MAGIC 0x54424B43
+
+/**
+ * Metadata read from the SD card by the single pass of a cold boot, kept in RTC memory along deep sleep.
+ * See the global variable bootMetadata in the main file.
+ * The configuration snapshot and the counters are kept in RTC memory by their own modules:
+ * app_config_t and file_counters_mirror_t.
+ *
+ * @see loadBootMetadata()
+ */
+typedef struct {
+  uint32_t magic;                                   // BOOT_METADATA_MAGIC
+  uint32_t loadDurationUs;                          // Duration of the pass, the mount and the configuration included
+  uint32_t catalogLastIndex;                        // Index of the last catalog record at the pass, see getCatalogLastIndex()
+  uint32_t catalogHeadIndex;                        // Index of the first record of catalogHead: the first picture to upload
+  uint8_t catalogHeadCount;                         // Number of records of catalogHead, 0 once taken or after the cold boot cycle
+  uint8_t reserved[3];                              // 0
+  catalog_record_t catalogHead[CATALOG_READ_RECORDS]; // Catalog records of the first pictures to upload
+  uint32_t crc;                                     // CRC-32 of the fields above, wrong after a power on
+} boot_metadata_t;
+
+/**
+ * @brief Give the boot metadata in RTC memory to the module.
+ *
+ * @param metadata the boot metadata in RTC memory
+ */
+void initBootMetadata(boot_metadata_t *metadata);
+
+/**
+ * @brief Set up the application configuration and, at a cold boot, read the metadata of the SD card in a single pass:
+ *        configuration snapshot, SD card strategy, counters and catalog head.
+ *
+ * @param appConfig the application configuration
+ *
+ * @return the initAppConfig() result
+ */
+status_code_t loadBootMetadata(app_config_t *appConfig);
+
+/**
+ * @brief Take the catalog records of the first pictures to upload read by the cold boot pass, once.
+ *
+ * @param firstIndex the index of the first picture, from 1
+ * @param records    the array receiving the records. A missing or damaged record has a 0 index.
+ * @param count      the maximum number of records to take
+ *
+ * @return the number of records taken from firstIndex, 0 when they have to be read from the catalog
+ */
+uint8_t takeBootCatalogHead(uint32_t firstIndex, catalog_record_t *records, uint8_t count);
+
+#endif
@@ -0,0 +1,104 @@
+#include "burst.h"
+
+/**
+ * @brief FreeRTOS task capturing the frames of a burst at the configured interval.
+ *        Each frame is queued for the writer, then the end of the burst.
+ *
+ * The frame buffers are the backpressure: when the writer holds them all,
+ * esp_camera_fb_get() waits for one to be returned.
+ *
+ * @param param the burst_t
+ */
+static void captureBurstTask(void *param) {
+  burst_t *burst = (burst_t *)param;
+  camera_fb_t *fb = NULL;
+  unsigned long lastCaptureMs = millis();
+
+  for (uint8_t i = 0; i < burst->frameCount; i++) {
+    unsigned long elapsedMs = millis() - lastCaptureMs;
+    if (elapsedMs < burst->intervalMs) {
+      delay(burst->intervalMs - elapsedMs);
+    }
+    lastCaptureMs = millis();
+    fb = esp_camera_fb_get();
+    if (!fb) {
+      logError(BURST_LOG, "%s: failed to capture frame #%d.", __func__, i + 2);
+      break;
+    }
+    xQueueSend(burst->frames, &fb, portMAX_DELAY);
+  }
+
+  // The burst must not be used after the end marker: its owner may release it.
+  fb = NULL;
+  xQueueSend(burst->frames, &fb, portMAX_DELAY);
+  vTaskDelete(NULL);
+}
+
+/**
+ * @brief Start capturing frames in the background.
+ *
+ * The first picture has been taken by takePicture(): the burst captures the next ones.
+ *
+ * @param burst      the burst to start
+ * @param frameCount the number of frames to capture, the first picture excluded
+ * @param intervalMs the interval between two frame captures
+ *
+ * @return IS_OK when it succeeds or CAMERA_TAKE_PICTURE_ERROR in case of failure
+ */
+status_code_t startBurst(burst_t *burst, uint8_t frameCount, uint16_t intervalMs) {
+  burst->frameCount = min(frameCount, (uint8_t)BURST_COUNT_MAX);
+  burst->intervalMs = intervalMs;
+  burst->ended = false;
+  burst->frames = xQueueCreate(BURST_QUEUE_LENGTH, sizeof(camera_fb_t *));
+  if (!burst->frames) {
+    logError(BURST_LOG, "%s: failed to create the frame queue.", __func__);
+    return CAMERA_TAKE_PICTURE_ERROR;
+  }
+  if (xTaskCreatePinnedToCore(captureBurstTask, "burst", BURST_TASK_STACK_SIZE, burst, BURST_TASK_PRIORITY, NULL, tskNO_AFFINITY) != pdPASS) {
+    logError(BURST_LOG, "%s: failed to create the capture task.", __func__);
+    vQueueDelete(burst->frames);
+    burst->frames = NULL;
+    return CAMERA_TAKE_PICTURE_ERROR;
+  }
+  logInfo(BURST_LOG, "Burst of %d frame(s) every %d ms started.", burst->frameCount, burst->intervalMs);
+  return IS_OK;
+}
+
+/**
+ * @brief Wait for the next frame of the burst.
+ *        The caller returns it with esp_camera_fb_return() as soon as possible,
+ *        so the sensor can fill it again.
+ *
+ * @param burst the started burst
+ *
+ * @return the next frame, NULL at the end of the burst
+ */
+camera_fb_t *nextBurstFrame(burst_t *burst) {
+  camera_fb_t *fb = NULL;
+  if (!burst->frames || burst->ended) {
+    return NULL;
+  }
+  xQueueReceive(burst->frames, &fb, portMAX_DELAY);
+  burst->ended = (fb == NULL);
+  return fb;
+}
+
+/**
+ * @brief Return the frames not consumed yet, wait for the end of the capture
+ *        and release the burst.
+ *
+ * It must be called before the camera is released, even when the burst has not been started.
+ *
+ * @param burst the burst, started or not
+ */
+void endBurst(burst_t *burst) {
+  camera_fb_t *fb;
+  if (!burst->frames) {
+    return;
+  }
+  while ((fb = nextBurstFrame(burst)) != NULL) {
+    esp_camera_fb_return(fb);
+  }
+  vQueueDelete(burst->frames);
+  burst->frames = NULL;
+}
@@ -0,0 +1,72 @@
+#ifndef BURST_H
+#define BURST_H
+
+#include "Arduino.h"
+#include "error.h"
+#include "logging.h"
+#include "esp_camera.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+// Logger name for this module
+#define BURST_LOG "Burst"
+
+// Default value of camera_settings_t.burstCount
+#define BURST_COUNT_DEFAULT 1
+// Default value of camera_settings_t.burstIntervalMs
+#define BURST_INTERVAL_MS_DEFAULT 250
+// Maximum value of camera_settings_t.burstCount
+#define BURST_COUNT_MAX 20
+// Stack size in bytes of the capture task
+#define BURST_TASK_STACK_SIZE 4096
+// Priority of the capture task
+#define BURST_TASK_PRIORITY 1
+// Number of captured frames waiting to be written.
+// With 2 frame buffers, one is written while the sensor fills the other one.
+#define BURST_QUEUE_LENGTH 1
+
+/**
+ * Burst of frames captured by a background task after the first picture.
+ * The frames are consumed in order by nextBurstFrame(), i.e. written
+ * on the SD card while the next one is captured.
+ *
+ * @see startBurst()
+ */
+typedef struct {
+  uint8_t frameCount;     // Number of frames to capture, the first picture excluded
+  uint16_t intervalMs;    // Interval between two frame captures
+  QueueHandle_t frames;   // Captured camera_fb_t pointers. NULL marks the end of the burst.
+  bool ended;             // True once the end of the burst has been consumed
+} burst_t;
+
+/**
+ * @brief Start capturing frames in the background.
+ *
+ * @param burst      the burst to start
+ * @param frameCount the number of frames to capture, the first picture excluded
+ * @param intervalMs the interval between two frame captures
+ *
+ * @return IS_OK when it succeeds or CAMERA_TAKE_PICTURE_ERROR in case of failure
+ */
+status_code_t startBurst(burst_t *burst, uint8_t frameCount, uint16_t intervalMs);
+
+/**
+ * @brief Wait for the next frame of the burst.
+ *        The caller returns it with esp_camera_fb_return() as soon as possible.
+ *
+ * @param burst the started burst
+ *
+ * @return the next frame, NULL at the end of the burst
+ */
+camera_fb_t *nextBurstFrame(burst_t *burst);
+
+/**
+ * @brief Return the frames not consumed yet, wait for the end of the capture
+ *        and release the burst.
+ *
+ * @param burst the burst, started or not
+ */
+void endBurst(burst_t *burst);
+
+#endif
@@ -1,17 +1,44 @@
 #include "camera.h"
 
+// OV2640 GAIN register value of each sensor_t.set_agc_gain() index, like the esp32-camera driver
+static const uint8_t ov2640GainRegisters[] = {
+  0x00, 0x10, 0x18, 0x30, 0x34, 0x38, 0x3C, 0x70, 0x72, 0x74, 0x76, 0x78, 0x7A, 0x7C, 0x7E, 0xF0,
+  0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA, 0xFB, 0xFC, 0xFD, 0xFE, 0xFF
+};
+
+/**
+ * @brief Compute the gain of an OV2640 GAIN register value:
+ *        (bit7 + 1) * (bit6 + 1) * (bit5 + 1) * (bit4 + 1) * (1 + bits[3:0] / 16).
+ *
+ * @param reg the GAIN register value
+ *
+ * @return the gain multiplied by 16
+ */
+static uint16_t computeOv2640Gain(uint8_t reg) {
+  uint16_t gain = 16 + (reg & 0x0F);
+  for (uint8_t bit = 4; bit < 8; bit++) {
+    if (reg & (1 << bit)) {
+      gain *= 2;
+    }
+  }
+  return gain;
+}
+
 /**
  * @brief Initializes the camera sensor according to the given camera settings.
  * 
  * It must be called before calling takePicture().
+ * The converged values of the previous wake up seed the sensor,
+ * which shortens the warm-up.
  *
- * @param camera camera settings.
+ * @param camera    camera settings.
+ * @param warmStart converged values of the previous wake up used to seed the sensor
  *
  * @return IS_OK when it succeeds. CAMERA_INIT_ERROR in case of failure.
  *
  * @see camera_settings_t
  */
-status_code_t initCamera(camera_settings_t *cameraSettings) {
+status_code_t initCamera(camera_settings_t *cameraSettings, sensor_warm_start_t *warmStart) {
   // Disable brownout detector
   // https://iotespresso.com/how-to-disable-brownout-detector-in-esp32-in-arduino/
   WRITE_PERI_REG(RTC_CNTL_BROWN_OUT_REG, 0);
@@ -54,7 +81,7 @@ status_code_t initCamera(camera_settings_t *cameraSettings) {
 
   // Camera quality adjustments
   sensor_t *s = esp_camera_sensor_get();
-#ifdef LOG_LEVEL >= LOG_LEVEL_DEBUG
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
   logDebug(CAMERA_LOG, "Sensor default settings:\n");
   logCameraStatus(&(s->status));
 #endif
@@ -66,22 +93,191 @@ status_code_t initCamera(camera_settings_t *cameraSettings) {
     if (sensorSetting->enabled) {
       // Apply enabled sensor setting
       logDebug(CAMERA_LOG, "%s: sensorSetting #%d.", __func__, i);
-      int (**setter)(sensor_t *, int) = (int (**)(sensor_t *, int))((unsigned int)s + sensorSetting->setterOffset);
-      (*setter)(s, sensorSetting->value);
+      applySensorSetting(s, sensorSetting);
     }
   }
+  bool seeded = seedSensor(s, cameraSettings, warmStart);
 
-#ifdef LOG_LEVEL >= LOG_LEVEL_INFO
+#if LOG_LEVEL >= LOG_LEVEL_INFO
   logInfo(CAMERA_LOG, "Sensor with customer settings:\n");
   logCameraStatus(&(s->status));
 #endif
 
   // Wait until camera is ready: avoid green dark pictures.
-  // Less than 1s does not work.
-  delay(cameraSettings->getReadyDelayMs);
+  // Less than 1s does not work with a fixed delay.
+  uint32_t readyStartUs = getTelemetryTimeUs();
+  if (cameraSettings->adaptiveWarmUp) {
+    waitForSensorConvergence(s, seeded ? CAMERA_WARM_UP_SEEDED_MIN_MS : CAMERA_WARM_UP_MIN_MS, cameraSettings->getReadyDelayMs);
+  } else {
+    delay(cameraSettings->getReadyDelayMs);
+  }
+  recordPhase(TELEMETRY_PHASE_CAMERA_READY, readyStartUs, IS_OK);
   return IS_OK;
 }
 
+/**
+ * @brief Apply a sensor setting, i.e. call the sensor_t setter at its offset.
+ *
+ * @param s             the sensor
+ * @param sensorSetting the setting to apply
+ */
+void applySensorSetting(sensor_t *s, sensor_param_setter_t *sensorSetting) {
+  int (**setter)(sensor_t *, int) = (int (**)(sensor_t *, int))((uintptr_t)s + sensorSetting->setterOffset);
+  (*setter)(s, sensorSetting->value);
+}
+
+/**
+ * @brief Seed the sensor with the converged values of the previous wake up
+ *        when they are recent enough.
+ *
+ * Triggers a few minutes apart see nearly the same light,
+ * so the auto exposure and gain start from there instead of from a dark frame.
+ * They keep running: the values are only a starting point.
+ * The exposure and the gain explicitly set in the camera settings are kept.
+ *
+ * @param s              the sensor
+ * @param cameraSettings camera settings: explicit exposure and gain settings are kept
+ * @param warmStart      the converged values
+ *
+ * @return true when the sensor has been seeded
+ */
+bool seedSensor(sensor_t *s, camera_settings_t *cameraSettings, sensor_warm_start_t *warmStart) {
+  if (!warmStart->valid) {
+    return false;
+  }
+  time_t age = time(NULL) - warmStart->savedTime;
+  if (age < 0 || age > CAMERA_WARM_START_MAX_AGE_SEC) {
+    logInfo(CAMERA_LOG, "%s: converged values are too old (%ld s).", __func__, (long)age);
+    return false;
+  }
+
+  sensor_param_setter_t seeds[] = {
+    { !cameraSettings->sensor.aec_value.enabled, warmStart->exposure, offsetof(sensor_t, set_aec_value) },
+    { !cameraSettings->sensor.agc_gain.enabled, warmStart->gain, offsetof(sensor_t, set_agc_gain) }
+  };
+  bool seeded = false;
+  for (uint8_t i = 0; i < sizeof(seeds) / sizeof(sensor_param_setter_t); i++) {
+    if (seeds[i].enabled) {
+      applySensorSetting(s, &(seeds[i]));
+      seeded = true;
+    }
+  }
+  logInfo(CAMERA_LOG, "%s: exposure = %d, gain = %d, age = %ld s.", __func__, warmStart->exposure, warmStart->gain, (long)age);
+  return seeded;
+}
+
+/**
+ * @brief Save the converged exposure and gain of the sensor for the next wake up.
+ *        It must be called after a successful takePicture().
+ *
+ * The OV2640 white balance gains are not readable, so they are not saved.
+ *
+ * @param warmStart the sensor_warm_start_t receiving the values
+ */
+void saveSensorWarmStart(sensor_warm_start_t *warmStart) {
+  sensor_t *s = esp_camera_sensor_get();
+  sensor_exposure_t exposure;
+  if (!s || !readSensorExposure(s, &exposure)) {
+    warmStart->valid = false;
+    return;
+  }
+
+  // Gain index whose register value is the closest gain
+  uint16_t gain = computeOv2640Gain(exposure.gain);
+  uint8_t gainIndex = 0;
+  for (uint8_t i = 1; i < sizeof(ov2640GainRegisters); i++) {
+    if (abs(computeOv2640Gain(ov2640GainRegisters[i]) - gain) < abs(computeOv2640Gain(ov2640GainRegisters[gainIndex]) - gain)) {
+      gainIndex = i;
+    }
+  }
+
+  warmStart->exposure = exposure.exposure;
+  warmStart->gain = gainIndex;
+  warmStart->savedTime = time(NULL);
+  warmStart->valid = true;
+  logDebug(CAMERA_LOG, "%s: exposure = %d, gain = %d.", __func__, warmStart->exposure, warmStart->gain);
+}
+
+/**
+ * @brief Read the current exposure and gain of the sensor.
+ *
+ * Only the OV2640 sensor of the ESP32-Cam is supported:
+ * its registers are read as the camera_status_t only keeps the manual values.
+ *
+ * @param s        the sensor
+ * @param exposure the sensor_exposure_t receiving the values
+ *
+ * @return true when it succeeds, false when the sensor is not supported
+ */
+bool readSensorExposure(sensor_t *s, sensor_exposure_t *exposure) {
+  if (s->id.PID != OV2640_PID || !s->get_reg) {
+    return false;
+  }
+  int gain = s->get_reg(s, OV2640_REG_GAIN, 0xFF);
+  int aecLow = s->get_reg(s, OV2640_REG_REG04, 0x03);
+  int aecMiddle = s->get_reg(s, OV2640_REG_AEC, 0xFF);
+  int aecHigh = s->get_reg(s, OV2640_REG_REG45, 0x3F);
+  if (gain < 0 || aecLow < 0 || aecMiddle < 0 || aecHigh < 0) {
+    return false;
+  }
+  exposure->exposure = (aecHigh << 10) | (aecMiddle << 2) | aecLow;
+  exposure->gain = gain;
+  return true;
+}
+
+/**
+ * @brief Wait until the auto exposure and gain of the sensor converged,
+ *        at most maxDelayMs.
+ *
+ * After minDelayMs, the exposure and the gain are polled
+ * every CAMERA_WARM_UP_POLL_MS. They converged once they stayed close to
+ * the same reference values during CAMERA_WARM_UP_STABLE_POLL_COUNT consecutive polls.
+ * Comparing to a reference rather than to the previous poll detects the slow drifts.
+ * The white balance registers of the OV2640 are not readable:
+ * it is expected to converge along with the exposure.
+ * When the sensor is not supported, it waits maxDelayMs like before.
+ *
+ * @param s          the sensor
+ * @param minDelayMs the minimum delay
+ * @param maxDelayMs the maximum delay
+ *
+ * @return the warm-up duration in milliseconds
+ */
+uint32_t waitForSensorConvergence(sensor_t *s, uint16_t minDelayMs, uint16_t maxDelayMs) {
+  unsigned long startMs = millis();
+  sensor_exposure_t reference, current;
+
+  delay(min(minDelayMs, maxDelayMs));
+  if (!readSensorExposure(s, &reference)) {
+    logWarn(CAMERA_LOG, "%s: unsupported sensor, wait %d ms.", __func__, maxDelayMs);
+    delay(maxDelayMs - min((unsigned long)maxDelayMs, millis() - startMs));
+    return millis() - startMs;
+  }
+
+  current = reference;
+  uint8_t stablePollCount = 0;
+  while (stablePollCount < CAMERA_WARM_UP_STABLE_POLL_COUNT && millis() - startMs + CAMERA_WARM_UP_POLL_MS <= maxDelayMs) {
+    delay(CAMERA_WARM_UP_POLL_MS);
+    readSensorExposure(s, &current);
+    if (abs(current.exposure - reference.exposure) <= (reference.exposure >> CAMERA_WARM_UP_EXPOSURE_TOLERANCE_SHIFT)
+        && abs(current.gain - reference.gain) <= CAMERA_WARM_UP_GAIN_TOLERANCE) {
+      stablePollCount++;
+    } else {
+      // Still moving: start a new stable window from there
+      stablePollCount = 0;
+      reference = current;
+    }
+  }
+
+  uint32_t warmUpMs = millis() - startMs;
+  if (stablePollCount < CAMERA_WARM_UP_STABLE_POLL_COUNT) {
+    logWarn(CAMERA_LOG, "%s: no convergence after %d ms (exposure = %d, gain = %d).", __func__, warmUpMs, current.exposure, current.gain);
+  } else {
+    logInfo(CAMERA_LOG, "%s: converged in %d ms (exposure = %d, gain = %d).", __func__, warmUpMs, current.exposure, current.gain);
+  }
+  return warmUpMs;
+}
+
 /**
  * @brief Take a picture and store the data in the given frame buffer.
  *
@@ -90,30 +286,89 @@ status_code_t initCamera(camera_settings_t *cameraSettings) {
  * I prefer to return the pointer to the camera_fb_t by reference rather than
  * by the return value of the function reserved here to the status code.
  *
+ * A dark, green or corrupted picture is retaken, before the SD card or the network
+ * spend time on it. When all the retakes are dark or green, the last one is kept:
+ * it may be the real scene. When they are all corrupted, it fails.
+ *
  * @param cameraFrameBuffer pointer of pointer of camera frame buffer. Assigned by the function.
+ * @param retakeMax         maximum number of retakes, 0 to disable the check
  *
  * @return IS_OK when it succeeds. CAMERA_TAKE_PICTURE_ERROR in case of failure.
  */
-status_code_t takePicture(camera_fb_t **cameraFrameBuffer) {
+status_code_t takePicture(camera_fb_t **cameraFrameBuffer, uint8_t retakeMax) {
+  picture_defect_t defect = PICTURE_VALID;
+  jpeg_dc_t dc;
+
   *cameraFrameBuffer = NULL;
   logInfo(CAMERA_LOG, "Take a picture.");
-  // Take Picture with Camera
-  *cameraFrameBuffer = esp_camera_fb_get();
-  if (!*cameraFrameBuffer) {
-    logError(CAMERA_LOG, "Failed to take a picture.");
+  for (uint8_t take = 0; take <= retakeMax; take++) {
+    if (take) {
+      esp_camera_fb_return(*cameraFrameBuffer);
+      delay(CAMERA_RETAKE_DELAY_MS);
+      logInfo(CAMERA_LOG, "Retake the picture (%d/%d).", take, retakeMax);
+    }
+    // Take Picture with Camera
+    *cameraFrameBuffer = esp_camera_fb_get();
+    if (!*cameraFrameBuffer) {
+      logError(CAMERA_LOG, "Failed to take a picture.");
+      return CAMERA_TAKE_PICTURE_ERROR;
+    }
+    if (!retakeMax || (defect = checkPicture(*cameraFrameBuffer, &dc)) == PICTURE_VALID) {
+      break;
+    }
+  }
+
+  if (defect == PICTURE_CORRUPTED) {
+    logError(CAMERA_LOG, "Failed to take a valid picture.");
+    esp_camera_fb_return(*cameraFrameBuffer);
+    *cameraFrameBuffer = NULL;
     return CAMERA_TAKE_PICTURE_ERROR;
   }
+  // A dark or green picture may be the real scene: it is kept
   logInfo(CAMERA_LOG, "Done.");
   return IS_OK;
 }
 
+/**
+ * @brief Check a JPEG picture from its DC coefficients, in a few milliseconds.
+ *        It must be valid and neither dark nor green, like the pictures
+ *        of a sensor not ready yet.
+ *
+ * @param fb the frame buffer of the picture
+ * @param dc the jpeg_dc_t receiving the decoded means
+ *
+ * @return the defect found, PICTURE_VALID if none
+ */
+picture_defect_t checkPicture(const camera_fb_t *fb, jpeg_dc_t *dc) {
+  if (fb->format != PIXFORMAT_JPEG) {
+    return PICTURE_VALID;
+  }
+  if (!decodeJpegDc(fb->buf, fb->len, dc)) {
+    logWarn(CAMERA_LOG, "Corrupted picture: %s.", dc->error);
+    return PICTURE_CORRUPTED;
+  }
+  logDebug(CAMERA_LOG, "Picture means: Y = %d, Cb = %d, Cr = %d.", dc->mean[0], dc->mean[1], dc->mean[2]);
+  if (dc->mean[0] <= CAMERA_DARK_LUMA_MAX) {
+    logWarn(CAMERA_LOG, "Dark picture.");
+    return PICTURE_DARK;
+  }
+  if (dc->componentCount == 3 && dc->mean[1] <= 128 - CAMERA_GREEN_CHROMA_OFFSET && dc->mean[2] <= 128 - CAMERA_GREEN_CHROMA_OFFSET) {
+    logWarn(CAMERA_LOG, "Green picture.");
+    return PICTURE_GREEN;
+  }
+  return PICTURE_VALID;
+}
+
 /**
  * @brief Free the given frame buffer and disable the lamp.
  *
  * @param cameraFrameBuffer pointer of pointer of camera frame buffer. Assigned by the function.
  */
 void endCamera(camera_fb_t **cameraFrameBuffer) {
-  esp_camera_fb_return(*cameraFrameBuffer);
+  if (*cameraFrameBuffer) {
+    esp_camera_fb_return(*cameraFrameBuffer);
+    *cameraFrameBuffer = NULL;
+  }
   disableLamp();
 }
 
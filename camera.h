@@ -6,8 +6,10 @@
 #include "error.h"
 #include "logging.h"
 #include "esp_camera.h"
+#include "jpegdc.h"
 #include "soc/soc.h"
 #include "soc/rtc_cntl_reg.h"
+#include "telemetry.h"
 
 // Logger name for this module
 #define CAMERA_LOG "Camera"
@@ -42,6 +44,39 @@
 
 // Default value of camera_settings_t.getReadyDelayMs
 #define GET_READY_DELAY_MS_DEFAULT 1500
+// Default value of camera_settings_t.adaptiveWarmUp
+#define ADAPTIVE_WARM_UP_DEFAULT true
+
+// Minimum warm-up duration: the first frames are always dark and the white balance needs them too
+#define CAMERA_WARM_UP_MIN_MS 300
+// Period of the exposure and gain polling during the warm-up
+#define CAMERA_WARM_UP_POLL_MS 50
+// Number of consecutive stable polls to consider that the auto exposure and gain converged
+#define CAMERA_WARM_UP_STABLE_POLL_COUNT 3
+// Exposure variation tolerated between two stable polls: 1/2^n of the exposure
+#define CAMERA_WARM_UP_EXPOSURE_TOLERANCE_SHIFT 5
+// Gain variation tolerated between two stable polls
+#define CAMERA_WARM_UP_GAIN_TOLERANCE 1
+
+// Minimum warm-up duration when the sensor has been seeded with the previous converged values
+#define CAMERA_WARM_UP_SEEDED_MIN_MS 100
+// Maximum age of the converged values used to seed the sensor
+#define CAMERA_WARM_START_MAX_AGE_SEC 1800
+
+// Default value of camera_settings_t.retakeMax
+#define RETAKE_MAX_DEFAULT 2
+// Delay before retaking a defective picture
+#define CAMERA_RETAKE_DELAY_MS 100
+// Mean luminance up to which a picture is dark
+#define CAMERA_DARK_LUMA_MAX 12
+// Offset below 128 of both mean chroma from which a picture is green
+#define CAMERA_GREEN_CHROMA_OFFSET 32
+
+// OV2640 registers of the sensor bank, as addressed by sensor_t.get_reg() (bank in bit 8)
+#define OV2640_REG_GAIN 0x100   // AGC gain
+#define OV2640_REG_REG04 0x104  // AEC[1:0] in bits 1:0
+#define OV2640_REG_AEC 0x110    // AEC[9:2]
+#define OV2640_REG_REG45 0x145  // AEC[15:10] in bits 5:0
 
 /**
  * Helper structure to set a value to a sensor_t parameter.
@@ -110,33 +145,154 @@ typedef struct {
   uint16_t getReadyDelayMs;  // Delay to let the camera sensor get ready
                              // especially about the environment light.
                              // This prevents "green" pictures.
+                             // With the adaptive warm-up, it is the maximum delay.
                              // Default value is defined by GET_READY_DELAY_MS_DEFAULT.
                              // See configuration management to override this value.
+  bool adaptiveWarmUp;       // True to stop waiting as soon as the auto exposure and gain converged.
+                             // Default value is defined by ADAPTIVE_WARM_UP_DEFAULT.
+  uint8_t retakeMax;         // Maximum number of retakes of a dark, green or corrupted picture. 0 disables the check.
+                             // Default value is defined by RETAKE_MAX_DEFAULT.
+  uint8_t burstCount;        // Number of pictures taken at each wake up. The pictures following the first one
+                             // are saved on the SD card while the next ones are captured.
+                             // Default value is defined by BURST_COUNT_DEFAULT (see burst.h).
+  uint16_t burstIntervalMs;  // Interval between two pictures of a burst.
+                             // Default value is defined by BURST_INTERVAL_MS_DEFAULT (see burst.h).
+  bool motionCheck;          // True to check that something moved before keeping the picture, when the PIR woke the board up.
+                             // Default value is defined by MOTION_CHECK_DEFAULT (see motion.h).
+  uint8_t motionThreshold;   // Minimum brightness difference of a changed pixel between two frames.
+                             // Default value is defined by MOTION_THRESHOLD_DEFAULT (see motion.h).
+  uint16_t motionMinBlobCells;  // Minimum size of a moving blob, in cells of 4x4 pixels of a frame decoded at 1/8 scale.
+                                // Default value is defined by MOTION_MIN_BLOB_CELLS_DEFAULT (see motion.h).
+  uint8_t duplicateDistance;    // Maximum Hamming distance between the hashes of a near-duplicate picture and of a previous one.
+                                // 0 disables the check.
+                                // Default value is defined by DUPLICATE_DISTANCE_DEFAULT (see dedupe.h).
+  bool duplicateKeepOnSd;       // True to save the near-duplicate pictures on the SD card without uploading them.
+                                // False to drop them.
+                                // Default value is defined by DUPLICATE_KEEP_ON_SD_DEFAULT (see dedupe.h).
   union {
     sensor_settings_t sensor;                       // Sensor settings.
     sensor_param_setter_t sensorSettingsArray[27];  // Unioned with an array to easily browse sensor parameters setters.
   };
 } camera_settings_t;
 
+/**
+ * Converged exposure and gain of the last picture.
+ * Stored in the RTC memory, they seed the sensor at the next wake up,
+ * so the auto exposure and gain start close to their target.
+ * See the global variable sensorWarmStart in the main file.
+ *
+ * @see saveSensorWarmStart()
+ * @see seedSensor()
+ */
+typedef struct {
+  bool valid;         // True once values have been saved
+  uint16_t exposure;  // Exposure in lines, as given to sensor_t.set_aec_value()
+  uint8_t gain;       // Gain index, as given to sensor_t.set_agc_gain()
+  time_t savedTime;   // Time of the save. The RTC time goes on during the deep sleep.
+} sensor_warm_start_t;
+
 /**
  * @brief Initialize the camera sensor according to the given camera settings.
  *
- * @param camera camera settings.
+ * @param camera    camera settings.
+ * @param warmStart converged values of the previous wake up used to seed the sensor
  *
  * @return IS_OK when it succeeds. CAMERA_INIT_ERROR in case of failure.
  *
  * @see camera_settings_t
  */
-status_code_t initCamera(camera_settings_t *cameraSettings);
+status_code_t initCamera(camera_settings_t *cameraSettings, sensor_warm_start_t *warmStart);
+
+/**
+ * @brief Apply a sensor setting, i.e. call the sensor_t setter at its offset.
+ *
+ * @param s             the sensor
+ * @param sensorSetting the setting to apply
+ */
+void applySensorSetting(sensor_t *s, sensor_param_setter_t *sensorSetting);
+
+/**
+ * @brief Seed the sensor with the converged values of the previous wake up
+ *        when they are recent enough.
+ *
+ * @param s              the sensor
+ * @param cameraSettings camera settings: explicit exposure and gain settings are kept
+ * @param warmStart      the converged values
+ *
+ * @return true when the sensor has been seeded
+ */
+bool seedSensor(sensor_t *s, camera_settings_t *cameraSettings, sensor_warm_start_t *warmStart);
+
+/**
+ * @brief Save the converged exposure and gain of the sensor for the next wake up.
+ *        It must be called after a successful takePicture().
+ *
+ * @param warmStart the sensor_warm_start_t receiving the values
+ */
+void saveSensorWarmStart(sensor_warm_start_t *warmStart);
+
+/**
+ * Exposure and gain of the sensor, as computed by its auto exposure and gain controls.
+ *
+ * @see readSensorExposure()
+ */
+typedef struct {
+  uint16_t exposure;  // Exposure in lines
+  uint8_t gain;       // Gain
+} sensor_exposure_t;
+
+/**
+ * @brief Read the current exposure and gain of the sensor.
+ *
+ * @param s        the sensor
+ * @param exposure the sensor_exposure_t receiving the values
+ *
+ * @return true when it succeeds, false when the sensor is not supported
+ */
+bool readSensorExposure(sensor_t *s, sensor_exposure_t *exposure);
+
+/**
+ * @brief Wait until the auto exposure and gain of the sensor converged,
+ *        at most maxDelayMs.
+ *
+ * @param s          the sensor
+ * @param minDelayMs the minimum delay
+ * @param maxDelayMs the maximum delay
+ *
+ * @return the warm-up duration in milliseconds
+ */
+uint32_t waitForSensorConvergence(sensor_t *s, uint16_t minDelayMs, uint16_t maxDelayMs);
+
+/**
+ * Defect of a picture found by checkPicture().
+ */
+typedef enum {
+  PICTURE_VALID = 0,  // No defect found
+  PICTURE_CORRUPTED,  // Missing SOI or EOI marker, truncated or corrupted data
+  PICTURE_DARK,       // Mean luminance up to CAMERA_DARK_LUMA_MAX
+  PICTURE_GREEN       // Both mean chroma CAMERA_GREEN_CHROMA_OFFSET below 128 at least
+} picture_defect_t;
+
+/**
+ * @brief Check a JPEG picture from its DC coefficients, in a few milliseconds.
+ *
+ * @param fb the frame buffer of the picture
+ * @param dc the jpeg_dc_t receiving the decoded means
+ *
+ * @return the defect found, PICTURE_VALID if none
+ */
+picture_defect_t checkPicture(const camera_fb_t *fb, jpeg_dc_t *dc);
 
 /**
  * @brief Take a picture and store the data in the given frame buffer.
+ *        A dark, green or corrupted picture is retaken retakeMax times at most.
  *
  * @param cameraFrameBuffer pointer of pointer of camera frame buffer. Assigned by the function.
+ * @param retakeMax         maximum number of retakes, 0 to disable the check
  *
  * @return IS_OK when it succeeds. CAMERA_TAKE_PICTURE_ERROR in case of failure.
  */
-status_code_t takePicture(camera_fb_t **cameraFrameBuffer);
+status_code_t takePicture(camera_fb_t **cameraFrameBuffer, uint8_t retakeMax);
 
 /**
  * @brief Free the given frame buffer and disable the lamp.
@@ -0,0 +1,157 @@
+#include "catalog.h"
+
+// Serializes the accesses to the catalog file once enableCatalogLock() has been called.
+// Without it, records written through two open files in the same sector would overwrite each other.
+static SemaphoreHandle_t catalogLock = NULL;
+
+/**
+ * @brief Serialize the accesses to the catalog file from now on.
+ *
+ * It must be called before several tasks access the catalog, e.g. by startWriteBehind():
+ * the lock is not created concurrently. Further calls do nothing.
+ */
+void enableCatalogLock() {
+  if (!catalogLock) {
+    catalogLock = xSemaphoreCreateMutex();
+  }
+}
+
+/**
+ * @brief Take the catalog lock, when enabled.
+ */
+static void lockCatalog() {
+  if (catalogLock) {
+    xSemaphoreTake(catalogLock, portMAX_DELAY);
+  }
+}
+
+/**
+ * @brief Give the catalog lock back, when enabled.
+ */
+static void unlockCatalog() {
+  if (catalogLock) {
+    xSemaphoreGive(catalogLock);
+  }
+}
+
+/**
+ * @brief Compute the CRC-32 of a record, its recordCrc field excluded.
+ *
+ * @param record the record
+ *
+ * @return the CRC-32
+ */
+static uint32_t computeCatalogRecordCrc(const catalog_record_t *record) {
+  return crc32_le(0, (const uint8_t *)record, offsetof(catalog_record_t, recordCrc));
+}
+
+/**
+ * @brief Write the record of a picture at its position in the catalog file:
+ *        appended after a save, or updated in place.
+ *
+ * Missing records before it, e.g. pictures saved before the catalog, are written empty
+ * by blocks of CATALOG_PADDING_SIZE, so a card of thousands of pictures doesn't cost thousands of writes.
+ * The SD card has to be mounted first by calling initSdCard().
+ *
+ * @param record the record, its recordCrc is computed
+ *
+ * @return IS_OK when the operation succeeds. SD_WRITE_ERROR in case of failure
+ */
+status_code_t writeCatalogRecord(catalog_record_t *record) {
+  fs::FS &fs = SD_MMC;
+  uint32_t position = (record->index - 1) * sizeof(catalog_record_t);
+  catalog_record_t emptyRecord = {};
+  bool written;
+
+  record->recordCrc = computeCatalogRecordCrc(record);
+  lockCatalog();
+  File file = fs.exists(CATALOG_FILE_NAME) ? fs.open(CATALOG_FILE_NAME, "r+") : fs.open(CATALOG_FILE_NAME, FILE_WRITE);
+  if (!file) {
+    unlockCatalog();
+    logError(CATALOG_LOG, "%s: failed to open %s.", __func__, CATALOG_FILE_NAME);
+    return SD_WRITE_ERROR;
+  }
+  uint32_t size = file.size() - file.size() % sizeof(catalog_record_t);
+  written = file.seek(size < position ? size : position);
+  if (size < position) {
+    // Without memory for a block, the empty records are written one by one
+    uint8_t *padding = position - size > sizeof(catalog_record_t) ? (uint8_t *)calloc(1, CATALOG_PADDING_SIZE) : NULL;
+    const uint8_t *block = padding ? padding : (const uint8_t *)&emptyRecord;
+    size_t blockSize = padding ? CATALOG_PADDING_SIZE : sizeof(catalog_record_t);
+    while (written && size < position) {
+      size_t len = position - size < blockSize ? position - size : blockSize;
+      written = file.write(block, len) == len;
+      size += len;
+    }
+    free(padding);
+  }
+  written = written && file.write((const uint8_t *)record, sizeof(catalog_record_t)) == sizeof(catalog_record_t);
+  file.close();
+  unlockCatalog();
+  if (!written) {
+    logError(CATALOG_LOG, "%s: failed to write the record of picture %u.", __func__, (unsigned int)record->index);
+    return SD_WRITE_ERROR;
+  }
+  logDebug(CATALOG_LOG, "%s: picture %u, flags %02x.", __func__, (unsigned int)record->index, record->flags);
+  return IS_OK;
+}
+
+/**
+ * @brief Get the index of the last record of the catalog, from its size.
+ *
+ * The record of a picture is written once it is saved: the pictures up to it have been saved,
+ * even when the oldest ones have been evicted since.
+ * The SD card has to be mounted first by calling initSdCard().
+ *
+ * @return the picture index, 0 when the catalog is empty or missing
+ */
+uint32_t getCatalogLastIndex() {
+  fs::FS &fs = SD_MMC;
+  uint32_t size = 0;
+
+  lockCatalog();
+  if (fs.exists(CATALOG_FILE_NAME)) {
+    File file = fs.open(CATALOG_FILE_NAME, FILE_READ);
+    size = file ? file.size() : 0;
+    file.close();
+  }
+  unlockCatalog();
+  return size / sizeof(catalog_record_t);
+}
+
+/**
+ * @brief Read the records of consecutive pictures with a single sequential read.
+ *
+ * The records are at computed positions: no scan of the directory nor of the catalog.
+ * The SD card has to be mounted first by calling initSdCard().
+ *
+ * @param firstIndex the index of the first picture, from 1
+ * @param records    the array receiving the records. A missing or damaged record has a 0 index.
+ * @param count      the number of records to read
+ *
+ * @return the number of valid records
+ */
+uint8_t readCatalogRecords(uint32_t firstIndex, catalog_record_t *records, uint8_t count) {
+  fs::FS &fs = SD_MMC;
+  size_t readLen = 0;
+  uint8_t validCount = 0;
+
+  lockCatalog();
+  if (fs.exists(CATALOG_FILE_NAME)) {
+    File file = fs.open(CATALOG_FILE_NAME, FILE_READ);
+    if (file && file.seek((firstIndex - 1) * sizeof(catalog_record_t))) {
+      readLen = file.read((uint8_t *)records, count * sizeof(catalog_record_t));
+    }
+    file.close();
+  }
+  unlockCatalog();
+  for (uint8_t i = 0; i < count; i++) {
+    if ((i + 1) * sizeof(catalog_record_t) <= readLen && records[i].index == firstIndex + i
+        && records[i].recordCrc == computeCatalogRecordCrc(&records[i])) {
+      validCount++;
+    } else {
+      memset(&records[i], 0, sizeof(catalog_record_t));
+    }
+  }
+  return validCount;
+}
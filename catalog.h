@@ -0,0 +1,107 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include "Arduino.h"
+#include "error.h"
+#include "logging.h"
+#include "esp32/rom/crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "FS.h"
+#include "SD_MMC.h"
+
+// Logger name for this module
+#define CATALOG_LOG "Catalog"
+
+// Name of the catalog file on the SD card
+#define CATALOG_FILE_NAME "/catalog.bin"
+// Number of records read at once by a sequential scan, i.e. 512 bytes
+#define CATALOG_READ_RECORDS 16
+// Size in bytes of the blocks of empty records written before a record beyond the end of the catalog, i.e. 128 records
+#define CATALOG_PADDING_SIZE 4096
+// Number of failed uploads after which a picture is abandoned, so it doesn't block the next ones
+#define CATALOG_UPLOAD_ATTEMPT_MAX 3
+// Number of wake cycles failing to read a picture, or to match its CRC-32, after which it is abandoned.
+// A read error may be transient: the picture is read again in the same cycle before counting it.
+#define CATALOG_READ_ATTEMPT_MAX 2
+
+/**
+ * Flags of a catalog record.
+ */
+typedef enum {
+  CATALOG_FLAG_UPLOADED = 0x01,  // The picture has been uploaded
+  CATALOG_FLAG_SD_ONLY = 0x02,   // The picture is a near-duplicate kept on the SD card only, see checkDuplicatePicture()
+  CATALOG_FLAG_ABANDONED = 0x04, // The picture failed to be read CATALOG_READ_ATTEMPT_MAX times or to be uploaded CATALOG_UPLOAD_ATTEMPT_MAX times
+  CATALOG_FLAG_EVICTED = 0x08,   // The picture has been removed from the SD card to free space, see evictPictures()
+  CATALOG_FLAG_CORRUPTED = 0x10  // The picture read back from the SD card doesn't match its CRC-32 at its last read. It is abandoned too.
+} catalog_flag_t;
+
+/**
+ * Priority of a picture in the catalog.
+ */
+typedef enum {
+  CATALOG_PRIORITY_BURST = 0,    // A picture following the first one of a wake cycle, see camera_settings_t.burstCount
+  CATALOG_PRIORITY_WAKE_UP = 1   // The first picture of a wake cycle
+} catalog_priority_t;
+
+/**
+ * Record of a picture in the catalog file.
+ * The catalog is an array of records: the record of the picture index i
+ * is at (i - 1) * sizeof(catalog_record_t), whatever the storage layout.
+ * It is written when the picture is saved and updated in place by the upload.
+ * All the integers are little endian.
+ */
+typedef struct {
+  uint32_t index;          // Picture index, 0 for a missing record
+  uint32_t timestamp;      // Time of the save in seconds since the epoch, before 2000 when the time is not synchronized
+  uint32_t length;         // Length of the JPEG data
+  uint32_t crc;            // CRC-32 of the JPEG data, as computed by crc32_le(0, ...)
+  uint64_t hash;           // Difference hash of the picture, 0 when it has not been computed, see computePictureHash()
+  uint8_t flags;           // catalog_flag_t values
+  uint8_t priority;        // catalog_priority_t
+  uint8_t uploadAttempts;  // Number of failed uploads
+  uint8_t reserved;        // 0
+  uint32_t recordCrc;      // CRC-32 of the fields above
+} catalog_record_t;
+
+/**
+ * @brief Serialize the accesses to the catalog file from now on.
+ *        It must be called before several tasks access the catalog, e.g. by startWriteBehind().
+ */
+void enableCatalogLock();
+
+/**
+ * @brief Write the record of a picture at its position in the catalog file:
+ *        appended after a save, or updated in place.
+ *
+ * The SD card has to be mounted first by calling initSdCard().
+ *
+ * @param record the record, its recordCrc is computed
+ *
+ * @return IS_OK when the operation succeeds. SD_WRITE_ERROR in case of failure
+ */
+status_code_t writeCatalogRecord(catalog_record_t *record);
+
+/**
+ * @brief Get the index of the last record of the catalog, from its size.
+ *
+ * The SD card has to be mounted first by calling initSdCard().
+ *
+ * @return the picture index, 0 when the catalog is empty or missing
+ */
+uint32_t getCatalogLastIndex();
+
+/**
+ * @brief Read the records of consecutive pictures with a single sequential read.
+ *
+ * The SD card has to be mounted first by calling initSdCard().
+ *
+ * @param firstIndex the index of the first picture, from 1
+ * @param records    the array receiving the records. A missing or damaged record has a 0 index.
+ * @param count      the number of records to read
+ *
+ * @return the number of valid records
+ */
+uint8_t readCatalogRecords(uint32_t firstIndex, catalog_record_t *records, uint8_t count);
+
+#endif
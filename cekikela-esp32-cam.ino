@@ -35,20 +35,75 @@
 // Thus, the config is kept along deep sleep.
 RTC_DATA_ATTR app_config_t appConfig = { .setupConfigDone = false };
 
+// Converged exposure and gain of the last picture, seeding the sensor at the next wake up.
+// Kept in the RTC memory along deep sleep.
+RTC_DATA_ATTR sensor_warm_start_t sensorWarmStart = { .valid = false };
+
+// Hashes of the last distinct pictures and near-duplicates not to upload.
+// Kept in the RTC memory along deep sleep, see checkDuplicatePicture().
+RTC_DATA_ATTR picture_history_t pictureHistory;
+
+// Picture counters and state of their journal on the SD card.
+// Kept in the RTC memory along deep sleep, see initFileCounters().
+RTC_DATA_ATTR file_counters_mirror_t fileCountersMirror;
+
+// Timings of the wake cycle phases not yet flushed to the SD card.
+// Kept in the RTC memory along deep sleep, see initTelemetry().
+RTC_DATA_ATTR telemetry_ring_t telemetryRing;
+
+// Used space of the SD card, kept up to date at each written and removed file.
+// Kept in the RTC memory along deep sleep, see initSdSpace().
+RTC_DATA_ATTR sd_space_t sdSpace;
+
+// Progress of the removal of the oldest pictures.
+// Kept in the RTC memory along deep sleep, see initRetention().
+RTC_DATA_ATTR retention_state_t retentionState;
+
+// Results of the SD card benchmark and the write strategy chosen from them.
+// Kept in the RTC memory along deep sleep, see initSdBenchmark().
+RTC_DATA_ATTR sd_benchmark_t sdBenchmark;
+
+// Metadata read from the SD card by the single pass of a cold boot.
+// Kept in the RTC memory along deep sleep, see initBootMetadata().
+RTC_DATA_ATTR boot_metadata_t bootMetadata;
+
+// State of the write-behind barrier of the wake cycle, see flushPicturesBehind()
+static bool picturesFlushed = false;
+static bool sdCardStalled = false;
+
+// Telemetry phase of each job, indexed by app_job_t
+static const telemetry_phase_t jobPhases[] = {
+  TELEMETRY_PHASE_CONFIG, TELEMETRY_PHASE_CAMERA_INIT, TELEMETRY_PHASE_WIFI, TELEMETRY_PHASE_PICTURE,
+  TELEMETRY_PHASE_TIME, TELEMETRY_PHASE_SAVE, TELEMETRY_PHASE_UPLOAD, TELEMETRY_PHASE_OTA
+};
+
 /**
  * The application starts here.
  * No loop.
  * Basically, it
+ * - starts the telemetry of the wake cycle
  * - initializes the red led and serial bus
  * - prints a startup message with the version and the Mac address
  * - disables the lamp
  * - takes a picture and saves it
  * - signals the resulting status code via the red led
- * - pauses to avoid picture burst
+ * - pauses to avoid picture burst, removing the oldest pictures meanwhile when the SD card is getting full
  * - goes sleeping, waiting for a PIR and/or timer interrupt
  */
 void setup() {
   status_code_t result;
+  // Time the boot and the next phases
+  initTelemetry(&telemetryRing);
+  picturesFlushed = false;
+  sdCardStalled = false;
+  // Read the picture counters from the RTC memory rather than the SD card
+  initFileCounters(&fileCountersMirror);
+  // Account the SD card space without scanning it at each wake up
+  initSdSpace(&sdSpace);
+  initRetention(&retentionState);
+  // Read the SD card benchmark results from the RTC memory rather than the SD card
+  initSdBenchmark(&sdBenchmark);
+  initBootMetadata(&bootMetadata);
   // Switch on the red led to inform that the program is running
   pinMode(RED_LED_PIN, OUTPUT);
   // Indicate the board is awake
@@ -69,7 +124,18 @@ void setup() {
   // Signal result
   signalError(result);
   // Pause to prevent picture burst
-  delay(appConfig.awakeDurationMs);
+  uint32_t pauseStartUs = getTelemetryTimeUs();
+  // The layout is unknown until the SD card is calibrated by the save job.
+  // The space accounting and the directories must not change under the flush task.
+  if (appConfig.savePictureOnSdCard && appConfig.freeSpaceLowMB && appConfig.pictureStorage != PICTURE_STORAGE_AUTO
+      && flushPicturesBehind()) {
+    evictPictures(appConfig.pictureStorage, appConfig.freeSpaceLowMB);
+  }
+  uint32_t pausedMs = (getTelemetryTimeUs() - pauseStartUs) / 1000;
+  if (pausedMs < appConfig.awakeDurationMs) {
+    delay(appConfig.awakeDurationMs - pausedMs);
+  }
+  recordPhase(TELEMETRY_PHASE_PAUSE, pauseStartUs, IS_OK);
   // Go to sleep
   zzzzZZZZ();
 }
@@ -77,87 +143,333 @@ void setup() {
 /**
  * Take the picture and save it:
  * - setup the application configuration (by instruction and by file on SD card when enabled)
+ *   and, at a cold boot, read the SD card metadata in a single pass
  * - initialize the camera 
- * - take the picture
+ * - take the picture, once something moved when the motion check is enabled
+ * - drop the picture or keep it on the SD card only when it is a near-duplicate of a previous one
  * - synchronize the time by NTP
- * - save the picture on SD card when enabled
+ * - save the picture on SD card when enabled, in the background when write-behind is enabled
  * - upload the picture when enabled
  * - check for a firmware update by OTA
  *
+ * These phases are declared as a job graph with their real dependencies,
+ * so independent ones run concurrently on both cores.
+ * Typically, the WiFi association overlaps the camera warm-up.
+ *
  * @return status_code_t which is used by signalError
+ *
+ * @see runJobGraph()
  */
 status_code_t takeAndSavePicture() {
   status_code_t result = IS_OK;
-  bool pictureSavedOnSd = false;
-  camera_fb_t *fb = NULL;
-  char pictureName[20];
-  fileCounters_t fileCounters;
+  wake_cycle_t wakeCycle = { .fb = NULL, .burst = { .frames = NULL }, .duplicate = false, .pictureHash = 0, .pictureSavedOnSd = false, .saveResult = IS_OK, .uploadResult = IS_OK };
 
-  // Setup App Config
-  if ((result = initAppConfig(&appConfig)) != IS_OK) {
+  // Jobs are declared in a topological order, see job_t.
+  job_t jobs[] = {
+    { "config", configJob, 0, JOB_ANY_CORE },
+    { "camera", cameraJob, JOB_BIT(APP_JOB_CONFIG), 1 },
+    { "wifi", wifiJob, JOB_BIT(APP_JOB_CONFIG), 0 },
+    { "picture", pictureJob, JOB_BIT(APP_JOB_CAMERA), 1 },
+    { "time", timeJob, JOB_BIT(APP_JOB_WIFI), 0 },
+    { "save", saveJob, JOB_BIT(APP_JOB_PICTURE) | JOB_BIT(APP_JOB_TIME), 1 },
+    { "upload", uploadJob, JOB_BIT(APP_JOB_SAVE) | JOB_BIT(APP_JOB_WIFI), 0 },
+    { "ota", otaJob, JOB_BIT(APP_JOB_UPLOAD), 0 }
+  };
+  uint8_t jobCount = sizeof(jobs) / sizeof(job_t);
+
+  result = runJobGraph(jobs, jobCount, &wakeCycle);
+  logJobGraph(jobs, jobCount);
+  recordJobPhases(jobs, jobCount);
+  // The capture task may still hold frame buffers when the save job failed or has been skipped
+  endBurst(&(wakeCycle.burst));
+  if (result == NO_MOTION_DETECTED || result == DUPLICATE_PICTURE) {
+    // A false PIR trigger or a dropped near-duplicate is not an error
+    result = IS_OK;
+  } else if (result != IS_OK) {
     return result;
+  } else {
+    // Don't override the SD card error code with the upload one.
+    result = (wakeCycle.saveResult != IS_OK) ? wakeCycle.saveResult : wakeCycle.uploadResult;
   }
 
-  wifi_settings_t *wifi = &(appConfig.wifi);
-  time_settings_t *time = &(appConfig.time);
-  ota_settings_t *ota = &(appConfig.ota);
-  upload_settings_t *uploadSettings = &(appConfig.upload);
+  endWifi();
+  // The SD card is usually still mounted by the save job.
+  // It is unmounted by zzzzZZZZ(), once the queued pictures are written.
+  flushTelemetry();
+  endCamera(&(wakeCycle.fb));
 
-  // Init camera
-  if ((result = initCamera(&(appConfig.camera))) != IS_OK) {
-    return result;
+  return result;
+}
+
+/**
+ * Record the timing of the jobs which have been run in the telemetry.
+ * Job times come from micros() which is esp_timer_get_time() on the ESP32.
+ *
+ * @param jobs     the job array given to runJobGraph()
+ * @param jobCount the number of jobs
+ */
+void recordJobPhases(job_t *jobs, uint8_t jobCount) {
+  for (uint8_t i = 0; i < jobCount; i++) {
+    if (!jobs[i].skipped) {
+      recordPhaseBetween(jobPhases[i], jobs[i].startUs, jobs[i].endUs, jobs[i].result);
+    }
   }
+}
 
-  // Take picture
-  if ((result = takePicture(&fb)) != IS_OK) {
-    return result;
+/**
+ * Setup the application configuration and, at a cold boot,
+ * read the SD card metadata needed by the next jobs in a single pass.
+ *
+ * @param context the wake_cycle_t of the current cycle
+ *
+ * @return the initAppConfig() result
+ *
+ * @see loadBootMetadata()
+ */
+status_code_t configJob(void *context) {
+  return loadBootMetadata(&appConfig);
+}
+
+/**
+ * Initialize the camera and let its sensor get ready.
+ *
+ * @param context the wake_cycle_t of the current cycle
+ *
+ * @return the initCamera() result
+ */
+status_code_t cameraJob(void *context) {
+  return initCamera(&(appConfig.camera), &sensorWarmStart);
+}
+
+/**
+ * Associate with the WiFi network early, while the camera warms up,
+ * when the upload will need it.
+ * Else, the WiFi connection is established lazily by the next jobs.
+ * A failure is not fatal: the next jobs handle it.
+ *
+ * @param context the wake_cycle_t of the current cycle
+ *
+ * @return IS_OK
+ */
+status_code_t wifiJob(void *context) {
+  if (appConfig.wifi.enabled && appConfig.upload.enabled) {
+    initWifi(&(appConfig.wifi));
   }
+  return IS_OK;
+}
 
-  // Sync time with NTP
-  syncTime(wifi, time);
+/**
+ * Take the picture, then save the converged exposure and gain
+ * to seed the sensor at the next wake up.
+ * When the PIR woke the board up, the motion check may drop the picture:
+ * the dependent jobs are skipped.
+ * A near-duplicate of one of the last distinct pictures is dropped too,
+ * unless it is kept on the SD card without being uploaded.
+ * In burst mode, the capture of the next pictures starts in the background:
+ * the save job writes them while the next ones are captured.
+ * A near-duplicate doesn't start a burst.
+ *
+ * @param context the wake_cycle_t of the current cycle receiving the frame buffer
+ *
+ * @return the takePicture() or checkMotion() result, or DUPLICATE_PICTURE
+ */
+status_code_t pictureJob(void *context) {
+  wake_cycle_t *wakeCycle = (wake_cycle_t *)context;
+  status_code_t result;
+  if (appConfig.camera.motionCheck && esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_EXT0) {
+    result = checkMotion(&(appConfig.camera), &(wakeCycle->fb));
+  } else {
+    result = takePicture(&(wakeCycle->fb), appConfig.camera.retakeMax);
+  }
+  if (result == IS_OK) {
+    saveSensorWarmStart(&sensorWarmStart);
+    if (checkDuplicatePicture(&pictureHistory, wakeCycle->fb, appConfig.camera.duplicateDistance, &(wakeCycle->pictureHash))) {
+      if (!appConfig.camera.duplicateKeepOnSd || !appConfig.savePictureOnSdCard) {
+        return DUPLICATE_PICTURE;
+      }
+      wakeCycle->duplicate = true;
+    } else if (appConfig.camera.burstCount > 1 && appConfig.savePictureOnSdCard) {
+      // Not fatal: the first picture is there
+      startBurst(&(wakeCycle->burst), appConfig.camera.burstCount - 1, appConfig.camera.burstIntervalMs);
+    }
+  }
+  return result;
+}
+
+/**
+ * Synchronize the time with NTP.
+ *
+ * @param context the wake_cycle_t of the current cycle
+ *
+ * @return IS_OK
+ */
+status_code_t timeJob(void *context) {
+  syncTime(&(appConfig.wifi), &(appConfig.time));
+  return IS_OK;
+}
+
+/**
+ * Save the picture on the SD card when enabled.
+ * With write-behind, the pictures are copied in PSRAM and written by a background task:
+ * the job doesn't wait for the SD card, and the upload job waits for each picture it reads.
+ * A failure is recorded in the wake cycle rather than returned,
+ * so the upload job still runs and uploads the frame buffer instead.
+ *
+ * @param context the wake_cycle_t of the current cycle
+ *
+ * @return IS_OK
+ */
+status_code_t saveJob(void *context) {
+  wake_cycle_t *wakeCycle = (wake_cycle_t *)context;
+  status_code_t result = IS_OK;
+  catalog_record_t record = {
+    .hash = wakeCycle->pictureHash, .flags = (uint8_t)(wakeCycle->duplicate ? CATALOG_FLAG_SD_ONLY : 0), .priority = CATALOG_PRIORITY_WAKE_UP
+  };
 
   if (appConfig.savePictureOnSdCard) {
     // Writing on SD card involves flash lighting
     disableLamp();
-    if ((result = initSdCard()) == IS_OK && (result = loadOrCreateFileCounters(&fileCounters)) == IS_OK) {
-      computePictureNameFromIndex(pictureName, fileCounters.pictureCounter + 1);
-      if ((result = savePictureOnSdCard(pictureName, fb->buf, fb->len)) == IS_OK) {
-        fileCounters.pictureCounter++;
-        saveFileCounters(&fileCounters);
-        pictureSavedOnSd = true;
+    if ((result = initSdCard()) == IS_OK) {
+      // Not fatal: the default write strategy is used. Usually applied from the RTC memory.
+      // A card to measure, e.g. at its first mount, is measured here rather than before the picture.
+      calibrateSdCard(appConfig.sdBenchmark, appConfig.flushDeadlineMs, &(appConfig.pictureStorage));
+      result = loadOrCreateFileCounters(&(wakeCycle->fileCounters), appConfig.pictureStorage);
+    }
+    if (result == IS_OK) {
+      if (appConfig.writeBehind) {
+        // Not fatal: the pictures are saved directly
+        startWriteBehind(appConfig.flushDeadlineMs);
+      }
+      if ((result = writePictureBehind(appConfig.pictureStorage, wakeCycle->fileCounters.pictureCounter + 1, wakeCycle->fb->buf, wakeCycle->fb->len, &record)) == IS_OK) {
+        wakeCycle->fileCounters.pictureCounter++;
+        setPictureSdOnly(&pictureHistory, wakeCycle->fileCounters.pictureCounter, wakeCycle->duplicate);
+        wakeCycle->pictureSavedOnSd = true;
+        // The upload reads the saved or queued copy: give the frame buffer back to the burst capture
+        endCamera(&(wakeCycle->fb));
+        // The first picture is saved: a burst failure is logged and recorded by saveBurstPictures() only
+        saveBurstPictures(wakeCycle);
+        saveFileCounters(&(wakeCycle->fileCounters));
       }
     }
   }
+  wakeCycle->saveResult = result;
+  return IS_OK;
+}
+
+/**
+ * Save the burst pictures following the first one on the SD card,
+ * as soon as they are captured. Each frame buffer is returned once written or queued,
+ * so the sensor fills it while the next picture is written.
+ * The pictures are numbered after the first one.
+ * A failure doesn't change the result of the save job, as the first picture is saved.
+ *
+ * @param wakeCycle the wake_cycle_t of the current cycle
+ *
+ * @return IS_OK when all the pictures have been saved or queued, or the writePictureBehind() error
+ */
+status_code_t saveBurstPictures(wake_cycle_t *wakeCycle) {
+  status_code_t result = IS_OK;
+  camera_fb_t *fb;
+  uint32_t startUs = getTelemetryTimeUs();
+  uint8_t savedCount = 0;
+  catalog_record_t record = { .priority = CATALOG_PRIORITY_BURST };
+
+  if (!wakeCycle->burst.frames) {
+    return IS_OK;
+  }
+  while ((fb = nextBurstFrame(&(wakeCycle->burst))) != NULL) {
+    result = writePictureBehind(appConfig.pictureStorage, wakeCycle->fileCounters.pictureCounter + 1, fb->buf, fb->len, &record);
+    esp_camera_fb_return(fb);
+    if (result != IS_OK) {
+      logWarn(APP_LOG, "Burst picture %d not saved, error %d: the next ones are dropped.", savedCount + 1, result);
+      break;
+    }
+    wakeCycle->fileCounters.pictureCounter++;
+    setPictureSdOnly(&pictureHistory, wakeCycle->fileCounters.pictureCounter, false);
+    savedCount++;
+  }
+  logInfo(APP_LOG, "%d burst picture(s) saved.", savedCount);
+  recordPhase(TELEMETRY_PHASE_BURST, startUs, result);
+  return result;
+}
+
+/**
+ * Upload the picture when enabled:
+ * the frame buffer when it could not be saved on the SD card,
+ * unless it is a near-duplicate, else a bunch of the pictures saved on the SD card.
+ * The result is recorded in the wake cycle.
+ *
+ * @param context the wake_cycle_t of the current cycle
+ *
+ * @return IS_OK
+ */
+status_code_t uploadJob(void *context) {
+  wake_cycle_t *wakeCycle = (wake_cycle_t *)context;
+  wifi_settings_t *wifi = &(appConfig.wifi);
+  upload_settings_t *uploadSettings = &(appConfig.upload);
+
   if (appConfig.upload.enabled) {
-    if (!pictureSavedOnSd) {
-      status_code_t uploadResult;
-      // Failed to saved on SD card, then try to upload.
-      computePictureNameFromRandom(pictureName, uploadSettings->fileNameRandSize);
-      uploadResult = uploadPicture(wifi, uploadSettings, pictureName, fb->buf, fb->len);
-      // Don't override result when result already contains an error code.
-      if (result == IS_OK) {
-        result = uploadResult;
+    if (!wakeCycle->pictureSavedOnSd) {
+      if (wakeCycle->duplicate) {
+        // Not worth the upload
+        return IS_OK;
       }
+      // Failed to saved on SD card, then try to upload.
+      computePictureNameFromRandom(wakeCycle->pictureName, uploadSettings->fileNameRandSize);
+      wakeCycle->uploadResult = uploadPicture(wifi, uploadSettings, wakeCycle->pictureName, wakeCycle->fb->buf, wakeCycle->fb->len);
     } else {
       // Upload a bunch of files.
-      result = uploadPictureFiles(wifi, uploadSettings, &fileCounters);
+      wakeCycle->uploadResult = uploadPictureFiles(wifi, uploadSettings, appConfig.pictureStorage, &(wakeCycle->fileCounters), &pictureHistory);
     }
   }
+  return IS_OK;
+}
 
-  // Update firmware OTA
-  updateFirmware(wifi, ota, APP_VERSION);
+/**
+ * Update firmware OTA.
+ * It runs last, as a successful update restarts the board:
+ * the pictures queued by write-behind are written first, else they would be lost.
+ *
+ * @param context the wake_cycle_t of the current cycle
+ *
+ * @return IS_OK
+ */
+status_code_t otaJob(void *context) {
+  flushPicturesBehind();
+  updateFirmware(&(appConfig.wifi), &(appConfig.ota), APP_VERSION);
+  return IS_OK;
+}
 
-  endWifi();
-  endSdCard();
-  endCamera(&fb);
+/**
+ * Write the pictures still queued by write-behind, until app_config_t.flushDeadlineMs.
+ * Those not written by then are lost: the picture counter is moved back before them.
+ * It is the barrier before anything the queue must not outlive: an OTA restart,
+ * the eviction of the oldest pictures and the deep sleep. Further calls return the result of the first one.
+ *
+ * @return true when the queue is flushed, false when the SD card is stalled: the flush task may still use it
+ */
+bool flushPicturesBehind() {
+  uint32_t firstLostIndex;
 
-  return result;
+  if (!picturesFlushed) {
+    picturesFlushed = true;
+    sdCardStalled = endWriteBehind(appConfig.flushDeadlineMs, &firstLostIndex) != IS_OK;
+    if (sdCardStalled && firstLostIndex) {
+      rewindFileCounters(firstLostIndex - 1);
+    }
+  }
+  return !sdCardStalled;
 }
 
 /**
  * Prepare the deep sleep and how to be waked up.
+ * The pictures still queued by write-behind are written first, see flushPicturesBehind().
  */
 void zzzzZZZZ() {
+  uint32_t sleepStartUs = getTelemetryTimeUs();
+  if (flushPicturesBehind()) {
+    endSdCard();
+  }
   // Switch off the red led to inform that the program is stopped
   switchOffRedLed();
   logInfo(APP_LOG, "Going to sleep now.");
@@ -172,6 +484,9 @@ void zzzzZZZZ() {
     esp_sleep_enable_timer_wakeup(appConfig.deepSleepDurationSec * 1000000); // us to sec factor
   }
 
+  recordPhase(TELEMETRY_PHASE_SLEEP, sleepStartUs, IS_OK);
+  recordPhase(TELEMETRY_PHASE_AWAKE, 0, IS_OK);
+
   // Go to sleep
   esp_deep_sleep_start();
   logInfo(APP_LOG, "This will never be printed");
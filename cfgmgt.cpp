@@ -49,6 +49,12 @@ void initAppConfigWithDefaultValues(app_config_t *appConfig) {
   appConfig->readConfigFromSdCard = true;
   // Save the picture on the SD card
   appConfig->savePictureOnSdCard = true;
+  appConfig->pictureStorage = PICTURE_STORAGE_DEFAULT;
+  // Write the pictures on the SD card in the background
+  appConfig->writeBehind = WRITE_BEHIND_DEFAULT;
+  appConfig->flushDeadlineMs = WRITE_BEHIND_FLUSH_DEADLINE_MS_DEFAULT;
+  appConfig->freeSpaceLowMB = RETENTION_FREE_SPACE_LOW_MB_DEFAULT;
+  appConfig->sdBenchmark = SD_BENCHMARK_DEFAULT;
   // Continue even if the config could not be read from the SD card
   appConfig->ignoreConfigFromSdCardReadError = true;
   // Awake Duration
@@ -73,8 +79,22 @@ void initAppConfigWithDefaultValues(app_config_t *appConfig) {
   appConfig->upload.serverPort = UPLOAD_SERVER_PORT_DEFAULT;
   appConfig->upload.bunchSize = UPLOAD_BUNCH_SIZE_DEFAULT;
   appConfig->upload.fileNameRandSize = UPLOAD_FILE_NAME_RANDOM_SIZE;
+  appConfig->upload.batchSize = UPLOAD_BATCH_SIZE_DEFAULT;
+  appConfig->upload.responseTimeoutMs = UPLOAD_RESPONSE_TIMEOUT_MS_DEFAULT;
+  appConfig->upload.sendBufferKB = UPLOAD_PIPE_BUFFER_KB_DEFAULT;
+  appConfig->upload.writeSize = UPLOAD_WRITE_SIZE_DEFAULT;
+  appConfig->upload.noDelay = UPLOAD_NO_DELAY_DEFAULT;
   // Camera sensor settings
   appConfig->camera.getReadyDelayMs = GET_READY_DELAY_MS_DEFAULT;
+  appConfig->camera.adaptiveWarmUp = ADAPTIVE_WARM_UP_DEFAULT;
+  appConfig->camera.retakeMax = RETAKE_MAX_DEFAULT;
+  appConfig->camera.burstCount = BURST_COUNT_DEFAULT;
+  appConfig->camera.burstIntervalMs = BURST_INTERVAL_MS_DEFAULT;
+  appConfig->camera.motionCheck = MOTION_CHECK_DEFAULT;
+  appConfig->camera.motionThreshold = MOTION_THRESHOLD_DEFAULT;
+  appConfig->camera.motionMinBlobCells = MOTION_MIN_BLOB_CELLS_DEFAULT;
+  appConfig->camera.duplicateDistance = DUPLICATE_DISTANCE_DEFAULT;
+  appConfig->camera.duplicateKeepOnSd = DUPLICATE_KEEP_ON_SD_DEFAULT;
 
   // Adjustments from https://forum.arduino.cc/t/about-esp32cam-image-too-dark-how-to-fix/1015490/5
   sensor_settings_t settingsWithInitializedSetterOffset;
@@ -100,6 +120,11 @@ void logAppConfig(app_config_t *appConfig) {
   logInfo(CFG_LOG, "- configOnSdCardRead              = %s", bool_str(appConfig->configOnSdCardRead));
   logInfo(CFG_LOG, "- ignoreConfigFromSdCardReadError = %s", bool_str(appConfig->ignoreConfigFromSdCardReadError));
   logInfo(CFG_LOG, "- savePictureOnSdCard             = %s", bool_str(appConfig->savePictureOnSdCard));
+  logInfo(CFG_LOG, "- pictureStorage                  = %d", appConfig->pictureStorage);
+  logInfo(CFG_LOG, "- writeBehind                     = %s", bool_str(appConfig->writeBehind));
+  logInfo(CFG_LOG, "- flushDeadlineMs                 = %d", appConfig->flushDeadlineMs);
+  logInfo(CFG_LOG, "- freeSpaceLowMB                  = %d", appConfig->freeSpaceLowMB);
+  logInfo(CFG_LOG, "- sdBenchmark                     = %d", appConfig->sdBenchmark);
   logInfo(CFG_LOG, "- awakeDurationMs                 = %d", appConfig->awakeDurationMs);
   logInfo(CFG_LOG, "- deepSleepDurationSec            = %d", appConfig->deepSleepDurationSec);
   logInfo(CFG_LOG, "[wifi]");
@@ -124,8 +149,22 @@ void logAppConfig(app_config_t *appConfig) {
   logInfo(CFG_LOG, "- auth                            = %s", appConfig->upload.auth);
   logInfo(CFG_LOG, "- bunchSize                       = %d", appConfig->upload.bunchSize);
   logInfo(CFG_LOG, "- fileNameRandSize                = %d", appConfig->upload.fileNameRandSize);
+  logInfo(CFG_LOG, "- batchSize                       = %d", appConfig->upload.batchSize);
+  logInfo(CFG_LOG, "- responseTimeoutMs               = %d", appConfig->upload.responseTimeoutMs);
+  logInfo(CFG_LOG, "- sendBufferKB                    = %d", appConfig->upload.sendBufferKB);
+  logInfo(CFG_LOG, "- writeSize                       = %d", appConfig->upload.writeSize);
+  logInfo(CFG_LOG, "- noDelay                         = %d", appConfig->upload.noDelay);
   logInfo(CFG_LOG, "[camera]");
   logInfo(CFG_LOG, "- getReadyDelayMs                 = %d", appConfig->camera.getReadyDelayMs);
+  logInfo(CFG_LOG, "- adaptiveWarmUp                  = %s", bool_str(appConfig->camera.adaptiveWarmUp));
+  logInfo(CFG_LOG, "- retakeMax                       = %d", appConfig->camera.retakeMax);
+  logInfo(CFG_LOG, "- burstCount                      = %d", appConfig->camera.burstCount);
+  logInfo(CFG_LOG, "- burstIntervalMs                 = %d", appConfig->camera.burstIntervalMs);
+  logInfo(CFG_LOG, "- motionCheck                     = %s", bool_str(appConfig->camera.motionCheck));
+  logInfo(CFG_LOG, "- motionThreshold                 = %d", appConfig->camera.motionThreshold);
+  logInfo(CFG_LOG, "- motionMinBlobCells              = %d", appConfig->camera.motionMinBlobCells);
+  logInfo(CFG_LOG, "- duplicateDistance               = %d", appConfig->camera.duplicateDistance);
+  logInfo(CFG_LOG, "- duplicateKeepOnSd               = %s", bool_str(appConfig->camera.duplicateKeepOnSd));
   logInfo(CFG_LOG, "- camera status will be displayed further.");
 }
 
@@ -140,6 +179,9 @@ void logAppConfig(app_config_t *appConfig) {
  * In other cases, it always returns the IS_OK.
  * When appConfig.ignoreConfigFromSdCardReadError is true,
  * the process will skip all wrong written / unknown parameters.
+ * The parsed configuration is saved as a binary snapshot on the SD card.
+ * As long as the configuration file and the firmware don't change,
+ * the next cold boots load this snapshot with a single read instead of parsing the file.
  * 
  * @param appConfig
  * @return IS_OK on successful reading
@@ -148,6 +190,8 @@ void logAppConfig(app_config_t *appConfig) {
  *
  * @see initAppConfigWithDefaultValues()
  * @see initAppConfigWithCustomValues
+ * @see parseConfigFile()
+ * @see loadConfigSnapshot()
  */
 status_code_t readConfigFromSdCard(app_config_t *appConfig) {
   status_code_t statusCode = IS_OK;
@@ -174,9 +218,43 @@ status_code_t readConfigFromSdCard(app_config_t *appConfig) {
     return statusCode;
   }
 
+  // Parse the configuration file only when it changed since the last snapshot
+  config_snapshot_header_t key;
+  bool keyComputed = computeConfigSnapshotKey(&key) == IS_OK;
+  if (keyComputed && loadConfigSnapshot(appConfig, &key) == IS_OK) {
+    logInfo(CFG_LOG, "Config loaded from snapshot %s.", CFG_CONFIG_SNAPSHOT_FILE_NAME);
+    return statusCode;
+  }
+
+  statusCode = parseConfigFile(appConfig);
+  if (keyComputed && statusCode == IS_OK) {
+    saveConfigSnapshot(appConfig, &key);
+  }
+  return statusCode;
+}
+
+/**
+ * Parse the configuration file on the SD card and fill the
+ * application configuration structure.
+ * The SD card has to be mounted first by calling initSdCard().
+ *
+ * @param appConfig
+ * @return IS_OK on successful reading
+ *         or READ_CONFIG_ERROR on read error
+ *
+ * @see readConfigFromSdCard()
+ */
+status_code_t parseConfigFile(app_config_t *appConfig) {
+  status_code_t statusCode = IS_OK;
+
   // Prepare all known parameters that can be read.
   paramSetter_t rootParams[] = {
     { false, "savePictureOnSdCard", &(appConfig->savePictureOnSdCard), setBool, 0 },
+    { false, "pictureStorage", &(appConfig->pictureStorage), setUint8, 0 },
+    { false, "writeBehind", &(appConfig->writeBehind), setBool, 0 },
+    { false, "flushDeadlineMs", &(appConfig->flushDeadlineMs), setUint16, 0 },
+    { false, "freeSpaceLowMB", &(appConfig->freeSpaceLowMB), setUint16, 0 },
+    { false, "sdBenchmark", &(appConfig->sdBenchmark), setBool, 0 },
     { false, "awakeDurationMs", &(appConfig->awakeDurationMs), setUint16, 0 },
     { false, "deepSleepDurationSec", &(appConfig->deepSleepDurationSec), setUint16, 0 },
   };
@@ -208,11 +286,25 @@ status_code_t readConfigFromSdCard(app_config_t *appConfig) {
     { false, "path", appConfig->upload.path, copyCString, UPLOAD_PATH_MAX_SIZE },
     { false, "auth", appConfig->upload.auth, copyEncryptedCString, UPLOAD_AUTH_MAX_SIZE },
     { false, "bunchSize", &(appConfig->upload.bunchSize), setUint8, 0 },
-    { false, "fileNameRandSize", &(appConfig->upload.fileNameRandSize), setUint8, 0 }
+    { false, "fileNameRandSize", &(appConfig->upload.fileNameRandSize), setUint8, 0 },
+    { false, "batchSize", &(appConfig->upload.batchSize), setUint8, 0 },
+    { false, "responseTimeoutMs", &(appConfig->upload.responseTimeoutMs), setUint16, 0 },
+    { false, "sendBufferKB", &(appConfig->upload.sendBufferKB), setUint8, 0 },
+    { false, "writeSize", &(appConfig->upload.writeSize), setUint16, 0 },
+    { false, "noDelay", &(appConfig->upload.noDelay), setBool, 0 }
   };
 
   paramSetter_t cameraParams[] = {
-    { false, "getReadyDelayMs", &(appConfig->camera.getReadyDelayMs), setUint16, 0 }
+    { false, "getReadyDelayMs", &(appConfig->camera.getReadyDelayMs), setUint16, 0 },
+    { false, "adaptiveWarmUp", &(appConfig->camera.adaptiveWarmUp), setBool, 0 },
+    { false, "retakeMax", &(appConfig->camera.retakeMax), setUint8, 0 },
+    { false, "burstCount", &(appConfig->camera.burstCount), setUint8, 0 },
+    { false, "burstIntervalMs", &(appConfig->camera.burstIntervalMs), setUint16, 0 },
+    { false, "motionCheck", &(appConfig->camera.motionCheck), setBool, 0 },
+    { false, "motionThreshold", &(appConfig->camera.motionThreshold), setUint8, 0 },
+    { false, "motionMinBlobCells", &(appConfig->camera.motionMinBlobCells), setUint16, 0 },
+    { false, "duplicateDistance", &(appConfig->camera.duplicateDistance), setUint8, 0 },
+    { false, "duplicateKeepOnSd", &(appConfig->camera.duplicateKeepOnSd), setBool, 0 }
   };
 
   paramSetter_t sensorParams[] = {
@@ -317,6 +409,156 @@ status_code_t readConfigFromSdCard(app_config_t *appConfig) {
   return statusCode;
 }
 
+/**
+ * Compute the key of the configuration file, i.e. its size and its CRC32,
+ * and the one of the firmware, as default and custom values come from it.
+ * The file is read by blocks, which is much faster than parsing it.
+ *
+ * @param header the snapshot header receiving the keys
+ *
+ * @return IS_OK when it succeeds or SD_READ_ERROR in case of failure
+ *
+ * @see config_snapshot_header_t
+ */
+status_code_t computeConfigSnapshotKey(config_snapshot_header_t *header) {
+  fs::FS &fs = SD_MMC;
+  File file = fs.open(CFG_CONFIG_FILE_NAME, FILE_READ);
+  if (!file) {
+    return SD_READ_ERROR;
+  }
+
+  uint8_t buffer[CFG_CONFIG_HASH_BUFFER_SIZE];
+  size_t len;
+  memset(header, 0, sizeof(config_snapshot_header_t));
+  memcpy(header->magic, CFG_CONFIG_SNAPSHOT_MAGIC, sizeof(header->magic));
+  header->version = CFG_CONFIG_SNAPSHOT_VERSION;
+  header->configSize = sizeof(app_config_t);
+  header->firmwareCrc = crc32_le(0, esp_ota_get_app_description()->app_elf_sha256, sizeof(esp_ota_get_app_description()->app_elf_sha256));
+  while ((len = file.read(buffer, sizeof(buffer))) > 0) {
+    header->textCrc = crc32_le(header->textCrc, buffer, len);
+    header->textSize += len;
+  }
+  file.close();
+  return IS_OK;
+}
+
+/**
+ * Load the configuration snapshot when its key matches the given one,
+ * i.e. when it has been computed from the same configuration file
+ * by the same firmware.
+ * The application configuration is left unchanged when the snapshot is not loaded.
+ *
+ * @param appConfig the application configuration receiving the snapshot
+ * @param key       the snapshot header containing the expected key
+ *
+ * @return IS_OK when the snapshot has been loaded.
+ *         SD_READ_ERROR when it is missing, stale or corrupted.
+ *
+ * @see saveConfigSnapshot()
+ */
+status_code_t loadConfigSnapshot(app_config_t *appConfig, const config_snapshot_header_t *key) {
+  fs::FS &fs = SD_MMC;
+  if (!fs.exists(CFG_CONFIG_SNAPSHOT_FILE_NAME)) {
+    logInfo(CFG_LOG, "No config snapshot.");
+    return SD_READ_ERROR;
+  }
+  File file = fs.open(CFG_CONFIG_SNAPSHOT_FILE_NAME, FILE_READ);
+  if (!file) {
+    logError(CFG_LOG, "%s: failed to open file %s in reading mode.", __func__, CFG_CONFIG_SNAPSHOT_FILE_NAME);
+    return SD_READ_ERROR;
+  }
+
+  // Read the header and the configuration at once
+  size_t snapshotSize = sizeof(config_snapshot_header_t) + sizeof(app_config_t);
+  uint8_t *snapshot = (uint8_t *)malloc(snapshotSize);
+  if (!snapshot) {
+    file.close();
+    return SD_READ_ERROR;
+  }
+  size_t readSize = file.read(snapshot, snapshotSize);
+  file.close();
+
+  status_code_t result = SD_READ_ERROR;
+  config_snapshot_header_t *header = (config_snapshot_header_t *)snapshot;
+  uint8_t *config = snapshot + sizeof(config_snapshot_header_t);
+  if (readSize != snapshotSize || memcmp(header, key, offsetof(config_snapshot_header_t, configCrc)) != 0) {
+    logInfo(CFG_LOG, "Config snapshot is stale.");
+  } else {
+    obfuscateConfigSnapshot(config, sizeof(app_config_t));
+    if (crc32_le(0, config, sizeof(app_config_t)) != header->configCrc) {
+      logWarn(CFG_LOG, "Config snapshot is corrupted.");
+    } else {
+      memcpy(appConfig, config, sizeof(app_config_t));
+      result = IS_OK;
+    }
+  }
+  memset(snapshot, 0, snapshotSize);
+  free(snapshot);
+  return result;
+}
+
+/**
+ * Save the application configuration as a snapshot for the given key.
+ * The snapshot is written in a temporary file first, then renamed,
+ * so a reset while writing leaves no truncated snapshot.
+ *
+ * @param appConfig the application configuration to save
+ * @param key       the snapshot header containing the key
+ *
+ * @return IS_OK when it succeeds or SD_WRITE_ERROR in case of failure
+ *
+ * @see loadConfigSnapshot()
+ */
+status_code_t saveConfigSnapshot(app_config_t *appConfig, const config_snapshot_header_t *key) {
+  size_t snapshotSize = sizeof(config_snapshot_header_t) + sizeof(app_config_t);
+  uint8_t *snapshot = (uint8_t *)malloc(snapshotSize);
+  if (!snapshot) {
+    return SD_WRITE_ERROR;
+  }
+  config_snapshot_header_t *header = (config_snapshot_header_t *)snapshot;
+  uint8_t *config = snapshot + sizeof(config_snapshot_header_t);
+  memcpy(header, key, sizeof(config_snapshot_header_t));
+  memcpy(config, appConfig, sizeof(app_config_t));
+  header->configCrc = crc32_le(0, config, sizeof(app_config_t));
+  obfuscateConfigSnapshot(config, sizeof(app_config_t));
+
+  status_code_t result = SD_WRITE_ERROR;
+  fs::FS &fs = SD_MMC;
+  File file = fs.open(CFG_CONFIG_SNAPSHOT_TMP_FILE_NAME, FILE_WRITE);
+  if (file) {
+    size_t writtenSize = file.write(snapshot, snapshotSize);
+    file.close();
+    fs.remove(CFG_CONFIG_SNAPSHOT_FILE_NAME);
+    if (writtenSize == snapshotSize && fs.rename(CFG_CONFIG_SNAPSHOT_TMP_FILE_NAME, CFG_CONFIG_SNAPSHOT_FILE_NAME)) {
+      logInfo(CFG_LOG, "Config snapshot saved to %s.", CFG_CONFIG_SNAPSHOT_FILE_NAME);
+      result = IS_OK;
+    }
+  }
+  if (result != IS_OK) {
+    logError(CFG_LOG, "%s: failed to write file %s.", __func__, CFG_CONFIG_SNAPSHOT_FILE_NAME);
+  }
+  free(snapshot);
+  return result;
+}
+
+/**
+ * Obfuscate or clear a snapshot with the MAC address.
+ * It is the XOR used for encrypted parameters: applied twice, it restores the data.
+ * Thus, the WiFi password and the upload authorization are not stored in clear.
+ *
+ * @param data the data to obfuscate or to clear, in place
+ * @param len  the data length
+ *
+ * @see decryptToCString()
+ */
+void obfuscateConfigSnapshot(uint8_t *data, size_t len) {
+  byte key[6];
+  fillWithMacAddress(key);
+  for (size_t i = 0; i < len; i++) {
+    data[i] ^= key[i % sizeof(key)];
+  }
+}
+
 /**
  * @brief Set the memory location referenced by paramValueAddress
  *        with the current FileConfig parameter value casted as bool.
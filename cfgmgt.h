@@ -4,14 +4,22 @@
 #include "Arduino.h"
 #include "FileConfig.h"
 #include "mbedtls/base64.h"
+#include "esp32/rom/crc.h"
+#include "esp_ota_ops.h"
+#include "burst.h"
 #include "camera.h"
+#include "dedupe.h"
 #include "error.h"
 #include "logging.h"
+#include "motion.h"
 #include "ota.h"
+#include "retention.h"
+#include "sdbench.h"
 #include "SD.h"
 #include "sensor.h"
 #include "upload.h"
 #include "wifimgt.h"
+#include "writebehind.h"
 
 // Logger name for this module
 #define CFG_LOG "Config"
@@ -21,6 +29,17 @@
 // Maximum size in byte of a parameter value
 #define CFG_CONFIG_VALUE_MAX_SIZE 100
 
+// Binary snapshot of the configuration parsed from CFG_CONFIG_FILE_NAME
+#define CFG_CONFIG_SNAPSHOT_FILE_NAME "/config.bin"
+// Temporary file written before replacing the snapshot
+#define CFG_CONFIG_SNAPSHOT_TMP_FILE_NAME "/config.tmp"
+// Magic number at the beginning of the snapshot file
+#define CFG_CONFIG_SNAPSHOT_MAGIC "CKCF"
+// Version of the snapshot file format
+#define CFG_CONFIG_SNAPSHOT_VERSION 1
+// Size of the buffer used to hash the configuration file
+#define CFG_CONFIG_HASH_BUFFER_SIZE 512
+
 // Default value for the parameter app_config_t.awakeDurationMs
 #define AWAKE_DURATION_MS_DEFAULT 2000 /* 2s */
 // Default value for the parameter app_config_t.deepSleepDurationSec
@@ -40,6 +59,11 @@ typedef struct {
   bool configOnSdCardRead;               // Internal. False until the configuration on the SD card is read.
   bool ignoreConfigFromSdCardReadError;  // User. Set it to true to ignore errors occuring during the configuration file reading.
   bool savePictureOnSdCard;              // User. Set it to true to save pictures on the SD card.
+  uint8_t pictureStorage;                // User. Set the layout of the pictures on the SD card. See picture_storage_t.
+  bool writeBehind;                      // User. Set it to true to queue the pictures in PSRAM and write them on the SD card in the background.
+  uint16_t flushDeadlineMs;              // User. Set the maximum time in milliseconds to wait for the queued pictures before the deep sleep.
+  uint16_t freeSpaceLowMB;               // User. Set the free space in MB of the SD card below which the oldest pictures are removed, 0 to keep them.
+  bool sdBenchmark;                      // User. Set it to true to measure the SD card again at each power on. It is measured at its first mount anyway.
   uint16_t awakeDurationMs;              // User. Set a value in milliseconds to pause once the picture is taken to prevent picture burst.
   uint16_t deepSleepDurationSec;         // User. Set a value in seconds defining the deep sleep duration before the wake up. 0 means infinite.
   wifi_settings_t wifi;                  // User. Set the WiFi settings. See wifi_settings_t.
@@ -107,6 +131,25 @@ typedef struct {
   size_t paramCount;
 } section_param_setter_t;
 
+/**
+ * Header of the configuration snapshot file, followed by the app_config_t.
+ * The snapshot is valid only for the configuration file and the firmware
+ * it has been computed from.
+ *
+ * @see loadConfigSnapshot()
+ * @see saveConfigSnapshot()
+ */
+typedef struct __attribute__((packed)) {
+  char magic[4];          // CFG_CONFIG_SNAPSHOT_MAGIC
+  uint16_t version;       // CFG_CONFIG_SNAPSHOT_VERSION
+  uint16_t reserved;      // 0
+  uint32_t configSize;    // sizeof(app_config_t)
+  uint32_t firmwareCrc;   // CRC32 of the firmware ELF SHA256: default and custom values come from the firmware
+  uint32_t textSize;      // Size of the configuration file
+  uint32_t textCrc;       // CRC32 of the configuration file
+  uint32_t configCrc;     // CRC32 of the app_config_t, before its obfuscation
+} config_snapshot_header_t;
+
 /**
  * @brief Read the configuration file on SD card and fills the
  *        application configuration structure.
@@ -118,6 +161,56 @@ typedef struct {
  */
 status_code_t readConfigFromSdCard(app_config_t *appConfig);
 
+/**
+ * @brief Parse the configuration file on the SD card and fill the
+ *        application configuration structure.
+ *
+ * @param appConfig
+ * @return IS_OK on successful reading
+ *         or READ_CONFIG_ERROR on read error
+ */
+status_code_t parseConfigFile(app_config_t *appConfig);
+
+/**
+ * @brief Compute the key of the configuration file, i.e. its size and its CRC32,
+ *        and the one of the firmware.
+ *
+ * @param header the snapshot header receiving the keys
+ *
+ * @return IS_OK when it succeeds or SD_READ_ERROR in case of failure
+ */
+status_code_t computeConfigSnapshotKey(config_snapshot_header_t *header);
+
+/**
+ * @brief Load the configuration snapshot when its key matches the given one.
+ *
+ * @param appConfig the application configuration receiving the snapshot
+ * @param key       the snapshot header containing the expected key
+ *
+ * @return IS_OK when the snapshot has been loaded.
+ *         SD_READ_ERROR when it is missing, stale or corrupted.
+ */
+status_code_t loadConfigSnapshot(app_config_t *appConfig, const config_snapshot_header_t *key);
+
+/**
+ * @brief Save the application configuration as a snapshot for the given key.
+ *
+ * @param appConfig the application configuration to save
+ * @param key       the snapshot header containing the key
+ *
+ * @return IS_OK when it succeeds or SD_WRITE_ERROR in case of failure
+ */
+status_code_t saveConfigSnapshot(app_config_t *appConfig, const config_snapshot_header_t *key);
+
+/**
+ * @brief Obfuscate or clear a snapshot with the MAC address, like encrypted parameters,
+ *        so secrets are not stored in clear on the SD card.
+ *
+ * @param data the data to obfuscate or to clear, in place
+ * @param len  the data length
+ */
+void obfuscateConfigSnapshot(uint8_t *data, size_t len);
+
 /**
  * @brief Set the memory location referenced by paramValueAddress
  *        with the current FileConfig parameter value casted as bool.
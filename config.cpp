@@ -12,6 +12,15 @@ void initAppConfigWithCustomValues(app_config_t* appConfig) {
     
   // // Save picture on SD card
   // appConfig->savePictureOnSdCard = true;
+  // // Append pictures to segment files rather than one file by picture
+  // appConfig->pictureStorage = PICTURE_STORAGE_SEGMENTS;
+  // // Or group pictures in directories of 256 pictures rather than in the root directory
+  // appConfig->pictureStorage = PICTURE_STORAGE_DIRECTORIES;
+  // // Write the pictures on the SD card while the wake cycle goes on, waiting 5000ms at most before the deep sleep
+  // appConfig->writeBehind = true;
+  // appConfig->flushDeadlineMs = 5000;
+  // appConfig->freeSpaceLowMB = 512;
+  // appConfig->sdBenchmark = true;
   // // Still awaken 5000ms before going in deep sleep mode
   // appConfig->awakeDurationMs = 5000;
   // // Do not periodically wake up the board
@@ -44,10 +53,33 @@ void initAppConfigWithCustomValues(app_config_t* appConfig) {
   // appConfig->upload.bunchSize = 10;
   // // 
   // appConfig->upload.fileNameRandSize = 5;
+  // // Upload up to 8 pictures by request, when the server returns a result manifest
+  // appConfig->upload.batchSize = 8;
+  // // Give up waiting for the server response after 5 seconds
+  // appConfig->upload.responseTimeoutMs = 5000;
+  // // Read the pictures from the SD card by 32 KB while sending them
+  // appConfig->upload.sendBufferKB = 32;
+  // // Write the pictures not stored on SD card by 8 TCP segments
+  // appConfig->upload.writeSize = 11488;
+  // // Keep the Nagle algorithm
+  // appConfig->upload.noDelay = false;
   
   // // **** Camera ****
   
   // appConfig->camera.getReadyDelayMs = 1500;
+  // appConfig->camera.adaptiveWarmUp = true;
+  // // Retake dark, green or corrupted pictures twice at most
+  // appConfig->camera.retakeMax = 2;
+  // // 4 pictures, 250ms apart, at each wake up
+  // appConfig->camera.burstCount = 4;
+  // appConfig->camera.burstIntervalMs = 250;
+  // // Drop the pictures of PIR triggers where nothing moved (wind, sun)
+  // appConfig->camera.motionCheck = true;
+  // appConfig->camera.motionThreshold = 24;
+  // appConfig->camera.motionMinBlobCells = 6;
+  // // Don't upload the near-duplicates of the last pictures, e.g. a bird sitting on the feeder
+  // appConfig->camera.duplicateDistance = 6;
+  // appConfig->camera.duplicateKeepOnSd = true;
   
   // // **** Camera sensor ****
   
@@ -0,0 +1,131 @@
+#include "dedupe.h"
+
+/**
+ * @brief Compute the 64-bit difference hash of a JPEG picture from its DC coefficients.
+ *
+ * The luminance thumbnail is decoded without any IDCT, see decodeJpegDc().
+ *
+ * @param fb   the frame buffer of the picture
+ * @param hash the hash
+ *
+ * @return false when the picture can't be decoded
+ */
+bool computePictureHash(const camera_fb_t *fb, uint64_t *hash) {
+  jpeg_dc_t dc;
+  if (fb->format != PIXFORMAT_JPEG || !decodeJpegDc(fb->buf, fb->len, &dc)) {
+    return false;
+  }
+  *hash = computeThumbnailHash(dc.thumbnail);
+  return true;
+}
+
+/**
+ * @brief Compute the difference hash of a luminance thumbnail:
+ *        one bit by pair of horizontally adjacent cells, set when the left one is darker.
+ *
+ * Comparing neighbour cells rather than absolute values makes the hash
+ * insensitive to the global brightness changes of the auto exposure.
+ *
+ * @param thumbnail the thumbnail decoded by decodeJpegDc()
+ *
+ * @return the hash
+ */
+uint64_t computeThumbnailHash(const uint8_t thumbnail[JPEGDC_THUMBNAIL_HEIGHT][JPEGDC_THUMBNAIL_WIDTH]) {
+  uint64_t hash = 0;
+  for (uint8_t y = 0; y < JPEGDC_THUMBNAIL_HEIGHT; y++) {
+    for (uint8_t x = 0; x + 1 < JPEGDC_THUMBNAIL_WIDTH; x++) {
+      hash = (hash << 1) | (thumbnail[y][x] < thumbnail[y][x + 1]);
+    }
+  }
+  return hash;
+}
+
+/**
+ * @brief Find the Hamming distance between a hash and the nearest one of the history.
+ *
+ * @param history the picture history
+ * @param hash    the hash of the new picture
+ *
+ * @return the distance, 65 when the history is empty
+ */
+uint8_t findNearestPictureDistance(const picture_history_t *history, uint64_t hash) {
+  uint8_t nearest = 65;
+  for (uint8_t i = 0; i < history->hashCount; i++) {
+    uint8_t distance = __builtin_popcountll(history->hashes[i] ^ hash);
+    if (distance < nearest) {
+      nearest = distance;
+    }
+  }
+  return nearest;
+}
+
+/**
+ * @brief Tell whether the picture is a near-duplicate of one of the last distinct pictures.
+ *        When it is not, its hash is added to the history.
+ *
+ * Only distinct pictures enter the history: a scene changing slowly,
+ * e.g. the daylight, still gives a picture from time to time.
+ * When the picture can't be decoded, it is distinct.
+ *
+ * @param history     the picture history
+ * @param fb          the frame buffer of the picture
+ * @param maxDistance the maximum Hamming distance of a near-duplicate, 0 to disable the check
+ * @param hash        the hash of the picture, 0 when it has not been computed
+ *
+ * @return true when the picture is a near-duplicate
+ */
+bool checkDuplicatePicture(picture_history_t *history, const camera_fb_t *fb, uint8_t maxDistance, uint64_t *hash) {
+  uint8_t distance;
+
+  *hash = 0;
+  if (!maxDistance) {
+    return false;
+  }
+  if (!computePictureHash(fb, hash)) {
+    logWarn(DEDUPE_LOG, "Failed to hash the picture: it is kept.");
+    *hash = 0;
+    return false;
+  }
+  distance = findNearestPictureDistance(history, *hash);
+  if (distance <= maxDistance) {
+    logInfo(DEDUPE_LOG, "Near-duplicate picture: distance %d to a previous one.", distance);
+    return true;
+  }
+  logDebug(DEDUPE_LOG, "Distinct picture: hash %016llx, distance %d.", (unsigned long long)*hash, distance);
+  history->hashes[history->nextHash] = *hash;
+  history->nextHash = (history->nextHash + 1) % DEDUPE_HISTORY_LENGTH;
+  if (history->hashCount < DEDUPE_HISTORY_LENGTH) {
+    history->hashCount++;
+  }
+  return false;
+}
+
+/**
+ * @brief Flag a picture index saved on the SD card as not to be uploaded, or clear the flag.
+ *        It must be called for each saved picture, to clear the flag of an older index.
+ *
+ * @param history the picture history
+ * @param index   the picture index
+ * @param sdOnly  true when the picture must not be uploaded
+ */
+void setPictureSdOnly(picture_history_t *history, uint32_t index, bool sdOnly) {
+  uint8_t bit = 1 << (index % 8);
+  uint8_t *flags = &(history->sdOnly[(index % DEDUPE_SD_ONLY_WINDOW) / 8]);
+  *flags = sdOnly ? (*flags | bit) : (*flags & ~bit);
+}
+
+/**
+ * @brief Tell whether a picture saved on the SD card must not be uploaded.
+ *
+ * @param history   the picture history
+ * @param index     the picture index
+ * @param lastIndex the index of the last saved picture: the older flags have been overwritten
+ *
+ * @return true when the picture must not be uploaded
+ */
+bool isPictureSdOnly(const picture_history_t *history, uint32_t index, uint32_t lastIndex) {
+  if (lastIndex - index >= DEDUPE_SD_ONLY_WINDOW) {
+    return false;
+  }
+  return history->sdOnly[(index % DEDUPE_SD_ONLY_WINDOW) / 8] & (1 << (index % 8));
+}
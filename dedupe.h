@@ -0,0 +1,101 @@
+#ifndef DEDUPE_H
+#define DEDUPE_H
+
+#include "Arduino.h"
+#include "error.h"
+#include "logging.h"
+#include "esp_camera.h"
+#include "jpegdc.h"
+
+// Logger name for this module
+#define DEDUPE_LOG "Dedupe"
+
+// Default value of camera_settings_t.duplicateDistance
+#define DUPLICATE_DISTANCE_DEFAULT 0
+// Default value of camera_settings_t.duplicateKeepOnSd
+#define DUPLICATE_KEEP_ON_SD_DEFAULT false
+
+// Number of hashes of the last distinct pictures compared to a new picture
+#define DEDUPE_HISTORY_LENGTH 8
+// Number of the last picture indexes for which the "SD card only" flag is kept
+#define DEDUPE_SD_ONLY_WINDOW 256
+
+/**
+ * Hashes of the last distinct pictures and near-duplicates kept on the SD card only.
+ * Stored in the RTC memory, see the global variable pictureHistory in the main file.
+ * It is lost when the board is powered off: the next picture is then always distinct
+ * and the near-duplicates waiting on the SD card are uploaded.
+ *
+ * @see checkDuplicatePicture()
+ */
+typedef struct {
+  uint64_t hashes[DEDUPE_HISTORY_LENGTH];    // Difference hashes of the last distinct pictures. The oldest one is overwritten.
+  uint8_t hashCount;                         // Number of valid hashes
+  uint8_t nextHash;                          // Index of the next hash to write
+  uint8_t sdOnly[DEDUPE_SD_ONLY_WINDOW / 8]; // One bit by picture index modulo DEDUPE_SD_ONLY_WINDOW, set when it must not be uploaded
+} picture_history_t;
+
+/**
+ * @brief Compute the 64-bit difference hash of a JPEG picture from its DC coefficients.
+ *
+ * @param fb   the frame buffer of the picture
+ * @param hash the hash
+ *
+ * @return false when the picture can't be decoded
+ */
+bool computePictureHash(const camera_fb_t *fb, uint64_t *hash);
+
+/**
+ * @brief Compute the difference hash of a luminance thumbnail:
+ *        one bit by pair of horizontally adjacent cells, set when the left one is darker.
+ *
+ * @param thumbnail the thumbnail decoded by decodeJpegDc()
+ *
+ * @return the hash
+ */
+uint64_t computeThumbnailHash(const uint8_t thumbnail[JPEGDC_THUMBNAIL_HEIGHT][JPEGDC_THUMBNAIL_WIDTH]);
+
+/**
+ * @brief Find the Hamming distance between a hash and the nearest one of the history.
+ *
+ * @param history the picture history
+ * @param hash    the hash of the new picture
+ *
+ * @return the distance, 65 when the history is empty
+ */
+uint8_t findNearestPictureDistance(const picture_history_t *history, uint64_t hash);
+
+/**
+ * @brief Tell whether the picture is a near-duplicate of one of the last distinct pictures.
+ *        When it is not, its hash is added to the history.
+ *
+ * @param history     the picture history
+ * @param fb          the frame buffer of the picture
+ * @param maxDistance the maximum Hamming distance of a near-duplicate, 0 to disable the check
+ * @param hash        the hash of the picture, 0 when it has not been computed
+ *
+ * @return true when the picture is a near-duplicate
+ */
+bool checkDuplicatePicture(picture_history_t *history, const camera_fb_t *fb, uint8_t maxDistance, uint64_t *hash);
+
+/**
+ * @brief Flag a picture index saved on the SD card as not to be uploaded, or clear the flag.
+ *
+ * @param history the picture history
+ * @param index   the picture index
+ * @param sdOnly  true when the picture must not be uploaded
+ */
+void setPictureSdOnly(picture_history_t *history, uint32_t index, bool sdOnly);
+
+/**
+ * @brief Tell whether a picture saved on the SD card must not be uploaded.
+ *
+ * @param history   the picture history
+ * @param index     the picture index
+ * @param lastIndex the index of the last saved picture: the older flags have been overwritten
+ *
+ * @return true when the picture must not be uploaded
+ */
+bool isPictureSdOnly(const picture_history_t *history, uint32_t index, uint32_t lastIndex);
+
+#endif
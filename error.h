@@ -28,8 +28,13 @@ typedef enum {
   SD_WRITE_ERROR = 5,            // Failed to write a file on the SD card
   WIFI_INIT_ERROR = 6,           // Failed to initialize the WiFi. Check the WiFi settings.
   UPLOAD_PICTURE_ERROR = 7,      // Failed to upload the picture. Check the upload settings.
-  READ_CONFIG_ERROR = 8          // Failed to read the configuration file on SD card.
+  READ_CONFIG_ERROR = 8,         // Failed to read the configuration file on SD card.
                                  // Check the content of your configuration file.
+  NO_MOTION_DETECTED = 9,        // Not an error: nothing moved in front of the camera after a PIR trigger.
+                                 // The wake cycle stops early and it is not signaled.
+  DUPLICATE_PICTURE = 10,        // Not an error: the picture is a near-duplicate of a previous one and it is dropped.
+                                 // The wake cycle stops early and it is not signaled.
+  SD_CORRUPTED_DATA_ERROR = 11   // The data read from the SD card doesn't match the CRC-32 computed when it was written
 } status_code_t;
 
 /**
@@ -35,7 +35,7 @@ void fillWithRandom(char *destToFill, uint8_t len) {
 }
 
 /**
- * @brief Compute a picture name in "pic-%05d.jpg" format
+ * @brief Compute a picture name in "pic-%05u.jpg" format
  *        with the given index.
  *
  * The generated picture name is stored as a C string
@@ -45,8 +45,8 @@ void fillWithRandom(char *destToFill, uint8_t len) {
  * @param destPictureName the char array receiving the computed picture name
  * @param index           the index to include in the picture name
  */
-void computePictureNameFromIndex(char * destPictureName, uint16_t index){
-  sprintf(destPictureName, "pic-%05d.jpg", index);
+void computePictureNameFromIndex(char * destPictureName, uint32_t index){
+  sprintf(destPictureName, "pic-%05u.jpg", (unsigned int)index);
 }
 
 /**
@@ -23,13 +23,13 @@ char getRandomChar();
 void fillWithRandom(char *destToFill, uint8_t len);
 
 /**
- * @brief Compute a picture name in "pic-%05d.jpg" format
+ * @brief Compute a picture name in "pic-%05u.jpg" format
  *        with the given index.
  *
  * @param destPictureName the char array receiving the computed picture name
  * @param index           the index to include in the picture name
  */
-void computePictureNameFromIndex(char * destPictureName, uint16_t index);
+void computePictureNameFromIndex(char * destPictureName, uint32_t index);
 
 /**
  * @brief Computes a picture name in "pic-R.jpg" format
@@ -0,0 +1,209 @@
+#ifndef FRAMEDIFF_H
+#define FRAMEDIFF_H
+
+/**
+ * Frame difference kernel detecting motion between two grayscale frames.
+ * It only depends on the C library, so it is built as is on the host
+ * to be tested and benchmarked against recorded frames (see host/motion-bench.cpp).
+ *
+ * The frames are split in cells of FRAMEDIFF_CELL_SIZE x FRAMEDIFF_CELL_SIZE pixels.
+ * A cell changed when enough of its pixels changed, and the motion is the largest
+ * blob of 4-connected changed cells: leaves shaken by the wind and sensor noise
+ * make scattered cells, a bird makes a blob.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Side in pixels of a cell
+#define FRAMEDIFF_CELL_SIZE 4
+// Maximum frame width in pixels
+#define FRAMEDIFF_MAX_WIDTH 256
+// Maximum frame height in pixels
+#define FRAMEDIFF_MAX_HEIGHT 192
+// Maximum number of cells of a frame
+#define FRAMEDIFF_MAX_CELLS ((FRAMEDIFF_MAX_WIDTH / FRAMEDIFF_CELL_SIZE) * (FRAMEDIFF_MAX_HEIGHT / FRAMEDIFF_CELL_SIZE))
+
+/**
+ * Thresholds of the motion detection.
+ *
+ * @see framediffCompare()
+ */
+typedef struct {
+  uint8_t pixelThreshold;  // Minimum absolute difference of a changed pixel, the global brightness change excluded
+  uint8_t cellThreshold;   // Minimum number of changed pixels of a changed cell, out of FRAMEDIFF_CELL_SIZE^2
+  uint16_t minBlobCells;   // Minimum number of cells of a moving blob
+} framediff_params_t;
+
+/**
+ * Result of a frame comparison.
+ *
+ * @see framediffCompare()
+ */
+typedef struct {
+  uint32_t changedPixels;     // Number of changed pixels
+  uint16_t changedCells;      // Number of changed cells
+  uint16_t largestBlobCells;  // Number of cells of the largest blob of changed cells
+  int16_t brightnessShift;    // Mean brightness of the current frame minus the one of the previous frame
+  bool motion;                // True when largestBlobCells reaches framediff_params_t.minBlobCells
+} framediff_result_t;
+
+/**
+ * Working memory of framediffCompare(), too large for a task stack.
+ */
+typedef struct {
+  uint8_t cellCounts[FRAMEDIFF_MAX_CELLS];  // Number of changed pixels of each cell
+  uint16_t stack[FRAMEDIFF_MAX_CELLS];      // Cells to visit by the blob search
+  uint8_t rowMask[FRAMEDIFF_MAX_WIDTH];     // 1 for each changed pixel of the current row
+} framediff_workspace_t;
+
+/**
+ * @brief Sum the pixels of a frame.
+ *
+ * @param frame the frame
+ * @param len   the number of pixels
+ *
+ * @return the sum
+ */
+static inline uint32_t framediffSum(const uint8_t *frame, size_t len) {
+  uint32_t sum = 0;
+  for (size_t i = 0; i < len; i++) {
+    sum += frame[i];
+  }
+  return sum;
+}
+
+/**
+ * @brief Mark the changed pixels of a row.
+ *
+ * The loop is branch-free, so compilers vectorize it where SIMD exists.
+ *
+ * @param previous  the row of the previous frame
+ * @param current   the row of the current frame
+ * @param width     the number of pixels
+ * @param shift     the brightness shift to compensate
+ * @param threshold the minimum absolute difference of a changed pixel
+ * @param rowMask   the mask receiving 1 for each changed pixel, 0 otherwise
+ *
+ * @return the number of changed pixels
+ */
+static inline uint32_t framediffMaskRow(const uint8_t *previous, const uint8_t *current, uint16_t width,
+                                        int16_t shift, uint8_t threshold, uint8_t *rowMask) {
+  uint32_t count = 0;
+  for (uint16_t x = 0; x < width; x++) {
+    int16_t diff = (int16_t)current[x] - (int16_t)previous[x] - shift;
+    uint8_t changed = (diff > threshold) | (diff < -threshold);
+    rowMask[x] = changed;
+    count += changed;
+  }
+  return count;
+}
+
+/**
+ * @brief Search the largest blob of 4-connected changed cells.
+ *        The changed cells are cleared while they are visited.
+ *
+ * @param cellCounts    the number of changed pixels of each cell
+ * @param gridWidth     the number of cells of a row
+ * @param gridHeight    the number of cell rows
+ * @param cellThreshold the minimum number of changed pixels of a changed cell
+ * @param stack         working memory of gridWidth * gridHeight entries
+ *
+ * @return the number of cells of the largest blob
+ */
+static inline uint16_t framediffLargestBlob(uint8_t *cellCounts, uint16_t gridWidth, uint16_t gridHeight,
+                                            uint8_t cellThreshold, uint16_t *stack) {
+  uint16_t largest = 0;
+  uint16_t cellCount = gridWidth * gridHeight;
+
+  for (uint16_t seed = 0; seed < cellCount; seed++) {
+    if (cellCounts[seed] < cellThreshold) {
+      continue;
+    }
+    uint16_t size = 0;
+    uint16_t top = 0;
+    cellCounts[seed] = 0;
+    stack[top++] = seed;
+    while (top) {
+      uint16_t cell = stack[--top];
+      uint16_t x = cell % gridWidth;
+      size++;
+      // Each cell is pushed once at most, as it is cleared when pushed
+      if (x > 0 && cellCounts[cell - 1] >= cellThreshold) {
+        cellCounts[cell - 1] = 0;
+        stack[top++] = cell - 1;
+      }
+      if (x + 1 < gridWidth && cellCounts[cell + 1] >= cellThreshold) {
+        cellCounts[cell + 1] = 0;
+        stack[top++] = cell + 1;
+      }
+      if (cell >= gridWidth && cellCounts[cell - gridWidth] >= cellThreshold) {
+        cellCounts[cell - gridWidth] = 0;
+        stack[top++] = cell - gridWidth;
+      }
+      if (cell + gridWidth < cellCount && cellCounts[cell + gridWidth] >= cellThreshold) {
+        cellCounts[cell + gridWidth] = 0;
+        stack[top++] = cell + gridWidth;
+      }
+    }
+    if (size > largest) {
+      largest = size;
+    }
+  }
+  return largest;
+}
+
+/**
+ * @brief Compare two grayscale frames of the same size and tell whether something moved.
+ *
+ * The global brightness change, like the sun going behind a cloud, is compensated.
+ * Pixels of the right and bottom borders not filling a whole cell are ignored.
+ *
+ * @param previous  the previous frame
+ * @param current   the current frame
+ * @param width     the frame width, FRAMEDIFF_MAX_WIDTH at most
+ * @param height    the frame height, FRAMEDIFF_MAX_HEIGHT at most
+ * @param params    the thresholds
+ * @param workspace the working memory
+ * @param result    the framediff_result_t receiving the result
+ *
+ * @return false when the frame size is not supported
+ */
+static inline bool framediffCompare(const uint8_t *previous, const uint8_t *current, uint16_t width, uint16_t height,
+                                    const framediff_params_t *params, framediff_workspace_t *workspace,
+                                    framediff_result_t *result) {
+  uint16_t gridWidth = width / FRAMEDIFF_CELL_SIZE;
+  uint16_t gridHeight = height / FRAMEDIFF_CELL_SIZE;
+  size_t pixelCount = (size_t)width * height;
+
+  memset(result, 0, sizeof(framediff_result_t));
+  if (width > FRAMEDIFF_MAX_WIDTH || height > FRAMEDIFF_MAX_HEIGHT || !gridWidth || !gridHeight) {
+    return false;
+  }
+
+  result->brightnessShift = (int16_t)(((int32_t)framediffSum(current, pixelCount) - (int32_t)framediffSum(previous, pixelCount)) / (int32_t)pixelCount);
+
+  memset(workspace->cellCounts, 0, gridWidth * gridHeight);
+  for (uint16_t y = 0; y < gridHeight * FRAMEDIFF_CELL_SIZE; y++) {
+    size_t offset = (size_t)y * width;
+    uint8_t *cellRow = workspace->cellCounts + (y / FRAMEDIFF_CELL_SIZE) * gridWidth;
+    result->changedPixels += framediffMaskRow(previous + offset, current + offset, width, result->brightnessShift,
+                                              params->pixelThreshold, workspace->rowMask);
+    for (uint16_t cx = 0; cx < gridWidth; cx++) {
+      const uint8_t *mask = workspace->rowMask + cx * FRAMEDIFF_CELL_SIZE;
+      for (uint8_t i = 0; i < FRAMEDIFF_CELL_SIZE; i++) {
+        cellRow[cx] += mask[i];
+      }
+    }
+  }
+
+  for (uint16_t cell = 0; cell < gridWidth * gridHeight; cell++) {
+    result->changedCells += workspace->cellCounts[cell] >= params->cellThreshold;
+  }
+  result->largestBlobCells = framediffLargestBlob(workspace->cellCounts, gridWidth, gridHeight, params->cellThreshold, workspace->stack);
+  result->motion = result->largestBlobCells >= params->minBlobCells;
+  return true;
+}
+
+#endif
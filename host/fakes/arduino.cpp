@@ -0,0 +1,198 @@
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+#include "Arduino.h"
+#include "esp_timer.h"
+#include "host_fakes.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+
+// Reset by the simulated deep sleep, like the timers of a board waking up
+static std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+static std::mt19937 randomGenerator;
+static std::mutex randomMutex;
+static bool timeConfigured = false;
+static uint64_t sleepTimerWakeupUs = 0;
+static esp_sleep_wakeup_cause_t wakeupCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (size--) {
+    n += write(*buffer++);
+  }
+  return n;
+}
+
+int Print::printf(const char *format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (len >= (int)sizeof(buffer)) {
+    char *largeBuffer = (char *)malloc(len + 1);
+    va_start(args, format);
+    vsnprintf(largeBuffer, len + 1, format, args);
+    va_end(args);
+    write((const uint8_t *)largeBuffer, len);
+    free(largeBuffer);
+  } else if (len > 0) {
+    write((const uint8_t *)buffer, len);
+  }
+  return len;
+}
+
+size_t Print::print(struct tm *timeinfo, const char *format) {
+  char buffer[64];
+  size_t len = strftime(buffer, sizeof(buffer), format ? format : "%c", timeinfo);
+  return write((const uint8_t *)buffer, len);
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  if (c != '\r') {
+    fputc(c, stdout);
+  }
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    write(buffer[i]);
+  }
+  return size;
+}
+
+void EspClass::restart() {
+  Serial.printf("\nESP.restart(): end of the simulation.\n");
+  fflush(stdout);
+  exit(0);
+}
+
+unsigned long millis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+unsigned long micros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+int64_t esp_timer_get_time() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+void delay(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us) {
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+}
+
+long random(long max) {
+  return random(0, max);
+}
+
+long random(long min, long max) {
+  if (max <= min) {
+    return min;
+  }
+  std::lock_guard<std::mutex> lock(randomMutex);
+  return min + (long)(randomGenerator() % (unsigned long)(max - min));
+}
+
+void randomSeed(unsigned long seed) {
+  std::lock_guard<std::mutex> lock(randomMutex);
+  randomGenerator.seed(seed);
+}
+
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char *server1, const char *server2, const char *server3) {
+  timeConfigured = true;
+}
+
+bool getLocalTime(struct tm *info, uint32_t ms) {
+  if (!timeConfigured) {
+    return false;
+  }
+  time_t now = time(NULL);
+  localtime_r(&now, info);
+  return true;
+}
+
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char *dst, const char *src, size_t size) {
+  size_t len = strlen(src);
+  if (size) {
+    size_t n = len < size - 1 ? len : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return len;
+}
+#endif
+
+esp_err_t esp_sleep_enable_ext0_wakeup(gpio_num_t gpio, int level) {
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t timeUs) {
+  sleepTimerWakeupUs = timeUs;
+  return ESP_OK;
+}
+
+void esp_deep_sleep_start() {
+  host_deep_sleep_t deepSleep = { sleepTimerWakeupUs };
+  wakeupCause = sleepTimerWakeupUs ? ESP_SLEEP_WAKEUP_TIMER : ESP_SLEEP_WAKEUP_EXT0;
+  sleepTimerWakeupUs = 0;
+  bootTime = std::chrono::steady_clock::now();
+  throw deepSleep;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() {
+  return wakeupCause;
+}
+
+host_fakes_t hostFakes = {
+  .framesDir = "../res",
+  .cameraInitMs = 300,
+  .cameraFrameMs = 120,
+  .cameraInitFails = false,
+  .cameraFrameFailCount = 0,
+  .cameraSettleMs = 900,
+  .sceneExposure = 600,
+  .sceneGain = 0x34,
+  .sceneMotion = true,
+  .sdRoot = "build/sdcard",
+  .sdMountMs = 80,
+  .sdOpenMs = 15,
+  .sdDirEntryUs = 0,
+  .sdWriteKBps = 2000,
+  .sdReadKBps = 8000,
+  .sdWriteCallUs = 0,
+  .sdNonDmaSectorUs = 0,
+  .sdStallMs = 0,
+  .sdStallEvery = 0,
+  .sdReadCorruptEvery = 0,
+  .sdMountFails = false,
+  .sdWriteFails = false,
+  .sdCardSize = 16ULL * 1024 * 1024 * 1024,
+  .wifiConnectMs = 2000,
+  .wifiFails = false,
+  .tcpConnectMs = 60,
+  .tcpConnectFails = false,
+  .tcpWriteKBps = 500,
+  .otaCheckMs = 150
+};
+
+void hostFakeTransferDelay(size_t len, uint32_t kBps) {
+  if (kBps) {
+    std::this_thread::sleep_for(std::chrono::microseconds((uint64_t)len * 1000 / kBps * 1000 / 1024));
+  }
+}
@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <math.h>
+#include <dirent.h>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include "esp_camera.h"
+#include "host_fakes.h"
+
+static bool cameraInitialized = false;
+static sensor_t sensor;
+static std::vector<std::string> framePaths;
+static size_t nextFrame = 0;
+// Frame buffers held by the application, at most camera_config_t.fb_count
+static std::mutex frameBuffersMutex;
+static std::condition_variable frameBufferReturned;
+static size_t frameBufferCount = 1;
+static size_t heldFrameBufferCount = 0;
+
+#define STATUS_SETTER(NAME, FIELD)                  \
+  static int NAME(sensor_t *s, int value) {         \
+    s->status.FIELD = value;                        \
+    return 0;                                       \
+  }
+
+STATUS_SETTER(setContrast, contrast)
+STATUS_SETTER(setBrightness, brightness)
+STATUS_SETTER(setSaturation, saturation)
+STATUS_SETTER(setSharpness, sharpness)
+STATUS_SETTER(setDenoise, denoise)
+STATUS_SETTER(setQuality, quality)
+STATUS_SETTER(setColorbar, colorbar)
+STATUS_SETTER(setWhitebal, awb)
+STATUS_SETTER(setGainCtrl, agc)
+STATUS_SETTER(setExposureCtrl, aec)
+STATUS_SETTER(setHmirror, hmirror)
+STATUS_SETTER(setVflip, vflip)
+STATUS_SETTER(setAec2, aec2)
+STATUS_SETTER(setAwbGain, awb_gain)
+STATUS_SETTER(setSpecialEffect, special_effect)
+STATUS_SETTER(setWbMode, wb_mode)
+STATUS_SETTER(setAeLevel, ae_level)
+STATUS_SETTER(setDcw, dcw)
+STATUS_SETTER(setBpc, bpc)
+STATUS_SETTER(setWpc, wpc)
+STATUS_SETTER(setRawGma, raw_gma)
+STATUS_SETTER(setLenc, lenc)
+
+/**
+ * Simulated auto exposure and auto gain: from their values at the last
+ * manual setting, they converge exponentially to the scene values
+ * in hostFakes.cameraSettleMs.
+ */
+static unsigned long controlStartMs;
+static uint32_t startExposure;
+static uint32_t startGain;
+
+static uint32_t convergedValue(uint32_t startValue, uint32_t sceneValue) {
+  unsigned long elapsedMs = millis() - controlStartMs;
+  if (!hostFakes.cameraSettleMs || elapsedMs >= hostFakes.cameraSettleMs) {
+    return sceneValue;
+  }
+  // 5 time constants in the settle time
+  double remaining = exp(-5.0 * elapsedMs / hostFakes.cameraSettleMs);
+  return lround(sceneValue + ((double)startValue - sceneValue) * remaining);
+}
+
+static uint32_t currentExposure() {
+  return sensor.status.aec ? convergedValue(startExposure, hostFakes.sceneExposure) : sensor.status.aec_value;
+}
+
+static uint32_t currentGain() {
+  return sensor.status.agc ? convergedValue(startGain, hostFakes.sceneGain) : startGain;
+}
+
+static int setAecValue(sensor_t *s, int value) {
+  startGain = currentGain();
+  s->status.aec_value = startExposure = value;
+  controlStartMs = millis();
+  return 0;
+}
+
+static int setAgcGain(sensor_t *s, int value) {
+  // GAIN register value of each index, like the real driver
+  static const uint8_t gainRegisters[] = {
+    0x00, 0x10, 0x18, 0x30, 0x34, 0x38, 0x3C, 0x70, 0x72, 0x74, 0x76, 0x78, 0x7A, 0x7C, 0x7E, 0xF0,
+    0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA, 0xFB, 0xFC, 0xFD, 0xFE, 0xFF
+  };
+  startExposure = currentExposure();
+  s->status.agc_gain = value;
+  startGain = gainRegisters[std::min(std::max(value, 0), 30)];
+  controlStartMs = millis();
+  return 0;
+}
+
+/**
+ * Only the exposure and gain registers of the OV2640 sensor bank are readable:
+ * GAIN (0x00), REG04 (0x04, AEC[1:0]), AEC (0x10, AEC[9:2]) and REG45 (0x45, AEC[15:10]).
+ */
+static int getReg(sensor_t *s, int reg, int mask) {
+  uint32_t exposure = currentExposure();
+  int value;
+  switch (reg) {
+    case 0x100: value = currentGain(); break;
+    case 0x104: value = exposure & 0x03; break;
+    case 0x110: value = (exposure >> 2) & 0xFF; break;
+    case 0x145: value = (exposure >> 10) & 0x3F; break;
+    default: return -1;
+  }
+  return value & mask;
+}
+
+static int setReg(sensor_t *s, int reg, int mask, int value) {
+  return -1;
+}
+
+static int setGainceiling(sensor_t *s, gainceiling_t value) {
+  s->status.gainceiling = value;
+  return 0;
+}
+
+static int setFramesize(sensor_t *s, framesize_t value) {
+  s->status.framesize = value;
+  return 0;
+}
+
+static int setPixformat(sensor_t *s, pixformat_t value) {
+  s->pixformat = value;
+  return 0;
+}
+
+/**
+ * Read the frame dimensions in the SOF segment of a JPEG buffer.
+ */
+static void readJpegSize(camera_fb_t *fb) {
+  size_t i = 2;
+  while (i + 9 < fb->len && fb->buf[i] == 0xFF) {
+    uint8_t marker = fb->buf[i + 1];
+    if (marker == 0xC0 || marker == 0xC1 || marker == 0xC2) {
+      fb->height = (fb->buf[i + 5] << 8) | fb->buf[i + 6];
+      fb->width = (fb->buf[i + 7] << 8) | fb->buf[i + 8];
+      return;
+    }
+    i += 2 + ((fb->buf[i + 2] << 8) | fb->buf[i + 3]);
+  }
+}
+
+/**
+ * List the JPEG files of the frames directory, in name order.
+ */
+static void loadFramePaths() {
+  framePaths.clear();
+  DIR *dir = opendir(hostFakes.framesDir);
+  if (!dir) {
+    return;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    std::string name(entry->d_name);
+    if (name.size() > 4 && (name.compare(name.size() - 4, 4, ".jpg") == 0 || name.compare(name.size() - 4, 4, ".JPG") == 0)) {
+      framePaths.push_back(std::string(hostFakes.framesDir) + "/" + name);
+    }
+  }
+  closedir(dir);
+  std::sort(framePaths.begin(), framePaths.end());
+}
+
+static void releaseFrameBuffer() {
+  std::lock_guard<std::mutex> lock(frameBuffersMutex);
+  if (heldFrameBufferCount) {
+    heldFrameBufferCount--;
+  }
+  frameBufferReturned.notify_all();
+}
+
+esp_err_t esp_camera_init(const camera_config_t *config) {
+  delay(hostFakes.cameraInitMs);
+  if (hostFakes.cameraInitFails) {
+    return ESP_FAIL;
+  }
+  loadFramePaths();
+  if (framePaths.empty()) {
+    fprintf(stderr, "No JPEG frame in %s.\n", hostFakes.framesDir);
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  frameBufferCount = config->fb_count ? config->fb_count : 1;
+  heldFrameBufferCount = 0;
+
+  sensor = sensor_t();
+  sensor.id.PID = OV2640_PID;
+  sensor.pixformat = config->pixel_format;
+  sensor.status.framesize = config->frame_size;
+  sensor.status.quality = config->jpeg_quality;
+  sensor.status.awb = 1;
+  sensor.status.awb_gain = 1;
+  sensor.status.aec = 1;
+  sensor.status.aec_value = 204;
+  sensor.status.agc = 1;
+  sensor.status.wpc = 1;
+  sensor.status.raw_gma = 1;
+  sensor.status.lenc = 1;
+  sensor.status.dcw = 1;
+  sensor.set_pixformat = setPixformat;
+  sensor.set_framesize = setFramesize;
+  sensor.set_contrast = setContrast;
+  sensor.set_brightness = setBrightness;
+  sensor.set_saturation = setSaturation;
+  sensor.set_sharpness = setSharpness;
+  sensor.set_denoise = setDenoise;
+  sensor.set_gainceiling = setGainceiling;
+  sensor.set_quality = setQuality;
+  sensor.set_colorbar = setColorbar;
+  sensor.set_whitebal = setWhitebal;
+  sensor.set_gain_ctrl = setGainCtrl;
+  sensor.set_exposure_ctrl = setExposureCtrl;
+  sensor.set_hmirror = setHmirror;
+  sensor.set_vflip = setVflip;
+  sensor.set_aec2 = setAec2;
+  sensor.set_awb_gain = setAwbGain;
+  sensor.set_agc_gain = setAgcGain;
+  sensor.set_aec_value = setAecValue;
+  sensor.set_special_effect = setSpecialEffect;
+  sensor.set_wb_mode = setWbMode;
+  sensor.set_ae_level = setAeLevel;
+  sensor.set_dcw = setDcw;
+  sensor.set_bpc = setBpc;
+  sensor.set_wpc = setWpc;
+  sensor.set_raw_gma = setRawGma;
+  sensor.set_lenc = setLenc;
+  sensor.get_reg = getReg;
+  sensor.set_reg = setReg;
+  // Dark start, like the real sensor
+  startExposure = 0;
+  startGain = 0;
+  controlStartMs = millis();
+
+  cameraInitialized = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_camera_deinit() {
+  cameraInitialized = false;
+  return ESP_OK;
+}
+
+camera_fb_t *esp_camera_fb_get() {
+  if (!cameraInitialized) {
+    return NULL;
+  }
+  {
+    // Like the real driver, wait for a free frame buffer, else fail after a timeout
+    std::unique_lock<std::mutex> lock(frameBuffersMutex);
+    if (!frameBufferReturned.wait_for(lock, std::chrono::seconds(4), [] { return heldFrameBufferCount < frameBufferCount; })) {
+      fprintf(stderr, "esp_camera_fb_get: all the %zu frame buffers are held.\n", frameBufferCount);
+      return NULL;
+    }
+    heldFrameBufferCount++;
+  }
+  delay(hostFakes.cameraFrameMs);
+  if (hostFakes.cameraFrameFailCount) {
+    hostFakes.cameraFrameFailCount--;
+    releaseFrameBuffer();
+    return NULL;
+  }
+
+  const std::string &path = framePaths[nextFrame++ % framePaths.size()];
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file) {
+    releaseFrameBuffer();
+    return NULL;
+  }
+  fseek(file, 0, SEEK_END);
+  long len = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  camera_fb_t *fb = (camera_fb_t *)calloc(1, sizeof(camera_fb_t));
+  fb->buf = (uint8_t *)malloc(len);
+  fb->len = fread(fb->buf, 1, len, file);
+  readJpegSize(fb);
+  fb->format = PIXFORMAT_JPEG;
+  gettimeofday(&(fb->timestamp), NULL);
+  fclose(file);
+  return fb;
+}
+
+void esp_camera_fb_return(camera_fb_t *fb) {
+  if (fb) {
+    free(fb->buf);
+    free(fb);
+    releaseFrameBuffer();
+  }
+}
+
+sensor_t *esp_camera_sensor_get() {
+  return cameraInitialized ? &sensor : NULL;
+}
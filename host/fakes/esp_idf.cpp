@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <mutex>
+#include "esp32/rom/crc.h"
+#include "esp_heap_caps.h"
+#include "esp_ota_ops.h"
+#include "host_fakes.h"
+
+typedef struct {
+  uint32_t entries[256];
+} crc_table_t;
+
+static crc_table_t computeCrcTable() {
+  crc_table_t table;
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; k++) {
+      c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+    }
+    table.entries[i] = c;
+  }
+  return table;
+}
+
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+  static const crc_table_t table = computeCrcTable();
+  crc = ~crc;
+  while (len--) {
+    crc = table.entries[(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+/**
+ * The ELF hash is derived from the running executable,
+ * so it changes with each build, like on the board.
+ */
+const esp_app_desc_t *esp_ota_get_app_description() {
+  static esp_app_desc_t description;
+  if (!description.magic_word) {
+    description.magic_word = 0xABCD5432;
+    strncpy(description.project_name, "cekikela-esp32-cam", sizeof(description.project_name) - 1);
+    strncpy(description.date, __DATE__, sizeof(description.date) - 1);
+    strncpy(description.time, __TIME__, sizeof(description.time) - 1);
+    uint32_t crcs[sizeof(description.app_elf_sha256) / sizeof(uint32_t)];
+    for (uint32_t i = 0; i < sizeof(crcs) / sizeof(uint32_t); i++) {
+      crcs[i] = i;
+    }
+    FILE *file = fopen("/proc/self/exe", "rb");
+    uint8_t buffer[4096];
+    size_t len;
+    while (file && (len = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      for (uint32_t &crc : crcs) {
+        crc = crc32_le(crc, buffer, len);
+      }
+    }
+    if (file) {
+      fclose(file);
+    }
+    memcpy(description.app_elf_sha256, crcs, sizeof(crcs));
+  }
+  return &description;
+}
+
+// Allocations with MALLOC_CAP_DMA: start address and size
+static std::map<const uint8_t *, size_t> dmaAllocations;
+static std::mutex dmaAllocationsMutex;
+
+void *heap_caps_malloc(size_t size, uint32_t caps) {
+  void *ptr = malloc(size);
+  if (ptr && (caps & MALLOC_CAP_DMA)) {
+    std::lock_guard<std::mutex> lock(dmaAllocationsMutex);
+    dmaAllocations[(const uint8_t *)ptr] = size;
+  }
+  return ptr;
+}
+
+void heap_caps_free(void *ptr) {
+  {
+    std::lock_guard<std::mutex> lock(dmaAllocationsMutex);
+    dmaAllocations.erase((const uint8_t *)ptr);
+  }
+  free(ptr);
+}
+
+bool hostFakeIsDmaCapable(const void *buffer) {
+  std::lock_guard<std::mutex> lock(dmaAllocationsMutex);
+  auto next = dmaAllocations.upper_bound((const uint8_t *)buffer);
+  if (next == dmaAllocations.begin()) {
+    return false;
+  }
+  auto allocation = std::prev(next);
+  return (const uint8_t *)buffer < allocation->first + allocation->second;
+}
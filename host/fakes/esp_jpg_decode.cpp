@@ -0,0 +1,67 @@
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <jpeglib.h>
+#include "esp_jpg_decode.h"
+#include "host_fakes.h"
+
+// Number of decoded frames, moving the simulated blob
+static uint32_t decodedFrameCount = 0;
+
+typedef struct {
+  struct jpeg_error_mgr manager;
+  jmp_buf exit;
+} jpeg_error_t;
+
+static void exitOnJpegError(j_common_ptr info) {
+  longjmp(((jpeg_error_t *)info->err)->exit, 1);
+}
+
+esp_err_t esp_jpg_decode(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jpg_writer_cb writer, void *arg) {
+  std::vector<uint8_t> jpeg(len);
+  if (reader(arg, 0, jpeg.data(), len) != len) {
+    return ESP_FAIL;
+  }
+
+  struct jpeg_decompress_struct info;
+  jpeg_error_t error;
+  info.err = jpeg_std_error(&error.manager);
+  error.manager.error_exit = exitOnJpegError;
+  if (setjmp(error.exit)) {
+    jpeg_destroy_decompress(&info);
+    return ESP_FAIL;
+  }
+  jpeg_create_decompress(&info);
+  jpeg_mem_src(&info, jpeg.data(), len);
+  jpeg_read_header(&info, TRUE);
+  info.scale_num = 1;
+  info.scale_denom = 1 << scale;
+  info.out_color_space = JCS_RGB;
+  jpeg_start_decompress(&info);
+
+  uint16_t width = info.output_width;
+  uint16_t height = info.output_height;
+  // A blob of a fifth of the frame width crossing the frame
+  uint16_t blobSize = width / 5;
+  uint16_t blobX = (decodedFrameCount++ * width / 8) % (width - blobSize);
+  uint16_t blobY = (height - blobSize) / 2;
+  std::vector<uint8_t> row(width * 3);
+  uint8_t *rowPointer = row.data();
+  bool written = writer(arg, 0, 0, width, height, NULL);
+
+  while (written && info.output_scanline < height) {
+    uint16_t y = info.output_scanline;
+    jpeg_read_scanlines(&info, &rowPointer, 1);
+    if (hostFakes.sceneMotion && y >= blobY && y < blobY + blobSize) {
+      memset(row.data() + blobX * 3, 16, blobSize * 3);
+    }
+    written = writer(arg, 0, y, width, 1, row.data());
+  }
+  if (written) {
+    jpeg_finish_decompress(&info);
+    written = writer(arg, 0, height, width, 0, NULL);
+  }
+  jpeg_destroy_decompress(&info);
+  return written ? ESP_OK : ESP_FAIL;
+}
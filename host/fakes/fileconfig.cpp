@@ -0,0 +1,103 @@
+#include <ctype.h>
+#include <strings.h>
+#include "Arduino.h"
+#include "FileConfig.h"
+
+/**
+ * Remove the leading and trailing white spaces of a C string in place.
+ */
+static char *trim(char *s) {
+  while (isspace((unsigned char)*s)) s++;
+  char *end = s + strlen(s);
+  while (end > s && isspace((unsigned char)end[-1])) *--end = '\0';
+  return s;
+}
+
+bool FileConfig::begin(fs::FS &fs, const char *fileName, uint8_t maxLineLength, uint8_t maxSectionLength,
+                       bool ignoreCase, bool ignoreError) {
+  file = fs.open(fileName, FILE_READ);
+  this->ignoreCase = ignoreCase;
+  this->ignoreError = ignoreError;
+  this->maxLineLength = maxLineLength;
+  changed = false;
+  section[0] = '\0';
+  name = value = NULL;
+  return file;
+}
+
+void FileConfig::end() {
+  file.close();
+}
+
+bool FileConfig::readLine() {
+  size_t len = 0;
+  int c;
+  while ((c = file.read()) >= 0 && c != '\n') {
+    if (len < sizeof(line) - 1) {
+      line[len++] = c;
+    }
+  }
+  line[len] = '\0';
+  return c >= 0 || len > 0;
+}
+
+bool FileConfig::readNextSetting() {
+  changed = false;
+  while (readLine()) {
+    char *s = trim(line);
+    if (*s == '\0' || *s == '#' || *s == ';') {
+      continue;
+    }
+    if (*s == '[') {
+      char *end = strchr(s, ']');
+      if (end) *end = '\0';
+      strlcpy(section, trim(s + 1), sizeof(section));
+      changed = true;
+      continue;
+    }
+    char *equal = strchr(s, '=');
+    if (!equal) {
+      continue;
+    }
+    *equal = '\0';
+    name = trim(s);
+    value = trim(equal + 1);
+    if (strlen(value) > maxLineLength) {
+      value[maxLineLength] = '\0';
+    }
+    return true;
+  }
+  return false;
+}
+
+bool FileConfig::sectionChanged() {
+  return changed;
+}
+
+bool FileConfig::sectionIs(const char *s) {
+  return (ignoreCase ? strcasecmp(section, s) : strcmp(section, s)) == 0;
+}
+
+bool FileConfig::nameIs(const char *n) {
+  return name && (ignoreCase ? strcasecmp(name, n) : strcmp(name, n)) == 0;
+}
+
+const char *FileConfig::getSection() {
+  return section;
+}
+
+const char *FileConfig::getName() {
+  return name;
+}
+
+const char *FileConfig::getValue(bool trim) {
+  return value;
+}
+
+int FileConfig::getIntValue() {
+  return value ? atoi(value) : 0;
+}
+
+bool FileConfig::getBooleanValue() {
+  return value && (strcasecmp(value, "true") == 0 || strcmp(value, "1") == 0);
+}
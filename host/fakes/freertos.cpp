@@ -0,0 +1,139 @@
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+static const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t taskFunction, const char *name, uint32_t stackSize,
+                                   void *param, UBaseType_t priority, TaskHandle_t *createdTask, BaseType_t core) {
+  std::thread thread(taskFunction, param);
+  if (createdTask) {
+    *createdTask = (TaskHandle_t)(uintptr_t)std::hash<std::thread::id>()(thread.get_id());
+  }
+  thread.detach();
+  return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+}
+
+void vTaskDelay(TickType_t ticks) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TickType_t xTaskGetTickCount() {
+  return (TickType_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+struct host_event_group {
+  std::mutex mutex;
+  std::condition_variable changed;
+  EventBits_t bits = 0;
+};
+
+EventGroupHandle_t xEventGroupCreate() {
+  return new host_event_group();
+}
+
+void vEventGroupDelete(EventGroupHandle_t group) {
+  delete group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+  std::lock_guard<std::mutex> lock(group->mutex);
+  group->bits |= bits;
+  group->changed.notify_all();
+  return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+  std::lock_guard<std::mutex> lock(group->mutex);
+  EventBits_t previousBits = group->bits;
+  group->bits &= ~bits;
+  return previousBits;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+  std::lock_guard<std::mutex> lock(group->mutex);
+  return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clearOnExit,
+                                BaseType_t waitForAllBits, TickType_t ticksToWait) {
+  std::unique_lock<std::mutex> lock(group->mutex);
+  auto satisfied = [&] { return waitForAllBits ? (group->bits & bits) == bits : (group->bits & bits) != 0; };
+  if (ticksToWait == portMAX_DELAY) {
+    group->changed.wait(lock, satisfied);
+  } else {
+    group->changed.wait_for(lock, std::chrono::milliseconds(ticksToWait), satisfied);
+  }
+  EventBits_t result = group->bits;
+  if (clearOnExit && satisfied()) {
+    group->bits &= ~bits;
+  }
+  return result;
+}
+
+struct host_queue {
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<std::vector<uint8_t>> items;
+  UBaseType_t length;
+  UBaseType_t itemSize;
+};
+
+/**
+ * Wait on the condition variable of a queue at most ticksToWait.
+ */
+template <typename Predicate>
+static bool waitQueue(host_queue *queue, std::unique_lock<std::mutex> &lock, TickType_t ticksToWait, Predicate predicate) {
+  if (ticksToWait == portMAX_DELAY) {
+    queue->changed.wait(lock, predicate);
+    return true;
+  }
+  return queue->changed.wait_for(lock, std::chrono::milliseconds(ticksToWait), predicate);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  host_queue *queue = new host_queue();
+  queue->length = length;
+  queue->itemSize = itemSize;
+  return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+  delete queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  if (!waitQueue(queue, lock, ticksToWait, [&] { return queue->items.size() < queue->length; })) {
+    return pdFAIL;
+  }
+  queue->items.emplace_back((const uint8_t *)item, (const uint8_t *)item + queue->itemSize);
+  queue->changed.notify_all();
+  return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticksToWait) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  if (!waitQueue(queue, lock, ticksToWait, [&] { return !queue->items.empty(); })) {
+    return pdFAIL;
+  }
+  memcpy(item, queue->items.front().data(), queue->itemSize);
+  queue->items.pop_front();
+  queue->changed.notify_all();
+  return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  std::lock_guard<std::mutex> lock(queue->mutex);
+  return queue->items.size();
+}
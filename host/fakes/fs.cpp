@@ -0,0 +1,329 @@
+#include <atomic>
+#include <dirent.h>
+#include <errno.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Arduino.h"
+#include "FS.h"
+#include "SD_MMC.h"
+#include "host_fakes.h"
+
+fs::SDMMCFS SD_MMC;
+
+namespace fs {
+
+/**
+ * An open file (FILE *) or directory (DIR *).
+ */
+class FileImpl {
+public:
+  ~FileImpl() { close(); }
+
+  void close() {
+    if (file) fclose(file);
+    if (dir) closedir(dir);
+    file = NULL;
+    dir = NULL;
+  }
+
+  std::string path;      // Path in the file system
+  std::string hostPath;  // Path on the host
+  FILE *file = NULL;
+  DIR *dir = NULL;
+};
+
+size_t File::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t File::write(const uint8_t *buffer, size_t size) {
+  // Counted from all the tasks writing on the card
+  static std::atomic<uint32_t> writeCount(0);
+  if (!impl || !impl->file) {
+    return 0;
+  }
+  if (hostFakes.sdStallEvery && ++writeCount % hostFakes.sdStallEvery == 0) {
+    delay(hostFakes.sdStallMs);
+  }
+  hostFakeTransferDelay(size, hostFakes.sdWriteKBps);
+  if (hostFakes.sdWriteCallUs) {
+    delayMicroseconds(hostFakes.sdWriteCallUs);
+  }
+  if (hostFakes.sdNonDmaSectorUs && !hostFakeIsDmaCapable(buffer)) {
+    delayMicroseconds((size + 511) / 512 * hostFakes.sdNonDmaSectorUs);
+  }
+  return fwrite(buffer, 1, size, impl->file);
+}
+
+int File::available() {
+  if (!impl || !impl->file) {
+    return 0;
+  }
+  return size() - position();
+}
+
+int File::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+size_t File::read(uint8_t *buffer, size_t size) {
+  // Counted from all the tasks reading the card
+  static std::atomic<uint32_t> readCount(0);
+  if (!impl || !impl->file) {
+    return 0;
+  }
+  hostFakeTransferDelay(size, hostFakes.sdReadKBps);
+  size_t readLen = fread(buffer, 1, size, impl->file);
+  // Bulk reads only, like the picture data, not the character reads of the configuration file
+  if (readLen >= 512 && hostFakes.sdReadCorruptEvery && ++readCount % hostFakes.sdReadCorruptEvery == 0) {
+    buffer[readLen / 2] ^= 0x10;
+  }
+  return readLen;
+}
+
+int File::peek() {
+  if (!impl || !impl->file) {
+    return -1;
+  }
+  int c = fgetc(impl->file);
+  if (c != EOF) {
+    ungetc(c, impl->file);
+  }
+  return c;
+}
+
+void File::flush() {
+  if (impl && impl->file) {
+    fflush(impl->file);
+  }
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+  if (!impl || !impl->file) {
+    return false;
+  }
+  return fseek(impl->file, pos, mode == SeekSet ? SEEK_SET : (mode == SeekCur ? SEEK_CUR : SEEK_END)) == 0;
+}
+
+size_t File::position() const {
+  if (!impl || !impl->file) {
+    return 0;
+  }
+  return ftell(impl->file);
+}
+
+size_t File::size() const {
+  if (!impl || !impl->file) {
+    return 0;
+  }
+  fflush(impl->file);
+  struct stat st;
+  return fstat(fileno(impl->file), &st) == 0 ? st.st_size : 0;
+}
+
+void File::close() {
+  if (impl) {
+    impl->close();
+  }
+}
+
+File::operator bool() const {
+  return impl && (impl->file || impl->dir);
+}
+
+time_t File::getLastWrite() {
+  struct stat st;
+  return impl && stat(impl->hostPath.c_str(), &st) == 0 ? st.st_mtime : 0;
+}
+
+const char *File::path() const {
+  return impl ? impl->path.c_str() : NULL;
+}
+
+const char *File::name() const {
+  if (!impl) {
+    return NULL;
+  }
+  size_t slash = impl->path.rfind('/');
+  return impl->path.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+}
+
+bool File::isDirectory() {
+  return impl && impl->dir;
+}
+
+File File::openNextFile(const char *mode) {
+  if (!impl || !impl->dir) {
+    return File();
+  }
+  struct dirent *entry;
+  while ((entry = readdir(impl->dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    FileImplPtr child = std::make_shared<FileImpl>();
+    child->path = impl->path + (impl->path == "/" ? "" : "/") + entry->d_name;
+    child->hostPath = impl->hostPath + "/" + entry->d_name;
+    struct stat st;
+    if (stat(child->hostPath.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+      child->dir = opendir(child->hostPath.c_str());
+    } else {
+      child->file = fopen(child->hostPath.c_str(), mode[0] == 'r' ? "rb" : mode);
+    }
+    return File(child);
+  }
+  return File();
+}
+
+void File::rewindDirectory() {
+  if (impl && impl->dir) {
+    rewinddir(impl->dir);
+  }
+}
+
+/**
+ * Sleep sdDirEntryUs by entry of the directory of a host path.
+ */
+static void directoryScanDelay(const char *hostPath) {
+  if (!hostFakes.sdDirEntryUs) {
+    return;
+  }
+  std::string directory(hostPath);
+  size_t slash = directory.rfind('/');
+  DIR *dir = opendir(slash == std::string::npos ? "." : directory.substr(0, slash).c_str());
+  uint32_t entryCount = 0;
+  if (dir) {
+    while (readdir(dir) != NULL) {
+      entryCount++;
+    }
+    closedir(dir);
+  }
+  usleep(entryCount * hostFakes.sdDirEntryUs);
+}
+
+bool FS::hostPath(char *dest, size_t size, const char *path) {
+  const char *root = hostRoot();
+  if (!root || !path || path[0] != '/') {
+    return false;
+  }
+  snprintf(dest, size, "%s%s", root, path);
+  return true;
+}
+
+File FS::open(const char *path, const char *mode, const bool create) {
+  char fullPath[512];
+  if (!hostPath(fullPath, sizeof(fullPath), path)) {
+    return File();
+  }
+  delay(hostFakes.sdOpenMs);
+  directoryScanDelay(fullPath);
+  if (mode[0] != 'r' && hostFakes.sdWriteFails) {
+    return File();
+  }
+
+  FileImplPtr impl = std::make_shared<FileImpl>();
+  impl->path = path;
+  impl->hostPath = fullPath;
+  struct stat st;
+  if (mode[0] == 'r' && stat(fullPath, &st) == 0 && S_ISDIR(st.st_mode)) {
+    impl->dir = opendir(fullPath);
+  } else {
+    std::string binaryMode = std::string(mode) + "b";
+    impl->file = fopen(fullPath, binaryMode.c_str());
+  }
+  return (impl->file || impl->dir) ? File(impl) : File();
+}
+
+bool FS::exists(const char *path) {
+  char fullPath[512];
+  struct stat st;
+  return hostPath(fullPath, sizeof(fullPath), path) && stat(fullPath, &st) == 0;
+}
+
+bool FS::remove(const char *path) {
+  char fullPath[512];
+  return hostPath(fullPath, sizeof(fullPath), path) && unlink(fullPath) == 0;
+}
+
+bool FS::rename(const char *pathFrom, const char *pathTo) {
+  char fullPathFrom[512];
+  char fullPathTo[512];
+  return hostPath(fullPathFrom, sizeof(fullPathFrom), pathFrom) && hostPath(fullPathTo, sizeof(fullPathTo), pathTo)
+         && ::rename(fullPathFrom, fullPathTo) == 0;
+}
+
+bool FS::mkdir(const char *path) {
+  char fullPath[512];
+  return hostPath(fullPath, sizeof(fullPath), path) && (::mkdir(fullPath, 0755) == 0 || errno == EEXIST);
+}
+
+bool FS::rmdir(const char *path) {
+  char fullPath[512];
+  return hostPath(fullPath, sizeof(fullPath), path) && ::rmdir(fullPath) == 0;
+}
+
+bool SDMMCFS::begin(const char *mountpoint, bool mode1bit, bool formatOnFail, int sdmmcFrequency, uint8_t maxOpenFiles) {
+  if (mounted) {
+    return true;
+  }
+  delay(hostFakes.sdMountMs);
+  if (hostFakes.sdMountFails) {
+    return false;
+  }
+  ::mkdir(hostFakes.sdRoot, 0755);
+  mounted = true;
+  return true;
+}
+
+void SDMMCFS::end() {
+  mounted = false;
+}
+
+sdcard_type_t SDMMCFS::cardType() {
+  return mounted ? CARD_SDHC : CARD_NONE;
+}
+
+uint64_t SDMMCFS::cardSize() {
+  return mounted ? hostFakes.sdCardSize : 0;
+}
+
+uint64_t SDMMCFS::totalBytes() {
+  return cardSize();
+}
+
+/**
+ * Sum the size of the files in a host directory, recursively.
+ */
+static uint64_t hostDirectorySize(const std::string &path) {
+  uint64_t size = 0;
+  DIR *dir = opendir(path.c_str());
+  if (!dir) {
+    return 0;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    std::string child = path + "/" + entry->d_name;
+    struct stat st;
+    if (stat(child.c_str(), &st) == 0) {
+      delay(1);
+      size += S_ISDIR(st.st_mode) ? hostDirectorySize(child) : (uint64_t)st.st_size;
+    }
+  }
+  closedir(dir);
+  return size;
+}
+
+uint64_t SDMMCFS::usedBytes() {
+  return mounted ? hostDirectorySize(hostFakes.sdRoot) : 0;
+}
+
+const char *SDMMCFS::hostRoot() {
+  return mounted ? hostFakes.sdRoot : NULL;
+}
+
+}  // namespace fs
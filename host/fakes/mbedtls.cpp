@@ -0,0 +1,41 @@
+#include <stdint.h>
+#include <string.h>
+#include "mbedtls/base64.h"
+
+static int base64Value(unsigned char c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+') return 62;
+  if (c == '/') return 63;
+  return -1;
+}
+
+int mbedtls_base64_decode(unsigned char *dst, size_t dlen, size_t *olen, const unsigned char *src, size_t slen) {
+  size_t n = 0;
+  uint32_t accumulator = 0;
+  int bits = 0;
+
+  for (size_t i = 0; i < slen; i++) {
+    if (src[i] == '=' || src[i] == '\r' || src[i] == '\n' || src[i] == ' ') {
+      continue;
+    }
+    int value = base64Value(src[i]);
+    if (value < 0) {
+      *olen = 0;
+      return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+    }
+    accumulator = (accumulator << 6) | value;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      if (n >= dlen) {
+        *olen = 0;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+      }
+      dst[n++] = (accumulator >> bits) & 0xFF;
+    }
+  }
+  *olen = n;
+  return 0;
+}
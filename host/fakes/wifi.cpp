@@ -0,0 +1,168 @@
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "HTTPUpdate.h"
+#include "WiFi.h"
+#include "host_fakes.h"
+
+WiFiClass WiFi;
+HTTPUpdate httpUpdate;
+
+String IPAddress::toString() const {
+  char s[16];
+  snprintf(s, sizeof(s), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+  return String(s);
+}
+
+wl_status_t WiFiClass::begin(const char *ssid, const char *password) {
+  begun = true;
+  connectedTimeMs = millis() + hostFakes.wifiConnectMs;
+  return WL_DISCONNECTED;
+}
+
+wl_status_t WiFiClass::status() {
+  if (!begun) {
+    return WL_IDLE_STATUS;
+  }
+  if (hostFakes.wifiFails) {
+    return WL_CONNECT_FAILED;
+  }
+  return (long)(millis() - connectedTimeMs) >= 0 ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+bool WiFiClass::disconnect(bool wifiOff) {
+  begun = false;
+  return true;
+}
+
+uint8_t *WiFiClass::macAddress(uint8_t *mac) {
+  static const uint8_t fakeMac[6] = { 0xBE, 0xBA, 0xFE, 0xCA, 0x0D, 0x60 };
+  memcpy(mac, fakeMac, 6);
+  return mac;
+}
+
+IPAddress WiFiClass::localIP() {
+  return status() == WL_CONNECTED ? IPAddress(127, 0, 0, 1) : IPAddress();
+}
+
+/**
+ * A connected host socket, closed when the last client copy is destroyed.
+ */
+class WiFiClientSocket {
+public:
+  WiFiClientSocket(int fd) : fd(fd) {}
+  ~WiFiClientSocket() { ::close(fd); }
+  int fd;
+};
+
+int WiFiClient::connect(const char *host, uint16_t port) {
+  stop();
+  delay(hostFakes.tcpConnectMs);
+  if (hostFakes.tcpConnectFails || WiFi.status() != WL_CONNECTED) {
+    return 0;
+  }
+
+  struct addrinfo hints = {};
+  struct addrinfo *addresses;
+  char service[8];
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  snprintf(service, sizeof(service), "%u", port);
+  if (getaddrinfo(host, service, &hints, &addresses) != 0) {
+    return 0;
+  }
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  int connected = fd >= 0 && ::connect(fd, addresses->ai_addr, addresses->ai_addrlen) == 0;
+  freeaddrinfo(addresses);
+  if (!connected) {
+    if (fd >= 0) ::close(fd);
+    return 0;
+  }
+  socket = std::make_shared<WiFiClientSocket>(fd);
+  return 1;
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+  return connect(ip.toString().c_str(), port);
+}
+
+size_t WiFiClient::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t WiFiClient::write(const uint8_t *buffer, size_t size) {
+  if (!socket) {
+    return 0;
+  }
+  hostFakeTransferDelay(size, hostFakes.tcpWriteKBps);
+  size_t sent = 0;
+  while (sent < size) {
+    ssize_t n = ::send(socket->fd, buffer + sent, size - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      break;
+    }
+    sent += n;
+  }
+  return sent;
+}
+
+int WiFiClient::available() {
+  int count = 0;
+  if (!socket || ioctl(socket->fd, FIONREAD, &count) != 0) {
+    return 0;
+  }
+  return count;
+}
+
+int WiFiClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t *buffer, size_t size) {
+  if (!socket || !available()) {
+    return -1;
+  }
+  return ::recv(socket->fd, buffer, size, MSG_DONTWAIT);
+}
+
+int WiFiClient::peek() {
+  uint8_t c;
+  if (!socket || ::recv(socket->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) != 1) {
+    return -1;
+  }
+  return c;
+}
+
+void WiFiClient::stop() {
+  socket.reset();
+}
+
+uint8_t WiFiClient::connected() {
+  if (!socket) {
+    return 0;
+  }
+  uint8_t c;
+  ssize_t n = ::recv(socket->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  // 0 means that the peer closed the connection
+  return n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+}
+
+int WiFiClient::fd() const {
+  return socket ? socket->fd : -1;
+}
+
+int WiFiClient::setNoDelay(bool noDelay) {
+  int flag = noDelay;
+  return socket ? setsockopt(socket->fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag)) : -1;
+}
+
+t_httpUpdate_return HTTPUpdate::update(WiFiClient &client, const String &url, const String &currentVersion) {
+  delay(hostFakes.otaCheckMs);
+  return HTTP_UPDATE_NO_UPDATES;
+}
@@ -0,0 +1,88 @@
+/**
+ * Host fake of the Arduino core for the ESP32.
+ * Only the API used by the application is provided.
+ * Time is the host monotonic clock, delays are real sleeps.
+ * RTC memory is plain memory: it survives the simulated deep sleeps.
+ */
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+#include "esp_sleep.h"
+#include "Print.h"
+#include "WString.h"
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0x01
+#define OUTPUT 0x03
+
+// Like the Arduino core for the ESP32
+using std::max;
+using std::min;
+
+#define RTC_DATA_ATTR
+#define IRAM_ATTR
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+/**
+ * Serial port writing to the standard output.
+ */
+class HardwareSerial : public Print {
+public:
+  void begin(unsigned long baud) {}
+  void flush() { fflush(stdout); }
+  size_t write(uint8_t c);
+  size_t write(const uint8_t *buffer, size_t size);
+  using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+/**
+ * ESP chip helper.
+ * restart() ends the simulation.
+ */
+class EspClass {
+public:
+  void restart() __attribute__((noreturn));
+  uint32_t getFreeHeap() { return 200000; }
+  uint32_t getFreePsram() { return 4000000; }
+};
+
+extern EspClass ESP;
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+/**
+ * The time is not set until configTime() is called once.
+ */
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char *server1, const char *server2 = NULL, const char *server3 = NULL);
+bool getLocalTime(struct tm *info, uint32_t ms = 5000);
+
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char *dst, const char *src, size_t size);
+#endif
+
+#endif
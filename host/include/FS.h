@@ -0,0 +1,91 @@
+/**
+ * Host fake of the Arduino ESP32 file system API.
+ * Paths are relative to the root of the file system, a host directory.
+ */
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+#include <memory>
+#include "Print.h"
+#include "WString.h"
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+enum SeekMode {
+  SeekSet = 0,
+  SeekCur = 1,
+  SeekEnd = 2
+};
+
+class FileImpl;
+typedef std::shared_ptr<FileImpl> FileImplPtr;
+
+class File : public Print {
+public:
+  File(FileImplPtr impl = FileImplPtr()) : impl(impl) {}
+
+  size_t write(uint8_t c);
+  size_t write(const uint8_t *buffer, size_t size);
+  using Print::write;
+  int available();
+  int read();
+  size_t read(uint8_t *buffer, size_t size);
+  int peek();
+  void flush();
+  bool seek(uint32_t pos, SeekMode mode = SeekSet);
+  size_t position() const;
+  size_t size() const;
+  void close();
+  operator bool() const;
+  time_t getLastWrite();
+  const char *path() const;
+  const char *name() const;
+  bool isDirectory();
+  File openNextFile(const char *mode = FILE_READ);
+  void rewindDirectory();
+
+private:
+  FileImplPtr impl;
+};
+
+class FS {
+public:
+  virtual ~FS() {}
+
+  File open(const char *path, const char *mode = FILE_READ, const bool create = false);
+  File open(const String &path, const char *mode = FILE_READ, const bool create = false) { return open(path.c_str(), mode, create); }
+  bool exists(const char *path);
+  bool exists(const String &path) { return exists(path.c_str()); }
+  bool remove(const char *path);
+  bool remove(const String &path) { return remove(path.c_str()); }
+  bool rename(const char *pathFrom, const char *pathTo);
+  bool rename(const String &pathFrom, const String &pathTo) { return rename(pathFrom.c_str(), pathTo.c_str()); }
+  bool mkdir(const char *path);
+  bool mkdir(const String &path) { return mkdir(path.c_str()); }
+  bool rmdir(const char *path);
+  bool rmdir(const String &path) { return rmdir(path.c_str()); }
+
+protected:
+  /**
+   * Host directory of the file system root, NULL when not mounted.
+   */
+  virtual const char *hostRoot() = 0;
+
+private:
+  bool hostPath(char *dest, size_t size, const char *path);
+};
+
+}  // namespace fs
+
+using fs::File;
+using fs::FS;
+using fs::SeekCur;
+using fs::SeekEnd;
+using fs::SeekMode;
+using fs::SeekSet;
+
+#endif
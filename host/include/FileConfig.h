@@ -0,0 +1,40 @@
+/**
+ * Host fake of the FileConfig library reading "name=value" settings
+ * grouped by "[section]" from a file.
+ * Lines starting with '#' or ';' are comments.
+ */
+#ifndef HOST_FILECONFIG_H
+#define HOST_FILECONFIG_H
+
+#include "FS.h"
+
+class FileConfig {
+public:
+  bool begin(fs::FS &fs, const char *fileName, uint8_t maxLineLength, uint8_t maxSectionLength,
+             bool ignoreCase = true, bool ignoreError = false);
+  void end();
+  bool readNextSetting();
+  bool sectionChanged();
+  bool sectionIs(const char *section);
+  bool nameIs(const char *name);
+  const char *getSection();
+  const char *getName();
+  const char *getValue(bool trim = false);
+  int getIntValue();
+  bool getBooleanValue();
+
+private:
+  bool readLine();
+
+  File file;
+  bool ignoreCase;
+  bool ignoreError;
+  bool changed;
+  uint8_t maxLineLength;
+  char line[256];
+  char section[256];
+  char *name;
+  char *value;
+};
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef HOST_HTTPCLIENT_H
+#define HOST_HTTPCLIENT_H
+
+#include "WiFi.h"
+
+#endif
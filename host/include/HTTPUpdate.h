@@ -0,0 +1,24 @@
+/**
+ * Host fake of the HTTP firmware update: there is never any update.
+ */
+#ifndef HOST_HTTPUPDATE_H
+#define HOST_HTTPUPDATE_H
+
+#include "WiFi.h"
+
+typedef enum {
+  HTTP_UPDATE_FAILED,
+  HTTP_UPDATE_NO_UPDATES,
+  HTTP_UPDATE_OK
+} t_httpUpdate_return;
+
+class HTTPUpdate {
+public:
+  t_httpUpdate_return update(WiFiClient &client, const String &url, const String &currentVersion = "");
+  int getLastError() { return 0; }
+  String getLastErrorString() { return String(""); }
+};
+
+extern HTTPUpdate httpUpdate;
+
+#endif
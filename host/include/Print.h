@@ -0,0 +1,41 @@
+/**
+ * Host fake of the Arduino Print class.
+ * Subclasses implement write().
+ */
+#ifndef HOST_PRINT_H
+#define HOST_PRINT_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "WString.h"
+
+#define HEX 16
+#define DEC 10
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+
+  int printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+  size_t print(const char *s) { return write(s); }
+  size_t print(const String &s) { return write((const uint8_t *)s.c_str(), s.length()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int n, int base = DEC) { return printf(base == HEX ? "%X" : "%d", n); }
+  size_t print(unsigned int n, int base = DEC) { return printf(base == HEX ? "%X" : "%u", n); }
+  size_t print(unsigned char n, int base = DEC) { return print((unsigned int)n, base); }
+  size_t print(long n, int base = DEC) { return printf(base == HEX ? "%lX" : "%ld", n); }
+  size_t print(unsigned long n, int base = DEC) { return printf(base == HEX ? "%lX" : "%lu", n); }
+  size_t print(double n, int digits = 2) { return printf("%.*f", digits, n); }
+  size_t print(struct tm *timeinfo, const char *format = NULL);
+  size_t println() { return write((const uint8_t *)"\r\n", 2); }
+  template<typename T> size_t println(T value) { return print(value) + println(); }
+  size_t println(struct tm *timeinfo, const char *format = NULL) { return print(timeinfo, format) + println(); }
+};
+
+#endif
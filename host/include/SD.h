@@ -0,0 +1,9 @@
+/**
+ * Host fake of the SD (SPI) library: only its file system types are used.
+ */
+#ifndef HOST_SD_H
+#define HOST_SD_H
+
+#include "FS.h"
+
+#endif
@@ -0,0 +1,43 @@
+/**
+ * Host fake of the SD_MMC file system, backed by hostFakes.sdRoot.
+ */
+#ifndef HOST_SD_MMC_H
+#define HOST_SD_MMC_H
+
+#include "FS.h"
+
+typedef enum {
+  CARD_NONE,
+  CARD_MMC,
+  CARD_SD,
+  CARD_SDHC,
+  CARD_UNKNOWN
+} sdcard_type_t;
+
+namespace fs {
+
+class SDMMCFS : public FS {
+public:
+  bool begin(const char *mountpoint = "/sdcard", bool mode1bit = false, bool formatOnFail = false,
+             int sdmmcFrequency = 20000, uint8_t maxOpenFiles = 5);
+  void end();
+  sdcard_type_t cardType();
+  uint64_t cardSize();
+  uint64_t totalBytes();
+  /**
+   * Walk the whole directory tree, like the FAT scan of the real one.
+   */
+  uint64_t usedBytes();
+
+protected:
+  const char *hostRoot();
+
+private:
+  bool mounted = false;
+};
+
+}  // namespace fs
+
+extern fs::SDMMCFS SD_MMC;
+
+#endif
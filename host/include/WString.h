@@ -0,0 +1,44 @@
+/**
+ * Host fake of the Arduino String class, built on std::string.
+ */
+#ifndef HOST_WSTRING_H
+#define HOST_WSTRING_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <string>
+
+class String {
+public:
+  String(const char *s = "") : s(s ? s : "") {}
+  String(const std::string &s) : s(s) {}
+  String(char c) : s(1, c) {}
+  String(int n) : s(std::to_string(n)) {}
+  String(unsigned int n) : s(std::to_string(n)) {}
+  String(long n) : s(std::to_string(n)) {}
+  String(unsigned long n) : s(std::to_string(n)) {}
+  String(long long n) : s(std::to_string(n)) {}
+  String(unsigned long long n) : s(std::to_string(n)) {}
+
+  const char *c_str() const { return s.c_str(); }
+  unsigned int length() const { return s.length(); }
+  bool isEmpty() const { return s.empty(); }
+  char operator[](unsigned int i) const { return s[i]; }
+  int indexOf(char c) const { size_t i = s.find(c); return i == std::string::npos ? -1 : (int)i; }
+  String substring(unsigned int from) const { return String(s.substr(from)); }
+  String substring(unsigned int from, unsigned int to) const { return String(s.substr(from, to - from)); }
+  int toInt() const { return atoi(s.c_str()); }
+  bool equals(const String &other) const { return s == other.s; }
+  bool equalsIgnoreCase(const String &other) const { return strcasecmp(s.c_str(), other.s.c_str()) == 0; }
+
+  String &operator+=(const String &other) { s += other.s; return *this; }
+  bool operator==(const String &other) const { return s == other.s; }
+  bool operator!=(const String &other) const { return s != other.s; }
+  friend String operator+(const String &a, const String &b) { return String(a.s + b.s); }
+
+private:
+  std::string s;
+};
+
+#endif
@@ -0,0 +1,69 @@
+/**
+ * Host fake of the WiFi library.
+ * The association is simulated. WiFiClient uses real host sockets.
+ */
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include <memory>
+#include "Arduino.h"
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+class IPAddress {
+public:
+  IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) : bytes{ a, b, c, d } {}
+  String toString() const;
+  uint8_t operator[](int i) const { return bytes[i]; }
+
+private:
+  uint8_t bytes[4];
+};
+
+class WiFiClass {
+public:
+  wl_status_t begin(const char *ssid, const char *password = NULL);
+  wl_status_t status();
+  bool disconnect(bool wifiOff = false);
+  uint8_t *macAddress(uint8_t *mac);
+  IPAddress localIP();
+
+private:
+  bool begun = false;
+  unsigned long connectedTimeMs = 0;
+};
+
+extern WiFiClass WiFi;
+
+class WiFiClientSocket;
+
+class WiFiClient : public Print {
+public:
+  int connect(const char *host, uint16_t port);
+  int connect(IPAddress ip, uint16_t port);
+  size_t write(uint8_t c);
+  size_t write(const uint8_t *buffer, size_t size);
+  using Print::write;
+  int available();
+  int read();
+  int read(uint8_t *buffer, size_t size);
+  int peek();
+  void flush() {}
+  void stop();
+  uint8_t connected();
+  int fd() const;
+  operator bool() { return connected(); }
+  int setNoDelay(bool noDelay);
+  void setTimeout(uint32_t seconds) {}
+
+private:
+  std::shared_ptr<WiFiClientSocket> socket;
+};
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef HOST_DRIVER_GPIO_H
+#define HOST_DRIVER_GPIO_H
+
+typedef enum {
+  GPIO_NUM_0 = 0,
+  GPIO_NUM_4 = 4,
+  GPIO_NUM_12 = 12,
+  GPIO_NUM_13 = 13,
+  GPIO_NUM_33 = 33
+} gpio_num_t;
+
+#endif
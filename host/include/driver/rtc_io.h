@@ -0,0 +1,10 @@
+#ifndef HOST_DRIVER_RTC_IO_H
+#define HOST_DRIVER_RTC_IO_H
+
+#include "driver/gpio.h"
+#include "esp_err.h"
+
+inline esp_err_t rtc_gpio_hold_en(gpio_num_t gpio) { return ESP_OK; }
+inline esp_err_t rtc_gpio_hold_dis(gpio_num_t gpio) { return ESP_OK; }
+
+#endif
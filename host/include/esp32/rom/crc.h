@@ -0,0 +1,15 @@
+/**
+ * Host fake of the CRC functions of the ESP32 ROM.
+ */
+#ifndef HOST_ESP32_ROM_CRC_H
+#define HOST_ESP32_ROM_CRC_H
+
+#include <stdint.h>
+
+/**
+ * CRC-32 (IEEE 802.3) like the ROM one: the CRC is inverted on input and on output,
+ * so crc32_le(0, ...) starts a CRC and the result can be given back to continue it.
+ */
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+#endif
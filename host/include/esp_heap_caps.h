@@ -0,0 +1,20 @@
+/**
+ * Host fake of the ESP-IDF capability based heap allocator.
+ * All the memory comes from malloc(): the allocations with MALLOC_CAP_DMA are tracked,
+ * so the SD card fake can tell DMA capable buffers, see hostFakeIsDmaCapable().
+ */
+#ifndef HOST_ESP_HEAP_CAPS_H
+#define HOST_ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+void *heap_caps_malloc(size_t size, uint32_t caps);
+void heap_caps_free(void *ptr);
+
+#endif
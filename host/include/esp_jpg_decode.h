@@ -0,0 +1,29 @@
+/**
+ * Host fake of the JPEG decoder of the esp32-camera driver, based on libjpeg.
+ */
+#ifndef HOST_ESP_JPG_DECODE_H
+#define HOST_ESP_JPG_DECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum {
+  JPG_SCALE_NONE,
+  JPG_SCALE_2X,
+  JPG_SCALE_4X,
+  JPG_SCALE_8X,
+  JPG_SCALE_MAX = JPG_SCALE_8X
+} jpg_scale_t;
+
+typedef size_t (*jpg_reader_cb)(void *arg, size_t index, uint8_t *buf, size_t len);
+typedef bool (*jpg_writer_cb)(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data);
+
+/**
+ * Like the driver, the writer is called first without data with the output size,
+ * then with the RGB888 pixels, one row at a time here, and last without data at y = height.
+ * When hostFakes.sceneMotion is set, a dark blob moves a bit at each call.
+ */
+esp_err_t esp_jpg_decode(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jpg_writer_cb writer, void *arg);
+
+#endif
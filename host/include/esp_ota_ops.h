@@ -0,0 +1,24 @@
+/**
+ * Host fake of the ESP-IDF OTA API: only the description of the running application.
+ */
+#ifndef HOST_ESP_OTA_OPS_H
+#define HOST_ESP_OTA_OPS_H
+
+#include <stdint.h>
+
+typedef struct {
+  uint32_t magic_word;
+  uint32_t secure_version;
+  uint32_t reserv1[2];
+  char version[32];
+  char project_name[32];
+  char time[16];
+  char date[16];
+  char idf_ver[32];
+  uint8_t app_elf_sha256[32];
+  uint32_t reserv2[20];
+} esp_app_desc_t;
+
+const esp_app_desc_t *esp_ota_get_app_description();
+
+#endif
@@ -0,0 +1,32 @@
+/**
+ * Host fake of the ESP32 sleep modes.
+ * esp_deep_sleep_start() throws a host_deep_sleep_t, so the simulation
+ * can start the next wake cycle with the RTC memory preserved.
+ */
+#ifndef HOST_ESP_SLEEP_H
+#define HOST_ESP_SLEEP_H
+
+#include <stdint.h>
+#include "driver/gpio.h"
+#include "esp_err.h"
+
+typedef enum {
+  ESP_SLEEP_WAKEUP_UNDEFINED = 0,
+  ESP_SLEEP_WAKEUP_EXT0 = 2,
+  ESP_SLEEP_WAKEUP_TIMER = 4
+} esp_sleep_wakeup_cause_t;
+
+/**
+ * Thrown by esp_deep_sleep_start().
+ */
+typedef struct {
+  uint64_t timerWakeupUs;  // Timer wake up delay, 0 if disabled
+} host_deep_sleep_t;
+
+esp_err_t esp_sleep_enable_ext0_wakeup(gpio_num_t gpio, int level);
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t timeUs);
+void esp_deep_sleep_start() __attribute__((noreturn));
+// UNDEFINED at the first boot, TIMER when the timer wake up was enabled, else EXT0 (PIR)
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause();
+
+#endif
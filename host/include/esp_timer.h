@@ -0,0 +1,12 @@
+/**
+ * Host fake of the ESP32 high resolution timer.
+ * Like micros(), the time restarts from 0 at each simulated boot.
+ */
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time();
+
+#endif
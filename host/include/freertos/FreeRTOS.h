@@ -0,0 +1,31 @@
+/**
+ * Host fake of FreeRTOS for the ESP32, built on the C++ standard threads.
+ * Ticks are milliseconds.
+ */
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdint.h>
+#include <mutex>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(MS) ((TickType_t)(MS))
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+// Critical sections are mutex sections
+typedef std::mutex portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portENTER_CRITICAL(MUX) (MUX)->lock()
+#define portEXIT_CRITICAL(MUX) (MUX)->unlock()
+
+#endif
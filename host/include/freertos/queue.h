@@ -0,0 +1,24 @@
+#ifndef HOST_FREERTOS_QUEUE_H
+#define HOST_FREERTOS_QUEUE_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_queue *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+
+void vQueueDelete(QueueHandle_t queue);
+
+/**
+ * Copy the item to the back of the queue, waiting for a free slot at most ticksToWait.
+ */
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait);
+
+/**
+ * Copy the front item of the queue and remove it, waiting for an item at most ticksToWait.
+ */
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticksToWait);
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#endif
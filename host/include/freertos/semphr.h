@@ -0,0 +1,36 @@
+#ifndef HOST_FREERTOS_SEMPHR_H
+#define HOST_FREERTOS_SEMPHR_H
+
+#include "freertos/queue.h"
+
+// As in FreeRTOS, a semaphore is a queue of items without data
+typedef QueueHandle_t SemaphoreHandle_t;
+
+/**
+ * Create a mutex, given.
+ */
+inline SemaphoreHandle_t xSemaphoreCreateMutex() {
+  uint8_t item = 0;
+  QueueHandle_t queue = xQueueCreate(1, 0);
+  xQueueSend(queue, &item, 0);
+  return queue;
+}
+
+inline void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+  vQueueDelete(semaphore);
+}
+
+/**
+ * Take the semaphore, waiting for it at most ticksToWait.
+ */
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait) {
+  uint8_t item;
+  return xQueueReceive(semaphore, &item, ticksToWait);
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  uint8_t item = 0;
+  return xQueueSend(semaphore, &item, 0);
+}
+
+#endif
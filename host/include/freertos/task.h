@@ -0,0 +1,26 @@
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+/**
+ * Run the task function in a detached thread.
+ * The core is ignored.
+ */
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t taskFunction, const char *name, uint32_t stackSize,
+                                   void *param, UBaseType_t priority, TaskHandle_t *createdTask, BaseType_t core);
+
+/**
+ * The thread ends when the task function returns.
+ * So, vTaskDelete(NULL) must be the last instruction of a task function.
+ */
+void vTaskDelete(TaskHandle_t task);
+
+void vTaskDelay(TickType_t ticks);
+
+TickType_t xTaskGetTickCount();
+
+#endif
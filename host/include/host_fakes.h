@@ -0,0 +1,61 @@
+/**
+ * Knobs of the host fakes: latencies and failure injection.
+ * Latencies are real sleeps, so they show up in the phase timings.
+ */
+#ifndef HOST_FAKES_H
+#define HOST_FAKES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+  // Camera
+  const char *framesDir;          // Directory of the JPEG files served in turn by esp_camera_fb_get()
+  uint32_t cameraInitMs;          // esp_camera_init() latency
+  uint32_t cameraFrameMs;         // esp_camera_fb_get() latency
+  bool cameraInitFails;           // esp_camera_init() fails
+  uint32_t cameraFrameFailCount;  // Count of next esp_camera_fb_get() calls which fail
+  uint32_t cameraSettleMs;        // Time for the auto exposure and gain to converge from their initial values
+  uint32_t sceneExposure;         // Exposure the auto exposure converges to, in lines
+  uint32_t sceneGain;             // GAIN register value the auto gain converges to
+  bool sceneMotion;               // A dark blob crosses the frames decoded by esp_jpg_decode()
+  // SD card
+  const char *sdRoot;             // Host directory backing the SD card
+  uint32_t sdMountMs;             // SD_MMC.begin() latency
+  uint32_t sdOpenMs;              // File open latency
+  uint32_t sdDirEntryUs;          // Additional file open latency by entry of the directory, like a FAT directory scan
+  uint32_t sdWriteKBps;           // Write throughput in KB/s, 0 for no latency
+  uint32_t sdReadKBps;            // Read throughput in KB/s, 0 for no latency
+  uint32_t sdWriteCallUs;         // Additional latency of each File::write() call, like the command overhead of a transfer
+  uint32_t sdNonDmaSectorUs;      // Additional write latency by 512-byte sector of a buffer not allocated with MALLOC_CAP_DMA,
+                                  // like the sector by sector copy of the SDMMC driver
+  uint32_t sdStallMs;             // Additional latency of one write out of sdStallEvery, like the garbage collection of the card
+  uint32_t sdStallEvery;          // Period of the write stalls in number of File::write() calls, 0 for none
+  uint32_t sdReadCorruptEvery;    // Period of the File::read() calls of 512 bytes or more returning a flipped bit,
+                                  // like a silent corruption of the card, 0 for none
+  bool sdMountFails;              // SD_MMC.begin() fails
+  bool sdWriteFails;              // File opening in writing mode fails
+  uint64_t sdCardSize;            // Card size in bytes
+  // Network
+  uint32_t wifiConnectMs;         // Delay before WiFi.status() returns WL_CONNECTED
+  bool wifiFails;                 // WiFi never connects
+  uint32_t tcpConnectMs;          // WiFiClient::connect() latency
+  bool tcpConnectFails;           // WiFiClient::connect() fails
+  uint32_t tcpWriteKBps;          // WiFiClient::write() throughput in KB/s, 0 for no latency
+  // OTA
+  uint32_t otaCheckMs;            // httpUpdate.update() latency
+} host_fakes_t;
+
+extern host_fakes_t hostFakes;
+
+/**
+ * Sleep for the time required to transfer len bytes at kBps KB/s.
+ */
+void hostFakeTransferDelay(size_t len, uint32_t kBps);
+
+/**
+ * Tell whether a buffer has been allocated by heap_caps_malloc() with MALLOC_CAP_DMA.
+ */
+bool hostFakeIsDmaCapable(const void *buffer);
+
+#endif
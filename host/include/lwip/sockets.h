@@ -0,0 +1,11 @@
+/**
+ * Host fake of the lwIP socket API: the host sockets.
+ */
+#ifndef HOST_LWIP_SOCKETS_H
+#define HOST_LWIP_SOCKETS_H
+
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#endif
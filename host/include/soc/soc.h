@@ -0,0 +1,10 @@
+#ifndef HOST_SOC_SOC_H
+#define HOST_SOC_SOC_H
+
+#include <stdint.h>
+
+// Peripheral registers are not simulated
+#define WRITE_PERI_REG(ADDR, VAL) ((void)(ADDR), (void)(VAL))
+#define READ_PERI_REG(ADDR) ((void)(ADDR), 0)
+
+#endif
@@ -0,0 +1,99 @@
+/**
+ * Host simulation of the wake cycle job graph with stubbed phases.
+ * It runs the same graph as takeAndSavePicture(), where each job
+ * just sleeps for a typical duration, then checks that no job started
+ * before its dependencies ended and prints the critical path length.
+ *
+ * Usage: jobgraph-sim [job=ms|fail]...
+ * Ex: jobgraph-sim wifi=4000 picture=fail
+ */
+#include "jobgraph.h"
+
+/**
+ * Stubbed phase: its duration and its result.
+ */
+typedef struct {
+  const char *name;
+  uint32_t durationMs;
+  status_code_t result;
+} stub_phase_t;
+
+// Typical durations measured on an ESP32-CAM with the default configuration
+static stub_phase_t stubPhases[] = {
+  { "config", 120, IS_OK },
+  { "camera", 1700, IS_OK },
+  { "wifi", 2200, IS_OK },
+  { "picture", 150, IS_OK },
+  { "time", 300, IS_OK },
+  { "save", 250, IS_OK },
+  { "upload", 900, IS_OK },
+  { "ota", 200, IS_OK }
+};
+
+static status_code_t runStubPhase(stub_phase_t *phase) {
+  delay(phase->durationMs);
+  return phase->result;
+}
+
+static status_code_t configStub(void *context) { return runStubPhase(&(stubPhases[0])); }
+static status_code_t cameraStub(void *context) { return runStubPhase(&(stubPhases[1])); }
+static status_code_t wifiStub(void *context) { return runStubPhase(&(stubPhases[2])); }
+static status_code_t pictureStub(void *context) { return runStubPhase(&(stubPhases[3])); }
+static status_code_t timeStub(void *context) { return runStubPhase(&(stubPhases[4])); }
+static status_code_t saveStub(void *context) { return runStubPhase(&(stubPhases[5])); }
+static status_code_t uploadStub(void *context) { return runStubPhase(&(stubPhases[6])); }
+static status_code_t otaStub(void *context) { return runStubPhase(&(stubPhases[7])); }
+
+int main(int argc, char **argv) {
+  uint8_t phaseCount = sizeof(stubPhases) / sizeof(stub_phase_t);
+
+  for (int a = 1; a < argc; a++) {
+    const char *value = strchr(argv[a], '=');
+    uint8_t i = 0;
+    while (i < phaseCount && (!value || strncmp(stubPhases[i].name, argv[a], value - argv[a]) != 0)) i++;
+    if (i == phaseCount) {
+      fprintf(stderr, "Unknown argument %s. Usage: %s [job=ms|fail]...\n", argv[a], argv[0]);
+      return 2;
+    }
+    if (strcmp(value + 1, "fail") == 0) {
+      stubPhases[i].result = CAMERA_TAKE_PICTURE_ERROR;
+    } else {
+      stubPhases[i].durationMs = atoi(value + 1);
+    }
+  }
+
+  // Same graph as takeAndSavePicture()
+  job_t jobs[] = {
+    { "config", configStub, 0, JOB_ANY_CORE },
+    { "camera", cameraStub, JOB_BIT(0), 1 },
+    { "wifi", wifiStub, JOB_BIT(0), 0 },
+    { "picture", pictureStub, JOB_BIT(1), 1 },
+    { "time", timeStub, JOB_BIT(2), 0 },
+    { "save", saveStub, JOB_BIT(3) | JOB_BIT(4), 1 },
+    { "upload", uploadStub, JOB_BIT(5) | JOB_BIT(2), 0 },
+    { "ota", otaStub, JOB_BIT(6), 0 }
+  };
+  uint8_t jobCount = sizeof(jobs) / sizeof(job_t);
+
+  status_code_t result = runJobGraph(jobs, jobCount, NULL);
+  logJobGraph(jobs, jobCount);
+
+  // Check the ordering
+  int violationCount = 0;
+  for (uint8_t i = 0; i < jobCount; i++) {
+    for (uint8_t d = 0; d < i; d++) {
+      if ((jobs[i].dependencies & JOB_BIT(d)) && (int32_t)(jobs[i].startUs - jobs[d].endUs) < 0) {
+        printf("\nOrdering violation: %s started before %s ended.", jobs[i].name, jobs[d].name);
+        violationCount++;
+      }
+    }
+  }
+
+  uint32_t sequentialMs = 0;
+  for (uint8_t i = 0; i < jobCount; i++) {
+    sequentialMs += jobs[i].skipped ? 0 : stubPhases[i].durationMs;
+  }
+  printf("\nResult: %d, ordering violations: %d, critical path: %lu ms, sequential: %lu ms.\n",
+         result, violationCount, (unsigned long)computeJobGraphCriticalPathUs(jobs, jobCount) / 1000, (unsigned long)sequentialMs);
+  return violationCount ? 1 : 0;
+}
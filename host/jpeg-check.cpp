@@ -0,0 +1,159 @@
+/**
+ * Test bench of the picture check (see checkPicture() and jpegdc.h) on recorded frames.
+ * For each JPEG file, it prints the means decoded from the DC coefficients,
+ * the means of a full libjpeg decoding as a reference, the defect found,
+ * the DC decoding duration, the difference hash (see dedupe.h) and its
+ * Hamming distance to the hash of the previous file, to tune camera_settings_t.duplicateDistance.
+ *
+ * Usage: jpeg-check [option=value]... frame.jpg...
+ * Options:
+ *   iterations=N  number of DC decodings of each file for the timing (default 100)
+ *   truncate=P    keep only the first P percent of each file, then append an EOI marker,
+ *                 like a frame cut by the driver (default 100)
+ * Ex: jpeg-check build/sdcard/pic-*.jpg
+ */
+#include <setjmp.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "camera.h"
+#include "dedupe.h"
+// Arduino.h defines boolean as bool, libjpeg as int
+#define boolean jpeg_boolean
+#include <jpeglib.h>
+#undef boolean
+
+static const char *defectNames[] = { "valid", "corrupted", "dark", "green" };
+
+typedef struct {
+  struct jpeg_error_mgr manager;
+  jmp_buf exit;
+} jpeg_error_t;
+
+static void exitOnJpegError(j_common_ptr info) {
+  longjmp(((jpeg_error_t *)info->err)->exit, 1);
+}
+
+/**
+ * Fully decode a JPEG buffer with libjpeg and compute the mean of each YCbCr component.
+ *
+ * @return false when libjpeg fails
+ */
+static bool computeReferenceMeans(const std::vector<uint8_t> &jpeg, double *means) {
+  struct jpeg_decompress_struct info;
+  jpeg_error_t error;
+  info.err = jpeg_std_error(&error.manager);
+  error.manager.error_exit = exitOnJpegError;
+  error.manager.emit_message = [](j_common_ptr info, int level) {};
+  if (setjmp(error.exit)) {
+    jpeg_destroy_decompress(&info);
+    return false;
+  }
+  jpeg_create_decompress(&info);
+  jpeg_mem_src(&info, jpeg.data(), jpeg.size());
+  jpeg_read_header(&info, TRUE);
+  info.out_color_space = info.num_components == 3 ? JCS_YCbCr : JCS_GRAYSCALE;
+  jpeg_start_decompress(&info);
+  std::vector<uint8_t> row(info.output_width * info.output_components);
+  uint8_t *rowPointer = row.data();
+  double sums[3] = { 0, 0, 0 };
+  while (info.output_scanline < info.output_height) {
+    jpeg_read_scanlines(&info, &rowPointer, 1);
+    for (size_t i = 0; i < row.size(); i++) {
+      sums[i % info.output_components] += row[i];
+    }
+  }
+  for (int c = 0; c < 3; c++) {
+    means[c] = c < info.output_components ? sums[c] / ((double)info.output_width * info.output_height) : 128;
+  }
+  jpeg_finish_decompress(&info);
+  jpeg_destroy_decompress(&info);
+  return true;
+}
+
+/**
+ * Read a file, keeping only the first percent of it.
+ */
+static bool readFile(const char *path, uint32_t percent, std::vector<uint8_t> *data) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    perror(path);
+    return false;
+  }
+  fseek(file, 0, SEEK_END);
+  data->resize(ftell(file));
+  fseek(file, 0, SEEK_SET);
+  data->resize(fread(data->data(), 1, data->size(), file));
+  fclose(file);
+  if (percent < 100) {
+    data->resize(data->size() * percent / 100);
+    data->push_back(0xFF);
+    data->push_back(0xD9);
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  uint32_t iterations = 100;
+  uint32_t percent = 100;
+  std::vector<const char *> paths;
+
+  for (int a = 1; a < argc; a++) {
+    std::string argument(argv[a]);
+    if (argument.rfind("iterations=", 0) == 0) {
+      iterations = strtoul(argv[a] + 11, NULL, 10);
+    } else if (argument.rfind("truncate=", 0) == 0) {
+      percent = strtoul(argv[a] + 9, NULL, 10);
+    } else {
+      paths.push_back(argv[a]);
+    }
+  }
+  if (paths.empty() || !iterations) {
+    fprintf(stderr, "Usage: %s [iterations=N] [truncate=P] frame.jpg...\n", argv[0]);
+    return 2;
+  }
+
+  printf("%-32s | %9s | %-16s | %-20s | %8s | %-16s | %4s | %s\n", "Frame", "Size", "DC Y/Cb/Cr", "libjpeg Y/Cb/Cr", "DC us", "Hash", "Dist", "Defect");
+  uint64_t previousHash = 0;
+  bool previousHashed = false;
+  for (const char *path : paths) {
+    std::vector<uint8_t> jpeg;
+    if (!readFile(path, percent, &jpeg)) {
+      return 1;
+    }
+    camera_fb_t fb = {};
+    fb.buf = jpeg.data();
+    fb.len = jpeg.size();
+    fb.format = PIXFORMAT_JPEG;
+    jpeg_dc_t dc;
+    picture_defect_t defect = checkPicture(&fb, &dc);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+      decodeJpegDc(jpeg.data(), jpeg.size(), &dc);
+    }
+    double elapsedUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    char dcMeans[24] = "-";
+    char hash[20] = "-";
+    char distance[8] = "-";
+    char referenceMeans[32] = "-";
+    double means[3];
+    if (!dc.error) {
+      snprintf(dcMeans, sizeof(dcMeans), "%d/%d/%d", dc.mean[0], dc.mean[1], dc.mean[2]);
+      uint64_t currentHash = computeThumbnailHash(dc.thumbnail);
+      snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)currentHash);
+      if (previousHashed) {
+        snprintf(distance, sizeof(distance), "%d", __builtin_popcountll(currentHash ^ previousHash));
+      }
+      previousHash = currentHash;
+    }
+    previousHashed = !dc.error;
+    if (computeReferenceMeans(jpeg, means)) {
+      snprintf(referenceMeans, sizeof(referenceMeans), "%.1f/%.1f/%.1f", means[0], means[1], means[2]);
+    }
+    printf("%-32s | %9zu | %-16s | %-20s | %8.1f | %-16s | %4s | %s%s%s\n", path, jpeg.size(), dcMeans, referenceMeans,
+           elapsedUs / iterations, hash, distance, defectNames[defect], dc.error ? ": " : "", dc.error ? dc.error : "");
+  }
+  return 0;
+}
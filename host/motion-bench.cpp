@@ -0,0 +1,138 @@
+/**
+ * Test bench of the motion detection kernel (see framediff.h) on recorded frames.
+ * The JPEG frames, e.g. pictures of the SD card, are decoded in grayscale at 1/8 scale
+ * like the board does, then each frame is compared to the previous one.
+ * It prints the result of each comparison and the kernel duration.
+ *
+ * Usage: motion-bench [option=value]... frame.jpg...
+ * Options:
+ *   threshold=N     camera_settings_t.motionThreshold (default MOTION_THRESHOLD_DEFAULT)
+ *   minBlobCells=N  camera_settings_t.motionMinBlobCells (default MOTION_MIN_BLOB_CELLS_DEFAULT)
+ *   iterations=N    number of runs of all the comparisons for the timing (default 1000)
+ * Ex: motion-bench build/sdcard/pic-*.jpg
+ */
+#include <setjmp.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "motion.h"
+// Arduino.h defines boolean as bool, libjpeg as int
+#define boolean jpeg_boolean
+#include <jpeglib.h>
+#undef boolean
+
+/**
+ * A recorded frame decoded in grayscale.
+ */
+typedef struct {
+  const char *path;
+  std::vector<uint8_t> pixels;
+  uint16_t width;
+  uint16_t height;
+} recorded_frame_t;
+
+typedef struct {
+  struct jpeg_error_mgr manager;
+  jmp_buf exit;
+} jpeg_error_t;
+
+static void exitOnJpegError(j_common_ptr info) {
+  longjmp(((jpeg_error_t *)info->err)->exit, 1);
+}
+
+/**
+ * Decode a JPEG file in grayscale at 1/8 scale.
+ *
+ * @return false when the file can't be read or decoded
+ */
+static bool readFrame(const char *path, recorded_frame_t *frame) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    perror(path);
+    return false;
+  }
+  struct jpeg_decompress_struct info;
+  jpeg_error_t error;
+  info.err = jpeg_std_error(&error.manager);
+  error.manager.error_exit = exitOnJpegError;
+  if (setjmp(error.exit)) {
+    fprintf(stderr, "%s: not a JPEG file.\n", path);
+    jpeg_destroy_decompress(&info);
+    fclose(file);
+    return false;
+  }
+  jpeg_create_decompress(&info);
+  jpeg_stdio_src(&info, file);
+  jpeg_read_header(&info, TRUE);
+  info.scale_num = 1;
+  info.scale_denom = 1 << MOTION_JPEG_SCALE;
+  info.out_color_space = JCS_GRAYSCALE;
+  jpeg_start_decompress(&info);
+  frame->path = path;
+  frame->width = info.output_width;
+  frame->height = info.output_height;
+  frame->pixels.resize((size_t)frame->width * frame->height);
+  while (info.output_scanline < info.output_height) {
+    uint8_t *row = frame->pixels.data() + (size_t)info.output_scanline * frame->width;
+    jpeg_read_scanlines(&info, &row, 1);
+  }
+  jpeg_finish_decompress(&info);
+  jpeg_destroy_decompress(&info);
+  fclose(file);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  framediff_params_t params = { MOTION_THRESHOLD_DEFAULT, MOTION_CELL_THRESHOLD, MOTION_MIN_BLOB_CELLS_DEFAULT };
+  uint32_t iterations = 1000;
+  std::vector<recorded_frame_t> frames;
+  framediff_workspace_t *workspace = new framediff_workspace_t;
+  framediff_result_t diff;
+
+  for (int a = 1; a < argc; a++) {
+    std::string argument(argv[a]);
+    if (argument.rfind("threshold=", 0) == 0) {
+      params.pixelThreshold = atoi(argv[a] + 10);
+    } else if (argument.rfind("minBlobCells=", 0) == 0) {
+      params.minBlobCells = atoi(argv[a] + 13);
+    } else if (argument.rfind("iterations=", 0) == 0) {
+      iterations = strtoul(argv[a] + 11, NULL, 10);
+    } else {
+      frames.emplace_back();
+      if (!readFrame(argv[a], &frames.back())) {
+        return 1;
+      }
+    }
+  }
+  if (frames.size() < 2) {
+    fprintf(stderr, "Usage: %s [threshold=N] [minBlobCells=N] [iterations=N] frame.jpg...\n"
+                    "At least two frames are required.\n", argv[0]);
+    return 2;
+  }
+
+  printf("%-32s | %8s | %7s | %7s | %6s | %s\n", "Frame", "Pixels", "Cells", "Blob", "Shift", "Motion");
+  for (size_t i = 1; i < frames.size(); i++) {
+    const recorded_frame_t &previous = frames[i - 1];
+    const recorded_frame_t &current = frames[i];
+    if (current.width != previous.width || current.height != previous.height
+        || !framediffCompare(previous.pixels.data(), current.pixels.data(), current.width, current.height, &params, workspace, &diff)) {
+      printf("%-32s | frame size %dx%d not supported or different from the previous one\n", current.path, current.width, current.height);
+      return 1;
+    }
+    printf("%-32s | %8u | %7u | %7u | %6d | %s\n", current.path, diff.changedPixels, diff.changedCells,
+           diff.largestBlobCells, diff.brightnessShift, diff.motion ? "yes" : "no");
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+    for (size_t i = 1; i < frames.size(); i++) {
+      framediffCompare(frames[i - 1].pixels.data(), frames[i].pixels.data(), frames[i].width, frames[i].height, &params, workspace, &diff);
+    }
+  }
+  double elapsedUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+  uint64_t comparisonCount = (uint64_t)iterations * (frames.size() - 1);
+  printf("\n%dx%d frames: %.2f us per comparison (%llu comparisons).\n", frames[0].width, frames[0].height,
+         comparisonCount ? elapsedUs / comparisonCount : 0.0, (unsigned long long)comparisonCount);
+  delete workspace;
+  return 0;
+}
@@ -0,0 +1,354 @@
+/**
+ * Host simulation of full wake cycles of the application.
+ * setup() runs against the fakes of the platform: the SD card is a host
+ * directory, frames are the JPEG files of a directory and pictures
+ * are uploaded to a fake HTTP server listening on the loopback interface.
+ * Each wake cycle ends with the simulated deep sleep, RTC memory is kept.
+ *
+ * Usage: pipeline-sim [option=value]...
+ * Options:
+ *   cycles=N          number of wake cycles to simulate (default 3)
+ *   serverPort=P      port of the fake upload server (default 18080)
+ *   serverMs=MS       response latency of the fake upload server (default 50)
+ *   serverMaxRequests=N  requests served by connection before the fake upload server closes it, 0 for no limit (default 0)
+ *   serverChunked=1   the fake upload server sends its response bodies in chunks (default 0)
+ *   <knob>=VALUE      any field of host_fakes_t, see host_fakes.h. Ex: sdWriteKBps=800 wifiFails=1
+ *
+ * The default configuration file written on the fake SD card enables
+ * the WiFi and the upload to the fake server, unless a config.txt already exists.
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include "app.h"
+#include "host_fakes.h"
+
+#define SIM_LOG "Sim"
+
+/**
+ * A host_fakes_t field which can be set from the command line.
+ */
+typedef struct {
+  const char *name;
+  char type;  // 's' C string, 'u' uint32_t, 'b' bool, 'l' uint64_t
+  void *address;
+} knob_t;
+
+static knob_t knobs[] = {
+  { "framesDir", 's', &hostFakes.framesDir },
+  { "cameraInitMs", 'u', &hostFakes.cameraInitMs },
+  { "cameraFrameMs", 'u', &hostFakes.cameraFrameMs },
+  { "cameraInitFails", 'b', &hostFakes.cameraInitFails },
+  { "cameraFrameFailCount", 'u', &hostFakes.cameraFrameFailCount },
+  { "cameraSettleMs", 'u', &hostFakes.cameraSettleMs },
+  { "sceneExposure", 'u', &hostFakes.sceneExposure },
+  { "sceneGain", 'u', &hostFakes.sceneGain },
+  { "sceneMotion", 'b', &hostFakes.sceneMotion },
+  { "sdRoot", 's', &hostFakes.sdRoot },
+  { "sdMountMs", 'u', &hostFakes.sdMountMs },
+  { "sdOpenMs", 'u', &hostFakes.sdOpenMs },
+  { "sdDirEntryUs", 'u', &hostFakes.sdDirEntryUs },
+  { "sdWriteKBps", 'u', &hostFakes.sdWriteKBps },
+  { "sdReadKBps", 'u', &hostFakes.sdReadKBps },
+  { "sdWriteCallUs", 'u', &hostFakes.sdWriteCallUs },
+  { "sdNonDmaSectorUs", 'u', &hostFakes.sdNonDmaSectorUs },
+  { "sdStallMs", 'u', &hostFakes.sdStallMs },
+  { "sdStallEvery", 'u', &hostFakes.sdStallEvery },
+  { "sdReadCorruptEvery", 'u', &hostFakes.sdReadCorruptEvery },
+  { "sdMountFails", 'b', &hostFakes.sdMountFails },
+  { "sdWriteFails", 'b', &hostFakes.sdWriteFails },
+  { "sdCardSize", 'l', &hostFakes.sdCardSize },
+  { "wifiConnectMs", 'u', &hostFakes.wifiConnectMs },
+  { "wifiFails", 'b', &hostFakes.wifiFails },
+  { "tcpConnectMs", 'u', &hostFakes.tcpConnectMs },
+  { "tcpConnectFails", 'b', &hostFakes.tcpConnectFails },
+  { "tcpWriteKBps", 'u', &hostFakes.tcpWriteKBps },
+  { "otaCheckMs", 'u', &hostFakes.otaCheckMs }
+};
+
+static uint32_t cycleCount = 3;
+static uint16_t serverPort = 18080;
+static uint32_t serverResponseMs = 50;
+static uint32_t serverMaxRequests = 0;
+static bool serverChunked = false;
+static std::atomic<uint32_t> connectionCount(0);
+static std::atomic<uint32_t> uploadRequestCount(0);
+static std::atomic<uint32_t> uploadedPictureCount(0);
+static std::atomic<uint64_t> uploadedByteCount(0);
+static std::atomic<uint32_t> crcCheckedCount(0);
+static std::atomic<uint32_t> crcMismatchCount(0);
+
+/**
+ * Set a knob or an option from a "name=value" argument.
+ *
+ * @return false when the name is unknown
+ */
+static bool parseArgument(const char *argument) {
+  const char *value = strchr(argument, '=');
+  if (!value) {
+    return false;
+  }
+  std::string name(argument, value - argument);
+  value++;
+  if (name == "cycles") {
+    cycleCount = atoi(value);
+    return true;
+  }
+  if (name == "serverPort") {
+    serverPort = atoi(value);
+    return true;
+  }
+  if (name == "serverMs") {
+    serverResponseMs = atoi(value);
+    return true;
+  }
+  if (name == "serverMaxRequests") {
+    serverMaxRequests = atoi(value);
+    return true;
+  }
+  if (name == "serverChunked") {
+    serverChunked = atoi(value) != 0;
+    return true;
+  }
+  for (knob_t &knob : knobs) {
+    if (name == knob.name) {
+      switch (knob.type) {
+        case 's': *(const char **)knob.address = value; break;
+        case 'u': *(uint32_t *)knob.address = strtoul(value, NULL, 10); break;
+        case 'b': *(bool *)knob.address = strcmp(value, "1") == 0 || strcmp(value, "true") == 0; break;
+        case 'l': *(uint64_t *)knob.address = strtoull(value, NULL, 10); break;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Write a default config.txt on the fake SD card when there is none.
+ * The directory of the fake SD card is created with its parents, so the simulation can run from any directory.
+ *
+ * @return false when config.txt can't be written
+ */
+static bool writeDefaultConfig() {
+  std::string path = std::string(hostFakes.sdRoot) + "/config.txt";
+  for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+    mkdir(path.substr(0, slash).c_str(), 0755);
+  }
+  if (access(path.c_str(), F_OK) == 0) {
+    return true;
+  }
+  FILE *file = fopen(path.c_str(), "w");
+  if (!file) {
+    fprintf(stderr, "Can't write %s: %s.\n", path.c_str(), strerror(errno));
+    return false;
+  }
+  fprintf(file,
+          "savePictureOnSdCard=true\n"
+          "awakeDurationMs=0\n"
+          "\n[wifi]\nenabled=true\nssid=SimWifi\npassword=\nconnectAttemptMax=30\n"
+          "\n[upload]\nenabled=true\nserverAddress=127.0.0.1\nserverPort=%u\npath=/upload.php\nauth=\nbunchSize=1\n",
+          serverPort);
+  fclose(file);
+  return true;
+}
+
+/**
+ * Check the picture of an upload request against the CRC-32 of its UPLOAD_CRC_HEADER header, if any.
+ *
+ * @return false when the picture doesn't match the CRC-32
+ */
+static bool checkUploadCrc(const std::string &request, size_t headerEnd, size_t contentLength) {
+  size_t position = request.find(UPLOAD_CRC_HEADER ": ");
+  if (position == std::string::npos || position > headerEnd) {
+    return true;
+  }
+  uint32_t expectedCrc = strtoul(request.c_str() + position + sizeof(UPLOAD_CRC_HEADER) + 1, NULL, 16);
+  std::string body = request.substr(headerEnd + 4, contentLength);
+  size_t dataStart = body.find("Content-Type: image/jpeg\r\n\r\n");
+  size_t dataEnd = body.rfind("\r\n--EspCamWebUpload--");
+  if (dataStart == std::string::npos || dataEnd == std::string::npos) {
+    return false;
+  }
+  dataStart += 28;
+  crcCheckedCount++;
+  return crc32_le(0, (const uint8_t *)body.data() + dataStart, dataEnd - dataStart) == expectedCrc;
+}
+
+/**
+ * Check each picture part of a batched upload request against the CRC-32 of its UPLOAD_CRC_HEADER part header, if any,
+ * and render the result manifest: one "file name status code" line by picture.
+ *
+ * @return the number of pictures matching their CRC-32
+ */
+static uint32_t checkBatchParts(const std::string &request, size_t headerEnd, size_t contentLength, std::string *manifest) {
+  std::string body = request.substr(headerEnd + 4, contentLength);
+  uint32_t receivedCount = 0;
+  size_t partStart = 0;
+  while ((partStart = body.find("filename=\"", partStart)) != std::string::npos) {
+    partStart += 10;
+    std::string name = body.substr(partStart, body.find('"', partStart) - partStart);
+    size_t dataStart = body.find("\r\n\r\n", partStart);
+    size_t dataEnd = body.find("\r\n--" UPLOAD_MULTIPART_BOUNDARY, dataStart);
+    if (dataStart == std::string::npos || dataEnd == std::string::npos) {
+      break;
+    }
+    bool crcChecked = true;
+    size_t crcPosition = body.find(UPLOAD_CRC_HEADER ": ", partStart);
+    if (crcPosition < dataStart) {
+      uint32_t expectedCrc = strtoul(body.c_str() + crcPosition + sizeof(UPLOAD_CRC_HEADER) + 1, NULL, 16);
+      crcCheckedCount++;
+      crcChecked = crc32_le(0, (const uint8_t *)body.data() + dataStart + 4, dataEnd - dataStart - 4) == expectedCrc;
+    }
+    if (crcChecked) {
+      receivedCount++;
+    } else {
+      crcMismatchCount++;
+    }
+    *manifest += name + (crcChecked ? " 200\n" : " 400\n");
+    partStart = dataEnd;
+  }
+  return receivedCount;
+}
+
+/**
+ * Serve one connection of the fake upload server:
+ * read requests, reply 200 to each one until the client closes,
+ * or 400 when the picture doesn't match its CRC-32.
+ * A batched upload request, with the UPLOAD_BATCH_HEADER header, is answered by its result manifest.
+ * The connection is closed after a request with "Connection: close",
+ * or after serverMaxRequests requests, like the keep-alive limit of a web server.
+ */
+static void serveUploadConnection(int fd) {
+  std::string request;
+  char buffer[4096];
+  ssize_t n;
+  uint32_t requestCount = 0;
+  bool closing = false;
+
+  connectionCount++;
+  while (!closing && (n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+    request.append(buffer, n);
+    size_t headerEnd;
+    while ((headerEnd = request.find("\r\n\r\n")) != std::string::npos) {
+      size_t contentLength = 0;
+      size_t position = request.find("Content-Length: ");
+      if (position != std::string::npos && position < headerEnd) {
+        contentLength = strtoul(request.c_str() + position + 16, NULL, 10);
+      }
+      if (request.size() < headerEnd + 4 + contentLength) {
+        break;
+      }
+      uploadRequestCount++;
+      size_t batchPosition = request.find(UPLOAD_BATCH_HEADER ": ");
+      bool batch = batchPosition != std::string::npos && batchPosition < headerEnd;
+      std::string manifest;
+      uint32_t receivedCount = batch ? checkBatchParts(request, headerEnd, contentLength, &manifest) : 0;
+      bool crcChecked = batch || checkUploadCrc(request, headerEnd, contentLength);
+      size_t closePosition = request.find("Connection: close");
+      closing = (closePosition != std::string::npos && closePosition < headerEnd) || (serverMaxRequests && ++requestCount >= serverMaxRequests);
+      request.erase(0, headerEnd + 4 + contentLength);
+      delay(serverResponseMs);
+      std::string response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n";
+      std::string body = "OK";
+      if (batch) {
+        uploadedPictureCount += receivedCount;
+        uploadedByteCount += contentLength;
+        body = manifest;
+      } else if (crcChecked) {
+        uploadedPictureCount++;
+        uploadedByteCount += contentLength;
+      } else {
+        crcMismatchCount++;
+        response = "HTTP/1.1 400 Bad Request\r\nContent-Type: text/plain\r\n";
+        body = "CRC mismatch";
+      }
+      if (serverChunked) {
+        // Two chunks, so the client has to join them
+        char sizes[2][20];
+        size_t half = body.size() / 2;
+        snprintf(sizes[0], sizeof(sizes[0]), "%zx\r\n", half);
+        snprintf(sizes[1], sizeof(sizes[1]), "%zx\r\n", body.size() - half);
+        response += "Transfer-Encoding: chunked\r\n";
+        body = sizes[0] + body.substr(0, half) + "\r\n" + sizes[1] + body.substr(half) + "\r\n0\r\n\r\n";
+      } else {
+        response += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+      }
+      response += closing ? "Connection: close\r\n\r\n" : "\r\n";
+      response += body;
+      send(fd, response.data(), response.size(), MSG_NOSIGNAL);
+      if (closing) {
+        break;
+      }
+    }
+  }
+  close(fd);
+}
+
+/**
+ * Run the fake upload server on the loopback interface.
+ */
+static bool startUploadServer() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(serverPort);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, 4) != 0) {
+    perror("Fake upload server");
+    close(fd);
+    return false;
+  }
+  std::thread([fd] {
+    int client;
+    while ((client = accept(fd, NULL, NULL)) >= 0) {
+      std::thread(serveUploadConnection, client).detach();
+    }
+  }).detach();
+  return true;
+}
+
+int main(int argc, char **argv) {
+  for (int a = 1; a < argc; a++) {
+    if (!parseArgument(argv[a])) {
+      fprintf(stderr, "Unknown argument %s. See the usage in pipeline-sim.cpp.\n", argv[a]);
+      return 2;
+    }
+  }
+
+  if (!writeDefaultConfig() || !startUploadServer()) {
+    return 1;
+  }
+
+  uint32_t cycleDurationMs[cycleCount];
+  for (uint32_t cycle = 0; cycle < cycleCount; cycle++) {
+    logInfo(SIM_LOG, "==== Wake cycle #%u ====", cycle + 1);
+    // millis() restarts at each simulated boot
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    try {
+      setup();
+    } catch (host_deep_sleep_t &deepSleep) {
+      // End of the wake cycle
+    }
+    cycleDurationMs[cycle] = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  printf("\n\nWake cycle | Awake ms\n");
+  for (uint32_t cycle = 0; cycle < cycleCount; cycle++) {
+    printf("%10u | %8u\n", cycle + 1, cycleDurationMs[cycle]);
+  }
+  printf("Pictures received by the fake upload server: %u (%llu bytes).\n",
+         uploadedPictureCount.load(), (unsigned long long)uploadedByteCount.load());
+  printf("Pictures checked against their CRC-32: %u, mismatching: %u.\n", crcCheckedCount.load(), crcMismatchCount.load());
+  printf("Connections accepted by the fake upload server: %u, requests: %u.\n", connectionCount.load(), uploadRequestCount.load());
+  return 0;
+}
@@ -0,0 +1,150 @@
+/**
+ * Runner of the SD card benchmark (see sdbench.h) against the fake SD card.
+ * For each card profile, it mounts an empty fake card in a temporary directory,
+ * measures it with runSdBenchmark() and prints the measures with the write strategy
+ * chosen from them: chunk size, write-behind queue size and picture layout.
+ * The latency knobs override the ones of the profiles, to try other cards.
+ *
+ * Usage: sd-bench [option=value]...
+ * Options:
+ *   profile=NAME        fast, typical or slow card (default: all)
+ *   flushDeadlineMs=N   flush deadline sizing the write-behind queue (default: WRITE_BEHIND_FLUSH_DEADLINE_MS_DEFAULT)
+ *   sdWriteKBps=N, sdReadKBps=N, sdOpenMs=N, sdDirEntryUs=N, sdWriteCallUs=N
+ *                       latency knobs of the fake SD card, see host_fakes.h
+ * Ex: sd-bench profile=slow sdWriteCallUs=8000
+ */
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "sdbench.h"
+#include "host_fakes.h"
+
+/**
+ * Latencies of a kind of SD card.
+ */
+typedef struct {
+  const char *name;
+  uint32_t writeKBps;
+  uint32_t readKBps;
+  uint32_t openMs;
+  uint32_t dirEntryUs;
+  uint32_t writeCallUs;
+} card_profile_t;
+
+static const card_profile_t profiles[] = {
+  { "fast", 20000, 40000, 0, 20, 100 },
+  { "typical", 2000, 8000, 15, 50, 1000 },
+  { "slow", 800, 2000, 40, 200, 4000 }
+};
+
+/**
+ * A latency knob overriding the one of the profiles.
+ */
+typedef struct {
+  const char *name;
+  uint32_t *address;
+  bool set;
+} knob_override_t;
+
+static knob_override_t overrides[] = {
+  { "sdWriteKBps", &hostFakes.sdWriteKBps, false },
+  { "sdReadKBps", &hostFakes.sdReadKBps, false },
+  { "sdOpenMs", &hostFakes.sdOpenMs, false },
+  { "sdDirEntryUs", &hostFakes.sdDirEntryUs, false },
+  { "sdWriteCallUs", &hostFakes.sdWriteCallUs, false }
+};
+
+/**
+ * Apply a profile to the fake SD card, then the overriding knobs.
+ */
+static void applyProfile(const card_profile_t &profile, const std::vector<uint32_t> &values) {
+  hostFakes.sdWriteKBps = profile.writeKBps;
+  hostFakes.sdReadKBps = profile.readKBps;
+  hostFakes.sdOpenMs = profile.openMs;
+  hostFakes.sdDirEntryUs = profile.dirEntryUs;
+  hostFakes.sdWriteCallUs = profile.writeCallUs;
+  for (size_t i = 0; i < sizeof(overrides) / sizeof(overrides[0]); i++) {
+    if (overrides[i].set) {
+      *overrides[i].address = values[i];
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *profileName = NULL;
+  uint16_t flushDeadlineMs = WRITE_BEHIND_FLUSH_DEADLINE_MS_DEFAULT;
+  std::vector<uint32_t> values(sizeof(overrides) / sizeof(overrides[0]));
+
+  for (int a = 1; a < argc; a++) {
+    std::string argument = argv[a];
+    size_t equal = argument.find('=');
+    std::string name = argument.substr(0, equal);
+    const char *value = equal == std::string::npos ? "" : argv[a] + equal + 1;
+    bool known = equal != std::string::npos;
+    if (name == "profile") {
+      profileName = value;
+    } else if (name == "flushDeadlineMs") {
+      flushDeadlineMs = strtoul(value, NULL, 10);
+    } else {
+      known = false;
+      for (size_t i = 0; i < values.size(); i++) {
+        if (name == overrides[i].name) {
+          values[i] = strtoul(value, NULL, 10);
+          overrides[i].set = known = true;
+        }
+      }
+    }
+    if (!known) {
+      fprintf(stderr, "Unknown argument %s. See the usage in sd-bench.cpp.\n", argv[a]);
+      return 2;
+    }
+  }
+
+  char sdRoot[] = "/tmp/sd-bench-XXXXXX";
+  if (!mkdtemp(sdRoot)) {
+    perror(sdRoot);
+    return 1;
+  }
+  hostFakes.sdRoot = sdRoot;
+  hostFakes.sdMountMs = 0;
+  if (initSdCard() != IS_OK) {
+    rmdir(sdRoot);
+    return 1;
+  }
+
+  int result = 0;
+  std::vector<std::string> lines;
+  for (const card_profile_t &profile : profiles) {
+    if (profileName && strcmp(profileName, profile.name) != 0) {
+      continue;
+    }
+    applyProfile(profile, values);
+    sd_benchmark_t benchmark = {};
+    if (runSdBenchmark(&benchmark) != IS_OK) {
+      result = 1;
+      continue;
+    }
+    benchmark.storage = PICTURE_STORAGE_AUTO;
+    selectSdStrategy(&benchmark);
+    char line[160];
+    snprintf(line, sizeof(line), "%-8s | %6u | %6u | %6u | %6u | %6u | %8u | %6u KB | %8u KB | %s", profile.name,
+             benchmark.writeKBps[0], benchmark.writeKBps[1], benchmark.writeKBps[2], benchmark.writeKBps[3],
+             benchmark.readKBps, benchmark.createUs, benchmark.chunkSize / 1024,
+             (unsigned int)(computeWriteBehindQueueBytes(&benchmark, flushDeadlineMs) / 1024),
+             benchmark.storage == PICTURE_STORAGE_SEGMENTS ? "segments" : "directories");
+    lines.push_back(line);
+  }
+  rmdir(sdRoot);
+  if (lines.empty() && !result) {
+    fprintf(stderr, "Unknown profile %s.\n", profileName);
+    return 2;
+  }
+
+  printf("\n%-8s | %6s | %6s | %6s | %6s | %6s | %8s | %9s | %11s | %s\n", "Profile", "W 4K", "W 8K", "W 16K", "W 32K",
+         "Read", "Create", "Chunk", "Queue", "Layout");
+  printf("%-8s | %6s | %6s | %6s | %6s | %6s | %8s | %9s | %11s |\n", "", "KB/s", "KB/s", "KB/s", "KB/s", "KB/s", "us", "", "");
+  for (const std::string &line : lines) {
+    printf("%s\n", line.c_str());
+  }
+  return result;
+}
@@ -0,0 +1,135 @@
+/**
+ * Extractor of the pictures of segment files written on the SD card (see segment.h).
+ * For each segment, it lists the pictures with their CRC check and,
+ * when an output directory is given, writes them as pic-NNNNN.jpg files.
+ * The index file next to the segment file (.idx) is used when it exists,
+ * else the record headers of the segment file are walked.
+ *
+ * Usage: segment-extract [option=value]... seg-NNNNN.bin...
+ * Options:
+ *   out=DIR    directory receiving the extracted pictures (default: list only)
+ *   index=N    extract the picture index N only, may be repeated (default: all)
+ * Ex: segment-extract out=/tmp/pics build/sdcard/seg-*.bin
+ */
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "segment.h"
+#include "filename.h"
+
+/**
+ * A picture found in a segment file.
+ */
+typedef struct {
+  uint32_t index;
+  segment_index_entry_t entry;
+} segment_picture_t;
+
+/**
+ * Read the pictures of a segment from its index file.
+ * The picture indexes come from the segment number in the file name.
+ *
+ * @return false when the index file can't be read
+ */
+static bool readIndexFile(const std::string &dataPath, std::vector<segment_picture_t> *pictures) {
+  std::string indexPath = dataPath.substr(0, dataPath.size() - 4) + ".idx";
+  size_t slash = dataPath.rfind('/');
+  unsigned int segment;
+  if (sscanf(dataPath.c_str() + (slash == std::string::npos ? 0 : slash + 1), "seg-%u.bin", &segment) != 1) {
+    return false;
+  }
+  FILE *file = fopen(indexPath.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  segment_picture_t picture;
+  for (uint32_t slot = 0; fread(&picture.entry, sizeof(segment_index_entry_t), 1, file) == 1; slot++) {
+    if (picture.entry.length) {
+      picture.index = segment * SEGMENT_PICTURE_COUNT + slot + 1;
+      pictures->push_back(picture);
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+/**
+ * Read the pictures of a segment by walking its record headers.
+ * A record appended twice, after a reset, is listed twice.
+ */
+static void walkRecords(FILE *file, std::vector<segment_picture_t> *pictures) {
+  segment_record_t record;
+  long offset = 0;
+  while (fseek(file, offset, SEEK_SET) == 0 && fread(&record, sizeof(record), 1, file) == 1) {
+    if (record.magic != SEGMENT_RECORD_MAGIC) {
+      fprintf(stderr, "Invalid record header at offset %ld: the end of the segment is ignored.\n", offset);
+      return;
+    }
+    segment_picture_t picture = { record.index, { (uint32_t)(offset + sizeof(record)), record.length, record.timestamp, record.crc } };
+    pictures->push_back(picture);
+    offset += sizeof(record) + record.length;
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *outDir = NULL;
+  std::vector<uint32_t> selectedIndexes;
+  std::vector<const char *> paths;
+  int result = 0;
+
+  for (int a = 1; a < argc; a++) {
+    std::string argument(argv[a]);
+    if (argument.rfind("out=", 0) == 0) {
+      outDir = argv[a] + 4;
+    } else if (argument.rfind("index=", 0) == 0) {
+      selectedIndexes.push_back(strtoul(argv[a] + 6, NULL, 10));
+    } else {
+      paths.push_back(argv[a]);
+    }
+  }
+  if (paths.empty()) {
+    fprintf(stderr, "Usage: %s [out=DIR] [index=N]... seg-NNNNN.bin...\n", argv[0]);
+    return 2;
+  }
+
+  printf("%-24s | %7s | %10s | %9s | %10s | %s\n", "Segment", "Index", "Offset", "Length", "Timestamp", "CRC");
+  for (const char *path : paths) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+      perror(path);
+      return 1;
+    }
+    std::vector<segment_picture_t> pictures;
+    if (!readIndexFile(path, &pictures)) {
+      fprintf(stderr, "%s: no index file, the records are walked.\n", path);
+      walkRecords(file, &pictures);
+    }
+    for (const segment_picture_t &picture : pictures) {
+      if (!selectedIndexes.empty() && std::find(selectedIndexes.begin(), selectedIndexes.end(), picture.index) == selectedIndexes.end()) {
+        continue;
+      }
+      std::vector<uint8_t> jpeg(picture.entry.length);
+      bool read = fseek(file, picture.entry.offset, SEEK_SET) == 0 && fread(jpeg.data(), 1, jpeg.size(), file) == jpeg.size();
+      bool valid = read && crc32_le(0, jpeg.data(), jpeg.size()) == picture.entry.crc;
+      printf("%-24s | %7u | %10u | %9u | %10u | %s\n", path, picture.index, picture.entry.offset, picture.entry.length,
+             picture.entry.timestamp, !read ? "truncated" : (valid ? "ok" : "mismatch"));
+      if (!valid) {
+        result = 1;
+      } else if (outDir) {
+        char pictureName[20];
+        computePictureNameFromIndex(pictureName, picture.index);
+        std::string outPath = std::string(outDir) + "/" + pictureName;
+        FILE *out = fopen(outPath.c_str(), "wb");
+        if (!out || fwrite(jpeg.data(), 1, jpeg.size(), out) != jpeg.size()) {
+          perror(outPath.c_str());
+          result = 1;
+        }
+        if (out) {
+          fclose(out);
+        }
+      }
+    }
+    fclose(file);
+  }
+  return result;
+}
@@ -0,0 +1,94 @@
+/**
+ * Decoder of the telemetry file written on the SD card (see telemetry.h).
+ * It prints the duration percentiles of each wake cycle phase,
+ * and the median throughput of the phases transferring data.
+ * Several files, from several boards, can be given: their records are merged.
+ * Files of the version 1, without byte counts, are read too.
+ *
+ * Usage: telemetry-stats telemetry.bin...
+ * Ex: telemetry-stats build/sdcard/telemetry.bin
+ */
+#include <algorithm>
+#include <vector>
+#include "telemetry.h"
+
+/**
+ * Read the records of a telemetry file and append the phase durations.
+ *
+ * @return false when the file can't be read or is not a telemetry file
+ */
+static bool readTelemetryFile(const char *path, std::vector<uint32_t> *durationsUs, std::vector<double> *throughputs, uint32_t *cycleCount) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    perror(path);
+    return false;
+  }
+  telemetry_file_header_t header;
+  if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TELEMETRY_FILE_MAGIC, sizeof(header.magic)) != 0
+      || header.version < 1 || header.version > TELEMETRY_FILE_VERSION || header.recordSize > sizeof(telemetry_record_t)) {
+    fprintf(stderr, "%s: not a telemetry file of version 1 to %d.\n", path, TELEMETRY_FILE_VERSION);
+    fclose(file);
+    return false;
+  }
+  telemetry_record_t record = {};
+  // The fields added by the next versions stay 0
+  while (fread(&record, header.recordSize, 1, file) == 1) {
+    if (record.phase < TELEMETRY_PHASE_COUNT) {
+      durationsUs[record.phase].push_back(record.durationUs);
+      if (record.bytes && record.durationUs) {
+        // Bytes by microsecond are MB/s
+        throughputs[record.phase].push_back((double)record.bytes / record.durationUs);
+      }
+    }
+    if (record.phase == TELEMETRY_PHASE_BOOT) {
+      (*cycleCount)++;
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+/**
+ * Nearest rank percentile of sorted values.
+ */
+static uint32_t percentile(const std::vector<uint32_t> &sortedValues, uint32_t p) {
+  size_t rank = (sortedValues.size() * p + 99) / 100;
+  return sortedValues[rank ? rank - 1 : 0];
+}
+
+int main(int argc, char **argv) {
+  std::vector<uint32_t> durationsUs[TELEMETRY_PHASE_COUNT];
+  std::vector<double> throughputs[TELEMETRY_PHASE_COUNT];
+  uint32_t cycleCount = 0;
+
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s telemetry.bin...\n", argv[0]);
+    return 2;
+  }
+  for (int a = 1; a < argc; a++) {
+    if (!readTelemetryFile(argv[a], durationsUs, throughputs, &cycleCount)) {
+      return 1;
+    }
+  }
+
+  printf("%u wake cycle(s). Durations in ms.\n", cycleCount);
+  printf("%-12s | %6s | %8s | %8s | %8s | %8s | %8s\n", "Phase", "Count", "p50", "p95", "p99", "Max", "MB/s p50");
+  for (uint8_t phase = 0; phase < TELEMETRY_PHASE_COUNT; phase++) {
+    std::vector<uint32_t> &values = durationsUs[phase];
+    if (values.empty()) {
+      continue;
+    }
+    std::sort(values.begin(), values.end());
+    printf("%-12s | %6zu | %8.1f | %8.1f | %8.1f | %8.1f | ", getTelemetryPhaseName(phase), values.size(),
+           percentile(values, 50) / 1000.0, percentile(values, 95) / 1000.0, percentile(values, 99) / 1000.0,
+           values.back() / 1000.0);
+    std::vector<double> &rates = throughputs[phase];
+    if (rates.empty()) {
+      printf("%8s\n", "-");
+    } else {
+      std::sort(rates.begin(), rates.end());
+      printf("%8.2f\n", rates[(rates.size() - 1) / 2]);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,279 @@
+/**
+ * Loopback benchmark of the upload of a picture from a frame buffer, see BufferUploader.
+ * It compares the former send path, with a write by header piece and by 1024-byte packet,
+ * against the current one, with the request head rendered in a single write and the frame buffer
+ * written by upload.writeSize bytes. Both paths run with the same socket setting,
+ * with and without the Nagle algorithm (upload.noDelay), so the write pattern is compared alone.
+ * The fake server advertises the MSS of the ESP32 lwIP, so the segments are sized like on the WiFi.
+ * Each path uploads over a connection kept alive. For each one, it prints the TCP segments
+ * sent by the client, as counted by the kernel, ACKs included, and the time by upload.
+ * On the loopback, the time mostly tells the stalls between the Nagle algorithm and the delayed ACKs.
+ *
+ * The former path is the former code as it was, which didn't send the last 1024 bytes of a frame
+ * of a multiple of 1024 bytes: its request never completes, so it is not run for such a frame.
+ *
+ * Usage: upload-bench [option=value]...
+ * Options:
+ *   frameBytes=N     size of the frame (default 100000)
+ *   uploads=N        number of uploads by path (default 20)
+ *   writeSize=N      upload.writeSize of the current path, 0 for a single write (default UPLOAD_WRITE_SIZE_DEFAULT)
+ *   noDelay=0|1      run with this upload.noDelay only (default both)
+ *   mss=N            MSS advertised by the fake server (default 1436)
+ *   serverPort=P     port of the fake server (default 18090)
+ *   tcpWriteKBps=N   throughput of the fake WiFi client, see host_fakes.h (default 0: the loopback one)
+ * Ex: upload-bench writeSize=1024 noDelay=0
+ */
+#include <linux/tcp.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "upload.h"
+#include "host_fakes.h"
+
+/**
+ * Measures of the uploads of a path.
+ */
+typedef struct {
+  const char *name;
+  bool noDelay;
+  uint32_t okCount;
+  uint32_t segmentCount;
+  uint32_t durationMs;
+} bench_result_t;
+
+static uint16_t serverPort = 18090;
+static uint32_t mss = 1436;
+
+/**
+ * Serve one connection of the fake server: read each request up to its Content-Length, reply 200.
+ */
+static void serveConnection(int fd) {
+  std::string request;
+  char buffer[16384];
+  ssize_t n;
+  static const char response[] = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 2\r\n\r\nOK";
+
+  while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+    request.append(buffer, n);
+    size_t headerEnd;
+    while ((headerEnd = request.find("\r\n\r\n")) != std::string::npos) {
+      size_t position = request.find("Content-Length: ");
+      size_t contentLength = position < headerEnd ? strtoul(request.c_str() + position + 16, NULL, 10) : 0;
+      if (request.size() < headerEnd + 4 + contentLength) {
+        break;
+      }
+      request.erase(0, headerEnd + 4 + contentLength);
+      send(fd, response, sizeof(response) - 1, MSG_NOSIGNAL);
+    }
+  }
+  close(fd);
+}
+
+/**
+ * Run the fake server on the loopback interface, advertising the given MSS.
+ */
+static bool startServer() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  setsockopt(fd, IPPROTO_TCP, TCP_MAXSEG, &mss, sizeof(mss));
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(serverPort);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, 4) != 0) {
+    perror("Fake server");
+    close(fd);
+    return false;
+  }
+  std::thread([fd] {
+    int client;
+    while ((client = accept(fd, NULL, NULL)) >= 0) {
+      std::thread(serveConnection, client).detach();
+    }
+  }).detach();
+  return true;
+}
+
+/**
+ * @return the number of TCP segments sent over the client socket so far
+ */
+static uint32_t getSegmentCount(WiFiClient *client) {
+  struct tcp_info info = {};
+  socklen_t len = sizeof(info);
+  return getsockopt(client->fd(), IPPROTO_TCP, TCP_INFO, &info, &len) == 0 ? info.tcpi_segs_out : 0;
+}
+
+/**
+ * Read the response of the server.
+ *
+ * @return the status code, 0 without response
+ */
+static int readBenchResponse(WiFiClient *client) {
+  http_response_t response;
+  uint8_t buffer[UPLOAD_RESPONSE_BUFFER_SIZE];
+  initHttpResponse(&response, NULL, 0);
+  while (isHttpResponsePending(&response) && client->connected()) {
+    int len = client->read(buffer, sizeof(buffer));
+    if (len > 0) {
+      parseHttpResponse(&response, buffer, len);
+    }
+  }
+  return isHttpResponseComplete(&response) ? response.statusCode : 0;
+}
+
+/**
+ * Upload the frame by the former send path, as Uploader::sendRequest() and BufferUploader::sendData() did:
+ * a print() by header piece, the auth part, the part head and the tail as Strings, and the frame by 1024-byte packets.
+ *
+ * @return the status code of the response
+ */
+static int uploadByFormerPath(upload_settings_t *settings, UploadConnection *connection, const uint8_t *frame, size_t frameLen) {
+  bool reused;
+  if (!connection->open(&reused)) {
+    return 0;
+  }
+  WiFiClient &client = *(connection->getClient());
+  String head = "--" UPLOAD_MULTIPART_BOUNDARY "\r\nContent-Disposition: form-data; name=\"auth\"\r\n\r\n" + String(settings->auth) + "\r\n";
+  String partHead = "--" UPLOAD_MULTIPART_BOUNDARY "\r\nContent-Disposition: form-data; name=\"fileToUpload\"; filename=\"" + String("pic-00001.jpg") + "\"\r\n";
+  partHead += "Content-Type: image/jpeg\r\n\r\n";
+  String tail = "--" UPLOAD_MULTIPART_BOUNDARY "--\r\n";
+  uint32_t totalLen = head.length() + partHead.length() + frameLen + 2 + tail.length();
+
+  client.print("POST ");
+  client.print(settings->path);
+  client.println(" HTTP/1.1");
+  client.print("Host: ");
+  client.println(settings->serverAddress);
+  client.println("Content-Length: " + String(totalLen));
+  client.println("Content-Type: multipart/form-data; boundary=" UPLOAD_MULTIPART_BOUNDARY);
+  client.println("Connection: keep-alive");
+  client.println();
+  client.print(head);
+  client.print(partHead);
+  const uint8_t *iBuf = frame;
+  for (size_t n = 0; n < frameLen; n = n + UPLOAD_BUFFER_SIZE) {
+    if (n + UPLOAD_BUFFER_SIZE < frameLen) {
+      client.write(iBuf, UPLOAD_BUFFER_SIZE);
+      iBuf += UPLOAD_BUFFER_SIZE;
+    } else if (frameLen % UPLOAD_BUFFER_SIZE > 0) {
+      client.write(iBuf, frameLen % UPLOAD_BUFFER_SIZE);
+    }
+  }
+  client.print("\r\n");
+  client.print(tail);
+  return readBenchResponse(&client);
+}
+
+/**
+ * Upload the frame by the current send path of BufferUploader.
+ *
+ * @return the status code of the response
+ */
+static int uploadByCurrentPath(upload_settings_t *settings, UploadConnection *connection, uint8_t *frame, size_t frameLen) {
+  BufferUploader uploader(settings, frame, frameLen, String("pic-00001.jpg"), connection);
+  uploader.upload();
+  return uploader.getResponseStatusCode();
+}
+
+/**
+ * Run the uploads of a path over a connection kept alive.
+ */
+static bench_result_t runPath(const char *name, bool former, upload_settings_t *settings, uint8_t *frame, size_t frameLen, uint32_t uploadCount) {
+  bench_result_t result = { name, settings->noDelay, 0, 0, 0 };
+  UploadConnection connection(settings, true);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < uploadCount; i++) {
+    int statusCode = former ? uploadByFormerPath(settings, &connection, frame, frameLen) : uploadByCurrentPath(settings, &connection, frame, frameLen);
+    result.okCount += statusCode == 200;
+  }
+  result.durationMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+  result.segmentCount = getSegmentCount(connection.getClient());
+  if (connection.getConnectCount() > 1) {
+    fprintf(stderr, "%s: %u connections, the segments of the last one only are counted.\n", name, (unsigned int)connection.getConnectCount());
+  }
+  return result;
+}
+
+int main(int argc, char **argv) {
+  size_t frameLen = 100000;
+  int noDelay = -1;
+  uint32_t uploadCount = 20;
+  upload_settings_t settings = {};
+  settings.writeSize = UPLOAD_WRITE_SIZE_DEFAULT;
+  settings.noDelay = true;
+  settings.responseTimeoutMs = UPLOAD_RESPONSE_TIMEOUT_MS_DEFAULT;
+  hostFakes.wifiConnectMs = 0;
+  hostFakes.tcpConnectMs = 0;
+  hostFakes.tcpWriteKBps = 0;
+
+  for (int a = 1; a < argc; a++) {
+    std::string argument = argv[a];
+    size_t equal = argument.find('=');
+    std::string name = argument.substr(0, equal);
+    uint32_t value = equal == std::string::npos ? 0 : strtoul(argv[a] + equal + 1, NULL, 10);
+    if (equal == std::string::npos) {
+      name = "";
+    }
+    if (name == "frameBytes") {
+      frameLen = value;
+    } else if (name == "uploads") {
+      uploadCount = value;
+    } else if (name == "writeSize") {
+      settings.writeSize = value;
+    } else if (name == "noDelay") {
+      noDelay = value != 0;
+    } else if (name == "mss") {
+      mss = value;
+    } else if (name == "serverPort") {
+      serverPort = value;
+    } else if (name == "tcpWriteKBps") {
+      hostFakes.tcpWriteKBps = value;
+    } else {
+      fprintf(stderr, "Unknown argument %s. See the usage in upload-bench.cpp.\n", argv[a]);
+      return 2;
+    }
+  }
+
+  if (!startServer()) {
+    return 1;
+  }
+  strcpy(settings.serverAddress, "127.0.0.1");
+  settings.serverPort = serverPort;
+  strcpy(settings.path, "/upload.php");
+  WiFi.begin("BenchWifi", "");
+
+  std::vector<uint8_t> frame(frameLen);
+  for (size_t i = 0; i < frameLen; i++) {
+    frame[i] = (uint8_t)(i * 31 + 7);
+  }
+  bool formerRun = frameLen % UPLOAD_BUFFER_SIZE != 0;
+  if (!formerRun) {
+    fprintf(stderr, "The former path didn't send the last packet of a frame of a multiple of %u bytes: it is not run.\n", UPLOAD_BUFFER_SIZE);
+  }
+  std::vector<bench_result_t> results;
+  for (int d = 0; d <= 1; d++) {
+    if (noDelay >= 0 && d != noDelay) {
+      continue;
+    }
+    settings.noDelay = d;
+    if (formerRun) {
+      results.push_back(runPath("former", true, &settings, frame.data(), frameLen, uploadCount));
+    }
+    results.push_back(runPath("current", false, &settings, frame.data(), frameLen, uploadCount));
+  }
+
+  bool allOk = true;
+  printf("\n%-8s | %7s | %7s | %8s | %11s | %9s\n", "Path", "noDelay", "OK", "Segments", "Seg./upload", "ms/upload");
+  for (const bench_result_t &result : results) {
+    printf("%-8s | %7d | %7u | %8u | %11.1f | %9.1f\n", result.name, result.noDelay, result.okCount, result.segmentCount,
+           uploadCount ? (double)result.segmentCount / uploadCount : 0, uploadCount ? (double)result.durationMs / uploadCount : 0);
+    allOk = allOk && result.okCount == uploadCount;
+  }
+  printf("Frame of %u bytes, MSS %u, current path with writeSize=%u.\n", (unsigned int)frameLen, mss, settings.writeSize);
+  return allOk ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+#include "httpresponse.h"
+
+/**
+ * @brief Initialize the parser before the response.
+ *        An HTTP/1.1 connection is kept alive unless the server says otherwise.
+ *
+ * @param response the parser
+ * @param body     the buffer receiving the beginning of the body as a string, NULL to skip it
+ * @param bodySize the size of body
+ */
+void initHttpResponse(http_response_t *response, char *body, size_t bodySize) {
+  memset(response, 0, sizeof(http_response_t));
+  response->state = HTTP_RESPONSE_STATUS_LINE;
+  response->keepAlive = true;
+  response->contentLength = -1;
+  response->body = bodySize ? body : NULL;
+  response->bodySize = bodySize;
+  if (response->body) {
+    response->body[0] = 0;
+  }
+}
+
+/**
+ * @brief Keep the beginning of the body in the body buffer, up to its size.
+ *
+ * @param response the parser
+ * @param data     the bytes of the body
+ * @param len      the number of bytes
+ */
+static void appendHttpResponseBody(http_response_t *response, const uint8_t *data, size_t len) {
+  if (response->body && response->bodyLen < response->bodySize - 1) {
+    size_t copyLen = response->bodySize - 1 - response->bodyLen;
+    copyLen = copyLen < len ? copyLen : len;
+    memcpy(response->body + response->bodyLen, data, copyLen);
+    response->body[response->bodyLen + copyLen] = 0;
+  }
+  response->bodyLen += len;
+}
+
+/**
+ * @brief Choose how the body is read once the headers are read.
+ *        An interim 1xx response is skipped: the final response follows.
+ *        Without Content-Length nor chunks, the body ends with the connection, which can't be kept alive.
+ *
+ * @param response the parser
+ */
+static void endHttpResponseHeaders(http_response_t *response) {
+  if (response->statusCode < 200) {
+    response->statusCode = 0;
+    response->chunked = false;
+    response->contentLength = -1;
+    response->state = HTTP_RESPONSE_STATUS_LINE;
+    return;
+  }
+  response->headersRead = true;
+  if (response->statusCode == 204 || response->statusCode == 304) {
+    response->state = HTTP_RESPONSE_COMPLETE;
+  } else if (response->chunked) {
+    response->state = HTTP_RESPONSE_CHUNK_SIZE;
+  } else if (response->contentLength >= 0) {
+    response->remainingLen = response->contentLength;
+    response->state = response->contentLength ? HTTP_RESPONSE_BODY : HTTP_RESPONSE_COMPLETE;
+  } else {
+    response->keepAlive = false;
+    response->state = HTTP_RESPONSE_BODY;
+  }
+}
+
+/**
+ * @brief Parse a complete line: status line, header, chunk size, chunk end or trailer.
+ *
+ * @param response the parser, whose line is complete
+ */
+static void parseHttpResponseLine(http_response_t *response) {
+  char *line = response->line;
+
+  switch (response->state) {
+    case HTTP_RESPONSE_STATUS_LINE:
+      {
+        // HTTP/1.1 200 OK
+        const char *code = strchr(line, ' ');
+        response->statusCode = code ? atoi(code + 1) : 0;
+        if (strncmp(line, "HTTP/1.", 7) != 0 || response->statusCode < 100) {
+          response->state = HTTP_RESPONSE_INVALID;
+          break;
+        }
+        // An HTTP/1.0 connection is closed, unless the server says otherwise
+        response->keepAlive = line[7] != '0';
+        response->state = HTTP_RESPONSE_HEADERS;
+        break;
+      }
+    case HTTP_RESPONSE_HEADERS:
+      if (!response->lineLen) {
+        endHttpResponseHeaders(response);
+      } else if (strncasecmp(line, "Content-Length:", 15) == 0) {
+        response->contentLength = atol(line + 15);
+      } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+        response->chunked = strcasestr(line + 18, "chunked") != NULL;
+      } else if (strncasecmp(line, "Connection:", 11) == 0) {
+        if (strcasestr(line + 11, "close")) {
+          response->keepAlive = false;
+        } else if (strcasestr(line + 11, "keep-alive")) {
+          response->keepAlive = true;
+        }
+      }
+      break;
+    case HTTP_RESPONSE_CHUNK_SIZE:
+      {
+        // Hexadecimal size, maybe followed by extensions. Ex: "1a;name=value"
+        char *end;
+        response->remainingLen = strtoul(line, &end, 16);
+        if (end == line) {
+          response->state = HTTP_RESPONSE_INVALID;
+        } else {
+          response->state = response->remainingLen ? HTTP_RESPONSE_CHUNK_DATA : HTTP_RESPONSE_TRAILERS;
+        }
+        break;
+      }
+    case HTTP_RESPONSE_CHUNK_END:
+      response->state = response->lineLen ? HTTP_RESPONSE_INVALID : HTTP_RESPONSE_CHUNK_SIZE;
+      break;
+    case HTTP_RESPONSE_TRAILERS:
+      if (!response->lineLen) {
+        response->state = HTTP_RESPONSE_COMPLETE;
+      }
+      break;
+  }
+}
+
+/**
+ * @brief Parse the next bytes of the response.
+ *
+ * The lines are read byte by byte, the body and the chunk data by blocks.
+ * The response is complete at the end of its Content-Length, after its last chunk
+ * and its trailers, or, without both, when the server closes the connection: see endHttpResponse().
+ *
+ * @param response the parser
+ * @param data     the bytes received
+ * @param len      the number of bytes
+ *
+ * @return the number of bytes parsed, less than len when the response completes before them
+ */
+size_t parseHttpResponse(http_response_t *response, const uint8_t *data, size_t len) {
+  size_t i = 0;
+
+  while (i < len && isHttpResponsePending(response)) {
+    if (response->state == HTTP_RESPONSE_BODY || response->state == HTTP_RESPONSE_CHUNK_DATA) {
+      bool untilClose = response->state == HTTP_RESPONSE_BODY && response->contentLength < 0;
+      size_t blockLen = len - i;
+      if (!untilClose && response->remainingLen < blockLen) {
+        blockLen = response->remainingLen;
+      }
+      appendHttpResponseBody(response, data + i, blockLen);
+      i += blockLen;
+      if (!untilClose) {
+        response->remainingLen -= blockLen;
+        if (!response->remainingLen) {
+          response->state = response->state == HTTP_RESPONSE_BODY ? HTTP_RESPONSE_COMPLETE : HTTP_RESPONSE_CHUNK_END;
+        }
+      }
+      continue;
+    }
+    char c = data[i++];
+    if (c != '\n') {
+      if (c != '\r' && response->lineLen < sizeof(response->line) - 1) {
+        response->line[response->lineLen++] = c;
+      }
+      continue;
+    }
+    response->line[response->lineLen] = 0;
+    parseHttpResponseLine(response);
+    response->lineLen = 0;
+  }
+  return i;
+}
+
+/**
+ * @brief Tell the parser that the server closed the connection.
+ *        It completes a body delimited by the end of the connection, else the response is truncated.
+ *
+ * @param response the parser
+ */
+void endHttpResponse(http_response_t *response) {
+  response->keepAlive = false;
+  if (response->state == HTTP_RESPONSE_BODY && response->contentLength < 0) {
+    response->state = HTTP_RESPONSE_COMPLETE;
+  } else if (isHttpResponsePending(response)) {
+    response->state = HTTP_RESPONSE_INVALID;
+  }
+}
+
+/**
+ * @brief Tell whether the response has been read up to its end.
+ *
+ * @param response the parser
+ *
+ * @return true when it is complete
+ */
+bool isHttpResponseComplete(const http_response_t *response) {
+  return response->state == HTTP_RESPONSE_COMPLETE;
+}
+
+/**
+ * @brief Tell whether more bytes are expected.
+ *
+ * @param response the parser
+ *
+ * @return true when the response is neither complete nor invalid
+ */
+bool isHttpResponsePending(const http_response_t *response) {
+  return response->state < HTTP_RESPONSE_COMPLETE;
+}
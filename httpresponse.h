@@ -0,0 +1,90 @@
+#ifndef HTTPRESPONSE_H
+#define HTTPRESPONSE_H
+
+#include "Arduino.h"
+
+// Maximum length of a line of the response status, headers and chunk sizes, longer ones are truncated
+#define HTTP_RESPONSE_LINE_MAX_SIZE 128
+
+/**
+ * States of the HTTP response parser.
+ */
+typedef enum {
+  HTTP_RESPONSE_STATUS_LINE = 0,  // Reading the status line. Ex: "HTTP/1.1 200 OK"
+  HTTP_RESPONSE_HEADERS = 1,      // Reading the header lines, up to the empty line
+  HTTP_RESPONSE_BODY = 2,         // Reading a body delimited by its Content-Length or by the end of the connection
+  HTTP_RESPONSE_CHUNK_SIZE = 3,   // Reading the hexadecimal size line of a chunk
+  HTTP_RESPONSE_CHUNK_DATA = 4,   // Reading the data of a chunk
+  HTTP_RESPONSE_CHUNK_END = 5,    // Reading the line break ending the data of a chunk
+  HTTP_RESPONSE_TRAILERS = 6,     // Reading the trailer lines after the last chunk, up to the empty line
+  HTTP_RESPONSE_COMPLETE = 7,     // The response is complete
+  HTTP_RESPONSE_INVALID = 8       // The response is malformed or truncated
+} http_response_state_t;
+
+/**
+ * Incremental parser of an HTTP/1.x response, fed with the bytes as they arrive,
+ * so the response is known complete as soon as its last byte is received.
+ *
+ * @see parseHttpResponse()
+ */
+typedef struct {
+  uint8_t state;                                    // See http_response_state_t
+  int statusCode;                                   // Status code of the final response, 0 until its status line is read
+  bool keepAlive;                                   // False when the server closes the connection after the response
+  bool chunked;                                     // True with "Transfer-Encoding: chunked"
+  bool headersRead;                                 // True once the headers of the final response are read
+  int32_t contentLength;                            // Content-Length of the body, -1 when not given
+  uint32_t remainingLen;                            // Bytes left of the body or of the current chunk
+  uint32_t bodyLen;                                 // Bytes of the body read so far
+  char *body;                                       // Buffer receiving the beginning of the body as a string, NULL to skip it
+  size_t bodySize;                                  // Size of body
+  size_t lineLen;                                   // Length of line
+  char line[HTTP_RESPONSE_LINE_MAX_SIZE];           // Line being read
+} http_response_t;
+
+/**
+ * @brief Initialize the parser before the response.
+ *
+ * @param response the parser
+ * @param body     the buffer receiving the beginning of the body as a string, NULL to skip it
+ * @param bodySize the size of body
+ */
+void initHttpResponse(http_response_t *response, char *body, size_t bodySize);
+
+/**
+ * @brief Parse the next bytes of the response.
+ *
+ * @param response the parser
+ * @param data     the bytes received
+ * @param len      the number of bytes
+ *
+ * @return the number of bytes parsed, less than len when the response completes before them
+ */
+size_t parseHttpResponse(http_response_t *response, const uint8_t *data, size_t len);
+
+/**
+ * @brief Tell the parser that the server closed the connection.
+ *
+ * @param response the parser
+ */
+void endHttpResponse(http_response_t *response);
+
+/**
+ * @brief Tell whether the response has been read up to its end.
+ *
+ * @param response the parser
+ *
+ * @return true when it is complete
+ */
+bool isHttpResponseComplete(const http_response_t *response);
+
+/**
+ * @brief Tell whether more bytes are expected.
+ *
+ * @param response the parser
+ *
+ * @return true when the response is neither complete nor invalid
+ */
+bool isHttpResponsePending(const http_response_t *response);
+
+#endif
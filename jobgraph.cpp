@@ -0,0 +1,211 @@
+#include "jobgraph.h"
+
+// Event group bit set when the job at the given index is done (run or skipped)
+#define JOB_DONE_BIT(INDEX) JOB_BIT(INDEX)
+// Event group bit set when the job at the given index failed or has been skipped
+#define JOB_FAILED_BIT(INDEX) JOB_BIT((INDEX) + JOB_GRAPH_MAX_JOBS)
+
+/**
+ * Parameter given to the FreeRTOS task running a job.
+ */
+typedef struct {
+  job_t *job;                // The job to run
+  uint8_t index;             // Index of the job in the graph
+  void *context;             // Context given to the job function
+  EventGroupHandle_t events; // Event group signaled when the job is done
+} job_task_param_t;
+
+/**
+ * @brief Run a job and measure its duration.
+ *
+ * @param job     the job to run
+ * @param context the context given to the job function
+ */
+static void runJob(job_t *job, void *context) {
+  job->startUs = micros();
+  job->result = job->run(context);
+  job->endUs = micros();
+}
+
+/**
+ * @brief FreeRTOS task running one job, then signaling
+ *        its completion to the scheduler through the event group.
+ *
+ * @param param a job_task_param_t
+ */
+static void runJobTask(void *param) {
+  job_task_param_t *taskParam = (job_task_param_t *)param;
+  runJob(taskParam->job, taskParam->context);
+  xEventGroupSetBits(taskParam->events,
+                     JOB_DONE_BIT(taskParam->index) | (taskParam->job->result != IS_OK ? JOB_FAILED_BIT(taskParam->index) : 0));
+  vTaskDelete(NULL);
+}
+
+/**
+ * @brief Run the jobs of the graph, each one as soon as its dependencies succeeded.
+ *
+ * The calling task acts as the scheduler: it launches one FreeRTOS task
+ * per ready job, pinned on the job core, then waits for any running job
+ * to complete before looking for newly ready jobs.
+ * So, independent jobs run concurrently on both cores, while the number
+ * of living tasks (and their stacks) is bounded by the graph width.
+ * A job whose dependency failed is not run: it is marked as skipped
+ * and inherits the result of the failed dependency.
+ * Should a task not be created, the job is run by the calling task.
+ * So are all the jobs, in their topological order, should the event group not be created.
+ *
+ * @param jobs     the job array, in a topological order
+ * @param jobCount the number of jobs, JOB_GRAPH_MAX_JOBS at most
+ * @param context  the pointer given to each job function
+ *
+ * @return IS_OK when all jobs succeeded, else the result of the first failed job
+ */
+status_code_t runJobGraph(job_t *jobs, uint8_t jobCount, void *context) {
+  if (jobCount > JOB_GRAPH_MAX_JOBS) {
+    logError(JOB_GRAPH_LOG, "%s: %d jobs exceed the maximum of %d. Extra jobs are ignored.", __func__, jobCount, JOB_GRAPH_MAX_JOBS);
+    jobCount = JOB_GRAPH_MAX_JOBS;
+  }
+
+  EventGroupHandle_t events = xEventGroupCreate();
+  if (!events) {
+    logWarn(JOB_GRAPH_LOG, "%s: failed to create the event group. Run the jobs inline.", __func__);
+  }
+  job_task_param_t taskParams[JOB_GRAPH_MAX_JOBS];
+  uint32_t allJobs = JOB_BIT(jobCount) - 1;
+  uint32_t launchedJobs = 0;
+  uint32_t doneJobs = 0;
+  uint32_t failedJobs = 0;
+
+  for (uint8_t i = 0; i < jobCount; i++) {
+    // Only jobs declared before can be waited for: it guarantees there is no cycle.
+    if (jobs[i].dependencies & ~(JOB_BIT(i) - 1)) {
+      logWarn(JOB_GRAPH_LOG, "%s: job %s depends on jobs declared after it. These dependencies are ignored.", __func__, jobs[i].name);
+      jobs[i].dependencies &= JOB_BIT(i) - 1;
+    }
+    jobs[i].result = IS_OK;
+    jobs[i].skipped = false;
+  }
+
+  while (doneJobs != allJobs) {
+    // Launch all the jobs whose dependencies are done
+    for (uint8_t i = 0; i < jobCount; i++) {
+      job_t *job = &(jobs[i]);
+      if ((launchedJobs & JOB_BIT(i)) || (job->dependencies & doneJobs) != job->dependencies) {
+        continue;
+      }
+      launchedJobs |= JOB_BIT(i);
+
+      if (job->dependencies & failedJobs) {
+        // Skip the job and propagate the failure to its own dependents
+        uint8_t failedDependency = 0;
+        while (!(job->dependencies & failedJobs & JOB_BIT(failedDependency))) failedDependency++;
+        job->result = jobs[failedDependency].result;
+        job->skipped = true;
+        job->startUs = job->endUs = micros();
+        doneJobs |= JOB_BIT(i);
+        failedJobs |= JOB_BIT(i);
+        logWarn(JOB_GRAPH_LOG, "%s: job %s skipped because job %s did not succeed.", __func__, job->name, jobs[failedDependency].name);
+        continue;
+      }
+
+      logDebug(JOB_GRAPH_LOG, "%s: launch job %s.", __func__, job->name);
+      taskParams[i] = { job, i, context, events };
+      if (!events || xTaskCreatePinnedToCore(runJobTask, job->name, JOB_GRAPH_TASK_STACK_SIZE, &(taskParams[i]),
+                                             JOB_GRAPH_TASK_PRIORITY, NULL, job->core == JOB_ANY_CORE ? tskNO_AFFINITY : job->core)
+          != pdPASS) {
+        if (events) {
+          logWarn(JOB_GRAPH_LOG, "%s: failed to create the task of job %s. Run it inline.", __func__, job->name);
+        }
+        runJob(job, context);
+        doneJobs |= JOB_BIT(i);
+        if (job->result != IS_OK) {
+          failedJobs |= JOB_BIT(i);
+        }
+      }
+    }
+
+    // Wait for any running job to be done
+    uint32_t runningJobs = launchedJobs & ~doneJobs;
+    if (runningJobs) {
+      EventBits_t bits = xEventGroupWaitBits(events, runningJobs, pdFALSE, pdFALSE, portMAX_DELAY);
+      doneJobs |= bits & allJobs;
+      failedJobs |= (bits >> JOB_GRAPH_MAX_JOBS) & allJobs;
+    }
+  }
+
+  if (events) {
+    vEventGroupDelete(events);
+  }
+
+  for (uint8_t i = 0; i < jobCount; i++) {
+    if (jobs[i].result != IS_OK) {
+      return jobs[i].result;
+    }
+  }
+  return IS_OK;
+}
+
+/**
+ * @brief Compute the critical path length of a graph which has been run,
+ *        i.e. the longest chain of dependent job durations.
+ *
+ * It is the minimal duration of the graph, whatever the number of cores.
+ * Compared to the sum of all job durations, it tells how much
+ * the concurrent execution saves.
+ *
+ * @param jobs     the job array given to runJobGraph()
+ * @param jobCount the number of jobs
+ *
+ * @return the critical path length in microseconds
+ */
+uint32_t computeJobGraphCriticalPathUs(job_t *jobs, uint8_t jobCount) {
+  uint32_t pathUs[JOB_GRAPH_MAX_JOBS];
+  uint32_t criticalPathUs = 0;
+
+  for (uint8_t i = 0; i < jobCount && i < JOB_GRAPH_MAX_JOBS; i++) {
+    uint32_t longestDependencyPathUs = 0;
+    for (uint8_t d = 0; d < i; d++) {
+      if ((jobs[i].dependencies & JOB_BIT(d)) && pathUs[d] > longestDependencyPathUs) {
+        longestDependencyPathUs = pathUs[d];
+      }
+    }
+    pathUs[i] = longestDependencyPathUs + (jobs[i].endUs - jobs[i].startUs);
+    if (pathUs[i] > criticalPathUs) {
+      criticalPathUs = pathUs[i];
+    }
+  }
+  return criticalPathUs;
+}
+
+/**
+ * @brief Log the timing of each job of a graph which has been run.
+ *
+ * Start times are relative to the first started job.
+ * It uses the INFO log level.
+ *
+ * @param jobs     the job array given to runJobGraph()
+ * @param jobCount the number of jobs
+ */
+void logJobGraph(job_t *jobs, uint8_t jobCount) {
+  uint32_t firstStartUs = jobs[0].startUs;
+  uint32_t lastEndUs = jobs[0].endUs;
+  uint32_t sumUs = 0;
+
+  for (uint8_t i = 0; i < jobCount; i++) {
+    if ((int32_t)(jobs[i].startUs - firstStartUs) < 0) firstStartUs = jobs[i].startUs;
+    if ((int32_t)(jobs[i].endUs - lastEndUs) > 0) lastEndUs = jobs[i].endUs;
+    sumUs += jobs[i].endUs - jobs[i].startUs;
+  }
+
+  logInfo(JOB_GRAPH_LOG, "Job            |  Start ms | Duration ms | Result");
+  for (uint8_t i = 0; i < jobCount; i++) {
+    logInfo(JOB_GRAPH_LOG, "%-15s| %9lu | %11lu | %s%d", jobs[i].name,
+            (unsigned long)(jobs[i].startUs - firstStartUs) / 1000,
+            (unsigned long)(jobs[i].endUs - jobs[i].startUs) / 1000,
+            jobs[i].skipped ? "skipped " : "", jobs[i].result);
+  }
+  logInfo(JOB_GRAPH_LOG, "Elapsed: %lu ms, critical path: %lu ms, sequential sum: %lu ms.",
+          (unsigned long)(lastEndUs - firstStartUs) / 1000,
+          (unsigned long)computeJobGraphCriticalPathUs(jobs, jobCount) / 1000,
+          (unsigned long)sumUs / 1000);
+}
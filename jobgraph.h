@@ -0,0 +1,85 @@
+#ifndef JOBGRAPH_H
+#define JOBGRAPH_H
+
+#include "Arduino.h"
+#include "error.h"
+#include "logging.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+
+// Logger name for this module
+#define JOB_GRAPH_LOG "JobGraph"
+
+// Maximum number of jobs in a graph.
+// Each job uses two bits of a FreeRTOS event group (done and failed)
+// which provides 24 usable bits.
+#define JOB_GRAPH_MAX_JOBS 12
+// Stack size in bytes of the task running a job
+#define JOB_GRAPH_TASK_STACK_SIZE 8192
+// Priority of the tasks running jobs
+#define JOB_GRAPH_TASK_PRIORITY 1
+// Let FreeRTOS choose the core running a job
+#define JOB_ANY_CORE -1
+
+// Dependency bit of the job at the given index in the graph
+#define JOB_BIT(INDEX) (1UL << (INDEX))
+
+/**
+ * Function run by a job.
+ * The context is the one given to runJobGraph().
+ *
+ * @return IS_OK when the job succeeds.
+ *         Any other status code makes the dependent jobs skipped.
+ */
+typedef status_code_t (*job_run_t)(void *context);
+
+/**
+ * One job of a graph, i.e. one phase of the wake cycle.
+ * Jobs are declared in an array, in a topological order:
+ * a job can only depend on jobs declared before it.
+ *
+ * @see runJobGraph()
+ */
+typedef struct {
+  const char *name;       // Job name, used by logs
+  job_run_t run;          // Function to run
+  uint32_t dependencies;  // JOB_BIT() of the jobs which must succeed before running this one
+  int8_t core;            // Core running the job: 0, 1 or JOB_ANY_CORE
+  status_code_t result;   // Output. Result of the job or of the first failed dependency
+  bool skipped;           // Output. True when the job has not been run because of a failed dependency
+  uint32_t startUs;       // Output. Start time in micros()
+  uint32_t endUs;         // Output. End time in micros()
+} job_t;
+
+/**
+ * @brief Run the jobs of the graph, each one as soon as its dependencies succeeded.
+ *
+ * @param jobs     the job array, in a topological order
+ * @param jobCount the number of jobs, JOB_GRAPH_MAX_JOBS at most
+ * @param context  the pointer given to each job function
+ *
+ * @return IS_OK when all jobs succeeded, else the result of the first failed job
+ */
+status_code_t runJobGraph(job_t *jobs, uint8_t jobCount, void *context);
+
+/**
+ * @brief Compute the critical path length of a graph which has been run,
+ *        i.e. the longest chain of dependent job durations.
+ *
+ * @param jobs     the job array given to runJobGraph()
+ * @param jobCount the number of jobs
+ *
+ * @return the critical path length in microseconds
+ */
+uint32_t computeJobGraphCriticalPathUs(job_t *jobs, uint8_t jobCount);
+
+/**
+ * @brief Log the timing of each job of a graph which has been run.
+ *
+ * @param jobs     the job array given to runJobGraph()
+ * @param jobCount the number of jobs
+ */
+void logJobGraph(job_t *jobs, uint8_t jobCount);
+
+#endif
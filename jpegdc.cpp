@@ -0,0 +1,568 @@
+#include <stdlib.h>
+#include <string.h>
+#include "jpegdc.h"
+
+// JPEG markers
+#define JPEG_SOF0 0xC0
+#define JPEG_SOF1 0xC1
+#define JPEG_DHT 0xC4
+#define JPEG_RST0 0xD0
+#define JPEG_RST7 0xD7
+#define JPEG_SOI 0xD8
+#define JPEG_EOI 0xD9
+#define JPEG_SOS 0xDA
+#define JPEG_DQT 0xDB
+#define JPEG_DRI 0xDD
+
+/**
+ * Huffman table, decoded by a lookup of its first JPEGDC_LOOKUP_BITS bits
+ * and by the canonical code ranges beyond.
+ */
+typedef struct {
+  uint16_t lookup[1 << JPEGDC_LOOKUP_BITS];  // (code length << 8) | symbol, 0 when the code is longer
+  int32_t maxCode[17];                       // Largest code of each length, -1 when there is none
+  int32_t valueOffset[17];                   // Index of the symbols of each length minus their first code
+  uint8_t values[256];                       // Symbols, in code order
+  bool defined;
+} huffman_table_t;
+
+/**
+ * Frame component, i.e. Y, Cb or Cr.
+ */
+typedef struct {
+  uint8_t id;
+  uint8_t h;             // Horizontal sampling factor
+  uint8_t v;             // Vertical sampling factor
+  uint8_t quantTable;    // Quantization table index
+  uint8_t dcTable;       // DC Huffman table index
+  uint8_t acTable;       // AC Huffman table index
+  int32_t predictor;     // DC value of the previous block
+  int64_t dcSum;         // Sum of the DC values of the blocks
+} component_t;
+
+/**
+ * Reader of the entropy coded data: it removes the stuffed zeros
+ * and stops at the next marker, without reading it.
+ */
+typedef struct {
+  const uint8_t *data;
+  size_t len;
+  size_t position;
+  uint32_t bits;         // Read bits, left aligned
+  uint8_t bitCount;      // Number of read bits
+  uint8_t padding;       // Number of zero bytes fed after the end of the data
+} bit_reader_t;
+
+/**
+ * Decoder state, too large for a task stack.
+ */
+typedef struct {
+  huffman_table_t dcTables[4];
+  huffman_table_t acTables[4];
+  uint16_t quantDc[4];   // DC quantization value of each table
+  component_t components[JPEGDC_MAX_COMPONENTS];
+  uint8_t componentCount;
+  uint8_t hMax;
+  uint8_t vMax;
+  uint16_t restartInterval;
+  uint32_t lumaColumns;  // Number of luminance blocks in a row of the frame
+  uint32_t lumaRows;     // Number of luminance blocks in a column of the frame
+  int32_t thumbnailSums[JPEGDC_THUMBNAIL_HEIGHT][JPEGDC_THUMBNAIL_WIDTH];     // Sum of the luminance DC values of each cell
+  uint32_t thumbnailCounts[JPEGDC_THUMBNAIL_HEIGHT][JPEGDC_THUMBNAIL_WIDTH];  // Number of luminance blocks of each cell
+  bit_reader_t reader;
+} jpeg_decoder_t;
+
+static uint16_t readUint16(const uint8_t *data) {
+  return (data[0] << 8) | data[1];
+}
+
+static uint8_t clampSample(int64_t value) {
+  return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+/**
+ * @brief Build a Huffman table from the code counts of each length and the symbols.
+ *
+ * @return false when the table is invalid
+ */
+static bool buildHuffmanTable(huffman_table_t *table, const uint8_t *counts, const uint8_t *values, uint16_t valueCount) {
+  int32_t code = 0;
+  uint16_t index = 0;
+
+  memset(table, 0, sizeof(huffman_table_t));
+  memcpy(table->values, values, valueCount);
+  for (uint8_t length = 1; length <= 16; length++) {
+    table->valueOffset[length] = index - code;
+    for (uint8_t i = 0; i < counts[length - 1]; i++, index++, code++) {
+      if (code >= (1 << length)) {
+        return false;
+      }
+      if (length <= JPEGDC_LOOKUP_BITS) {
+        uint16_t shift = JPEGDC_LOOKUP_BITS - length;
+        for (uint16_t fill = 0; fill < (1 << shift); fill++) {
+          table->lookup[(code << shift) | fill] = (length << 8) | values[index];
+        }
+      }
+    }
+    table->maxCode[length] = counts[length - 1] ? code - 1 : -1;
+    code <<= 1;
+  }
+  table->defined = true;
+  return true;
+}
+
+/**
+ * @brief Fill the bit buffer up to 25 bits at least.
+ *        Past a marker or the end of the data, zero bytes are fed and counted.
+ */
+static void fillBits(bit_reader_t *reader) {
+  while (reader->bitCount <= 24) {
+    uint8_t byte = 0;
+    if (reader->position < reader->len && !(reader->data[reader->position] == 0xFF
+        && (reader->position + 1 >= reader->len || reader->data[reader->position + 1] != 0x00))) {
+      byte = reader->data[reader->position++];
+      if (byte == 0xFF) {
+        // Stuffed zero
+        reader->position++;
+      }
+    } else {
+      reader->padding++;
+    }
+    reader->bits |= (uint32_t)byte << (24 - reader->bitCount);
+    reader->bitCount += 8;
+  }
+}
+
+static uint32_t peekBits(bit_reader_t *reader, uint8_t count) {
+  if (reader->bitCount < count) {
+    fillBits(reader);
+  }
+  return reader->bits >> (32 - count);
+}
+
+static void skipBits(bit_reader_t *reader, uint8_t count) {
+  reader->bits <<= count;
+  reader->bitCount -= count;
+}
+
+/**
+ * @brief Read a value of the given size, sign extended as JPEG does.
+ */
+static int32_t readValue(bit_reader_t *reader, uint8_t size) {
+  if (!size) {
+    return 0;
+  }
+  int32_t value = peekBits(reader, size);
+  skipBits(reader, size);
+  return value < (1 << (size - 1)) ? value - (1 << size) + 1 : value;
+}
+
+/**
+ * @brief Decode a Huffman symbol.
+ *
+ * @return the symbol, -1 when the code is invalid
+ */
+static int16_t decodeSymbol(bit_reader_t *reader, const huffman_table_t *table) {
+  uint16_t entry = table->lookup[peekBits(reader, JPEGDC_LOOKUP_BITS)];
+  if (entry) {
+    skipBits(reader, entry >> 8);
+    return entry & 0xFF;
+  }
+  for (uint8_t length = JPEGDC_LOOKUP_BITS + 1; length <= 16; length++) {
+    int32_t code = peekBits(reader, length);
+    if (code <= table->maxCode[length]) {
+      skipBits(reader, length);
+      return table->values[table->valueOffset[length] + code];
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Decode a block: keep its DC value and skip its AC coefficients.
+ *
+ * @return false when the data are corrupted
+ */
+static bool decodeBlock(jpeg_decoder_t *decoder, component_t *component) {
+  bit_reader_t *reader = &decoder->reader;
+  int16_t symbol = decodeSymbol(reader, &decoder->dcTables[component->dcTable]);
+  if (symbol < 0 || symbol > 11) {
+    return false;
+  }
+  component->predictor += readValue(reader, symbol);
+  component->dcSum += component->predictor;
+
+  const huffman_table_t *acTable = &decoder->acTables[component->acTable];
+  for (uint8_t k = 1; k < 64; k++) {
+    if ((symbol = decodeSymbol(reader, acTable)) < 0) {
+      return false;
+    }
+    uint8_t run = symbol >> 4;
+    uint8_t size = symbol & 0x0F;
+    if (!size) {
+      if (run != 15) {
+        // End of block
+        break;
+      }
+      k += 15;
+    } else {
+      k += run;
+      if (reader->bitCount < size) {
+        fillBits(reader);
+      }
+      skipBits(reader, size);
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Add the DC value of a luminance block to the cell of the thumbnail containing it.
+ *        The blocks padding the last MCUs, outside of the frame, are ignored.
+ *
+ * @param column the block column
+ * @param row    the block row
+ * @param value  the DC value of the block
+ */
+static void addToThumbnail(jpeg_decoder_t *decoder, uint32_t column, uint32_t row, int32_t value) {
+  if (column < decoder->lumaColumns && row < decoder->lumaRows) {
+    uint32_t x = column * JPEGDC_THUMBNAIL_WIDTH / decoder->lumaColumns;
+    uint32_t y = row * JPEGDC_THUMBNAIL_HEIGHT / decoder->lumaRows;
+    decoder->thumbnailSums[y][x] += value;
+    decoder->thumbnailCounts[y][x]++;
+  }
+}
+
+/**
+ * @brief Move the reader to the next marker, past the data already buffered.
+ *        They are the last bits of the interval or of the scan.
+ */
+static void skipToMarker(bit_reader_t *reader) {
+  while (reader->position + 1 < reader->len
+         && !(reader->data[reader->position] == 0xFF && reader->data[reader->position + 1] != 0x00)) {
+    reader->position += reader->data[reader->position] == 0xFF ? 2 : 1;
+  }
+}
+
+/**
+ * @brief Go past the restart marker expected at the end of the interval.
+ *
+ * @return false when it is missing
+ */
+static bool readRestartMarker(jpeg_decoder_t *decoder) {
+  bit_reader_t *reader = &decoder->reader;
+  skipToMarker(reader);
+  if (reader->position + 1 >= reader->len || reader->data[reader->position] != 0xFF
+      || reader->data[reader->position + 1] < JPEG_RST0 || reader->data[reader->position + 1] > JPEG_RST7) {
+    return false;
+  }
+  reader->position += 2;
+  reader->bits = 0;
+  reader->bitCount = 0;
+  reader->padding = 0;
+  for (uint8_t c = 0; c < decoder->componentCount; c++) {
+    decoder->components[c].predictor = 0;
+  }
+  return true;
+}
+
+/**
+ * @brief Decode the entropy coded data of the scan starting at the given position.
+ *
+ * @return the position following the data, 0 when they are corrupted
+ */
+static size_t decodeScan(jpeg_decoder_t *decoder, const uint8_t *data, size_t len, size_t position,
+                         component_t **scanComponents, uint8_t scanComponentCount, jpeg_dc_t *dc) {
+  bit_reader_t *reader = &decoder->reader;
+  uint32_t mcuColumns;
+  uint32_t mcuRows;
+
+  if (scanComponentCount == 1) {
+    // Non interleaved scan: one block per MCU
+    component_t *component = scanComponents[0];
+    mcuColumns = ((uint32_t)dc->width * component->h / decoder->hMax + 7) / 8;
+    mcuRows = ((uint32_t)dc->height * component->v / decoder->vMax + 7) / 8;
+  } else {
+    mcuColumns = (dc->width + 8 * decoder->hMax - 1) / (8 * decoder->hMax);
+    mcuRows = (dc->height + 8 * decoder->vMax - 1) / (8 * decoder->vMax);
+  }
+
+  memset(reader, 0, sizeof(bit_reader_t));
+  reader->data = data;
+  reader->len = len;
+  reader->position = position;
+  for (uint32_t mcu = 0; mcu < mcuColumns * mcuRows; mcu++) {
+    if (decoder->restartInterval && mcu && mcu % decoder->restartInterval == 0 && !readRestartMarker(decoder)) {
+      dc->error = "missing restart marker";
+      return 0;
+    }
+    for (uint8_t c = 0; c < scanComponentCount; c++) {
+      component_t *component = scanComponents[c];
+      uint8_t blockCount = scanComponentCount == 1 ? 1 : component->h * component->v;
+      for (uint8_t b = 0; b < blockCount; b++) {
+        if (!decodeBlock(decoder, component)) {
+          dc->error = "corrupted entropy coded data";
+          return 0;
+        }
+        dc->blockCount[component - decoder->components]++;
+        if (component == decoder->components) {
+          if (scanComponentCount == 1) {
+            addToThumbnail(decoder, mcu % mcuColumns, mcu / mcuColumns, component->predictor);
+          } else {
+            addToThumbnail(decoder, (mcu % mcuColumns) * component->h + b % component->h,
+                           (mcu / mcuColumns) * component->v + b / component->h, component->predictor);
+          }
+        }
+      }
+    }
+    // The padding fills the bit buffer: more than that means missing data
+    if (reader->padding > 4) {
+      dc->error = "truncated entropy coded data";
+      return 0;
+    }
+  }
+  skipToMarker(reader);
+  return reader->position;
+}
+
+/**
+ * @brief Find the EOI marker at the end of the data, zero padding excluded.
+ */
+static bool endsWithEoi(const uint8_t *data, size_t len) {
+  while (len > 2 && data[len - 1] == 0x00) {
+    len--;
+  }
+  return len >= 4 && data[len - 2] == 0xFF && data[len - 1] == JPEG_EOI;
+}
+
+/**
+ * @brief Parse the frame header (SOF0 or SOF1).
+ */
+static bool readFrameHeader(jpeg_decoder_t *decoder, const uint8_t *segment, uint16_t length, jpeg_dc_t *dc) {
+  if (length < 8 || segment[2] != 8) {
+    dc->error = "unsupported sample precision";
+    return false;
+  }
+  dc->height = readUint16(segment + 3);
+  dc->width = readUint16(segment + 5);
+  decoder->componentCount = segment[7];
+  if (!dc->width || !dc->height || !decoder->componentCount || decoder->componentCount > JPEGDC_MAX_COMPONENTS
+      || length < 8 + 3 * decoder->componentCount) {
+    dc->error = "invalid frame header";
+    return false;
+  }
+  for (uint8_t c = 0; c < decoder->componentCount; c++) {
+    component_t *component = &decoder->components[c];
+    const uint8_t *spec = segment + 8 + 3 * c;
+    component->id = spec[0];
+    component->h = spec[1] >> 4;
+    component->v = spec[1] & 0x0F;
+    component->quantTable = spec[2] & 0x03;
+    if (component->h < 1 || component->h > 2 || component->v < 1 || component->v > 2) {
+      dc->error = "unsupported sampling factors";
+      return false;
+    }
+    decoder->hMax = component->h > decoder->hMax ? component->h : decoder->hMax;
+    decoder->vMax = component->v > decoder->vMax ? component->v : decoder->vMax;
+  }
+  // Blocks of the first component, the luminance, inside the frame
+  decoder->lumaColumns = (((uint32_t)dc->width * decoder->components[0].h + decoder->hMax - 1) / decoder->hMax + 7) / 8;
+  decoder->lumaRows = (((uint32_t)dc->height * decoder->components[0].v + decoder->vMax - 1) / decoder->vMax + 7) / 8;
+  dc->componentCount = decoder->componentCount;
+  return true;
+}
+
+/**
+ * @brief Parse Huffman tables.
+ */
+static bool readHuffmanTables(jpeg_decoder_t *decoder, const uint8_t *segment, uint16_t length, jpeg_dc_t *dc) {
+  uint16_t offset = 2;
+  while (offset + 17 <= length) {
+    uint8_t tableClass = segment[offset] >> 4;
+    uint8_t tableIndex = segment[offset] & 0x0F;
+    const uint8_t *counts = segment + offset + 1;
+    uint16_t valueCount = 0;
+    for (uint8_t i = 0; i < 16; i++) {
+      valueCount += counts[i];
+    }
+    if (tableClass > 1 || tableIndex > 3 || valueCount > 256 || offset + 17 + valueCount > length) {
+      dc->error = "invalid Huffman table";
+      return false;
+    }
+    huffman_table_t *table = tableClass ? &decoder->acTables[tableIndex] : &decoder->dcTables[tableIndex];
+    if (!buildHuffmanTable(table, counts, segment + offset + 17, valueCount)) {
+      dc->error = "invalid Huffman table";
+      return false;
+    }
+    offset += 17 + valueCount;
+  }
+  return true;
+}
+
+/**
+ * @brief Parse quantization tables: only the DC value is kept.
+ */
+static bool readQuantizationTables(jpeg_decoder_t *decoder, const uint8_t *segment, uint16_t length, jpeg_dc_t *dc) {
+  uint16_t offset = 2;
+  while (offset < length) {
+    uint8_t precision = segment[offset] >> 4;
+    uint8_t tableIndex = segment[offset] & 0x0F;
+    uint16_t tableSize = precision ? 128 : 64;
+    if (tableIndex > 3 || offset + 1 + tableSize > length) {
+      dc->error = "invalid quantization table";
+      return false;
+    }
+    decoder->quantDc[tableIndex] = precision ? readUint16(segment + offset + 1) : segment[offset + 1];
+    offset += 1 + tableSize;
+  }
+  return true;
+}
+
+/**
+ * @brief Parse the scan header and decode the scan.
+ *
+ * @return the position following the scan data, 0 in case of failure
+ */
+static size_t readScan(jpeg_decoder_t *decoder, const uint8_t *data, size_t len, size_t position, uint16_t length, jpeg_dc_t *dc) {
+  const uint8_t *segment = data + position;
+  component_t *scanComponents[JPEGDC_MAX_COMPONENTS];
+  uint8_t scanComponentCount = segment[2];
+
+  if (!decoder->componentCount) {
+    dc->error = "scan before the frame header";
+    return 0;
+  }
+  if (!scanComponentCount || scanComponentCount > decoder->componentCount || length < 6 + 2 * scanComponentCount) {
+    dc->error = "invalid scan header";
+    return 0;
+  }
+  for (uint8_t s = 0; s < scanComponentCount; s++) {
+    const uint8_t *spec = segment + 3 + 2 * s;
+    scanComponents[s] = NULL;
+    for (uint8_t c = 0; c < decoder->componentCount; c++) {
+      if (decoder->components[c].id == spec[0]) {
+        scanComponents[s] = &decoder->components[c];
+      }
+    }
+    if (!scanComponents[s] || (spec[1] >> 4) > 3 || (spec[1] & 0x0F) > 3
+        || !decoder->dcTables[spec[1] >> 4].defined || !decoder->acTables[spec[1] & 0x0F].defined) {
+      dc->error = "invalid scan component";
+      return 0;
+    }
+    scanComponents[s]->dcTable = spec[1] >> 4;
+    scanComponents[s]->acTable = spec[1] & 0x0F;
+    scanComponents[s]->predictor = 0;
+  }
+  return decodeScan(decoder, data, len, position + length, scanComponents, scanComponentCount, dc);
+}
+
+/**
+ * @brief Decode the DC coefficients of a baseline JPEG frame.
+ *
+ * The frame is rejected when the SOI or EOI marker is missing, when the entropy coded
+ * data are corrupted or truncated, and when it is not a baseline Huffman JPEG.
+ * Zero padding after the EOI marker is accepted.
+ *
+ * The DC coefficient of a block is 8 times its mean value, level shifted by 128.
+ *
+ * @param data the JPEG data
+ * @param len  the JPEG data length
+ * @param dc   the jpeg_dc_t receiving the result
+ *
+ * @return true when it succeeds, else dc->error gives the reason
+ */
+bool decodeJpegDc(const uint8_t *data, size_t len, jpeg_dc_t *dc) {
+  jpeg_decoder_t *decoder;
+  size_t position = 2;
+  bool scanDecoded = false;
+
+  memset(dc, 0, sizeof(jpeg_dc_t));
+  if (len < 4 || data[0] != 0xFF || data[1] != JPEG_SOI) {
+    dc->error = "missing SOI marker";
+    return false;
+  }
+  if (!endsWithEoi(data, len)) {
+    dc->error = "missing EOI marker";
+    return false;
+  }
+  if (!(decoder = (jpeg_decoder_t *)calloc(1, sizeof(jpeg_decoder_t)))) {
+    dc->error = "out of memory";
+    return false;
+  }
+
+  while (!dc->error) {
+    // Markers may be preceded by fill bytes
+    while (position + 1 < len && data[position] == 0xFF && data[position + 1] == 0xFF) {
+      position++;
+    }
+    if (position + 1 >= len || data[position] != 0xFF) {
+      dc->error = "invalid marker";
+      break;
+    }
+    uint8_t marker = data[position + 1];
+    position += 2;
+    if (marker == JPEG_EOI) {
+      if (!scanDecoded) {
+        dc->error = "no scan";
+      }
+      break;
+    }
+    if (marker >= JPEG_RST0 && marker <= JPEG_RST7) {
+      continue;
+    }
+    if (position + 2 > len || readUint16(data + position) < 2 || position + readUint16(data + position) > len) {
+      dc->error = "truncated segment";
+      break;
+    }
+    uint16_t length = readUint16(data + position);
+    const uint8_t *segment = data + position;
+    switch (marker) {
+      case JPEG_SOF0:
+      case JPEG_SOF1:
+        readFrameHeader(decoder, segment, length, dc);
+        break;
+      case JPEG_DHT:
+        readHuffmanTables(decoder, segment, length, dc);
+        break;
+      case JPEG_DQT:
+        readQuantizationTables(decoder, segment, length, dc);
+        break;
+      case JPEG_DRI:
+        decoder->restartInterval = length >= 4 ? readUint16(segment + 2) : 0;
+        break;
+      case JPEG_SOS:
+        if ((position = readScan(decoder, data, len, position, length, dc))) {
+          scanDecoded = true;
+        }
+        continue;
+      default:
+        if ((marker & 0xF0) == 0xC0 && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+          dc->error = "not a baseline JPEG";
+        }
+        // APPn, COM and others are skipped
+        break;
+    }
+    position += length;
+  }
+
+  if (!dc->error) {
+    for (uint8_t c = 0; c < JPEGDC_MAX_COMPONENTS; c++) {
+      int32_t mean = 128;
+      if (c < decoder->componentCount && dc->blockCount[c]) {
+        component_t *component = &decoder->components[c];
+        mean += component->dcSum * decoder->quantDc[component->quantTable] / (8 * (int64_t)dc->blockCount[c]);
+      }
+      dc->mean[c] = clampSample(mean);
+    }
+    uint16_t lumaQuant = decoder->quantDc[decoder->components[0].quantTable];
+    for (uint8_t y = 0; y < JPEGDC_THUMBNAIL_HEIGHT; y++) {
+      for (uint8_t x = 0; x < JPEGDC_THUMBNAIL_WIDTH; x++) {
+        // A frame smaller than the thumbnail leaves empty cells: they get the mean luminance
+        uint32_t count = decoder->thumbnailCounts[y][x];
+        dc->thumbnail[y][x] = count ? clampSample(128 + (int64_t)decoder->thumbnailSums[y][x] * lumaQuant / (8 * (int64_t)count)) : dc->mean[0];
+      }
+    }
+  }
+  free(decoder);
+  return !dc->error;
+}
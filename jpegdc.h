@@ -0,0 +1,55 @@
+#ifndef JPEGDC_H
+#define JPEGDC_H
+
+/**
+ * DC-only decoder of baseline JPEG frames.
+ * It checks the markers and walks the entropy coded data to the end,
+ * but only keeps the DC coefficient of each block, i.e. the block mean:
+ * no dequantization of the AC coefficients and no IDCT.
+ * It gives the mean luminance and chroma of a frame in a few milliseconds,
+ * and a thumbnail of its luminance.
+ *
+ * It only depends on the C library, so it is built as is on the host
+ * to be tested against recorded frames (see host/jpeg-check.cpp).
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Maximum number of components: Y, Cb and Cr
+#define JPEGDC_MAX_COMPONENTS 3
+// Bits of the Huffman lookup tables: longer codes are decoded bit by bit
+#define JPEGDC_LOOKUP_BITS 9
+// Size of the luminance thumbnail, in cells of the frame
+#define JPEGDC_THUMBNAIL_WIDTH 9
+#define JPEGDC_THUMBNAIL_HEIGHT 8
+
+/**
+ * Result of decodeJpegDc().
+ */
+typedef struct {
+  uint16_t width;                           // Frame width in pixels
+  uint16_t height;                          // Frame height in pixels
+  uint8_t componentCount;                   // 1 for grayscale frames, 3 for YCbCr frames
+  uint32_t blockCount[JPEGDC_MAX_COMPONENTS];  // Number of decoded blocks of each component
+  uint8_t mean[JPEGDC_MAX_COMPONENTS];      // Mean value of each component: Y, Cb, Cr. 128 for missing chroma.
+  uint8_t thumbnail[JPEGDC_THUMBNAIL_HEIGHT][JPEGDC_THUMBNAIL_WIDTH];  // Mean luminance of each cell of the frame
+  const char *error;                        // Reason of the failure, NULL when it succeeds
+} jpeg_dc_t;
+
+/**
+ * @brief Decode the DC coefficients of a baseline JPEG frame.
+ *
+ * The frame is rejected when the SOI or EOI marker is missing, when the entropy coded
+ * data are corrupted or truncated, and when it is not a baseline Huffman JPEG.
+ * Zero padding after the EOI marker is accepted.
+ *
+ * @param data the JPEG data
+ * @param len  the JPEG data length
+ * @param dc   the jpeg_dc_t receiving the result
+ *
+ * @return true when it succeeds, else dc->error gives the reason
+ */
+bool decodeJpegDc(const uint8_t *data, size_t len, jpeg_dc_t *dc);
+
+#endif
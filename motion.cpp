@@ -0,0 +1,152 @@
+#include "motion.h"
+
+/**
+ * @brief esp_jpg_decode() reader: copy the JPEG data of the frame buffer.
+ *
+ * @param arg   the gray_frame_t
+ * @param index the offset of the data to read
+ * @param buf   the buffer receiving the data, NULL to skip them
+ * @param len   the length of the data to read
+ *
+ * @return the length of the data read
+ */
+static size_t readJpeg(void *arg, size_t index, uint8_t *buf, size_t len) {
+  const camera_fb_t *fb = ((gray_frame_t *)arg)->fb;
+  if (index >= fb->len) {
+    return 0;
+  }
+  len = min(len, fb->len - index);
+  if (buf) {
+    memcpy(buf, fb->buf + index, len);
+  }
+  return len;
+}
+
+/**
+ * @brief esp_jpg_decode() writer: convert a block of RGB888 pixels to gray.
+ *        A call without data gives the frame size first, then the end of the frame.
+ *
+ * @param arg  the gray_frame_t
+ * @param x    the block left position
+ * @param y    the block top position
+ * @param w    the block width
+ * @param h    the block height
+ * @param data the RGB888 pixels of the block
+ *
+ * @return false to stop the decoding
+ */
+static bool writeGray(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data) {
+  gray_frame_t *frame = (gray_frame_t *)arg;
+
+  if (!data) {
+    if (y) {
+      // End of the frame
+      return true;
+    }
+    if (!frame->pixels) {
+      frame->width = w;
+      frame->height = h;
+      frame->pixels = (uint8_t *)malloc((size_t)w * h);
+    }
+    return frame->pixels && frame->width == w && frame->height == h;
+  }
+
+  uint16_t right = min((uint16_t)(x + w), frame->width);
+  uint16_t bottom = min((uint16_t)(y + h), frame->height);
+  for (uint16_t row = y; row < bottom; row++) {
+    const uint8_t *rgb = data + (size_t)(row - y) * w * 3;
+    uint8_t *gray = frame->pixels + (size_t)row * frame->width;
+    for (uint16_t col = x; col < right; col++, rgb += 3) {
+      // ITU-R BT.601 luma
+      gray[col] = (77 * rgb[0] + 150 * rgb[1] + 29 * rgb[2]) >> 8;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Decode a JPEG frame buffer to a grayscale frame at the MOTION_JPEG_SCALE scale.
+ *
+ * At 1/8 scale, the decoder only uses the DC coefficient of each block:
+ * it is much faster than a full decoding.
+ *
+ * @param fb    the JPEG frame buffer
+ * @param frame the gray_frame_t receiving the pixels. Its size must not change between two decodings.
+ *
+ * @return true when it succeeds
+ */
+bool decodeGrayFrame(const camera_fb_t *fb, gray_frame_t *frame) {
+  frame->fb = fb;
+  return esp_jpg_decode(fb->len, MOTION_JPEG_SCALE, readJpeg, writeGray, frame) == ESP_OK;
+}
+
+/**
+ * @brief Grab a few frames and tell whether something moved between them.
+ *        The frame in which a motion has been detected is the picture.
+ *
+ * The frames are grabbed at the picture size, then decoded at 1/8 scale:
+ * the OV2640 can't switch from JPEG to grayscale without a new initialization.
+ * When the check can't be done, for instance when a frame can't be decoded,
+ * the last frame is the picture: a false trigger is better than a missed bird.
+ *
+ * @param cameraSettings    camera settings containing the thresholds
+ * @param cameraFrameBuffer pointer of pointer of camera frame buffer. Assigned by the function.
+ *
+ * @return IS_OK when something moved, NO_MOTION_DETECTED when nothing moved
+ *         or CAMERA_TAKE_PICTURE_ERROR in case of failure.
+ */
+status_code_t checkMotion(camera_settings_t *cameraSettings, camera_fb_t **cameraFrameBuffer) {
+  framediff_params_t params = { cameraSettings->motionThreshold, MOTION_CELL_THRESHOLD, cameraSettings->motionMinBlobCells };
+  framediff_workspace_t *workspace = (framediff_workspace_t *)malloc(sizeof(framediff_workspace_t));
+  gray_frame_t frames[2] = {};
+  framediff_result_t diff;
+  status_code_t result = NO_MOTION_DETECTED;
+  uint32_t startUs = getTelemetryTimeUs();
+  camera_fb_t *fb;
+
+  *cameraFrameBuffer = NULL;
+  logInfo(MOTION_LOG, "Look for motion.");
+  for (uint8_t i = 0; i < MOTION_FRAME_COUNT && result == NO_MOTION_DETECTED; i++) {
+    gray_frame_t *current = &frames[i % 2];
+    gray_frame_t *previous = &frames[(i + 1) % 2];
+    if (i) {
+      delay(MOTION_FRAME_INTERVAL_MS);
+    }
+    if (!(fb = esp_camera_fb_get())) {
+      logError(MOTION_LOG, "Failed to grab frame #%d.", i + 1);
+      result = CAMERA_TAKE_PICTURE_ERROR;
+      break;
+    }
+    if (!workspace || !decodeGrayFrame(fb, current)) {
+      logError(MOTION_LOG, "Failed to decode frame #%d: the motion check is skipped.", i + 1);
+      result = IS_OK;
+    } else if (i) {
+      if (!framediffCompare(previous->pixels, current->pixels, current->width, current->height, &params, workspace, &diff)) {
+        logError(MOTION_LOG, "Frame size %dx%d not supported: the motion check is skipped.", current->width, current->height);
+        result = IS_OK;
+      } else {
+        logDebug(MOTION_LOG, "Frame #%d: %d changed pixel(s), %d changed cell(s), largest blob of %d cell(s), brightness shift %d.",
+                 i + 1, diff.changedPixels, diff.changedCells, diff.largestBlobCells, diff.brightnessShift);
+        if (diff.motion) {
+          result = IS_OK;
+        }
+      }
+    }
+    if (result == IS_OK) {
+      *cameraFrameBuffer = fb;
+    } else {
+      esp_camera_fb_return(fb);
+    }
+  }
+
+  if (result == NO_MOTION_DETECTED) {
+    logInfo(MOTION_LOG, "Nothing moved.");
+  } else if (result == IS_OK) {
+    logInfo(MOTION_LOG, "Done.");
+  }
+  free(frames[0].pixels);
+  free(frames[1].pixels);
+  free(workspace);
+  recordPhase(TELEMETRY_PHASE_MOTION, startUs, result);
+  return result;
+}
@@ -0,0 +1,69 @@
+#ifndef MOTION_H
+#define MOTION_H
+
+#include "Arduino.h"
+#include "error.h"
+#include "logging.h"
+#include "camera.h"
+#include "esp_camera.h"
+#include "esp_jpg_decode.h"
+#include "framediff.h"
+#include "telemetry.h"
+
+// Logger name for this module
+#define MOTION_LOG "Motion"
+
+// Default value of camera_settings_t.motionCheck
+#define MOTION_CHECK_DEFAULT false
+// Default value of camera_settings_t.motionThreshold
+#define MOTION_THRESHOLD_DEFAULT 24
+// Default value of camera_settings_t.motionMinBlobCells
+#define MOTION_MIN_BLOB_CELLS_DEFAULT 6
+
+// Maximum number of frames grabbed to look for motion
+#define MOTION_FRAME_COUNT 3
+// Interval between two grabbed frames
+#define MOTION_FRAME_INTERVAL_MS 150
+// Scale of the JPEG decoding: 1/8, i.e. 128x96 for XGA frames
+#define MOTION_JPEG_SCALE JPG_SCALE_8X
+// Minimum number of changed pixels of a changed cell, out of FRAMEDIFF_CELL_SIZE^2
+#define MOTION_CELL_THRESHOLD 4
+
+/**
+ * Grayscale frame decoded from a JPEG frame buffer.
+ *
+ * @see decodeGrayFrame()
+ */
+typedef struct {
+  const camera_fb_t *fb;  // JPEG frame buffer being decoded
+  uint8_t *pixels;        // Grayscale pixels, allocated by the first decoding
+  uint16_t width;         // Frame width in pixels
+  uint16_t height;        // Frame height in pixels
+} gray_frame_t;
+
+/**
+ * @brief Grab a few frames and tell whether something moved between them.
+ *        The frame in which a motion has been detected is the picture.
+ *
+ * When the check can't be done, for instance when a frame can't be decoded,
+ * the last frame is the picture: a false trigger is better than a missed bird.
+ *
+ * @param cameraSettings    camera settings containing the thresholds
+ * @param cameraFrameBuffer pointer of pointer of camera frame buffer. Assigned by the function.
+ *
+ * @return IS_OK when something moved, NO_MOTION_DETECTED when nothing moved
+ *         or CAMERA_TAKE_PICTURE_ERROR in case of failure.
+ */
+status_code_t checkMotion(camera_settings_t *cameraSettings, camera_fb_t **cameraFrameBuffer);
+
+/**
+ * @brief Decode a JPEG frame buffer to a grayscale frame at the MOTION_JPEG_SCALE scale.
+ *
+ * @param fb    the JPEG frame buffer
+ * @param frame the gray_frame_t receiving the pixels. Its size must not change between two decodings.
+ *
+ * @return true when it succeeds
+ */
+bool decodeGrayFrame(const camera_fb_t *fb, gray_frame_t *frame);
+
+#endif
@@ -0,0 +1,213 @@
+#include "retention.h"
+
+// Retention state in RTC memory given to initRetention(), else in RAM
+static retention_state_t ramRetentionState;
+static retention_state_t *retentionState = &ramRetentionState;
+
+/**
+ * @brief Give the retention state in RTC memory to the module.
+ *
+ * The state is reset when its magic number is wrong, i.e. after a power on.
+ *
+ * @param state the retention state in RTC memory
+ */
+void initRetention(retention_state_t *state) {
+  retentionState = state;
+  if (state->magic != RETENTION_MAGIC) {
+    memset(state, 0, sizeof(retention_state_t));
+    state->magic = RETENTION_MAGIC;
+  }
+}
+
+/**
+ * @brief Get the free space of the SD card from the space accounting.
+ *
+ * @return the free bytes, 0 when the space is unknown
+ */
+static uint64_t getFreeBytes() {
+  uint64_t totalBytes;
+  uint64_t usedBytes;
+  if (getSdSpace(&totalBytes, &usedBytes) != IS_OK || usedBytes > totalBytes) {
+    return 0;
+  }
+  return totalBytes - usedBytes;
+}
+
+/**
+ * @brief Remove a picture file and mark it as evicted in the catalog,
+ *        even when the file was missing, so it is not looked for again.
+ *
+ * @param storage the storage layout of the pictures, see picture_storage_t
+ * @param index   the picture index
+ * @param record  the catalog record of the picture, a missing one has a 0 index
+ *
+ * @return the number of bytes released
+ */
+static uint64_t evictPicture(uint8_t storage, uint32_t index, catalog_record_t *record) {
+  uint64_t bytes = removePictureByIndex(storage, index);
+  if (record->index != index) {
+    memset(record, 0, sizeof(catalog_record_t));
+    record->index = index;
+  }
+  record->flags |= CATALOG_FLAG_EVICTED;
+  writeCatalogRecord(record);
+  logDebug(RETENTION_LOG, "%s: picture %u evicted, %u bytes released.", __func__, (unsigned int)index, (unsigned int)bytes);
+  return bytes;
+}
+
+/**
+ * @brief Evict the oldest picture files until the free space reaches the low watermark
+ *        or a batch limit is reached.
+ *
+ * The first pass removes the pictures already uploaded or kept on the SD card only as near-duplicates,
+ * from the oldest one. Once none is left, the second pass removes the oldest pictures, whatever their upload state.
+ * The catalog is read by chunks of CATALOG_READ_RECORDS, RETENTION_SCAN_MAX records at most.
+ *
+ * @param storage        the storage layout of the pictures, see picture_storage_t
+ * @param fileCounters   the file counters
+ * @param lastIndex      the index of the last picture which can be evicted, i.e. written on the SD card
+ * @param lowBytes       the low watermark of the free space
+ * @param evictedCount   receiving the number of evicted pictures
+ *
+ * @return the number of bytes released
+ */
+static uint64_t evictPictureFiles(uint8_t storage, fileCounters_t *fileCounters, uint32_t lastIndex, uint64_t lowBytes, uint32_t *evictedCount) {
+  catalog_record_t records[CATALOG_READ_RECORDS];
+  uint32_t firstIndex = 0;
+  uint32_t scannedCount = 0;
+  uint64_t releasedBytes = 0;
+
+  // First pass: the uploaded pictures, up to the upload counter
+  uint32_t uploadedLastIndex = min(fileCounters->uploadedPictureCounter, lastIndex);
+  uint32_t i = max(retentionState->uploadedScanIndex, retentionState->evictedIndex) + 1;
+  for (; i <= uploadedLastIndex && getFreeBytes() < lowBytes && *evictedCount < RETENTION_BATCH_PICTURES && scannedCount < RETENTION_SCAN_MAX;
+       i++, scannedCount++) {
+    if (!firstIndex || i >= firstIndex + CATALOG_READ_RECORDS) {
+      firstIndex = i;
+      readCatalogRecords(firstIndex, records, CATALOG_READ_RECORDS);
+    }
+    catalog_record_t *record = &(records[i - firstIndex]);
+    bool cataloged = record->index == i;
+    // Pictures without catalog record up to the upload counter have been uploaded or skipped as near-duplicates
+    if (!cataloged || (!(record->flags & CATALOG_FLAG_EVICTED) && (record->flags & (CATALOG_FLAG_UPLOADED | CATALOG_FLAG_SD_ONLY)))) {
+      releasedBytes += evictPicture(storage, i, record);
+      (*evictedCount)++;
+    }
+    retentionState->uploadedScanIndex = i;
+  }
+  if (i <= uploadedLastIndex) {
+    return releasedBytes;
+  }
+
+  // Second pass: the oldest pictures, not uploaded or abandoned
+  firstIndex = 0;
+  for (i = retentionState->evictedIndex + 1;
+       i <= lastIndex && getFreeBytes() < lowBytes && *evictedCount < RETENTION_BATCH_PICTURES && scannedCount < RETENTION_SCAN_MAX;
+       i++, scannedCount++) {
+    if (!firstIndex || i >= firstIndex + CATALOG_READ_RECORDS) {
+      firstIndex = i;
+      readCatalogRecords(firstIndex, records, CATALOG_READ_RECORDS);
+    }
+    catalog_record_t *record = &(records[i - firstIndex]);
+    if (record->index != i || !(record->flags & CATALOG_FLAG_EVICTED)) {
+      if (record->index != i || !(record->flags & (CATALOG_FLAG_UPLOADED | CATALOG_FLAG_SD_ONLY))) {
+        logWarn(RETENTION_LOG, "%s: picture %u evicted before being uploaded.", __func__, (unsigned int)i);
+      }
+      releasedBytes += evictPicture(storage, i, record);
+      (*evictedCount)++;
+    }
+    retentionState->evictedIndex = i;
+  }
+  return releasedBytes;
+}
+
+/**
+ * @brief Evict the oldest segments until the free space reaches the low watermark
+ *        or a batch limit is reached.
+ *
+ * A segment is removed as a whole, once all its pictures have been written:
+ * the segment being filled is never evicted. The segments are uploaded in order,
+ * so the oldest one is the first one to be fully uploaded. When it is not,
+ * the upload counter is moved past it rather than marking its pictures in the catalog one by one.
+ *
+ * @param fileCounters the file counters, saved when the upload counter is moved
+ * @param lastIndex    the index of the last picture which can be evicted, i.e. written on the SD card
+ * @param lowBytes     the low watermark of the free space
+ * @param evictedCount receiving the number of evicted pictures
+ *
+ * @return the number of bytes released
+ */
+static uint64_t evictSegments(fileCounters_t *fileCounters, uint32_t lastIndex, uint64_t lowBytes, uint32_t *evictedCount) {
+  char dataPath[SEGMENT_PATH_MAX_SIZE];
+  char indexPath[SEGMENT_PATH_MAX_SIZE];
+  uint64_t releasedBytes = 0;
+
+  for (uint8_t removedCount = 0; removedCount < RETENTION_BATCH_SEGMENTS && getFreeBytes() < lowBytes; removedCount++) {
+    uint32_t segment = retentionState->evictedIndex / SEGMENT_PICTURE_COUNT;
+    if ((segment + 1) * SEGMENT_PICTURE_COUNT > lastIndex) {
+      break;
+    }
+    computeSegmentPaths(segment, dataPath, indexPath);
+    releasedBytes += removeSdFile(dataPath) + removeSdFile(indexPath);
+    retentionState->evictedIndex = (segment + 1) * SEGMENT_PICTURE_COUNT;
+    *evictedCount += SEGMENT_PICTURE_COUNT;
+    logInfo(RETENTION_LOG, "%s: segment %u evicted.", __func__, (unsigned int)segment);
+  }
+  if (fileCounters->uploadedPictureCounter < retentionState->evictedIndex) {
+    logWarn(RETENTION_LOG, "%s: pictures %u to %u evicted before being uploaded.", __func__,
+            (unsigned int)fileCounters->uploadedPictureCounter + 1, (unsigned int)retentionState->evictedIndex);
+    fileCounters->uploadedPictureCounter = retentionState->evictedIndex;
+    saveFileCounters(fileCounters);
+  }
+  return releasedBytes;
+}
+
+/**
+ * @brief Remove a batch of the oldest pictures when the free space of the SD card is below the low watermark,
+ *        the ones already uploaded first.
+ *
+ * It is meant to run in the idle time of the wake cycle, i.e. the pause before the deep sleep,
+ * not on the capture path: a batch removes RETENTION_BATCH_PICTURES pictures
+ * or RETENTION_BATCH_SEGMENTS segments at most, and the next wake cycles go on.
+ * The free space comes from the space accounting, see getSdSpace(): the SD card is not scanned,
+ * nor mounted when there is nothing to evict.
+ * The pictures queued by writePictureBehind() and not written yet are not evicted.
+ * The batch is recorded in the telemetry with the number of bytes released.
+ *
+ * @param storage        the storage layout of the pictures, see picture_storage_t
+ * @param freeSpaceLowMB the low watermark of the free space in MB, 0 to disable the eviction
+ *
+ * @return IS_OK when nothing has to be evicted or when it succeeds.
+ *         SD_INIT_ERROR or SD_READ_ERROR in case of failure
+ */
+status_code_t evictPictures(uint8_t storage, uint16_t freeSpaceLowMB) {
+  uint64_t lowBytes = (uint64_t)freeSpaceLowMB * 1024 * 1024;
+  uint64_t freeBytes;
+  status_code_t result;
+  fileCounters_t fileCounters;
+  uint32_t evictedCount = 0;
+  uint64_t releasedBytes;
+
+  if (!freeSpaceLowMB || (freeBytes = getFreeBytes()) >= lowBytes) {
+    return IS_OK;
+  }
+  uint32_t startUs = getTelemetryTimeUs();
+  if ((result = initSdCard()) != IS_OK || (result = loadOrCreateFileCounters(&fileCounters, storage)) != IS_OK) {
+    recordPhase(TELEMETRY_PHASE_EVICT, startUs, result);
+    return result;
+  }
+  uint32_t pendingIndex = getPendingPictureIndex();
+  uint32_t lastIndex = pendingIndex ? pendingIndex - 1 : fileCounters.pictureCounter;
+
+  logInfo(RETENTION_LOG, "%u MB free, below %u MB: evicting the oldest pictures.", (unsigned int)(freeBytes / (1024 * 1024)),
+          freeSpaceLowMB);
+  if (storage == PICTURE_STORAGE_SEGMENTS) {
+    releasedBytes = evictSegments(&fileCounters, lastIndex, lowBytes, &evictedCount);
+  } else {
+    releasedBytes = evictPictureFiles(storage, &fileCounters, lastIndex, lowBytes, &evictedCount);
+  }
+  logInfo(RETENTION_LOG, "%u picture(s) evicted, %u KB released, %u MB free.", (unsigned int)evictedCount,
+          (unsigned int)(releasedBytes / 1024), (unsigned int)(getFreeBytes() / (1024 * 1024)));
+  recordTransfer(TELEMETRY_PHASE_EVICT, startUs, (uint32_t)releasedBytes, IS_OK);
+  return IS_OK;
+}
@@ -0,0 +1,59 @@
+#ifndef RETENTION_H
+#define RETENTION_H
+
+#include "Arduino.h"
+#include "catalog.h"
+#include "error.h"
+#include "logging.h"
+#include "sd.h"
+#include "segment.h"
+#include "telemetry.h"
+#include "writebehind.h"
+
+// Logger name for this module
+#define RETENTION_LOG "Retention"
+
+// Default value of app_config_t.freeSpaceLowMB
+#define RETENTION_FREE_SPACE_LOW_MB_DEFAULT 256
+// Maximum number of picture files removed by a batch, so it fits in the pause before the deep sleep
+#define RETENTION_BATCH_PICTURES 32
+// Maximum number of segments removed by a batch, with the segment storage layout
+#define RETENTION_BATCH_SEGMENTS 2
+// Maximum number of catalog records read by a batch while looking for pictures to remove
+#define RETENTION_SCAN_MAX 512
+// Magic number of the retention state in RTC memory: "CKRT"
+#define RETENTION_MAGIC 0x54524B43
+
+/**
+ * Progress of the eviction, kept in RTC memory along deep sleep.
+ * See the global variable retentionState in the main file.
+ * After a power on, the scans restart from the first picture, skipping the ones evicted in the catalog.
+ *
+ * @see initRetention()
+ */
+typedef struct {
+  uint32_t magic;              // RETENTION_MAGIC once initialized
+  uint32_t uploadedScanIndex;  // Index of the last picture looked at by the first pass, evicting the uploaded pictures
+  uint32_t evictedIndex;       // Index up to which all the pictures have been evicted by the second pass
+} retention_state_t;
+
+/**
+ * @brief Give the retention state in RTC memory to the module.
+ *
+ * @param state the retention state in RTC memory
+ */
+void initRetention(retention_state_t *state);
+
+/**
+ * @brief Remove a batch of the oldest pictures when the free space of the SD card is below the low watermark,
+ *        the ones already uploaded first.
+ *
+ * @param storage        the storage layout of the pictures, see picture_storage_t
+ * @param freeSpaceLowMB the low watermark of the free space in MB, 0 to disable the eviction
+ *
+ * @return IS_OK when nothing has to be evicted or when it succeeds.
+ *         SD_INIT_ERROR or SD_READ_ERROR in case of failure
+ */
+status_code_t evictPictures(uint8_t storage, uint16_t freeSpaceLowMB);
+
+#endif
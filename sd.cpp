@@ -1,5 +1,31 @@
 #include "sd.h"
 
+// Size of the write chunks set by setSdWriteChunkSize(), i.e. of the bounce buffer to allocate
+static size_t writeChunkSize = SD_WRITE_CHUNK_SIZE;
+
+// Space accounting in RTC memory given to initSdSpace(), else in RAM
+static sd_space_t ramSdSpace;
+static sd_space_t *sdSpace = &ramSdSpace;
+// Protects the space accounting, updated by the flush task and by the eviction
+static portMUX_TYPE sdSpaceMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Counters mirror in RTC memory given to initFileCounters(), else in RAM
+static file_counters_mirror_t ramCountersMirror;
+static file_counters_mirror_t *countersMirror = &ramCountersMirror;
+
+/**
+ * @brief Give the counters mirror in RTC memory to the module.
+ *        Without it, the counters are read from and written to the journal each time.
+ *
+ * The mirror is ignored when its CRC is wrong, i.e. after a power on
+ * or a firmware update changing its layout.
+ *
+ * @param mirror the counters mirror in RTC memory
+ */
+void initFileCounters(file_counters_mirror_t *mirror) {
+  countersMirror = mirror;
+}
+
 /**
  * @brief Initialize (mount) the SD card.
  *
@@ -55,27 +81,23 @@ void endSdCard() {
 }
 
 /**
- * @brief Save the picture data contained in pictureBuffer to a file named
- *        according to pictureFileName.
+ * @brief Save the picture data contained in pictureBuffer to a file
+ *        at the given path.
  *
  * The SD card has to be mounted first by calling initSdCard().
+ * The directory of the file must exist.
  *
- * @param pictureFileName a C string containing the picture file name
+ * @param path          a C string containing the picture file path, see computePicturePath()
  * @param pictureBuffer a byte buffer containing the picture data to store to the file
- * @param pictureLen the length of data contained the pictureBuffer
+ * @param pictureLen    the length of data contained the pictureBuffer
+ * @param crc           receiving the CRC-32 of the picture data computed while it is written, NULL when not needed
  *
  * @return IS_OK when the operation succeeds. SD_WRITE_ERROR in case of failure
  */
-status_code_t savePictureOnSdCard(char *pictureFileName, uint8_t *pictureBuffer, size_t pictureLen) {
+status_code_t savePictureOnSdCard(char *path, uint8_t *pictureBuffer, size_t pictureLen, uint32_t *crc) {
   logDebug(SD_LOG, "%s...", __func__);
   status_code_t result = IS_OK;
 
-  // Path where new picture will be saved in SD Card
-  // Format file name like "picture-xxxxx.jpg"
-  // where x is the current picture number with leading 0.
-  char path[20];
-  sprintf(path, "/%s", pictureFileName);
-
   fs::FS &fs = SD_MMC;
   logInfo(SD_LOG, "%s: save picture file name: %s.", __func__, path);
 
@@ -83,8 +105,10 @@ status_code_t savePictureOnSdCard(char *pictureFileName, uint8_t *pictureBuffer,
   if (!file) {
     result = SD_WRITE_ERROR;
     logError(SD_LOG, "%s: failed to open picture file %s in writing mode.", __func__, path);
+  } else if (!file.seek(pictureLen) || !file.seek(0) || writeSdChunks(&file, 0, NULL, 0, pictureBuffer, pictureLen, crc) != pictureLen) {
+    result = SD_WRITE_ERROR;
+    logError(SD_LOG, "%s: failed to write picture file %s.", __func__, path);
   } else {
-    file.write(pictureBuffer, pictureLen);  // payload (image), payload length
     logInfo(SD_LOG, "%s: saved file to path: %s.", __func__, path);
   }
   file.close();
@@ -92,25 +116,539 @@ status_code_t savePictureOnSdCard(char *pictureFileName, uint8_t *pictureBuffer,
 }
 
 /**
- * @brief Read file counters stored on the SD card and populate
- *        the given structure.
- * 
- * @param fileCounters a pointer to a fileCounters_t to populate
+ * @brief Set the size of the chunks written by writeSdChunks(), SD_WRITE_CHUNK_SIZE by default,
+ *        e.g. the smallest one reaching the card throughput, see selectSdStrategy().
  *
- * @return IS_OK when the operation succeeds. SD_READ_ERROR in case of failure
+ * It applies from the next write: the bounce buffer is allocated by each write.
  *
- * @see SD_FILES_COUNTERS_FILE_NAME
+ * @param size the chunk size, a power of 2 from SD_WRITE_CHUNK_MIN_SIZE to SD_WRITE_CHUNK_SIZE
  */
-status_code_t loadFileCounters(fileCounters_t *fileCounters) {
-  status_code_t result = IS_OK;
+void setSdWriteChunkSize(size_t size) {
+  writeChunkSize = size;
+}
 
-  // Init SD Card
-  result = initSdCard();
+/**
+ * @brief Allocate the bounce buffer of a writeSdChunks() call,
+ *        halving its size down to SD_WRITE_CHUNK_MIN_SIZE when the internal RAM is short.
+ *
+ * @param size receiving the size of the buffer, 0 without buffer
+ *
+ * @return the buffer to release by heap_caps_free(), NULL when the internal RAM is too short
+ */
+static uint8_t *allocateWriteBounceBuffer(size_t *size) {
+  uint8_t *buffer = NULL;
+  *size = 0;
+  for (size_t tried = writeChunkSize; !buffer && tried >= SD_WRITE_CHUNK_MIN_SIZE; tried /= 2) {
+    buffer = (uint8_t *)heap_caps_malloc(tried, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    *size = buffer ? tried : 0;
+  }
+  if (*size < writeChunkSize) {
+    logWarn(SD_LOG, "%s: bounce buffer of %u bytes only.", __func__, (unsigned int)*size);
+  }
+  return buffer;
+}
+
+/**
+ * @brief Write data to an open file in chunks aligned on SD_WRITE_CHUNK_SIZE file offsets,
+ *        copied to a DMA capable bounce buffer in internal RAM.
+ *        The throughput is recorded in the telemetry.
+ *
+ * The SDMMC driver can't transfer from PSRAM: given a frame buffer, it copies and writes
+ * each sector in turn. From the bounce buffer, a chunk is written by a single multi-sector transfer,
+ * and the aligned chunks never straddle a cluster, so no sector is read back and rewritten.
+ * Without bounce buffer, the data is written as is in the same chunks.
+ * The bounce buffer is allocated for the call only: the internal RAM is left to the WiFi between the saves.
+ * The CRC-32 of the data is computed chunk by chunk, from the copy in internal RAM when there is a bounce buffer:
+ * the data is read once from PSRAM, and no pass is needed before or after the write.
+ *
+ * @param file      the open file, at the offset
+ * @param offset    the offset of the file where the data is written
+ * @param header    the data written before the buffer, e.g. a record header, NULL when none
+ * @param headerLen the length of the header
+ * @param buffer    the data, e.g. a frame buffer in PSRAM
+ * @param len       the length of the data
+ * @param crc       receiving the CRC-32 of the data, header excluded, as computed by crc32_le(0, ...). NULL when not needed
+ *
+ * @return the number of bytes written, header included
+ */
+size_t writeSdChunks(File *file, uint32_t offset, const uint8_t *header, size_t headerLen, const uint8_t *buffer, size_t len, uint32_t *crc) {
+  uint32_t startUs = getTelemetryTimeUs();
+  size_t totalLen = headerLen + len;
+  size_t written = 0;
+  uint32_t dataCrc = 0;
+
+  size_t writeBounceBufferSize;
+  uint8_t *writeBounceBuffer = allocateWriteBounceBuffer(&writeBounceBufferSize);
+  size_t chunkSize = writeBounceBuffer ? writeBounceBufferSize : writeChunkSize;
+  while (written < totalLen) {
+    size_t chunkLen = chunkSize - (offset + written) % chunkSize;
+    size_t headerPartLen;
+    const uint8_t *chunk;
+    if (chunkLen > totalLen - written) {
+      chunkLen = totalLen - written;
+    }
+    if (writeBounceBuffer) {
+      headerPartLen = written < headerLen ? min(headerLen - written, chunkLen) : 0;
+      if (headerPartLen) {
+        memcpy(writeBounceBuffer, header + written, headerPartLen);
+      }
+      if (chunkLen > headerPartLen) {
+        memcpy(writeBounceBuffer + headerPartLen, buffer + written + headerPartLen - headerLen, chunkLen - headerPartLen);
+      }
+      chunk = writeBounceBuffer;
+    } else if (written < headerLen) {
+      chunkLen = headerLen - written;
+      headerPartLen = chunkLen;
+      chunk = header + written;
+    } else {
+      headerPartLen = 0;
+      chunk = buffer + written - headerLen;
+    }
+    if (crc && chunkLen > headerPartLen) {
+      dataCrc = crc32_le(dataCrc, chunk + headerPartLen, chunkLen - headerPartLen);
+    }
+    if (file->write(chunk, chunkLen) != chunkLen) {
+      break;
+    }
+    written += chunkLen;
+  }
+  if (writeBounceBuffer) {
+    heap_caps_free(writeBounceBuffer);
+  }
+  if (crc) {
+    *crc = dataCrc;
+  }
+  recordTransfer(TELEMETRY_PHASE_SD_WRITE, startUs, written, written == totalLen ? IS_OK : SD_WRITE_ERROR);
+  return written;
+}
+
+/**
+ * @brief Compute the path of a picture file on the SD card.
+ *        With the directory storage layout, the pictures are grouped by SD_DIRECTORY_PICTURE_COUNT
+ *        in directories of SD_PICTURE_DIRECTORY. Ex: the picture 300 is "/pictures/00001/pic-00300.jpg".
+ *        Else, the pictures are in the root directory. Ex: "/pic-00300.jpg".
+ *
+ * @param storage the storage layout, see picture_storage_t. Segments have no picture file.
+ * @param index   the picture index, from 1
+ * @param path    the char array of SD_PICTURE_PATH_MAX_SIZE receiving the path
+ *
+ * @return the length of the path of the directory, "/" excluded
+ */
+uint8_t computePicturePath(uint8_t storage, uint32_t index, char *path) {
+  uint8_t directoryLen = 0;
+  if (storage == PICTURE_STORAGE_DIRECTORIES) {
+    directoryLen = snprintf(path, SD_PICTURE_PATH_MAX_SIZE, SD_PICTURE_DIRECTORY "/%05u", (unsigned int)((index - 1) / SD_DIRECTORY_PICTURE_COUNT));
+  }
+  path[directoryLen] = '/';
+  computePictureNameFromIndex(path + directoryLen + 1, index);
+  return directoryLen;
+}
+
+/**
+ * @brief Create the directory of a picture when it doesn't exist, with its parent.
+ *
+ * @param path         the picture path, see computePicturePath()
+ * @param directoryLen the length of the path of the directory
+ *
+ * @return true when the directory exists
+ */
+static bool createPictureDirectory(const char *path, uint8_t directoryLen) {
+  fs::FS &fs = SD_MMC;
+  char directory[SD_PICTURE_PATH_MAX_SIZE];
+
+  memcpy(directory, path, directoryLen);
+  directory[directoryLen] = '\0';
+  if (fs.exists(directory)) {
+    return true;
+  }
+  logInfo(SD_LOG, "%s: create directory %s.", __func__, directory);
+  return (fs.exists(SD_PICTURE_DIRECTORY) || fs.mkdir(SD_PICTURE_DIRECTORY)) && fs.mkdir(directory);
+}
+
+/**
+ * @brief Give the space accounting in RTC memory to the module.
+ *        Without it, the card is scanned once by wake cycle.
+ *
+ * The accounting is ignored when its CRC is wrong, i.e. after a power on
+ * or a firmware update changing its layout.
+ *
+ * @param space the space accounting in RTC memory
+ */
+void initSdSpace(sd_space_t *space) {
+  sdSpace = space;
+}
+
+/**
+ * @brief Tell whether the space accounting is valid. The caller holds sdSpaceMux.
+ *
+ * @return true when it is valid
+ */
+static bool isSdSpaceValid() {
+  return sdSpace->magic == SD_SPACE_MAGIC && sdSpace->crc == crc32_le(0, (const uint8_t *)sdSpace, offsetof(sd_space_t, crc));
+}
+
+/**
+ * @brief Round a file length up to a whole number of clusters.
+ *
+ * @param len the file length
+ *
+ * @return the space used by the file
+ */
+static uint64_t roundUpToCluster(uint64_t len) {
+  return (len + SD_CLUSTER_SIZE - 1) / SD_CLUSTER_SIZE * SD_CLUSTER_SIZE;
+}
+
+/**
+ * @brief Add bytes to the used space, or release them, when the accounting is valid.
+ *        It can be called from any task.
+ *
+ * @param bytes the bytes used, negative when released
+ */
+static void addSdUsedBytes(int64_t bytes) {
+  portENTER_CRITICAL(&sdSpaceMux);
+  if (isSdSpaceValid()) {
+    sdSpace->usedBytes = (bytes < 0 && (uint64_t)-bytes > sdSpace->usedBytes) ? 0 : sdSpace->usedBytes + bytes;
+    sdSpace->crc = crc32_le(0, (const uint8_t *)sdSpace, offsetof(sd_space_t, crc));
+  }
+  portEXIT_CRITICAL(&sdSpaceMux);
+}
+
+/**
+ * @brief Get the space of the SD card, scanned at the first call after a power on only.
+ *
+ * SD_MMC.usedBytes() walks the whole FAT: it is called once, then the accounting
+ * is updated by savePictureByIndex() and removeSdFile(). The small files like the catalog,
+ * the journal or the telemetry are counted at the scan only.
+ * The SD card is mounted when it is not.
+ *
+ * @param totalBytes receiving the size of the FAT volume
+ * @param usedBytes  receiving the bytes used by the files
+ *
+ * @return IS_OK when it succeeds or SD_INIT_ERROR when the SD card can't be mounted
+ */
+status_code_t getSdSpace(uint64_t *totalBytes, uint64_t *usedBytes) {
+  portENTER_CRITICAL(&sdSpaceMux);
+  bool valid = isSdSpaceValid();
+  *totalBytes = sdSpace->totalBytes;
+  *usedBytes = sdSpace->usedBytes;
+  portEXIT_CRITICAL(&sdSpaceMux);
+  if (valid) {
+    return IS_OK;
+  }
+
+  status_code_t result = initSdCard();
   if (result != IS_OK) {
     return result;
   }
+  unsigned long startMs = millis();
+  *totalBytes = SD_MMC.totalBytes();
+  *usedBytes = SD_MMC.usedBytes();
+  logInfo(SD_LOG, "SD card space scanned in %lu ms: %u MB used out of %u MB.", millis() - startMs,
+          (unsigned int)(*usedBytes / (1024 * 1024)), (unsigned int)(*totalBytes / (1024 * 1024)));
+  portENTER_CRITICAL(&sdSpaceMux);
+  sdSpace->magic = SD_SPACE_MAGIC;
+  sdSpace->totalBytes = *totalBytes;
+  sdSpace->usedBytes = *usedBytes;
+  sdSpace->crc = crc32_le(0, (const uint8_t *)sdSpace, offsetof(sd_space_t, crc));
+  portEXIT_CRITICAL(&sdSpaceMux);
+  return IS_OK;
+}
+
+/**
+ * @brief Remove a file from the SD card and release its space.
+ *
+ * The SD card has to be mounted first by calling initSdCard().
+ *
+ * @param path the file path
+ *
+ * @return the number of bytes released, 0 when the file could not be removed
+ */
+uint64_t removeSdFile(const char *path) {
+  fs::FS &fs = SD_MMC;
+  File file = fs.open(path, FILE_READ);
+  if (!file) {
+    return 0;
+  }
+  uint64_t bytes = roundUpToCluster(file.size());
+  file.close();
+  if (!fs.remove(path)) {
+    logError(SD_LOG, "%s: failed to remove %s.", __func__, path);
+    return 0;
+  }
+  addSdUsedBytes(-(int64_t)bytes);
+  return bytes;
+}
+
+/**
+ * @brief Remove a picture file from the SD card and release its space.
+ *        The directory of the last picture of a directory is removed too.
+ *
+ * The SD card has to be mounted first by calling initSdCard().
+ *
+ * @param storage the storage layout, see picture_storage_t. Pictures can't be removed from a segment.
+ * @param index   the picture index, from 1
+ *
+ * @return the number of bytes released, 0 when the picture could not be removed
+ */
+uint64_t removePictureByIndex(uint8_t storage, uint32_t index) {
+  char path[SD_PICTURE_PATH_MAX_SIZE];
+  if (storage == PICTURE_STORAGE_SEGMENTS) {
+    return 0;
+  }
+  uint8_t directoryLen = computePicturePath(storage, index, path);
+  uint64_t bytes = removeSdFile(path);
+  if (bytes && directoryLen && index % SD_DIRECTORY_PICTURE_COUNT == 0) {
+    // The directory is empty when the pictures are removed in order
+    path[directoryLen] = '\0';
+    SD_MMC.rmdir(path);
+  }
+  return bytes;
+}
+
+/**
+ * @brief Save a picture on the SD card according to the storage layout,
+ *        then write its record in the catalog.
+ *
+ * A failure to write the record is not an error: the picture is uploaded without its record.
+ * The CRC-32 of the record is computed while the picture file is written, see writeSdChunks().
+ * With segments, it is computed first, as the record header carrying it precedes the data.
+ * The SD card has to be mounted first by calling initSdCard().
+ *
+ * @param storage       the storage layout, see picture_storage_t
+ * @param index         the picture index, from 1
+ * @param pictureBuffer a byte buffer containing the picture data
+ * @param pictureLen    the length of data contained the pictureBuffer
+ * @param record        the catalog record with its hash, flags and priority, the other fields are set
+ *
+ * @return IS_OK when the operation succeeds. SD_WRITE_ERROR in case of failure
+ *
+ * @see savePictureOnSdCard()
+ * @see appendPictureToSegment()
+ * @see writeCatalogRecord()
+ */
+status_code_t savePictureByIndex(uint8_t storage, uint32_t index, uint8_t *pictureBuffer, size_t pictureLen, catalog_record_t *record) {
+  status_code_t result;
+
+  record->index = index;
+  record->timestamp = (uint32_t)time(NULL);
+  record->length = pictureLen;
+  record->uploadAttempts = 0;
+  record->reserved = 0;
+  if (storage == PICTURE_STORAGE_SEGMENTS) {
+    // The record header carrying the CRC-32 is written before the data
+    record->crc = crc32_le(0, pictureBuffer, pictureLen);
+    result = appendPictureToSegment(index, pictureBuffer, pictureLen, record->timestamp, record->crc);
+  } else {
+    char path[SD_PICTURE_PATH_MAX_SIZE];
+    uint8_t directoryLen = computePicturePath(storage, index, path);
+    if (directoryLen && !createPictureDirectory(path, directoryLen)) {
+      logError(SD_LOG, "%s: failed to create the directory of %s.", __func__, path);
+      return SD_WRITE_ERROR;
+    }
+    result = savePictureOnSdCard(path, pictureBuffer, pictureLen, &(record->crc));
+  }
+  if (result == IS_OK) {
+    // A segment grows by its record, a file uses whole clusters
+    addSdUsedBytes(storage == PICTURE_STORAGE_SEGMENTS ? sizeof(segment_record_t) + pictureLen : roundUpToCluster(pictureLen));
+    writeCatalogRecord(record);
+  }
+  return result;
+}
+
+/**
+ * @brief Open a picture saved on the SD card at the beginning of its data.
+ *
+ * The SD card has to be mounted first by calling initSdCard().
+ *
+ * @param storage    the storage layout, see picture_storage_t
+ * @param index      the picture index, from 1
+ * @param file       the File receiving the open file
+ * @param pictureLen the length of the picture data
+ *
+ * @return IS_OK when the operation succeeds. SD_READ_ERROR in case of failure
+ *
+ * @see openSegmentPicture()
+ */
+status_code_t openPictureByIndex(uint8_t storage, uint32_t index, File *file, size_t *pictureLen) {
+  if (storage == PICTURE_STORAGE_SEGMENTS) {
+    segment_index_entry_t entry;
+    status_code_t result = openSegmentPicture(index, file, &entry);
+    if (result == IS_OK) {
+      *pictureLen = entry.length;
+    }
+    return result;
+  }
+  // Path of the picture in SD Card
+  char path[SD_PICTURE_PATH_MAX_SIZE];
+  computePicturePath(storage, index, path);
   fs::FS &fs = SD_MMC;
-  logInfo(SD_LOG, "%s: file %s %s.", __func__, SD_FILES_COUNTERS_FILE_NAME, fs.exists(SD_FILES_COUNTERS_FILE_NAME) ? "exists" : "does not exist");
+  *file = fs.open(path, FILE_READ);
+  if (!*file) {
+    logError(SD_LOG, "%s: failed to open file %s in reading mode.", __func__, path);
+    return SD_READ_ERROR;
+  }
+  *pictureLen = file->size();
+  return IS_OK;
+}
+
+/**
+ * @brief Tell whether a picture is saved on the SD card, without logging when it is missing.
+ *
+ * The SD card has to be mounted first by calling initSdCard().
+ *
+ * @param storage the storage layout, see picture_storage_t
+ * @param index   the picture index, from 1
+ *
+ * @return true when the picture exists
+ */
+bool pictureExistsByIndex(uint8_t storage, uint32_t index) {
+  if (storage == PICTURE_STORAGE_SEGMENTS) {
+    return segmentPictureExists(index);
+  }
+  char path[SD_PICTURE_PATH_MAX_SIZE];
+  computePicturePath(storage, index, path);
+  fs::FS &fs = SD_MMC;
+  return fs.exists(path);
+}
+
+/**
+ * @brief Compute the CRC-32 of the bytes of a structure before its crc field.
+ *
+ * @param data      the structure
+ * @param crcOffset the offset of its crc field
+ *
+ * @return the CRC-32
+ */
+static uint32_t computeCountersCrc(const void *data, size_t crcOffset) {
+  return crc32_le(0, (const uint8_t *)data, crcOffset);
+}
+
+/**
+ * @brief Tell whether the counters mirror holds counters loaded since the power on.
+ *
+ * @return true when its magic number and its CRC are right
+ */
+static bool isFileCountersMirrorValid() {
+  return countersMirror->magic == SD_COUNTERS_MIRROR_MAGIC
+         && countersMirror->crc == computeCountersCrc(countersMirror, offsetof(file_counters_mirror_t, crc));
+}
+
+/**
+ * @brief Set the counters mirror to counters matching the journal.
+ *
+ * @param fileCounters the counters
+ * @param sequence     the sequence number of the last journal record
+ * @param recordCount  the number of records of the journal file
+ */
+static void mirrorFileCounters(const fileCounters_t *fileCounters, uint32_t sequence, uint32_t recordCount) {
+  countersMirror->magic = SD_COUNTERS_MIRROR_MAGIC;
+  countersMirror->counters = *fileCounters;
+  countersMirror->journaled = *fileCounters;
+  countersMirror->sequence = sequence;
+  countersMirror->recordCount = recordCount;
+  countersMirror->crc = computeCountersCrc(countersMirror, offsetof(file_counters_mirror_t, crc));
+}
+
+/**
+ * @brief Read the counters journal and find its valid record with the highest sequence number.
+ *
+ * Records with a wrong magic number or CRC, e.g. torn by a reset, are skipped.
+ *
+ * @param path        the journal file path
+ * @param record      the file_counters_record_t receiving the record
+ * @param recordCount the number of records of the file, SD_COUNTERS_JOURNAL_MAX_RECORDS when a record is damaged
+ *
+ * @return true when a valid record has been found
+ */
+static bool readFileCountersJournal(const char *path, file_counters_record_t *record, uint32_t *recordCount) {
+  fs::FS &fs = SD_MMC;
+  file_counters_record_t records[SD_COUNTERS_READ_RECORDS];
+  bool damaged;
+  bool found = false;
+  size_t readLen;
+
+  if (!fs.exists(path)) {
+    return false;
+  }
+  File file = fs.open(path, FILE_READ);
+  if (!file) {
+    return false;
+  }
+  *recordCount = file.size() / sizeof(file_counters_record_t);
+  damaged = file.size() % sizeof(file_counters_record_t) != 0;
+  while ((readLen = file.read((uint8_t *)records, sizeof(records))) >= sizeof(file_counters_record_t)) {
+    for (size_t i = 0; i < readLen / sizeof(file_counters_record_t); i++) {
+      if (records[i].magic != SD_COUNTERS_RECORD_MAGIC
+          || records[i].crc != computeCountersCrc(&records[i], offsetof(file_counters_record_t, crc))) {
+        damaged = true;
+      } else if (!found || records[i].sequence > record->sequence) {
+        *record = records[i];
+        found = true;
+      }
+    }
+  }
+  file.close();
+  if (damaged) {
+    logWarn(SD_LOG, "%s: damaged records in %s, it will be compacted.", __func__, path);
+    // Records appended after a torn one would not be aligned: rewrite the journal first
+    *recordCount = SD_COUNTERS_JOURNAL_MAX_RECORDS;
+  }
+  return found;
+}
+
+/**
+ * @brief Append the counters of the mirror to the journal.
+ *
+ * Once the journal has SD_COUNTERS_JOURNAL_MAX_RECORDS records, it is compacted:
+ * the record is written to SD_COUNTERS_JOURNAL_TMP_FILE_NAME, which then replaces the journal file.
+ *
+ * @return IS_OK when the operation succeeds. SD_WRITE_ERROR in case of failure
+ */
+static status_code_t appendFileCountersRecord() {
+  fs::FS &fs = SD_MMC;
+  bool compact = countersMirror->recordCount >= SD_COUNTERS_JOURNAL_MAX_RECORDS;
+  const char *path = compact ? SD_COUNTERS_JOURNAL_TMP_FILE_NAME : SD_COUNTERS_JOURNAL_FILE_NAME;
+  file_counters_record_t record = {
+    SD_COUNTERS_RECORD_MAGIC, countersMirror->sequence + 1,
+    countersMirror->counters.pictureCounter, countersMirror->counters.uploadedPictureCounter, 0
+  };
+  record.crc = computeCountersCrc(&record, offsetof(file_counters_record_t, crc));
+
+  File file = fs.open(path, compact ? FILE_WRITE : FILE_APPEND);
+  bool written = file && file.write((const uint8_t *)&record, sizeof(record)) == sizeof(record);
+  file.close();
+  if (written && compact) {
+    if (fs.exists(SD_COUNTERS_JOURNAL_FILE_NAME)) {
+      fs.remove(SD_COUNTERS_JOURNAL_FILE_NAME);
+    }
+    written = fs.rename(SD_COUNTERS_JOURNAL_TMP_FILE_NAME, SD_COUNTERS_JOURNAL_FILE_NAME);
+  }
+  if (!written) {
+    logError(SD_LOG, "%s: failed to write the counters in %s.", __func__, path);
+    return SD_WRITE_ERROR;
+  }
+  logInfo(SD_LOG, "%s: counters %u/%u journaled (record %u%s).", __func__, (unsigned int)record.pictureCounter,
+          (unsigned int)record.uploadedPictureCounter, (unsigned int)record.sequence, compact ? ", compacted" : "");
+  mirrorFileCounters(&(countersMirror->counters), record.sequence, compact ? 1 : countersMirror->recordCount + 1);
+  return IS_OK;
+}
+
+/**
+ * @brief Read the counters from the text file written before the journal.
+ *
+ * @param fileCounters a pointer to a fileCounters_t to populate
+ *
+ * @return IS_OK when the operation succeeds. SD_READ_ERROR or READ_CONFIG_ERROR in case of failure
+ *
+ * @see SD_FILES_COUNTERS_FILE_NAME
+ */
+static status_code_t loadTextFileCounters(fileCounters_t *fileCounters) {
+  status_code_t result = IS_OK;
+  fs::FS &fs = SD_MMC;
+
+  if (!fs.exists(SD_FILES_COUNTERS_FILE_NAME)) {
+    return SD_READ_ERROR;
+  }
 
   FileConfig fileConfig;
 
@@ -150,69 +688,233 @@ status_code_t loadFileCounters(fileCounters_t *fileCounters) {
 }
 
 /**
- * @brief Write the given file counters in a file on the SD card,
- *        so they can be loaded at the next wakeup.
+ * @brief Read file counters stored on the SD card and populate
+ *        the given structure.
+ *
+ * The last valid record of the journal is used. When the journal file is missing,
+ * a compaction has been interrupted: it is completed with the temporary file.
+ * When there is no journal, the counters of the former text file are migrated to a new journal.
+ * The counters mirror is updated.
+ *
+ * @param fileCounters a pointer to a fileCounters_t to populate
+ *
+ * @return IS_OK when the operation succeeds. SD_READ_ERROR in case of failure
+ *
+ * @see SD_COUNTERS_JOURNAL_FILE_NAME
+ */
+status_code_t loadFileCounters(fileCounters_t *fileCounters) {
+  status_code_t result = IS_OK;
+  file_counters_record_t record;
+  uint32_t recordCount;
+
+  // Init SD Card
+  result = initSdCard();
+  if (result != IS_OK) {
+    return result;
+  }
+  fs::FS &fs = SD_MMC;
+
+  if (!readFileCountersJournal(SD_COUNTERS_JOURNAL_FILE_NAME, &record, &recordCount)) {
+    if (readFileCountersJournal(SD_COUNTERS_JOURNAL_TMP_FILE_NAME, &record, &recordCount)) {
+      logWarn(SD_LOG, "%s: complete the interrupted compaction of %s.", __func__, SD_COUNTERS_JOURNAL_FILE_NAME);
+      if (fs.exists(SD_COUNTERS_JOURNAL_FILE_NAME)) {
+        fs.remove(SD_COUNTERS_JOURNAL_FILE_NAME);
+      }
+      if (!fs.rename(SD_COUNTERS_JOURNAL_TMP_FILE_NAME, SD_COUNTERS_JOURNAL_FILE_NAME)) {
+        recordCount = SD_COUNTERS_JOURNAL_MAX_RECORDS;
+      }
+    } else if (loadTextFileCounters(fileCounters) == IS_OK) {
+      logInfo(SD_LOG, "%s: migrate %s to %s.", __func__, SD_FILES_COUNTERS_FILE_NAME, SD_COUNTERS_JOURNAL_FILE_NAME);
+      mirrorFileCounters(fileCounters, 0, SD_COUNTERS_JOURNAL_MAX_RECORDS);
+      if (appendFileCountersRecord() == IS_OK) {
+        fs.remove(SD_FILES_COUNTERS_FILE_NAME);
+      }
+      return IS_OK;
+    } else {
+      logWarn(SD_LOG, "%s: no valid counters in %s.", __func__, SD_COUNTERS_JOURNAL_FILE_NAME);
+      return SD_READ_ERROR;
+    }
+  }
+  fileCounters->pictureCounter = record.pictureCounter;
+  fileCounters->uploadedPictureCounter = record.uploadedPictureCounter;
+  mirrorFileCounters(fileCounters, record.sequence, recordCount);
+  logInfo(SD_LOG, "%s: counters %u/%u loaded from %s.", __func__, (unsigned int)fileCounters->pictureCounter,
+          (unsigned int)fileCounters->uploadedPictureCounter, SD_COUNTERS_JOURNAL_FILE_NAME);
+  return IS_OK;
+}
+
+/**
+ * @brief Update the counters mirror and append them to the journal on the SD card
+ *        when SD_COUNTERS_JOURNAL_PERIOD pictures have been saved or uploaded since the last record.
+ *
+ * Without a mirror in RTC memory (see initFileCounters()), a record is always appended.
+ * After a power loss, the pictures saved since the last record are found by loadOrCreateFileCounters(),
+ * and up to SD_COUNTERS_JOURNAL_PERIOD - 1 pictures are uploaded twice.
  *
  * @param fileCounters a pointer to a fileCounters_t to store
  *
  * @return IS_OK when the operation succeeds. SD_WRITE_ERROR in case of failure
  *
- * @see SD_FILES_COUNTERS_FILE_NAME
+ * @see SD_COUNTERS_JOURNAL_FILE_NAME
  */
 status_code_t saveFileCounters(fileCounters_t *fileCounters) {
   logDebug(SD_LOG, "%s...", __func__);
+  bool mirrorKept = countersMirror != &ramCountersMirror && isFileCountersMirrorValid();
+
+  if (!isFileCountersMirrorValid()) {
+    mirrorFileCounters(fileCounters, 0, SD_COUNTERS_JOURNAL_MAX_RECORDS);
+  }
+  countersMirror->counters = *fileCounters;
+  countersMirror->crc = computeCountersCrc(countersMirror, offsetof(file_counters_mirror_t, crc));
+  if (mirrorKept
+      && fileCounters->pictureCounter - countersMirror->journaled.pictureCounter < SD_COUNTERS_JOURNAL_PERIOD
+      && fileCounters->uploadedPictureCounter - countersMirror->journaled.uploadedPictureCounter < SD_COUNTERS_JOURNAL_PERIOD) {
+    logDebug(SD_LOG, "%s: counters %u/%u kept in RTC memory.", __func__, (unsigned int)fileCounters->pictureCounter,
+             (unsigned int)fileCounters->uploadedPictureCounter);
+    return IS_OK;
+  }
 
   // Init SD Card
   status_code_t result = initSdCard();
   if (result != IS_OK) {
     return result;
   }
+  return appendFileCountersRecord();
+}
 
-  fs::FS &fs = SD_MMC;
-  File file = fs.open(SD_FILES_COUNTERS_FILE_NAME, FILE_WRITE);
-  if (file) {
-    char buffer[64];
-    logInfo(SD_LOG, "%s: file %s open in writing mode.\n", __func__, SD_FILES_COUNTERS_FILE_NAME);
-    result = (file.write((uint8_t *)buffer, sprintf(buffer, "pictureCounter=%d\nuploadedPictureCounter=%d\n", fileCounters->pictureCounter, fileCounters->uploadedPictureCounter)) > 0) ? IS_OK : SD_WRITE_ERROR;
-    file.close();
-    logInfo(SD_LOG, "%s: written metadata:\n%s.", __func__, buffer);
-    return result;
+/**
+ * @brief Move the picture counter of the RTC mirror back to the last picture written on the SD card,
+ *        when the next ones have been lost, e.g. queued by writePictureBehind() when the deadline expired.
+ *
+ * The SD card is not accessed: it may be stalled. A journal record past the rewound counter
+ * is replaced at the next saveFileCounters(), as the difference with the journaled counter overflows.
+ * Nothing is done without a valid mirror, nor when the counter is not past the given index.
+ *
+ * @param pictureCounter the index of the last picture written
+ */
+void rewindFileCounters(uint32_t pictureCounter) {
+  if (!isFileCountersMirrorValid() || countersMirror->counters.pictureCounter <= pictureCounter) {
+    return;
   }
-  // Else
-  logError(SD_LOG, "%s: failed to open file %s in writing mode.", __func__, SD_FILES_COUNTERS_FILE_NAME);
-  return SD_WRITE_ERROR;
+  logWarn(SD_LOG, "%s: pictures %u to %u lost.", __func__, (unsigned int)pictureCounter + 1,
+          (unsigned int)countersMirror->counters.pictureCounter);
+  countersMirror->counters.pictureCounter = pictureCounter;
+  if (countersMirror->counters.uploadedPictureCounter > pictureCounter) {
+    countersMirror->counters.uploadedPictureCounter = pictureCounter;
+  }
+  countersMirror->crc = computeCountersCrc(countersMirror, offsetof(file_counters_mirror_t, crc));
 }
 
 /**
  * @brief Populate the given structure file counters to 0
- *        and save them on SD card using saveFileCounters().
+ *        and append them to the journal on the SD card.
  *
  * @param fileCounters a pointer to a fileCounters_t to store
  *
  * @return IS_OK when the operation succeeds. SD_WRITE_ERROR in case of failure
  *
- * @see SD_FILES_COUNTERS_FILE_NAME
+ * @see SD_COUNTERS_JOURNAL_FILE_NAME
  */
 status_code_t createFileCounters(fileCounters_t *fileCounters) {
   logDebug(SD_LOG, "%s...", __func__);
   fileCounters->pictureCounter = 0;
   fileCounters->uploadedPictureCounter = 0;
-  return saveFileCounters(fileCounters);
+  mirrorFileCounters(fileCounters, 0, SD_COUNTERS_JOURNAL_MAX_RECORDS);
+  return appendFileCountersRecord();
+}
+
+/**
+ * @brief Find the last picture saved on the SD card from a picture index,
+ *        assuming the pictures are saved without gaps.
+ *
+ * The indexes after it are probed with a step doubled at each found picture,
+ * then the first missing picture is searched by dichotomy: with the journal up to date,
+ * a single picture is probed.
+ *
+ * @param storage the storage layout, see picture_storage_t
+ * @param from    an index of a saved picture, 0 when there is none
+ *
+ * @return the index of the last saved picture
+ */
+static uint32_t findLastPictureIndex(uint8_t storage, uint32_t from) {
+  uint32_t found = from;
+  uint32_t step = 1;
+
+  while (step < 0x80000000 && pictureExistsByIndex(storage, found + step)) {
+    found += step;
+    step *= 2;
+  }
+  uint32_t missing = found + step;
+  while (missing - found > 1) {
+    uint32_t middle = found + (missing - found) / 2;
+    if (pictureExistsByIndex(storage, middle)) {
+      found = middle;
+    } else {
+      missing = middle;
+    }
+  }
+  return found;
 }
 
 /**
- * @brief Like loadFileCounters(), excepted that it calls createFileCounters
- *        in case of loading error.
+ * @brief Get the counters from the RTC mirror, else load them from the SD card
+ *        and move pictureCounter past the pictures saved after the last journal record.
+ *        The counters are created on an SD card without any, and recovered from the saved pictures
+ *        when the journal is damaged.
+ *
+ * The counters are never reset while counter files exist: when no valid record remains,
+ * pictureCounter is recovered from the saved pictures, so none is overwritten,
+ * and uploadedPictureCounter is set to it, so the SD card is not uploaded again.
+ *
+ * @param fileCounters a pointer to a fileCounters_t to populate
+ * @param storage      the storage layout of the pictures, see picture_storage_t
  *
  * @return IS_OK when the operation succeeds. SD_READ_ERROR or SD_WRITE_ERROR in case of failure
  *
- * @see SD_FILES_COUNTERS_FILE_NAME
  * @see loadFileCounters()
  * @see createFileCounters()
  * @see saveFileCounters()
  */
-status_code_t loadOrCreateFileCounters(fileCounters_t *fileCounters) {
+status_code_t loadOrCreateFileCounters(fileCounters_t *fileCounters, uint8_t storage) {
   logDebug(SD_LOG, "%s...", __func__);
-  return (loadFileCounters(fileCounters) == IS_OK) ? IS_OK : createFileCounters(fileCounters);
-}
+  status_code_t result;
+  bool lost = false;
+
+  if (isFileCountersMirrorValid()) {
+    *fileCounters = countersMirror->counters;
+    return IS_OK;
+  }
+  if ((result = loadFileCounters(fileCounters)) != IS_OK) {
+    fs::FS &fs = SD_MMC;
+    if (result == SD_INIT_ERROR) {
+      return result;
+    }
+    if (!fs.exists(SD_COUNTERS_JOURNAL_FILE_NAME) && !fs.exists(SD_COUNTERS_JOURNAL_TMP_FILE_NAME)
+        && !fs.exists(SD_FILES_COUNTERS_FILE_NAME)) {
+      result = createFileCounters(fileCounters);
+      if (result != IS_OK || !pictureExistsByIndex(storage, 1)) {
+        return result;
+      }
+    }
+    logError(SD_LOG, "%s: counters lost, they are recovered from the catalog and the saved pictures.", __func__);
+    // The oldest pictures may have been evicted: the probe starts after the last cataloged one
+    fileCounters->pictureCounter = getCatalogLastIndex();
+    lost = true;
+  }
 
+  // Pictures saved after the last journal record, e.g. before a power loss
+  uint32_t lastIndex = findLastPictureIndex(storage, fileCounters->pictureCounter);
+  if (lastIndex == fileCounters->pictureCounter && !lost) {
+    return IS_OK;
+  }
+  logWarn(SD_LOG, "%s: pictures saved up to %u after the counters %u.", __func__, (unsigned int)lastIndex,
+          (unsigned int)fileCounters->pictureCounter);
+  fileCounters->pictureCounter = lastIndex;
+  if (lost) {
+    fileCounters->uploadedPictureCounter = lastIndex;
+    mirrorFileCounters(fileCounters, 0, SD_COUNTERS_JOURNAL_MAX_RECORDS);
+  } else {
+    mirrorFileCounters(fileCounters, countersMirror->sequence, countersMirror->recordCount);
+  }
+  return appendFileCountersRecord();
+}
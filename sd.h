@@ -1,23 +1,75 @@
 #ifndef SD_H
 #define SD_H
 
+#include "catalog.h"
 #include "error.h"
 #include "FileConfig.h"
+#include "filename.h"
 #include "logging.h"
+#include "segment.h"
+#include "telemetry.h"
+#include "esp_heap_caps.h"
 #include "FS.h"
 #include "SD_MMC.h"
 
 // Logger name for this module
 #define SD_LOG "SD"
 
-// Name of the file storing the counters on the SD card
+// Name of the text file which stored the counters before the journal, migrated once
 #define SD_FILES_COUNTERS_FILE_NAME "/counters.txt"
-// Maximum length of a counter value in the file
+// Maximum length of a counter value in the text file
 #define SD_FILES_COUNTERS_VALUE_MAX_SIZE 10
+// Name of the journal file storing the counters on the SD card
+#define SD_COUNTERS_JOURNAL_FILE_NAME "/counters.bin"
+// Name of the file written when the journal is compacted, then renamed to the journal file
+#define SD_COUNTERS_JOURNAL_TMP_FILE_NAME "/counters.tmp"
+// Magic number of a journal record: "CKCN"
+#define SD_COUNTERS_RECORD_MAGIC 0x4E434B43
+// Magic number of the counters mirror in RTC memory: "CKCM"
+#define SD_COUNTERS_MIRROR_MAGIC 0x4D434B43
+// Number of records from which the journal is compacted into a single record, i.e. 5 KB
+#define SD_COUNTERS_JOURNAL_MAX_RECORDS 256
+// Maximum number of pictures saved or uploaded since the last journal record,
+// when the counters are mirrored in RTC memory. Bounds the pictures uploaded twice after a power loss.
+#define SD_COUNTERS_JOURNAL_PERIOD 8
+// Number of journal records read at once
+#define SD_COUNTERS_READ_RECORDS 16
+
+// Size of the chunks written to the SD card: a multiple of the 512-byte sector and of the cluster size up to 32 KB,
+// so the FAT layer hands whole clusters to multi-sector transfers
+#define SD_WRITE_CHUNK_SIZE (32 * 1024)
+// Minimum size of the bounce buffer, when the internal RAM lacks SD_WRITE_CHUNK_SIZE contiguous bytes
+#define SD_WRITE_CHUNK_MIN_SIZE 4096
+
+// Magic number of the space accounting in RTC memory: "CKSP"
+#define SD_SPACE_MAGIC 0x50534B43
+// Allocation unit assumed for the picture files, i.e. the cluster size of the FAT32 cards up to 32 GB.
+// A picture file uses a whole number of clusters.
+#define SD_CLUSTER_SIZE (32 * 1024)
+
+// Default value for the parameter app_config_t.pictureStorage
+#define PICTURE_STORAGE_DEFAULT PICTURE_STORAGE_FILES
+// Parent directory of the picture directories, with the directory storage layout
+#define SD_PICTURE_DIRECTORY "/pictures"
+// Maximum number of pictures of a directory, with the directory storage layout
+#define SD_DIRECTORY_PICTURE_COUNT 256
+// Maximum length of a picture file path
+#define SD_PICTURE_PATH_MAX_SIZE 40
+
+/**
+ * Layout of the pictures on the SD card.
+ * See app_config_t.pictureStorage.
+ */
+typedef enum {
+  PICTURE_STORAGE_FILES = 0,       // One file by picture in the root directory, named by computePictureNameFromIndex()
+  PICTURE_STORAGE_SEGMENTS = 1,    // Pictures appended to segment files with an index, see segment.h
+  PICTURE_STORAGE_DIRECTORIES = 2, // One file by picture in directories of SD_DIRECTORY_PICTURE_COUNT pictures, see computePicturePath()
+  PICTURE_STORAGE_AUTO = 3         // Segments or directories, chosen by the SD card benchmark at the first mount, see calibrateSdCard()
+} picture_storage_t;
 
 /**
  * File counters.
- * Stored in a file on the SD card, it is used to
+ * Stored in a journal on the SD card and mirrored in RTC memory, it is used to
  * - name picture files on the SD card
  * - memorizes which files have been already uploaded
  * Ex: if pictureCounter is 25 and uploadedPictureCounter is 15
@@ -27,10 +79,95 @@
  * to understand why counters are different.
  */
 typedef struct {
-  uint16_t pictureCounter;         // Counter of taken pictures used to name files stored on the SD card
-  uint16_t uploadedPictureCounter; // Counter of uploaded pictures
+  uint32_t pictureCounter;         // Counter of taken pictures used to name files stored on the SD card
+  uint32_t uploadedPictureCounter; // Counter of uploaded pictures
 } fileCounters_t;
 
+/**
+ * Record of the counters journal.
+ * Records are appended to SD_COUNTERS_JOURNAL_FILE_NAME: a write interrupted by a reset
+ * or a brownout damages the last record only, and the previous one is used.
+ * All the integers are little endian.
+ */
+typedef struct {
+  uint32_t magic;                  // SD_COUNTERS_RECORD_MAGIC
+  uint32_t sequence;               // Sequence number of the record, the highest valid one holds the counters
+  uint32_t pictureCounter;         // fileCounters_t.pictureCounter
+  uint32_t uploadedPictureCounter; // fileCounters_t.uploadedPictureCounter
+  uint32_t crc;                    // CRC-32 of the fields above, as computed by crc32_le(0, ...)
+} file_counters_record_t;
+
+/**
+ * Counters mirrored in RTC memory along deep sleep, see initFileCounters().
+ * While it is valid, the counters are not read from the SD card,
+ * and a journal record is appended every SD_COUNTERS_JOURNAL_PERIOD pictures only.
+ */
+typedef struct {
+  uint32_t magic;                  // SD_COUNTERS_MIRROR_MAGIC
+  fileCounters_t counters;         // Current counters
+  fileCounters_t journaled;        // Counters of the last journal record
+  uint32_t sequence;               // Sequence number of the last journal record
+  uint32_t recordCount;            // Number of records of the journal file, SD_COUNTERS_JOURNAL_MAX_RECORDS to compact it
+  uint32_t crc;                    // CRC-32 of the fields above, wrong after a power on
+} file_counters_mirror_t;
+
+/**
+ * Space of the SD card, kept in RTC memory along deep sleep, see initSdSpace().
+ * It is computed by a scan of the card once, then updated at each saved or removed picture.
+ */
+typedef struct {
+  uint32_t magic;                  // SD_SPACE_MAGIC
+  uint64_t totalBytes;             // Size of the FAT volume
+  uint64_t usedBytes;              // Bytes used by the files
+  uint32_t crc;                    // CRC-32 of the fields above, wrong after a power on
+} sd_space_t;
+
+/**
+ * @brief Give the space accounting in RTC memory to the module.
+ *        Without it, the card is scanned once by wake cycle.
+ *
+ * @param space the space accounting in RTC memory
+ */
+void initSdSpace(sd_space_t *space);
+
+/**
+ * @brief Get the space of the SD card, scanned at the first call after a power on only.
+ *
+ * @param totalBytes receiving the size of the FAT volume
+ * @param usedBytes  receiving the bytes used by the files
+ *
+ * @return IS_OK when it succeeds or SD_INIT_ERROR when the SD card can't be mounted
+ */
+status_code_t getSdSpace(uint64_t *totalBytes, uint64_t *usedBytes);
+
+/**
+ * @brief Remove a file from the SD card and release its space.
+ *
+ * @param path the file path
+ *
+ * @return the number of bytes released, 0 when the file could not be removed
+ */
+uint64_t removeSdFile(const char *path);
+
+/**
+ * @brief Remove a picture file from the SD card and release its space.
+ *        The directory of the last picture of a directory is removed too.
+ *
+ * @param storage the storage layout, see picture_storage_t. Pictures can't be removed from a segment.
+ * @param index   the picture index, from 1
+ *
+ * @return the number of bytes released, 0 when the picture could not be removed
+ */
+uint64_t removePictureByIndex(uint8_t storage, uint32_t index);
+
+/**
+ * @brief Give the counters mirror in RTC memory to the module.
+ *        Without it, the counters are read from and written to the journal each time.
+ *
+ * @param mirror the counters mirror in RTC memory
+ */
+void initFileCounters(file_counters_mirror_t *mirror);
+
 /**
  * @brief Initialize (mount) the SD card.
  *
@@ -44,64 +181,149 @@ status_code_t initSdCard();
 void endSdCard();
 
 /**
- * @brief Save the picture data contained in pictureBuffer to a file named
- *        according to pictureFileName.
+ * @brief Save the picture data contained in pictureBuffer to a file
+ *        at the given path.
  *
- * @param pictureFileName a C string containing the picture file name
+ * @param path          a C string containing the picture file path, see computePicturePath()
  * @param pictureBuffer a byte buffer containing the picture data to store to the file
- * @param pictureLen the length of data contained the pictureBuffer
+ * @param pictureLen    the length of data contained the pictureBuffer
+ * @param crc           receiving the CRC-32 of the picture data computed while it is written, NULL when not needed
  *
  * @return IS_OK when the operation succeeds. SD_WRITE_ERROR in case of failure
  */
-status_code_t savePictureOnSdCard(char * pictureFileName, uint8_t * pictureBuffer, size_t pictureLen);
+status_code_t savePictureOnSdCard(char * path, uint8_t * pictureBuffer, size_t pictureLen, uint32_t * crc);
+
+/**
+ * @brief Set the size of the chunks written by writeSdChunks(), SD_WRITE_CHUNK_SIZE by default.
+ *        It applies from the next write.
+ *
+ * @param size the chunk size, a power of 2 from SD_WRITE_CHUNK_MIN_SIZE to SD_WRITE_CHUNK_SIZE
+ */
+void setSdWriteChunkSize(size_t size);
+
+/**
+ * @brief Write data to an open file in chunks aligned on SD_WRITE_CHUNK_SIZE file offsets,
+ *        copied to a DMA capable bounce buffer in internal RAM.
+ *        The throughput is recorded in the telemetry.
+ *
+ * @param file      the open file, at the offset
+ * @param offset    the offset of the file where the data is written
+ * @param header    the data written before the buffer, e.g. a record header, NULL when none
+ * @param headerLen the length of the header
+ * @param buffer    the data, e.g. a frame buffer in PSRAM
+ * @param len       the length of the data
+ * @param crc       receiving the CRC-32 of the data, header excluded, as computed by crc32_le(0, ...). NULL when not needed
+ *
+ * @return the number of bytes written, header included
+ */
+size_t writeSdChunks(File *file, uint32_t offset, const uint8_t *header, size_t headerLen, const uint8_t *buffer, size_t len, uint32_t *crc);
+
+/**
+ * @brief Compute the path of a picture file on the SD card according to the storage layout.
+ *
+ * @param storage the storage layout, see picture_storage_t. Segments have no picture file.
+ * @param index   the picture index, from 1
+ * @param path    the char array of SD_PICTURE_PATH_MAX_SIZE receiving the path
+ *
+ * @return the length of the path of the directory, "/" excluded
+ */
+uint8_t computePicturePath(uint8_t storage, uint32_t index, char *path);
+
+/**
+ * @brief Save a picture on the SD card according to the storage layout,
+ *        then write its record in the catalog.
+ *
+ * @param storage       the storage layout, see picture_storage_t
+ * @param index         the picture index, from 1
+ * @param pictureBuffer a byte buffer containing the picture data
+ * @param pictureLen    the length of data contained the pictureBuffer
+ * @param record        the catalog record with its hash, flags and priority, the other fields are set
+ *
+ * @return IS_OK when the operation succeeds. SD_WRITE_ERROR in case of failure
+ */
+status_code_t savePictureByIndex(uint8_t storage, uint32_t index, uint8_t *pictureBuffer, size_t pictureLen, catalog_record_t *record);
+
+/**
+ * @brief Open a picture saved on the SD card at the beginning of its data.
+ *
+ * @param storage    the storage layout, see picture_storage_t
+ * @param index      the picture index, from 1
+ * @param file       the File receiving the open file
+ * @param pictureLen the length of the picture data
+ *
+ * @return IS_OK when the operation succeeds. SD_READ_ERROR in case of failure
+ */
+status_code_t openPictureByIndex(uint8_t storage, uint32_t index, File *file, size_t *pictureLen);
+
+/**
+ * @brief Tell whether a picture is saved on the SD card, without logging when it is missing.
+ *
+ * @param storage the storage layout, see picture_storage_t
+ * @param index   the picture index, from 1
+ *
+ * @return true when the picture exists
+ */
+bool pictureExistsByIndex(uint8_t storage, uint32_t index);
 
 /**
  * @brief Read file counters stored on the SD card and populate
  *        the given structure.
- * 
+ *
  * @param fileCounters a pointer to a fileCounters_t to populate
  *
  * @return IS_OK when the operation succeeds. SD_READ_ERROR in case of failure
  *
- * @see SD_FILES_COUNTERS_FILE_NAME
+ * @see SD_COUNTERS_JOURNAL_FILE_NAME
  */
-status_code_t loadFileCounters(fileCounters_t * fileCounters);  
+status_code_t loadFileCounters(fileCounters_t * fileCounters);
 
 /**
- * @brief Write the given file counters in a file on the SD card,
- *        so they can be loaded at the next wakeup.
+ * @brief Update the counters mirror and append them to the journal on the SD card
+ *        when SD_COUNTERS_JOURNAL_PERIOD pictures have been saved or uploaded since the last record.
  *
  * @param fileCounters a pointer to a fileCounters_t to store
  *
  * @return IS_OK when the operation succeeds. SD_WRITE_ERROR in case of failure
  *
- * @see SD_FILES_COUNTERS_FILE_NAME
+ * @see SD_COUNTERS_JOURNAL_FILE_NAME
  */
 status_code_t saveFileCounters(fileCounters_t * fileCounters);
 
+/**
+ * @brief Move the picture counter of the RTC mirror back to the last picture written on the SD card,
+ *        when the next ones have been lost, e.g. queued by writePictureBehind() when the deadline expired.
+ *
+ * @param pictureCounter the index of the last picture written
+ */
+void rewindFileCounters(uint32_t pictureCounter);
+
 /**
  * @brief Populate the given structure file counters to 0
- *        and save them on SD card using saveFileCounters().
+ *        and append them to the journal on the SD card.
  *
  * @param fileCounters a pointer to a fileCounters_t to store
  *
  * @return IS_OK when the operation succeeds. SD_WRITE_ERROR in case of failure
  *
- * @see SD_FILES_COUNTERS_FILE_NAME
+ * @see SD_COUNTERS_JOURNAL_FILE_NAME
  */
 status_code_t createFileCounters(fileCounters_t *fileCounters);
 
 /**
- * @brief Like loadFileCounters(), excepted that it calls createFileCounters
- *        in case of loading error.
+ * @brief Get the counters from the RTC mirror, else load them from the SD card
+ *        and move pictureCounter past the pictures saved after the last journal record.
+ *        The counters are created on an SD card without any, and recovered from the saved pictures
+ *        when the journal is damaged.
+ *
+ * @param fileCounters a pointer to a fileCounters_t to populate
+ * @param storage      the storage layout of the pictures, see picture_storage_t
  *
  * @return IS_OK when the operation succeeds. SD_READ_ERROR or SD_WRITE_ERROR in case of failure
  *
- * @see SD_FILES_COUNTERS_FILE_NAME
  * @see loadFileCounters()
  * @see createFileCounters()
  * @see saveFileCounters()
  */
-status_code_t loadOrCreateFileCounters(fileCounters_t * fileCounters);
+status_code_t loadOrCreateFileCounters(fileCounters_t * fileCounters, uint8_t storage);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,371 @@
+#include "sdbench.h"
+
+// Benchmark results in RTC memory given to initSdBenchmark(), else in RAM
+static sd_benchmark_t ramSdBenchmark;
+static sd_benchmark_t *sdBenchmark = &ramSdBenchmark;
+
+// Names of the picture layouts in the logs, indexed by picture_storage_t
+static const char *pictureStorageNames[PICTURE_STORAGE_AUTO] = { "file", "segment", "directory" };
+
+/**
+ * @brief Give the benchmark results in RTC memory to the module.
+ *        Without it, the results are read from the SD card at each wake up.
+ *
+ * The results are ignored when their CRC is wrong, i.e. after a power on:
+ * they are read again from the SD card, which may have been replaced.
+ *
+ * @param benchmark the benchmark results in RTC memory
+ */
+void initSdBenchmark(sd_benchmark_t *benchmark) {
+  sdBenchmark = benchmark;
+}
+
+/**
+ * @brief Compute the CRC-32 of the benchmark results, their crc field excluded.
+ *
+ * @param benchmark the benchmark results
+ *
+ * @return the CRC-32
+ */
+static uint32_t computeSdBenchmarkCrc(const sd_benchmark_t *benchmark) {
+  return crc32_le(0, (const uint8_t *)benchmark, offsetof(sd_benchmark_t, crc));
+}
+
+/**
+ * @brief Check the benchmark results.
+ *
+ * @param benchmark the benchmark results
+ *
+ * @return true when their magic number and their CRC are right
+ */
+static bool isSdBenchmarkValid(const sd_benchmark_t *benchmark) {
+  return benchmark->magic == SD_BENCHMARK_MAGIC && benchmark->crc == computeSdBenchmarkCrc(benchmark);
+}
+
+/**
+ * @brief Compute a throughput.
+ *
+ * @param bytes the number of bytes transferred
+ * @param us    the duration of the transfer in µs
+ *
+ * @return the throughput in KB/s
+ */
+static uint32_t computeKBps(size_t bytes, uint32_t us) {
+  return (uint32_t)((uint64_t)bytes * 1000000 / 1024 / (us ? us : 1));
+}
+
+/**
+ * @brief Write SD_BENCHMARK_SEQUENTIAL_SIZE bytes to the scratch file in chunks of the given size.
+ *        The file is closed within the measure, so the cached data is flushed to the card.
+ *
+ * @param buffer    the data, in DMA capable internal RAM like the bounce buffer of writeSdChunks()
+ * @param chunkSize the chunk size
+ * @param kBps      receiving the throughput
+ *
+ * @return true when the data has been written
+ */
+static bool measureSequentialWrite(const uint8_t *buffer, size_t chunkSize, uint32_t *kBps) {
+  fs::FS &fs = SD_MMC;
+  size_t written = 0;
+
+  File file = fs.open(SD_BENCHMARK_SCRATCH_FILE_NAME, FILE_WRITE);
+  if (!file) {
+    return false;
+  }
+  uint32_t startUs = getTelemetryTimeUs();
+  while (written < SD_BENCHMARK_SEQUENTIAL_SIZE && file.write(buffer, chunkSize) == chunkSize) {
+    written += chunkSize;
+  }
+  file.close();
+  *kBps = computeKBps(written, getTelemetryTimeUs() - startUs);
+  return written == SD_BENCHMARK_SEQUENTIAL_SIZE;
+}
+
+/**
+ * @brief Read the scratch file in chunks of SD_WRITE_CHUNK_SIZE.
+ *
+ * @param buffer the buffer receiving the data, of SD_WRITE_CHUNK_SIZE bytes
+ * @param kBps   receiving the throughput
+ *
+ * @return true when the whole file has been read
+ */
+static bool measureSequentialRead(uint8_t *buffer, uint32_t *kBps) {
+  fs::FS &fs = SD_MMC;
+  size_t readLen = 0;
+  size_t n;
+
+  File file = fs.open(SD_BENCHMARK_SCRATCH_FILE_NAME, FILE_READ);
+  if (!file) {
+    return false;
+  }
+  uint32_t startUs = getTelemetryTimeUs();
+  while ((n = file.read(buffer, SD_WRITE_CHUNK_SIZE)) > 0) {
+    readLen += n;
+  }
+  file.close();
+  *kBps = computeKBps(readLen, getTelemetryTimeUs() - startUs);
+  return readLen == SD_BENCHMARK_SEQUENTIAL_SIZE;
+}
+
+/**
+ * @brief Create, write and close SD_BENCHMARK_SMALL_FILE_COUNT small files in the scratch directory,
+ *        like the picture files of the directory layout, then remove them.
+ *
+ * @param buffer the data of the files
+ * @param us     receiving the mean time by file
+ *
+ * @return true when the files have been created
+ */
+static bool measureSmallFileCreation(const uint8_t *buffer, uint32_t *us) {
+  fs::FS &fs = SD_MMC;
+  char path[SD_PICTURE_PATH_MAX_SIZE];
+  bool created = fs.mkdir(SD_BENCHMARK_SCRATCH_DIRECTORY);
+
+  uint32_t startUs = getTelemetryTimeUs();
+  for (uint8_t i = 0; created && i < SD_BENCHMARK_SMALL_FILE_COUNT; i++) {
+    snprintf(path, sizeof(path), SD_BENCHMARK_SCRATCH_DIRECTORY "/f%u.tmp", i);
+    File file = fs.open(path, FILE_WRITE);
+    created = file && file.write(buffer, SD_BENCHMARK_SMALL_FILE_SIZE) == SD_BENCHMARK_SMALL_FILE_SIZE;
+    file.close();
+  }
+  *us = (getTelemetryTimeUs() - startUs) / SD_BENCHMARK_SMALL_FILE_COUNT;
+  for (uint8_t i = 0; i < SD_BENCHMARK_SMALL_FILE_COUNT; i++) {
+    snprintf(path, sizeof(path), SD_BENCHMARK_SCRATCH_DIRECTORY "/f%u.tmp", i);
+    fs.remove(path);
+  }
+  fs.rmdir(SD_BENCHMARK_SCRATCH_DIRECTORY);
+  return created;
+}
+
+/**
+ * @brief Measure the sequential write throughput by chunk size, the sequential read throughput
+ *        and the small file creation time of the SD card on scratch files.
+ *
+ * The writes are done from a DMA capable buffer in internal RAM, like the bounce buffer of writeSdChunks(),
+ * SD_BENCHMARK_SEQUENTIAL_SIZE bytes by chunk size: it takes about 1 s on a 1 MB/s card.
+ * The scratch files are removed. The benchmark is recorded in the telemetry with the number of bytes written.
+ * The SD card has to be mounted first by calling initSdCard().
+ *
+ * @param benchmark the results receiving the measures
+ *
+ * @return IS_OK when it succeeds, SD_WRITE_ERROR or SD_READ_ERROR in case of failure
+ */
+status_code_t runSdBenchmark(sd_benchmark_t *benchmark) {
+  status_code_t result = IS_OK;
+  uint32_t startUs = getTelemetryTimeUs();
+  uint32_t writtenBytes = 0;
+
+  uint8_t *buffer = (uint8_t *)heap_caps_malloc(SD_WRITE_CHUNK_SIZE, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+  if (!buffer) {
+    logError(SD_BENCHMARK_LOG, "%s: failed to allocate %u bytes.", __func__, (unsigned int)SD_WRITE_CHUNK_SIZE);
+    return SD_WRITE_ERROR;
+  }
+  memset(buffer, 0xA5, SD_WRITE_CHUNK_SIZE);
+  size_t chunkSize = SD_WRITE_CHUNK_MIN_SIZE;
+  for (uint8_t i = 0; result == IS_OK && i < SD_BENCHMARK_CHUNK_SIZE_COUNT; i++, chunkSize *= 2) {
+    if (measureSequentialWrite(buffer, chunkSize, &(benchmark->writeKBps[i]))) {
+      writtenBytes += SD_BENCHMARK_SEQUENTIAL_SIZE;
+    } else {
+      result = SD_WRITE_ERROR;
+    }
+  }
+  if (result == IS_OK && !measureSequentialRead(buffer, &(benchmark->readKBps))) {
+    result = SD_READ_ERROR;
+  }
+  SD_MMC.remove(SD_BENCHMARK_SCRATCH_FILE_NAME);
+  if (result == IS_OK && !measureSmallFileCreation(buffer, &(benchmark->createUs))) {
+    result = SD_WRITE_ERROR;
+  }
+  heap_caps_free(buffer);
+  if (result != IS_OK) {
+    logError(SD_BENCHMARK_LOG, "%s: failed to measure the SD card.", __func__);
+  }
+  recordTransfer(TELEMETRY_PHASE_SD_BENCHMARK, startUs, writtenBytes, result);
+  return result;
+}
+
+/**
+ * @brief Choose the write chunk size and, when not chosen yet, the picture layout from the measures.
+ *
+ * The chunk size is the smallest one reaching SD_BENCHMARK_CHUNK_EFFICIENCY_PERCENT of the best write throughput:
+ * a card without a penalty on small transfers spares internal RAM. Without measures, it is SD_WRITE_CHUNK_SIZE.
+ * The segments are chosen when creating a file costs more than SD_BENCHMARK_SEGMENTS_CREATE_PERCENT
+ * of writing a picture of SD_BENCHMARK_PICTURE_SIZE bytes, else the directories.
+ * Once chosen, the layout is kept: the saved pictures are read with it.
+ *
+ * @param benchmark the benchmark results
+ */
+void selectSdStrategy(sd_benchmark_t *benchmark) {
+  uint32_t bestKBps = 0;
+  for (uint8_t i = 0; i < SD_BENCHMARK_CHUNK_SIZE_COUNT; i++) {
+    bestKBps = max(bestKBps, benchmark->writeKBps[i]);
+  }
+  benchmark->chunkSize = SD_WRITE_CHUNK_SIZE;
+  size_t chunkSize = SD_WRITE_CHUNK_MIN_SIZE;
+  for (uint8_t i = 0; bestKBps && i < SD_BENCHMARK_CHUNK_SIZE_COUNT; i++, chunkSize *= 2) {
+    if ((uint64_t)benchmark->writeKBps[i] * 100 >= (uint64_t)bestKBps * SD_BENCHMARK_CHUNK_EFFICIENCY_PERCENT) {
+      benchmark->chunkSize = chunkSize;
+      break;
+    }
+  }
+  if (benchmark->storage == PICTURE_STORAGE_AUTO) {
+    uint64_t pictureWriteUs = (uint64_t)SD_BENCHMARK_PICTURE_SIZE * 1000000 / 1024 / (bestKBps ? bestKBps : 1);
+    bool segments = (uint64_t)benchmark->createUs * 100 > pictureWriteUs * SD_BENCHMARK_SEGMENTS_CREATE_PERCENT;
+    benchmark->storage = segments ? PICTURE_STORAGE_SEGMENTS : PICTURE_STORAGE_DIRECTORIES;
+  }
+}
+
+/**
+ * @brief Compute the size of the write-behind queue the SD card writes in half the flush deadline.
+ *
+ * A deeper queue would hold pictures lost at the deadline. It is bounded
+ * by SD_BENCHMARK_QUEUE_MIN_BYTES and SD_BENCHMARK_QUEUE_MAX_BYTES.
+ * Without measures, it is WRITE_BEHIND_QUEUE_MAX_BYTES.
+ *
+ * @param benchmark       the benchmark results
+ * @param flushDeadlineMs the flush deadline, see app_config_t.flushDeadlineMs
+ *
+ * @return the queue size in bytes
+ */
+size_t computeWriteBehindQueueBytes(const sd_benchmark_t *benchmark, uint16_t flushDeadlineMs) {
+  uint8_t i = 0;
+  for (size_t chunkSize = SD_WRITE_CHUNK_MIN_SIZE; chunkSize < benchmark->chunkSize && i < SD_BENCHMARK_CHUNK_SIZE_COUNT - 1; chunkSize *= 2) {
+    i++;
+  }
+  if (!benchmark->writeKBps[i]) {
+    return WRITE_BEHIND_QUEUE_MAX_BYTES;
+  }
+  uint64_t bytes = (uint64_t)benchmark->writeKBps[i] * 1024 * flushDeadlineMs / 1000 / 2;
+  return (size_t)min(max(bytes, (uint64_t)SD_BENCHMARK_QUEUE_MIN_BYTES), (uint64_t)SD_BENCHMARK_QUEUE_MAX_BYTES);
+}
+
+/**
+ * @brief Read the benchmark results cached on the SD card.
+ *
+ * @param benchmark the results receiving the cached ones
+ *
+ * @return true when valid results have been read
+ */
+static bool readSdBenchmark(sd_benchmark_t *benchmark) {
+  fs::FS &fs = SD_MMC;
+  bool read = false;
+
+  if (fs.exists(SD_BENCHMARK_FILE_NAME)) {
+    File file = fs.open(SD_BENCHMARK_FILE_NAME, FILE_READ);
+    read = file && file.read((uint8_t *)benchmark, sizeof(sd_benchmark_t)) == sizeof(sd_benchmark_t);
+    file.close();
+  }
+  return read && isSdBenchmarkValid(benchmark);
+}
+
+/**
+ * @brief Write the benchmark results on the SD card.
+ *
+ * @param benchmark the benchmark results, their crc is computed
+ *
+ * @return true when the results have been written
+ */
+static bool writeSdBenchmark(sd_benchmark_t *benchmark) {
+  fs::FS &fs = SD_MMC;
+
+  benchmark->crc = computeSdBenchmarkCrc(benchmark);
+  File file = fs.open(SD_BENCHMARK_FILE_NAME, FILE_WRITE);
+  bool written = file && file.write((const uint8_t *)benchmark, sizeof(sd_benchmark_t)) == sizeof(sd_benchmark_t);
+  file.close();
+  return written;
+}
+
+/**
+ * @brief Apply the write strategy of the benchmark results in RTC memory: write chunk size,
+ *        write-behind queue size and picture layout.
+ *
+ * @param flushDeadlineMs the flush deadline, see app_config_t.flushDeadlineMs
+ * @param storage         the picture layout, see app_config_t.pictureStorage. PICTURE_STORAGE_AUTO is replaced by the chosen one.
+ */
+static void applySdStrategy(uint16_t flushDeadlineMs, uint8_t *storage) {
+  size_t queueBytes = computeWriteBehindQueueBytes(sdBenchmark, flushDeadlineMs);
+  setSdWriteChunkSize(sdBenchmark->chunkSize);
+  setWriteBehindQueueMaxBytes(queueBytes);
+  if (*storage == PICTURE_STORAGE_AUTO) {
+    *storage = sdBenchmark->storage;
+  }
+  logInfo(SD_BENCHMARK_LOG, "Write chunks of %u bytes, write-behind queue of %u bytes, %s layout.", (unsigned int)sdBenchmark->chunkSize,
+          (unsigned int)queueBytes, *storage < PICTURE_STORAGE_AUTO ? pictureStorageNames[*storage] : "unknown");
+}
+
+/**
+ * @brief Apply the SD card strategy from the benchmark results in RTC memory or cached on the SD card, without measuring the card.
+ *
+ * It keeps the benchmark off the paths which must not wait for it, e.g. before the first picture of a cold boot.
+ * When the card has never been measured, or its last benchmark failed, nothing is applied:
+ * calibrateSdCard() measures it later.
+ * The SD card has to be mounted first by calling initSdCard().
+ *
+ * @param flushDeadlineMs the flush deadline, see app_config_t.flushDeadlineMs
+ * @param storage         the picture layout, see app_config_t.pictureStorage. PICTURE_STORAGE_AUTO is replaced by the chosen one.
+ *
+ * @return true when the strategy is applied, false when the card has to be measured
+ */
+bool loadSdStrategy(uint16_t flushDeadlineMs, uint8_t *storage) {
+  sd_benchmark_t benchmark;
+
+  if (!isSdBenchmarkValid(sdBenchmark)) {
+    // A failed benchmark has no read throughput
+    if (!readSdBenchmark(&benchmark) || !benchmark.readKBps) {
+      return false;
+    }
+    memcpy(sdBenchmark, &benchmark, sizeof(sd_benchmark_t));
+  }
+  applySdStrategy(flushDeadlineMs, storage);
+  return true;
+}
+
+/**
+ * @brief Apply the SD card strategy, running the benchmark when the card has never been measured or on demand.
+ *
+ * The results are read from RTC memory, else from SD_BENCHMARK_FILE_NAME once per power on.
+ * When they are missing, e.g. at the first mount of a card, or when forced, the card is measured
+ * and the results are cached there. The picture layout chosen by the first benchmark is kept by the next ones.
+ * Then the write chunk size and the write-behind queue size are set: it must be called
+ * before the first picture is written. A failed benchmark is cached without measures, so the defaults are used
+ * and the directory layout is chosen, and the card is measured again at the next power on.
+ * The SD card has to be mounted first by calling initSdCard().
+ *
+ * @param force           true to measure the card again, once per power on
+ * @param flushDeadlineMs the flush deadline, see app_config_t.flushDeadlineMs
+ * @param storage         the picture layout, see app_config_t.pictureStorage. PICTURE_STORAGE_AUTO is replaced by the chosen one.
+ *
+ * @return IS_OK when it succeeds, SD_WRITE_ERROR or SD_READ_ERROR when the benchmark failed
+ *
+ * @see selectSdStrategy()
+ */
+status_code_t calibrateSdCard(bool force, uint16_t flushDeadlineMs, uint8_t *storage) {
+  status_code_t result = IS_OK;
+  sd_benchmark_t benchmark;
+
+  if (!isSdBenchmarkValid(sdBenchmark)) {
+    bool cached = readSdBenchmark(&benchmark);
+    // A failed benchmark has no read throughput
+    if (!cached || force || !benchmark.readKBps) {
+      uint8_t chosenStorage = cached ? benchmark.storage : (uint8_t)PICTURE_STORAGE_AUTO;
+      memset(&benchmark, 0, sizeof(sd_benchmark_t));
+      if ((result = runSdBenchmark(&benchmark)) != IS_OK) {
+        memset(&benchmark, 0, sizeof(sd_benchmark_t));
+      }
+      benchmark.magic = SD_BENCHMARK_MAGIC;
+      benchmark.storage = chosenStorage;
+      selectSdStrategy(&benchmark);
+      if (!writeSdBenchmark(&benchmark)) {
+        logWarn(SD_BENCHMARK_LOG, "%s: failed to write %s.", __func__, SD_BENCHMARK_FILE_NAME);
+      }
+      logInfo(SD_BENCHMARK_LOG, "Write %u/%u/%u/%u KB/s by 4/8/16/32 KB chunks, read %u KB/s, file creation %u us.",
+              (unsigned int)benchmark.writeKBps[0], (unsigned int)benchmark.writeKBps[1], (unsigned int)benchmark.writeKBps[2],
+              (unsigned int)benchmark.writeKBps[3], (unsigned int)benchmark.readKBps, (unsigned int)benchmark.createUs);
+    }
+    benchmark.crc = computeSdBenchmarkCrc(&benchmark);
+    memcpy(sdBenchmark, &benchmark, sizeof(sd_benchmark_t));
+  }
+
+  applySdStrategy(flushDeadlineMs, storage);
+  return result;
+}
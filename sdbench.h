@@ -0,0 +1,121 @@
+#ifndef SDBENCH_H
+#define SDBENCH_H
+
+#include "Arduino.h"
+#include "error.h"
+#include "logging.h"
+#include "sd.h"
+#include "telemetry.h"
+#include "writebehind.h"
+#include "esp32/rom/crc.h"
+#include "esp_heap_caps.h"
+#include "FS.h"
+#include "SD_MMC.h"
+
+// Logger name for this module
+#define SD_BENCHMARK_LOG "SdBench"
+
+// Default value of app_config_t.sdBenchmark
+#define SD_BENCHMARK_DEFAULT false
+// Name of the file caching the benchmark results on the SD card
+#define SD_BENCHMARK_FILE_NAME "/sdbench.bin"
+// Name of the scratch file of the sequential write and read measures
+#define SD_BENCHMARK_SCRATCH_FILE_NAME "/sdbench.tmp"
+// Name of the scratch directory of the small file creation measure
+#define SD_BENCHMARK_SCRATCH_DIRECTORY "/sdbench"
+// Magic number of the benchmark results: "CKBM"
+#define SD_BENCHMARK_MAGIC 0x4D424B43
+// Number of bytes written and read by each sequential measure
+#define SD_BENCHMARK_SEQUENTIAL_SIZE (128 * 1024)
+// Number of chunk sizes measured, from SD_WRITE_CHUNK_MIN_SIZE doubling up to SD_WRITE_CHUNK_SIZE
+#define SD_BENCHMARK_CHUNK_SIZE_COUNT 4
+// Number of small files created by the creation measure
+#define SD_BENCHMARK_SMALL_FILE_COUNT 8
+// Size of the small files
+#define SD_BENCHMARK_SMALL_FILE_SIZE 512
+// Share in percent of the best write throughput from which a smaller chunk size is chosen, sparing internal RAM
+#define SD_BENCHMARK_CHUNK_EFFICIENCY_PERCENT 90
+// Typical size of a picture, to weigh the creation of its file against the writing of its data
+#define SD_BENCHMARK_PICTURE_SIZE (100 * 1024)
+// Share in percent of the writing time of a picture above which the creation of its file makes the segments worth it
+#define SD_BENCHMARK_SEGMENTS_CREATE_PERCENT 25
+// Minimum size of the write-behind queue, sized to what the card writes in half the flush deadline
+#define SD_BENCHMARK_QUEUE_MIN_BYTES (256 * 1024)
+// Maximum size of the write-behind queue, bounding the PSRAM used
+#define SD_BENCHMARK_QUEUE_MAX_BYTES (2 * 1024 * 1024)
+
+/**
+ * Results of the SD card benchmark and the strategy chosen from them,
+ * cached in SD_BENCHMARK_FILE_NAME and kept in RTC memory along deep sleep.
+ * See the global variable sdBenchmark in the main file.
+ * All the integers are little endian.
+ *
+ * @see calibrateSdCard()
+ */
+typedef struct {
+  uint32_t magic;                                     // SD_BENCHMARK_MAGIC
+  uint32_t writeKBps[SD_BENCHMARK_CHUNK_SIZE_COUNT];  // Sequential write throughput in KB/s by chunk size, from SD_WRITE_CHUNK_MIN_SIZE
+  uint32_t readKBps;                                  // Sequential read throughput in KB/s
+  uint32_t createUs;                                  // Mean time in µs to create, write and close a small file in a directory
+  uint32_t chunkSize;                                 // Chosen size of the write chunks, see setSdWriteChunkSize()
+  uint8_t storage;                                    // Layout chosen for PICTURE_STORAGE_AUTO at the first benchmark, then kept
+  uint8_t reserved[3];                                // 0
+  uint32_t crc;                                       // CRC-32 of the fields above
+} sd_benchmark_t;
+
+/**
+ * @brief Give the benchmark results in RTC memory to the module.
+ *
+ * @param benchmark the benchmark results in RTC memory
+ */
+void initSdBenchmark(sd_benchmark_t *benchmark);
+
+/**
+ * @brief Measure the sequential write throughput by chunk size, the sequential read throughput
+ *        and the small file creation time of the SD card on scratch files.
+ *
+ * @param benchmark the results receiving the measures
+ *
+ * @return IS_OK when it succeeds, SD_WRITE_ERROR or SD_READ_ERROR in case of failure
+ */
+status_code_t runSdBenchmark(sd_benchmark_t *benchmark);
+
+/**
+ * @brief Choose the write chunk size and, when not chosen yet, the picture layout from the measures.
+ *
+ * @param benchmark the benchmark results
+ */
+void selectSdStrategy(sd_benchmark_t *benchmark);
+
+/**
+ * @brief Compute the size of the write-behind queue the SD card writes in half the flush deadline.
+ *
+ * @param benchmark       the benchmark results
+ * @param flushDeadlineMs the flush deadline, see app_config_t.flushDeadlineMs
+ *
+ * @return the queue size in bytes
+ */
+size_t computeWriteBehindQueueBytes(const sd_benchmark_t *benchmark, uint16_t flushDeadlineMs);
+
+/**
+ * @brief Apply the SD card strategy from the benchmark results in RTC memory or cached on the SD card, without measuring the card.
+ *
+ * @param flushDeadlineMs the flush deadline, see app_config_t.flushDeadlineMs
+ * @param storage         the picture layout, see app_config_t.pictureStorage. PICTURE_STORAGE_AUTO is replaced by the chosen one.
+ *
+ * @return true when the strategy is applied, false when the card has to be measured
+ */
+bool loadSdStrategy(uint16_t flushDeadlineMs, uint8_t *storage);
+
+/**
+ * @brief Apply the SD card strategy, running the benchmark when the card has never been measured or on demand.
+ *
+ * @param force           true to measure the card again, once per power on
+ * @param flushDeadlineMs the flush deadline, see app_config_t.flushDeadlineMs
+ * @param storage         the picture layout, see app_config_t.pictureStorage. PICTURE_STORAGE_AUTO is replaced by the chosen one.
+ *
+ * @return IS_OK when it succeeds, SD_WRITE_ERROR or SD_READ_ERROR when the benchmark failed
+ */
+status_code_t calibrateSdCard(bool force, uint16_t flushDeadlineMs, uint8_t *storage);
+
+#endif
@@ -0,0 +1,167 @@
+#include "segment.h"
+#include "sd.h"
+
+/**
+ * @brief Compute the paths of the segment file and of the index file of a segment.
+ *
+ * @param segment   the segment number
+ * @param dataPath  the char array of SEGMENT_PATH_MAX_SIZE receiving the segment file path
+ * @param indexPath the char array of SEGMENT_PATH_MAX_SIZE receiving the index file path
+ */
+void computeSegmentPaths(uint32_t segment, char *dataPath, char *indexPath) {
+  snprintf(dataPath, SEGMENT_PATH_MAX_SIZE, SEGMENT_DATA_PATH_FORMAT, (unsigned int)segment);
+  snprintf(indexPath, SEGMENT_PATH_MAX_SIZE, SEGMENT_INDEX_PATH_FORMAT, (unsigned int)segment);
+}
+
+/**
+ * @brief Write the index entry of a picture at its position in the index file.
+ *        Missing entries before it, e.g. pictures which failed to be saved, are written empty.
+ *        An entry written by a save interrupted before the counters update is overwritten.
+ *
+ * @param indexPath the index file path
+ * @param slot      the position of the entry in the index file
+ * @param entry     the entry to write
+ *
+ * @return true when it succeeds
+ */
+static bool writeSegmentIndexEntry(const char *indexPath, uint32_t slot, const segment_index_entry_t *entry) {
+  fs::FS &fs = SD_MMC;
+  uint32_t position = slot * sizeof(segment_index_entry_t);
+  segment_index_entry_t emptyEntry = {};
+  bool written;
+
+  File file = fs.exists(indexPath) ? fs.open(indexPath, "r+") : fs.open(indexPath, FILE_WRITE);
+  if (!file) {
+    return false;
+  }
+  uint32_t size = file.size() - file.size() % sizeof(segment_index_entry_t);
+  written = file.seek(size < position ? size : position);
+  for (; written && size < position; size += sizeof(segment_index_entry_t)) {
+    written = file.write((const uint8_t *)&emptyEntry, sizeof(segment_index_entry_t)) == sizeof(segment_index_entry_t);
+  }
+  written = written && file.write((const uint8_t *)entry, sizeof(segment_index_entry_t)) == sizeof(segment_index_entry_t);
+  file.close();
+  return written;
+}
+
+/**
+ * @brief Append a picture to its segment file, then write its index entry.
+ *
+ * Only the end of the segment file and one entry of its index are written:
+ * the directory holds two files by SEGMENT_PICTURE_COUNT pictures.
+ * The record header and the JPEG data are written together by writeSdChunks().
+ * When the board resets between both writes, the record stays in the segment file
+ * without index entry, and the picture is saved again with the same index.
+ * The SD card has to be mounted first by calling initSdCard().
+ *
+ * @param index     the picture index, from 1
+ * @param buffer    the JPEG data
+ * @param len       the length of the JPEG data
+ * @param timestamp the time of the save
+ * @param crc       the CRC-32 of the JPEG data, as computed by crc32_le(0, ...)
+ *
+ * @return IS_OK when the operation succeeds. SD_WRITE_ERROR in case of failure
+ */
+status_code_t appendPictureToSegment(uint32_t index, const uint8_t *buffer, size_t len, time_t timestamp, uint32_t crc) {
+  fs::FS &fs = SD_MMC;
+  char dataPath[SEGMENT_PATH_MAX_SIZE];
+  char indexPath[SEGMENT_PATH_MAX_SIZE];
+  segment_record_t record = { SEGMENT_RECORD_MAGIC, index, (uint32_t)len, (uint32_t)timestamp, crc };
+  segment_index_entry_t entry = { 0, record.length, record.timestamp, record.crc };
+  bool written;
+
+  computeSegmentPaths((index - 1) / SEGMENT_PICTURE_COUNT, dataPath, indexPath);
+  logInfo(SEGMENT_LOG, "%s: append picture %u to %s.", __func__, (unsigned int)index, dataPath);
+
+  File file = fs.open(dataPath, FILE_APPEND);
+  if (!file) {
+    logError(SEGMENT_LOG, "%s: failed to open segment file %s in append mode.", __func__, dataPath);
+    return SD_WRITE_ERROR;
+  }
+  entry.offset = file.size() + sizeof(segment_record_t);
+  written = writeSdChunks(&file, file.size(), (const uint8_t *)&record, sizeof(segment_record_t), buffer, len, NULL) == sizeof(segment_record_t) + len;
+  file.close();
+  if (!written) {
+    logError(SEGMENT_LOG, "%s: failed to write picture %u in %s.", __func__, (unsigned int)index, dataPath);
+    return SD_WRITE_ERROR;
+  }
+
+  if (!writeSegmentIndexEntry(indexPath, (index - 1) % SEGMENT_PICTURE_COUNT, &entry)) {
+    logError(SEGMENT_LOG, "%s: failed to write the entry of picture %u in %s.", __func__, (unsigned int)index, indexPath);
+    return SD_WRITE_ERROR;
+  }
+  return IS_OK;
+}
+
+/**
+ * @brief Read the index entry of a picture at its computed position in the index file.
+ *
+ * @param indexPath the index file path
+ * @param index     the picture index, from 1
+ * @param entry     the segment_index_entry_t receiving the entry
+ *
+ * @return true when the entry has been read and the picture is not missing
+ */
+static bool readSegmentIndexEntry(const char *indexPath, uint32_t index, segment_index_entry_t *entry) {
+  fs::FS &fs = SD_MMC;
+  bool read;
+
+  if (!fs.exists(indexPath)) {
+    return false;
+  }
+  File indexFile = fs.open(indexPath, FILE_READ);
+  read = indexFile && indexFile.seek(((index - 1) % SEGMENT_PICTURE_COUNT) * sizeof(segment_index_entry_t))
+         && indexFile.read((uint8_t *)entry, sizeof(segment_index_entry_t)) == sizeof(segment_index_entry_t);
+  indexFile.close();
+  return read && entry->length;
+}
+
+/**
+ * @brief Open the segment file of a picture at the beginning of its JPEG data.
+ *
+ * The index entry is read at its computed position: one seek by file, whatever the number of pictures.
+ * The SD card has to be mounted first by calling initSdCard().
+ *
+ * @param index the picture index, from 1
+ * @param file  the File receiving the open segment file
+ * @param entry the segment_index_entry_t receiving the index entry of the picture
+ *
+ * @return IS_OK when the operation succeeds. SD_READ_ERROR when the picture is missing
+ */
+status_code_t openSegmentPicture(uint32_t index, File *file, segment_index_entry_t *entry) {
+  fs::FS &fs = SD_MMC;
+  char dataPath[SEGMENT_PATH_MAX_SIZE];
+  char indexPath[SEGMENT_PATH_MAX_SIZE];
+
+  computeSegmentPaths((index - 1) / SEGMENT_PICTURE_COUNT, dataPath, indexPath);
+  if (!readSegmentIndexEntry(indexPath, index, entry)) {
+    logError(SEGMENT_LOG, "%s: no entry for picture %u in %s.", __func__, (unsigned int)index, indexPath);
+    return SD_READ_ERROR;
+  }
+
+  *file = fs.open(dataPath, FILE_READ);
+  if (!*file || !file->seek(entry->offset) || file->size() < entry->offset + entry->length) {
+    logError(SEGMENT_LOG, "%s: picture %u is missing in %s.", __func__, (unsigned int)index, dataPath);
+    file->close();
+    return SD_READ_ERROR;
+  }
+  return IS_OK;
+}
+
+/**
+ * @brief Tell whether a picture has an index entry, without logging when it is missing.
+ *
+ * The SD card has to be mounted first by calling initSdCard().
+ *
+ * @param index the picture index, from 1
+ *
+ * @return true when the picture has been appended to its segment
+ */
+bool segmentPictureExists(uint32_t index) {
+  char dataPath[SEGMENT_PATH_MAX_SIZE];
+  char indexPath[SEGMENT_PATH_MAX_SIZE];
+  segment_index_entry_t entry;
+
+  computeSegmentPaths((index - 1) / SEGMENT_PICTURE_COUNT, dataPath, indexPath);
+  return readSegmentIndexEntry(indexPath, index, &entry);
+}
@@ -0,0 +1,102 @@
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include "Arduino.h"
+#include "error.h"
+#include "logging.h"
+#include "esp32/rom/crc.h"
+#include "FS.h"
+#include "SD_MMC.h"
+
+// Logger name for this module
+#define SEGMENT_LOG "Segment"
+
+// Number of pictures of a segment, i.e. about 45 MB of XGA pictures.
+// A fixed number makes the segment and the index entry of a picture index a computation.
+#define SEGMENT_PICTURE_COUNT 512
+// Format of the segment file paths, from the segment number
+#define SEGMENT_DATA_PATH_FORMAT "/seg-%05u.bin"
+// Format of the segment index file paths, from the segment number
+#define SEGMENT_INDEX_PATH_FORMAT "/seg-%05u.idx"
+// Maximum length of a segment file path
+#define SEGMENT_PATH_MAX_SIZE 20
+// Magic number of a picture record header: "CKPS"
+#define SEGMENT_RECORD_MAGIC 0x53504B43
+
+/**
+ * Header of a picture record in a segment file, followed by the JPEG data.
+ * Records are appended: the JPEG data of the picture index i
+ * are in the segment (i - 1) / SEGMENT_PICTURE_COUNT.
+ * The headers make a segment readable without its index.
+ * All the integers are little endian.
+ */
+typedef struct {
+  uint32_t magic;      // SEGMENT_RECORD_MAGIC
+  uint32_t index;      // Picture index
+  uint32_t length;     // Length of the JPEG data
+  uint32_t timestamp;  // Time of the save in seconds since the epoch, before 2000 when the time is not synchronized
+  uint32_t crc;        // CRC-32 of the JPEG data, as computed by crc32_le(0, ...)
+} segment_record_t;
+
+/**
+ * Entry of a segment index file.
+ * The index file of a segment is an array of SEGMENT_PICTURE_COUNT entries at most:
+ * the entry of the picture index i is at ((i - 1) % SEGMENT_PICTURE_COUNT) * sizeof(segment_index_entry_t).
+ * All the integers are little endian.
+ */
+typedef struct {
+  uint32_t offset;     // Offset of the JPEG data in the segment file, after the record header
+  uint32_t length;     // Length of the JPEG data, 0 when the picture is missing
+  uint32_t timestamp;  // Time of the save, see segment_record_t
+  uint32_t crc;        // CRC-32 of the JPEG data, see segment_record_t
+} segment_index_entry_t;
+
+/**
+ * @brief Compute the paths of the segment file and of the index file of a segment.
+ *
+ * @param segment   the segment number
+ * @param dataPath  the char array of SEGMENT_PATH_MAX_SIZE receiving the segment file path
+ * @param indexPath the char array of SEGMENT_PATH_MAX_SIZE receiving the index file path
+ */
+void computeSegmentPaths(uint32_t segment, char *dataPath, char *indexPath);
+
+/**
+ * @brief Append a picture to its segment file, then write its index entry.
+ *
+ * The SD card has to be mounted first by calling initSdCard().
+ *
+ * @param index     the picture index, from 1
+ * @param buffer    the JPEG data
+ * @param len       the length of the JPEG data
+ * @param timestamp the time of the save
+ * @param crc       the CRC-32 of the JPEG data, as computed by crc32_le(0, ...)
+ *
+ * @return IS_OK when the operation succeeds. SD_WRITE_ERROR in case of failure
+ */
+status_code_t appendPictureToSegment(uint32_t index, const uint8_t *buffer, size_t len, time_t timestamp, uint32_t crc);
+
+/**
+ * @brief Open the segment file of a picture at the beginning of its JPEG data.
+ *
+ * The SD card has to be mounted first by calling initSdCard().
+ *
+ * @param index the picture index, from 1
+ * @param file  the File receiving the open segment file
+ * @param entry the segment_index_entry_t receiving the index entry of the picture
+ *
+ * @return IS_OK when the operation succeeds. SD_READ_ERROR when the picture is missing
+ */
+status_code_t openSegmentPicture(uint32_t index, File *file, segment_index_entry_t *entry);
+
+/**
+ * @brief Tell whether a picture has an index entry, without logging when it is missing.
+ *
+ * The SD card has to be mounted first by calling initSdCard().
+ *
+ * @param index the picture index, from 1
+ *
+ * @return true when the picture has been appended to its segment
+ */
+bool segmentPictureExists(uint32_t index);
+
+#endif
@@ -0,0 +1,205 @@
+#include "telemetry.h"
+
+// Ring buffer in RTC memory given to initTelemetry()
+static telemetry_ring_t *telemetryRing = NULL;
+// Protects the ring buffer, as jobs record phases from both cores
+static portMUX_TYPE telemetryMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Phase names, indexed by telemetry_phase_t
+static const char *telemetryPhaseNames[TELEMETRY_PHASE_COUNT] = {
+  "boot", "config", "camera", "camera-ready", "wifi", "picture",
+  "time", "save", "upload", "ota", "pause", "sleep", "awake", "burst", "motion", "sd-write",
+  "flush", "spill", "evict", "sd-bench", "boot-meta", "upload-send"
+};
+
+/**
+ * @brief Start the telemetry of a new wake cycle and record the boot phase.
+ *        It must be called first in setup().
+ *
+ * The ring buffer is reset when its magic number is wrong,
+ * i.e. after a power on or a firmware update changing its layout.
+ *
+ * @param ring the ring buffer in RTC memory
+ */
+void initTelemetry(telemetry_ring_t *ring) {
+  telemetryRing = ring;
+  if (ring->magic != TELEMETRY_RING_MAGIC) {
+    memset(ring, 0, sizeof(telemetry_ring_t));
+    ring->magic = TELEMETRY_RING_MAGIC;
+  }
+  ring->cycle++;
+  recordPhaseBetween(TELEMETRY_PHASE_BOOT, 0, getTelemetryTimeUs(), IS_OK);
+}
+
+/**
+ * @brief Get the current time of the telemetry.
+ *
+ * @return the time since the boot in microseconds
+ */
+uint32_t getTelemetryTimeUs() {
+  return (uint32_t)esp_timer_get_time();
+}
+
+/**
+ * @brief Append a record to the ring buffer.
+ *
+ * When the ring buffer is full, the oldest record is overwritten
+ * and counted in telemetry_ring_t.droppedCount.
+ *
+ * @param phase   the phase
+ * @param startUs the start time given by getTelemetryTimeUs()
+ * @param endUs   the end time given by getTelemetryTimeUs()
+ * @param bytes   the number of bytes transferred, 0 when none
+ * @param result  the phase result
+ */
+static void appendRecord(telemetry_phase_t phase, uint32_t startUs, uint32_t endUs, uint32_t bytes, status_code_t result) {
+  if (!telemetryRing) {
+    return;
+  }
+  portENTER_CRITICAL(&telemetryMux);
+  telemetry_ring_t *ring = telemetryRing;
+  if (ring->count == TELEMETRY_RING_SIZE) {
+    ring->head = (ring->head + 1) % TELEMETRY_RING_SIZE;
+    ring->count--;
+    ring->droppedCount++;
+  }
+  telemetry_record_t *record = &(ring->records[(ring->head + ring->count) % TELEMETRY_RING_SIZE]);
+  record->cycle = ring->cycle;
+  record->phase = phase;
+  record->result = result;
+  record->startUs = startUs;
+  record->durationUs = endUs - startUs;
+  record->bytes = bytes;
+  ring->count++;
+  portEXIT_CRITICAL(&telemetryMux);
+}
+
+/**
+ * @brief Record a phase which started at startUs and ends now.
+ *        It can be called from any task.
+ *
+ * @param phase   the phase
+ * @param startUs the start time given by getTelemetryTimeUs()
+ * @param result  the phase result
+ */
+void recordPhase(telemetry_phase_t phase, uint32_t startUs, status_code_t result) {
+  recordPhaseBetween(phase, startUs, getTelemetryTimeUs(), result);
+}
+
+/**
+ * @brief Record a phase which started and ended at the given times.
+ *
+ * @param phase   the phase
+ * @param startUs the start time given by getTelemetryTimeUs()
+ * @param endUs   the end time given by getTelemetryTimeUs()
+ * @param result  the phase result
+ */
+void recordPhaseBetween(telemetry_phase_t phase, uint32_t startUs, uint32_t endUs, status_code_t result) {
+  appendRecord(phase, startUs, endUs, 0, result);
+}
+
+/**
+ * @brief Record a phase which started at startUs, ends now and transferred bytes,
+ *        so its throughput can be computed.
+ *        It can be called from any task.
+ *
+ * @param phase   the phase
+ * @param startUs the start time given by getTelemetryTimeUs()
+ * @param bytes   the number of bytes transferred
+ * @param result  the phase result
+ */
+void recordTransfer(telemetry_phase_t phase, uint32_t startUs, uint32_t bytes, status_code_t result) {
+  appendRecord(phase, startUs, getTelemetryTimeUs(), bytes, result);
+}
+
+/**
+ * @brief Tell whether the header of the telemetry file is of the current version.
+ *
+ * @return true when the records can be appended to the file, e.g. when it is empty
+ */
+static bool isCurrentTelemetryFile() {
+  fs::FS &fs = SD_MMC;
+  telemetry_file_header_t header;
+  File file = fs.open(TELEMETRY_FILE_NAME, FILE_READ);
+  bool current = file && (file.size() == 0 || (file.read((uint8_t *)&header, sizeof(header)) == sizeof(header)
+                 && memcmp(header.magic, TELEMETRY_FILE_MAGIC, sizeof(header.magic)) == 0
+                 && header.version == TELEMETRY_FILE_VERSION && header.recordSize == sizeof(telemetry_record_t)));
+  file.close();
+  return current;
+}
+
+/**
+ * @brief Append the pending records to the telemetry file on the SD card
+ *        once there are TELEMETRY_FLUSH_THRESHOLD of them.
+ *
+ * Flushing in batches amortizes the file opening over several wake cycles.
+ * It must not be called while jobs are recording phases.
+ * The records are kept in the ring buffer when the writing fails.
+ *
+ * @return IS_OK when nothing has to be flushed or when it succeeds.
+ *         SD_INIT_ERROR or SD_WRITE_ERROR in case of failure.
+ *
+ * @see TELEMETRY_FILE_NAME
+ */
+status_code_t flushTelemetry() {
+  telemetry_ring_t *ring = telemetryRing;
+  if (!ring || ring->count < TELEMETRY_FLUSH_THRESHOLD) {
+    return IS_OK;
+  }
+
+  status_code_t result = initSdCard();
+  if (result != IS_OK) {
+    return result;
+  }
+
+  fs::FS &fs = SD_MMC;
+  if (fs.exists(TELEMETRY_FILE_NAME) && !isCurrentTelemetryFile()) {
+    // Records of another size can't follow the former ones
+    logInfo(TELEMETRY_LOG, "%s: file %s of a former version renamed to %s.", __func__, TELEMETRY_FILE_NAME, TELEMETRY_OLD_FILE_NAME);
+    if (fs.exists(TELEMETRY_OLD_FILE_NAME)) {
+      fs.remove(TELEMETRY_OLD_FILE_NAME);
+    }
+    fs.rename(TELEMETRY_FILE_NAME, TELEMETRY_OLD_FILE_NAME);
+  }
+  File file = fs.open(TELEMETRY_FILE_NAME, FILE_APPEND);
+  if (!file) {
+    logError(TELEMETRY_LOG, "%s: failed to open file %s in append mode.", __func__, TELEMETRY_FILE_NAME);
+    return SD_WRITE_ERROR;
+  }
+
+  size_t expectedSize = 0;
+  size_t writtenSize = 0;
+  if (file.size() == 0) {
+    telemetry_file_header_t header = { .version = TELEMETRY_FILE_VERSION, .recordSize = sizeof(telemetry_record_t) };
+    memcpy(header.magic, TELEMETRY_FILE_MAGIC, sizeof(header.magic));
+    expectedSize += sizeof(header);
+    writtenSize += file.write((uint8_t *)&header, sizeof(header));
+  }
+  // Pending records wrap at most once around the end of the ring
+  uint16_t firstPartCount = min((uint16_t)(TELEMETRY_RING_SIZE - ring->head), ring->count);
+  expectedSize += ring->count * sizeof(telemetry_record_t);
+  writtenSize += file.write((uint8_t *)&(ring->records[ring->head]), firstPartCount * sizeof(telemetry_record_t));
+  writtenSize += file.write((uint8_t *)ring->records, (ring->count - firstPartCount) * sizeof(telemetry_record_t));
+  file.close();
+
+  if (writtenSize != expectedSize) {
+    logError(TELEMETRY_LOG, "%s: failed to write file %s.", __func__, TELEMETRY_FILE_NAME);
+    return SD_WRITE_ERROR;
+  }
+  logInfo(TELEMETRY_LOG, "%s: %d record(s) flushed, %d dropped since the last flush.", __func__, ring->count, ring->droppedCount);
+  ring->head = 0;
+  ring->count = 0;
+  ring->droppedCount = 0;
+  return IS_OK;
+}
+
+/**
+ * @brief Get the name of a phase.
+ *
+ * @param phase a telemetry_phase_t value
+ *
+ * @return the phase name, "unknown" for an unknown value
+ */
+const char *getTelemetryPhaseName(uint8_t phase) {
+  return phase < TELEMETRY_PHASE_COUNT ? telemetryPhaseNames[phase] : "unknown";
+}
@@ -0,0 +1,166 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "Arduino.h"
+#include "esp_timer.h"
+#include "error.h"
+#include "logging.h"
+#include "sd.h"
+#include "freertos/FreeRTOS.h"
+
+// Logger name for this module
+#define TELEMETRY_LOG "Telemetry"
+
+// File on the SD card receiving the flushed records
+#define TELEMETRY_FILE_NAME "/telemetry.bin"
+// Magic number at the beginning of the telemetry file
+#define TELEMETRY_FILE_MAGIC "CKTL"
+// Version of the telemetry file format
+#define TELEMETRY_FILE_VERSION 2
+// Telemetry file of a former version, renamed before a new file is started
+#define TELEMETRY_OLD_FILE_NAME "/telemetry.old"
+// Magic number telling that the ring in RTC memory has been initialized
+#define TELEMETRY_RING_MAGIC 0x544C4D32
+// Number of records kept in RTC memory
+#define TELEMETRY_RING_SIZE 64
+// Number of pending records from which they are flushed to the SD card.
+// Some cycles can pass without a flush, so it leaves room for them.
+#define TELEMETRY_FLUSH_THRESHOLD 32
+
+/**
+ * Phases of a wake cycle timed by the telemetry.
+ * Values are stored in the telemetry file: only append new ones.
+ *
+ * @see telemetry_record_t
+ */
+typedef enum {
+  TELEMETRY_PHASE_BOOT = 0,      // From the boot to setup()
+  TELEMETRY_PHASE_CONFIG,        // initAppConfig()
+  TELEMETRY_PHASE_CAMERA_INIT,   // initCamera(), camera ready wait included
+  TELEMETRY_PHASE_CAMERA_READY,  // Wait of camera_settings_t.getReadyDelayMs in initCamera()
+  TELEMETRY_PHASE_WIFI,          // Early WiFi association
+  TELEMETRY_PHASE_PICTURE,       // takePicture()
+  TELEMETRY_PHASE_TIME,          // syncTime()
+  TELEMETRY_PHASE_SAVE,          // Picture saving on the SD card
+  TELEMETRY_PHASE_UPLOAD,        // Picture upload
+  TELEMETRY_PHASE_OTA,           // Firmware update check
+  TELEMETRY_PHASE_PAUSE,         // Pause of app_config_t.awakeDurationMs
+  TELEMETRY_PHASE_SLEEP,         // zzzzZZZZ() until esp_deep_sleep_start()
+  TELEMETRY_PHASE_AWAKE,         // The whole wake cycle, from the boot to esp_deep_sleep_start()
+  TELEMETRY_PHASE_BURST,         // Saving of the burst pictures following the first one
+  TELEMETRY_PHASE_MOTION,        // checkMotion(), included in the picture phase
+  TELEMETRY_PHASE_SD_WRITE,      // Writing of the data of one picture by writeSdChunks(), with its byte count
+  TELEMETRY_PHASE_FLUSH,         // Wait for the pictures queued by writePictureBehind() before the sleep, with the byte count left
+  TELEMETRY_PHASE_SPILL,         // Saving of a picture which did not fit in the write-behind queue, with its byte count
+  TELEMETRY_PHASE_EVICT,         // Batch of evictPictures() removing the oldest pictures, with the byte count released
+  TELEMETRY_PHASE_SD_BENCHMARK,  // Benchmark of the SD card by runSdBenchmark(), with the byte count written
+  TELEMETRY_PHASE_BOOT_METADATA, // Single pass of loadBootMetadata() reading the SD card metadata at a cold boot
+  TELEMETRY_PHASE_UPLOAD_SEND,   // Sending of the data of one picture file by the upload, with its byte count
+  TELEMETRY_PHASE_COUNT
+} telemetry_phase_t;
+
+/**
+ * Timing of one phase of a wake cycle.
+ * It is stored as is in the telemetry file (little endian).
+ */
+typedef struct __attribute__((packed)) {
+  uint16_t cycle;       // Wake cycle number since the power on, wraps
+  uint8_t phase;        // telemetry_phase_t
+  uint8_t result;       // status_code_t of the phase
+  uint32_t startUs;     // Start time in esp_timer_get_time(), i.e. since the boot
+  uint32_t durationUs;  // Duration in microseconds
+  uint32_t bytes;       // Bytes transferred during the phase, 0 when it transfers nothing. Since version 2.
+} telemetry_record_t;
+
+/**
+ * Header of the telemetry file, followed by telemetry_record_t.
+ */
+typedef struct __attribute__((packed)) {
+  char magic[4];        // TELEMETRY_FILE_MAGIC
+  uint16_t version;     // TELEMETRY_FILE_VERSION
+  uint16_t recordSize;  // sizeof(telemetry_record_t)
+} telemetry_file_header_t;
+
+/**
+ * Ring buffer of the records not yet flushed to the SD card.
+ * Stored in the RTC memory, it is kept along deep sleep.
+ * See the global variable telemetryRing in the main file.
+ *
+ * @see initTelemetry()
+ */
+typedef struct {
+  uint32_t magic;          // TELEMETRY_RING_MAGIC once initialized
+  uint16_t cycle;          // Current wake cycle number
+  uint16_t head;           // Index of the oldest pending record
+  uint16_t count;          // Number of pending records
+  uint16_t droppedCount;   // Number of records overwritten before being flushed
+  telemetry_record_t records[TELEMETRY_RING_SIZE];
+} telemetry_ring_t;
+
+/**
+ * @brief Start the telemetry of a new wake cycle and record the boot phase.
+ *        It must be called first in setup().
+ *
+ * @param ring the ring buffer in RTC memory
+ */
+void initTelemetry(telemetry_ring_t *ring);
+
+/**
+ * @brief Get the current time of the telemetry.
+ *
+ * @return the time since the boot in microseconds
+ */
+uint32_t getTelemetryTimeUs();
+
+/**
+ * @brief Record a phase which started at startUs and ends now.
+ *        It can be called from any task.
+ *
+ * @param phase   the phase
+ * @param startUs the start time given by getTelemetryTimeUs()
+ * @param result  the phase result
+ */
+void recordPhase(telemetry_phase_t phase, uint32_t startUs, status_code_t result);
+
+/**
+ * @brief Record a phase which started and ended at the given times.
+ *
+ * @param phase   the phase
+ * @param startUs the start time given by getTelemetryTimeUs()
+ * @param endUs   the end time given by getTelemetryTimeUs()
+ * @param result  the phase result
+ */
+void recordPhaseBetween(telemetry_phase_t phase, uint32_t startUs, uint32_t endUs, status_code_t result);
+
+/**
+ * @brief Record a phase which started at startUs, ends now and transferred bytes,
+ *        so its throughput can be computed.
+ *
+ * @param phase   the phase
+ * @param startUs the start time given by getTelemetryTimeUs()
+ * @param bytes   the number of bytes transferred
+ * @param result  the phase result
+ */
+void recordTransfer(telemetry_phase_t phase, uint32_t startUs, uint32_t bytes, status_code_t result);
+
+/**
+ * @brief Append the pending records to the telemetry file on the SD card
+ *        once there are TELEMETRY_FLUSH_THRESHOLD of them.
+ *
+ * @return IS_OK when nothing has to be flushed or when it succeeds.
+ *         SD_INIT_ERROR or SD_WRITE_ERROR in case of failure.
+ *
+ * @see TELEMETRY_FILE_NAME
+ */
+status_code_t flushTelemetry();
+
+/**
+ * @brief Get the name of a phase.
+ *
+ * @param phase a telemetry_phase_t value
+ *
+ * @return the phase name, "unknown" for an unknown value
+ */
+const char *getTelemetryPhaseName(uint8_t phase);
+
+#endif
@@ -43,7 +43,7 @@ void syncTime(wifi_settings_t * wifi, time_settings_t * timeSettings) {
       logError(TIME_LOG, "No WiFi, no NTP, no time updated.");
     }
   }
-#ifdef LOG_LEVEL >= LOG_LEVEL_INFO
+#if LOG_LEVEL >= LOG_LEVEL_INFO
   logInfo(TIME_LOG, "Time: ");
   Serial.println(&tm, "%A, %B %d %Y %H:%M:%S");
 #endif
@@ -1,4 +1,87 @@
 #include "upload.h"
+#include "bootmeta.h"
+
+/**
+ * Connection to the upload server, kept open across the uploads of a batch
+ * with HTTP/1.1 keep-alive, so each picture doesn't cost a TCP handshake
+ * and a DNS lookup. It is opened again when the server has closed it.
+ *
+ * @see uploadPictureFiles()
+ * @see Uploader
+ */
+UploadConnection::UploadConnection(upload_settings_t *uploadSettings, bool keepAlive)
+  : uploadSettings(uploadSettings), keepAlive(keepAlive){};
+
+/**
+ * Destructor, closing the connection.
+ */
+UploadConnection::~UploadConnection() {
+  close();
+}
+
+/**
+ * Connect to the server, unless the connection is still open from a previous request.
+ * A connection closed by the server meanwhile, e.g. after its keep-alive timeout, is opened again.
+ * The Nagle algorithm is disabled according to upload_settings_t.noDelay.
+ *
+ * @param reused receiving true when the open connection is reused
+ *
+ * @return true when the connection is open
+ */
+bool UploadConnection::open(bool *reused) {
+  *reused = opened && client.connected();
+  if (!*reused) {
+    client.stop();
+    logInfo(UPLOAD_LOG, "Connecting to server: %s.", uploadSettings->serverAddress);
+    opened = client.connect(uploadSettings->serverAddress, uploadSettings->serverPort);
+    if (!opened) {
+      logError(UPLOAD_LOG, "%s: connection to %s failed.", __func__, uploadSettings->serverAddress);
+      return false;
+    }
+    client.setNoDelay(uploadSettings->noDelay);
+    connectCount++;
+  }
+  requestCount++;
+  return true;
+}
+
+/**
+ * Close the connection.
+ */
+void UploadConnection::close() {
+  if (opened) {
+    client.stop();
+    opened = false;
+  }
+}
+
+/**
+ * @return true when the connection is kept open after each request
+ */
+bool UploadConnection::isKeepAlive() {
+  return keepAlive;
+}
+
+/**
+ * @return the WiFi client of the connection
+ */
+WiFiClient *UploadConnection::getClient() {
+  return &client;
+}
+
+/**
+ * @return the number of connections opened to the server
+ */
+uint32_t UploadConnection::getConnectCount() {
+  return connectCount;
+}
+
+/**
+ * @return the number of requests sent to the server
+ */
+uint32_t UploadConnection::getRequestCount() {
+  return requestCount;
+}
 
 /**
  * Abstract class in charge to upload one picture to the server
@@ -8,144 +91,559 @@
  * @see BufferUploader
  * @see FileUploader
  */
-Uploader::Uploader(upload_settings_t *uploadSettings, uint32_t dataLen, String destFileName)
-  : uploadSettings(uploadSettings), dataLen(dataLen), destFileName(destFileName){};
+Uploader::Uploader(upload_settings_t *uploadSettings, uint32_t dataLen, String destFileName, UploadConnection *connection)
+  : uploadSettings(uploadSettings), dataLen(dataLen), destFileName(destFileName), ownConnection(uploadSettings, false),
+    connection(connection ? connection : &ownConnection), client(*(this->connection->getClient())){};
+
+/**
+  * Give the CRC-32 of the data, sent to the server in the UPLOAD_CRC_HEADER header
+  * and checked against the data actually sent.
+  *
+  * @param crc the CRC-32 of the data, as computed by crc32_le(0, ...)
+  */
+void Uploader::setDataCrc(uint32_t crc) {
+  dataCrc = crc;
+  dataCrcKnown = true;
+}
 
 /**
   * Launch the data upload.
   *
+  * The request is sent over the given connection when it is still open, else over a new one.
+  * When the server closed the reused connection before responding, the request is sent again
+  * over a new connection, once.
+  * When the data doesn't match its CRC-32, e.g. a picture corrupted on the SD card,
+  * the connection is closed before the end of the request, so the server drops it.
+  *
   * @return IS_OK when it succeeds
   *         or WIFI_INIT_ERROR when the WiFi can not be initialized
+  *         or SD_CORRUPTED_DATA_ERROR when the data sent doesn't match the CRC-32 given by setDataCrc()
   *         or UPLOAD_PICTURE_ERROR if the operation failed.
   */
 status_code_t Uploader::upload() {
-  status_code_t result = IS_OK;
-
-  logInfo(UPLOAD_LOG, "Connecting to server: %s.", uploadSettings->serverAddress);
-
-  if (client.connect(uploadSettings->serverAddress, uploadSettings->serverPort)) {
-    logInfo(UPLOAD_LOG, "Uploading file %s...", destFileName);
-
-    String head = "--EspCamWebUpload\r\nContent-Disposition: form-data; name=\"auth\"\r\n\r\n" + String(uploadSettings->auth) + "\r\n--EspCamWebUpload\r\nContent-Disposition: form-data; name=\"fileToUpload\"; filename=\"" + destFileName + "\"\r\nContent-Type: image/jpeg\r\n\r\n";
-    String tail = "\r\n--EspCamWebUpload--\r\n";
-
-    uint32_t extraLen = head.length() + tail.length();
-    uint32_t totalLen = dataLen + extraLen;
-
-    client.print("POST ");
-    client.print(uploadSettings->path);
-    client.println(" HTTP/1.1");
-    client.print("Host: ");
-    client.println(uploadSettings->serverAddress);
-    client.println("Content-Length: " + String(totalLen));
-    client.println("Content-Type: multipart/form-data; boundary=EspCamWebUpload");
-    client.println();
-    client.print(head);
-
-    sendData();
-
-    client.print(tail);
-
-    // Read response status code
-    long startTime = millis();
-    long timeoutTime = startTime + 10000;
-    boolean statusCodeReadingStarted = false;
-    uint8_t statusCodeReadingPosition = 0;
-    char status_code_tStr[4];
-
-    while (millis() < timeoutTime) {
-      Serial.print(".");
-      delay(100);
-      while (client.available()) {
-        char c = client.read();
-        if (!statusCodeReadingStarted) {
-          statusCodeReadingStarted = (c == ' ');
-        } else {
-          if (statusCodeReadingPosition == 3 || c == ' ') {
-            // status code read => break
-            break;
-          } else {
-            // status code recording
-            status_code_tStr[statusCodeReadingPosition++] = c;
-          }
-        }
-      }
-    }
-    client.stop();
-    // End char array with \0
-    status_code_tStr[statusCodeReadingPosition] = 0;
-    // Convert status code to int
-    int status_code_t = atoi(status_code_tStr);
-    logInfo(UPLOAD_LOG, "Response status code: %d.", status_code_t);
-    result = status_code_t == 200 ? IS_OK : UPLOAD_PICTURE_ERROR;
-  } else {
-    logError(UPLOAD_LOG, "%s: connection to %s failed.", __func__, uploadSettings->serverAddress);
-    result = UPLOAD_PICTURE_ERROR;
+  bool reused;
+  status_code_t result = sendRequest(&reused);
+  if (result == UPLOAD_PICTURE_ERROR && reused && !responseStatusCode && rewindData()) {
+    logInfo(UPLOAD_LOG, "Connection closed by the server, reconnecting.");
+    result = sendRequest(&reused);
   }
   return result;
 };
 
+/**
+  * @brief Render formatted text at the end of a buffer, like snprintf().
+  *
+  * @param buffer the buffer, NULL to compute the length only
+  * @param size   the size of the buffer
+  * @param len    the length already rendered in the buffer
+  * @param format the printf() format
+  *
+  * @return the new length, above size when the buffer is too small
+  */
+static size_t renderFormat(char *buffer, size_t size, size_t len, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  int addedLen = vsnprintf(buffer && len < size ? buffer + len : NULL, buffer && len < size ? size - len : 0, format, args);
+  va_end(args);
+  return len + (addedLen > 0 ? addedLen : 0);
+}
+
+/**
+  * Send the request over the connection, opened when needed, and read the response.
+  * The connection is closed after the response, unless it is kept alive by both sides.
+  *
+  * The request line, the headers, the auth part and the head of the first picture part
+  * are rendered once in a buffer and sent by a single write, so they fill TCP segments
+  * instead of a segment each. The picture data follows without intermediate copy, see sendData().
+  *
+  * @param reused receiving true when an open connection has been reused
+  *
+  * @return the upload() result
+  */
+status_code_t Uploader::sendRequest(bool *reused) {
+  responseStatusCode = 0;
+  if (!connection->open(reused)) {
+    return UPLOAD_PICTURE_ERROR;
+  }
+  logInfo(UPLOAD_LOG, "Uploading file %s...", destFileName.c_str());
+
+  static const char authPartFormat[] = "--" UPLOAD_MULTIPART_BOUNDARY "\r\nContent-Disposition: form-data; name=\"auth\"\r\n\r\n%s\r\n";
+  static const char tail[] = "\r\n--" UPLOAD_MULTIPART_BOUNDARY "--\r\n";
+  uint32_t totalLen = renderFormat(NULL, 0, 0, authPartFormat, uploadSettings->auth) + computePartsLen() + sizeof(tail) - 1;
+
+  char head[UPLOAD_REQUEST_HEAD_MAX_SIZE];
+  size_t headLen = renderFormat(head, sizeof(head), 0,
+                                "POST %s HTTP/1.1\r\nHost: %s\r\nContent-Length: %u\r\n"
+                                "Content-Type: multipart/form-data; boundary=" UPLOAD_MULTIPART_BOUNDARY "\r\nConnection: %s\r\n",
+                                uploadSettings->path, uploadSettings->serverAddress, (unsigned int)totalLen,
+                                connection->isKeepAlive() ? "keep-alive" : "close");
+  headLen = renderExtraHeaders(head, sizeof(head), headLen);
+  headLen = renderFormat(head, sizeof(head), headLen, "\r\n");
+  headLen = renderFormat(head, sizeof(head), headLen, authPartFormat, uploadSettings->auth);
+  headLen = renderFirstPartHead(head, sizeof(head), headLen);
+  if (headLen >= sizeof(head)) {
+    connection->close();
+    logError(UPLOAD_LOG, "%s: request head of %u bytes, above UPLOAD_REQUEST_HEAD_MAX_SIZE.", __func__, (unsigned int)headLen);
+    return UPLOAD_PICTURE_ERROR;
+  }
+  client.write((const uint8_t *)head, headLen);
+
+  status_code_t result = sendParts();
+  if (result != IS_OK) {
+    connection->close();
+    return result;
+  }
+
+  client.write((const uint8_t *)tail, sizeof(tail) - 1);
+
+  bool serverKeepAlive;
+  responseStatusCode = readResponse(&serverKeepAlive);
+  if (!serverKeepAlive || !connection->isKeepAlive()) {
+    connection->close();
+  }
+  logInfo(UPLOAD_LOG, "Response status code: %d.", responseStatusCode);
+  return responseStatusCode == 200 ? IS_OK : UPLOAD_PICTURE_ERROR;
+}
+
+/**
+  * Render the multipart head of a picture part at the end of a buffer, up to the picture data.
+  * The part is ended by the "\r\n" starting the delimiter of the next part or the closing one.
+  *
+  * @param buffer    the buffer, NULL to compute the length only
+  * @param size      the size of the buffer
+  * @param len       the length already rendered in the buffer
+  * @param delimited true to end the previous part first
+  * @param fileName  the file name that the server will see
+  * @param crcKnown  true to give the CRC-32 of the picture in a UPLOAD_CRC_HEADER part header
+  * @param crc       the CRC-32 of the picture
+  *
+  * @return the new length, above size when the buffer is too small
+  */
+size_t Uploader::renderPartHead(char *buffer, size_t size, size_t len, bool delimited, const char *fileName, bool crcKnown, uint32_t crc) {
+  len = renderFormat(buffer, size, len, "%s--" UPLOAD_MULTIPART_BOUNDARY "\r\nContent-Disposition: form-data; name=\"fileToUpload\"; filename=\"%s\"\r\n",
+                     delimited ? "\r\n" : "", fileName);
+  if (crcKnown) {
+    len = renderFormat(buffer, size, len, UPLOAD_CRC_HEADER ": %08x\r\n", (unsigned int)crc);
+  }
+  return renderFormat(buffer, size, len, "Content-Type: image/jpeg\r\n\r\n");
+}
+
+/**
+  * Compute the length of the picture parts of the request body, their data included.
+  * By default, a single part with the data of sendData().
+  *
+  * @return the length in bytes
+  */
+uint32_t Uploader::computePartsLen() {
+  return renderFirstPartHead(NULL, 0, 0) + dataLen;
+}
+
+/**
+  * Render the headers of the request specific to the uploader at the end of the request head.
+  * By default, the CRC-32 given by setDataCrc() in the UPLOAD_CRC_HEADER header.
+  *
+  * @param buffer the buffer, NULL to compute the length only
+  * @param size   the size of the buffer
+  * @param len    the length already rendered in the buffer
+  *
+  * @return the new length, above size when the buffer is too small
+  */
+size_t Uploader::renderExtraHeaders(char *buffer, size_t size, size_t len) {
+  return dataCrcKnown ? renderFormat(buffer, size, len, UPLOAD_CRC_HEADER ": %08x\r\n", (unsigned int)dataCrc) : len;
+}
+
+/**
+  * Render the head of the first picture part at the end of the request head.
+  * By default, the head of the single part, without CRC-32 part header: the CRC-32 is a request header.
+  *
+  * @param buffer the buffer, NULL to compute the length only
+  * @param size   the size of the buffer
+  * @param len    the length already rendered in the buffer
+  *
+  * @return the new length, above size when the buffer is too small
+  */
+size_t Uploader::renderFirstPartHead(char *buffer, size_t size, size_t len) {
+  return renderPartHead(buffer, size, len, false, destFileName.c_str(), false, 0);
+}
+
+/**
+  * Send the picture parts of the request body, after the head of the first one sent with the request head.
+  * By default, the data of sendData(), checked against the CRC-32 given by setDataCrc().
+  *
+  * @return IS_OK when they have been sent, SD_CORRUPTED_DATA_ERROR when the data doesn't match its CRC-32
+  */
+status_code_t Uploader::sendParts() {
+  sentCrc = 0;
+  sendData();
+  if (dataCrcKnown && sentCrc != dataCrc) {
+    logError(UPLOAD_LOG, "%s: %s read with CRC-32 %08x instead of %08x, upload aborted.", __func__, destFileName.c_str(),
+             (unsigned int)sentCrc, (unsigned int)dataCrc);
+    return SD_CORRUPTED_DATA_ERROR;
+  }
+  return IS_OK;
+}
+
+/**
+  * @brief Wait for the server to send data, or to close the connection, without polling.
+  *
+  * @param client    the WiFi client
+  * @param timeoutMs the maximum time to wait
+  *
+  * @return false when the connection has no socket
+  */
+static bool waitResponseData(WiFiClient &client, uint32_t timeoutMs) {
+  int fd = client.fd();
+  if (fd < 0) {
+    return false;
+  }
+  fd_set readSet;
+  FD_ZERO(&readSet);
+  FD_SET(fd, &readSet);
+  struct timeval timeout = { (time_t)(timeoutMs / 1000), (suseconds_t)((timeoutMs % 1000) * 1000) };
+  select(fd + 1, &readSet, NULL, NULL, &timeout);
+  return true;
+}
+
+/**
+  * Read the server response: status line, headers and body,
+  * until it is complete, the server closes the connection or upload_settings_t.responseTimeoutMs expires,
+  * even while data keeps arriving.
+  * The response is parsed by blocks as they arrive, see parseHttpResponse(): it returns as soon as
+  * the last byte of the body is received, whether it is delimited by its Content-Length or by chunks.
+  * Between the blocks, it sleeps until the socket is readable.
+  * The beginning of the body is kept in responseBody, when given.
+  *
+  * @param serverKeepAlive receiving false when the connection can't be reused:
+  *                        closed by the server or the response is incomplete
+  *
+  * @return the status code, 0 without response
+  */
+int Uploader::readResponse(bool *serverKeepAlive) {
+  http_response_t response;
+  uint8_t buffer[UPLOAD_RESPONSE_BUFFER_SIZE];
+  uint32_t startMs = millis();
+  uint32_t elapsedMs;
+
+  initHttpResponse(&response, responseBody, responseBodySize);
+  while (isHttpResponsePending(&response)) {
+    // The deadline holds even for a server trickling the response
+    if ((elapsedMs = millis() - startMs) >= uploadSettings->responseTimeoutMs) {
+      logWarn(UPLOAD_LOG, "%s: incomplete response after %u ms.", __func__, (unsigned int)elapsedMs);
+      break;
+    }
+    int len = client.available() ? client.read(buffer, sizeof(buffer)) : 0;
+    if (len > 0) {
+      parseHttpResponse(&response, buffer, len);
+    } else if (!client.connected()) {
+      endHttpResponse(&response);
+    } else if (!waitResponseData(client, uploadSettings->responseTimeoutMs - elapsedMs)) {
+      logWarn(UPLOAD_LOG, "%s: incomplete response after %u ms.", __func__, (unsigned int)(millis() - startMs));
+      break;
+    }
+  }
+  *serverKeepAlive = isHttpResponseComplete(&response) && response.keepAlive;
+  return response.headersRead ? response.statusCode : 0;
+}
+
+/**
+  * Get the HTTP status code of the server response to the last upload.
+  *
+  * @return the status code, 0 when the server could not be reached or did not respond
+  */
+int Uploader::getResponseStatusCode() {
+  return responseStatusCode;
+}
+
 /**
   * Called by upload() to send payload data
   * with the WiFi client.
   * Must be implemented by subclasses, because
   * it depends on the source type: buffer or file.
+  * When dataCrcKnown, it computes sentCrc on the fly.
   *
   * @see BufferUploader::sendData()
   * @see FileUploader::sendData()
   */
 void Uploader::sendData() {}
 
+/**
+  * Called by upload() to send the data again on a new connection,
+  * when the server closed the reused one.
+  *
+  * @return true when the data can be sent again
+  */
+bool Uploader::rewindData() {
+  return false;
+}
+
 /**
  * Uploads a picture contained in a buffer.
  * Useful when the picture can not be stored in the SD card.
  * It reads the data directly from the sensor buffer.
  */
-BufferUploader::BufferUploader(upload_settings_t *uploadSettings, uint8_t *srcBuffer, size_t len, String destFileName)
-  : Uploader(uploadSettings, len, destFileName), srcBuffer(srcBuffer){};
+BufferUploader::BufferUploader(upload_settings_t *uploadSettings, uint8_t *srcBuffer, size_t len, String destFileName, UploadConnection *connection)
+  : Uploader(uploadSettings, len, destFileName, connection), srcBuffer(srcBuffer){};
 
 /**
- * Read picture data from the frame buffer and
- * send it to the server by calling client.write().
- * Data is sent in 1024-byte packets.
+ * The frame buffer is sent from its beginning at each request.
+ *
+ * @return true
+ */
+bool BufferUploader::rewindData() {
+  return true;
+}
+
+/**
+ * Send picture data from the frame buffer to the server by calling client.write(),
+ * without intermediate copy, by writes of upload_settings_t.writeSize bytes:
+ * several TCP segments each, instead of a partial segment by 1024-byte packet.
  * Sending stops when the length of data sent reaches dataLen.
  */
 void BufferUploader::sendData() {
-  uint8_t *iBuf = srcBuffer;
-  size_t fbLen = dataLen;
-  for (size_t n = 0; n < fbLen; n = n + UPLOAD_BUFFER_SIZE) {
-    if (n + UPLOAD_BUFFER_SIZE < fbLen) {
-      client.write(iBuf, UPLOAD_BUFFER_SIZE);
-      iBuf += UPLOAD_BUFFER_SIZE;
-    } else if (fbLen % UPLOAD_BUFFER_SIZE > 0) {
-      size_t remainder = fbLen % UPLOAD_BUFFER_SIZE;
-      client.write(iBuf, remainder);
+  size_t writeSize = uploadSettings->writeSize ? uploadSettings->writeSize : dataLen;
+  for (size_t n = 0; n < dataLen; n += writeSize) {
+    size_t len = dataLen - n < writeSize ? dataLen - n : writeSize;
+    if (dataCrcKnown) {
+      sentCrc = crc32_le(sentCrc, srcBuffer + n, len);
+    }
+    client.write(srcBuffer + n, len);
+  }
+}
+
+/**
+ * @brief Send picture data read from a file, its CRC-32 computed on the fly: the file is read once.
+ *
+ * The data goes through the send pipeline of sendFileByPipeline(), overlapping the SD card reads
+ * and the network sends. Without it, the data is read then sent by 1024-byte packets.
+ * The throughput of the file is logged and recorded in the telemetry as a TELEMETRY_PHASE_UPLOAD_SEND phase.
+ *
+ * @param client   the WiFi client
+ * @param file     the file, at the beginning of the data
+ * @param len      the number of bytes to send. Sending stops earlier at the end of the file.
+ * @param bufferKB the size in KB of each buffer of the pipeline, 0 to send by 1024-byte packets
+ * @param crc      the CRC-32 updated with the data sent, NULL to skip it
+ * @param fileName the file name that the server will see, for the log
+ */
+static void sendFileData(WiFiClient &client, File &file, size_t len, uint8_t bufferKB, uint32_t *crc, const String &fileName) {
+  upload_pipe_stats_t stats;
+  uint32_t startUs = getTelemetryTimeUs();
+
+  if (!sendFileByPipeline(&client, &file, len, bufferKB, crc, &stats)) {
+    uint8_t srcBuffer[UPLOAD_BUFFER_SIZE];
+    size_t leftLen = len;
+    size_t readLen;
+    uint32_t stepUs = getTelemetryTimeUs();
+    while (leftLen && (readLen = file.read(srcBuffer, leftLen < UPLOAD_BUFFER_SIZE ? leftLen : (uint16_t)UPLOAD_BUFFER_SIZE)) > 0) {
+      if (crc) {
+        *crc = crc32_le(*crc, srcBuffer, readLen);
+      }
+      stats.readUs += getTelemetryTimeUs() - stepUs;
+      stepUs = getTelemetryTimeUs();
+      stats.sentBytes += client.write(srcBuffer, readLen);
+      stats.sendUs += getTelemetryTimeUs() - stepUs;
+      stepUs = getTelemetryTimeUs();
+      leftLen -= readLen;
     }
+    stats.durationUs = getTelemetryTimeUs() - startUs;
   }
+
+  recordTransfer(TELEMETRY_PHASE_UPLOAD_SEND, startUs, stats.sentBytes, stats.sentBytes == len ? IS_OK : UPLOAD_PICTURE_ERROR);
+  logInfo(UPLOAD_LOG, "%s: %u bytes sent in %u ms (%u KB/s), SD card reads %u ms, network sends %u ms%s.", fileName.c_str(),
+          (unsigned int)stats.sentBytes, (unsigned int)(stats.durationUs / 1000),
+          (unsigned int)(stats.durationUs ? (uint64_t)stats.sentBytes * 1000000 / 1024 / stats.durationUs : 0),
+          (unsigned int)(stats.readUs / 1000), (unsigned int)(stats.sendUs / 1000), stats.pipelined ? ", pipelined" : "");
 }
 
 /**
  * Upload a picture contained in a file.
  * Useful when the picture is stored in the SD card.
- * It reads the data from the given file.
- * The file name on the server will be the same as the source file.
+ * It reads the data from the current position of the given file,
+ * so the picture may be a part of a segment file.
  */
-FileUploader::FileUploader(upload_settings_t *uploadSettings, File srcFile)
-  : Uploader(uploadSettings, srcFile.size(), srcFile.name()), srcFile{ srcFile } {};
+FileUploader::FileUploader(upload_settings_t *uploadSettings, File srcFile, size_t dataLen, String destFileName, UploadConnection *connection)
+  : Uploader(uploadSettings, dataLen, destFileName, connection), srcFile{ srcFile }, dataPosition(srcFile.position()) {};
+
+/**
+ * Seek the file back to the beginning of the picture data.
+ *
+ * @return true when the file has been seeked
+ */
+bool FileUploader::rewindData() {
+  return srcFile.seek(dataPosition);
+}
 
 /**
  * Read picture data from the opened file and
  * send it to the server by calling client.write().
- * Data is sent in 1024-byte packets.
- * Sending stops when the length of data sent reaches the file size.
+ * Data is sent in 1024-byte packets, their CRC-32 computed on the fly:
+ * the file is read once.
+ * Sending stops when the length of data sent reaches dataLen
+ * or at the end of the file.
  */
 void FileUploader::sendData() {
-  uint8_t srcBuffer[UPLOAD_BUFFER_SIZE];
-  size_t len = srcFile.available();
-  while (len) {
-    client.write(srcBuffer, srcFile.read(srcBuffer, len < UPLOAD_BUFFER_SIZE ? len : (uint16_t)UPLOAD_BUFFER_SIZE));
-    len = srcFile.available();
+  sendFileData(client, srcFile, dataLen, uploadSettings->sendBufferKB, dataCrcKnown ? &sentCrc : NULL, destFileName);
+}
+
+/**
+ * Upload several pictures contained in files in a single request,
+ * as several fileToUpload parts, each one with its CRC-32 in a UPLOAD_CRC_HEADER part header.
+ * The request gives the number of pictures in the UPLOAD_BATCH_HEADER header,
+ * and the server returns a result manifest in the response body:
+ * one line by picture, with its file name and its HTTP status code. Ex: "pic-00042.jpg 200".
+ * A picture which doesn't match its CRC-32 aborts the request, so the server drops it.
+ *
+ * @see uploadPictureFiles()
+ */
+BatchFileUploader::BatchFileUploader(upload_settings_t *uploadSettings, UploadConnection *connection)
+  : Uploader(uploadSettings, 0, String(""), connection) {
+  manifest[0] = 0;
+  responseBody = manifest;
+  responseBodySize = sizeof(manifest);
+};
+
+/**
+ * Add a picture to the request.
+ *
+ * @param srcFile      the file to upload, open at the beginning of the picture data
+ * @param dataLen      the number of bytes of the picture
+ * @param destFileName the uploaded destination file name that the server will see
+ * @param record       the catalog record of the picture giving its CRC-32, NULL when it has none
+ *
+ * @return false when the request already has UPLOAD_BATCH_MAX_SIZE pictures
+ */
+bool BatchFileUploader::addFile(File srcFile, size_t dataLen, String destFileName, const catalog_record_t *record) {
+  if (fileCount >= UPLOAD_BATCH_MAX_SIZE) {
+    return false;
+  }
+  srcFiles[fileCount] = srcFile;
+  dataPositions[fileCount] = srcFile.position();
+  dataLens[fileCount] = dataLen;
+  destFileNames[fileCount] = destFileName;
+  crcKnown[fileCount] = record != NULL;
+  crcs[fileCount] = record ? record->crc : 0;
+  fileCount++;
+  this->dataLen += dataLen;
+  // Name of the request in the logs
+  this->destFileName = destFileNames[0];
+  if (fileCount > 1) {
+    this->destFileName += " and " + String(fileCount - 1) + " more";
+  }
+  return true;
+}
+
+/**
+ * @return the number of pictures of the request
+ */
+uint8_t BatchFileUploader::getFileCount() {
+  return fileCount;
+}
+
+/**
+ * Get the HTTP status code of a picture from the result manifest of the last upload.
+ *
+ * @param i the picture number, in the order of addFile()
+ *
+ * @return the status code, 0 when the picture is missing from the manifest
+ */
+int BatchFileUploader::getFileStatusCode(uint8_t i) {
+  const char *name = destFileNames[i].c_str();
+  size_t nameLen = destFileNames[i].length();
+  const char *line = manifest;
+  while (line) {
+    if (strncmp(line, name, nameLen) == 0 && line[nameLen] == ' ') {
+      return atoi(line + nameLen + 1);
+    }
+    line = strchr(line, '\n');
+    if (line) {
+      line++;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @param i the picture number, in the order of addFile()
+ *
+ * @return true when the upload has been aborted because the picture doesn't match its CRC-32
+ */
+bool BatchFileUploader::isFileCorrupted(uint8_t i) {
+  return corruptedFile == i;
+}
+
+/**
+ * One part by picture, each one with its CRC-32 part header when known.
+ *
+ * @return the length in bytes
+ */
+uint32_t BatchFileUploader::computePartsLen() {
+  uint32_t len = 0;
+  for (uint8_t i = 0; i < fileCount; i++) {
+    len += renderPartHead(NULL, 0, 0, i > 0, destFileNames[i].c_str(), crcKnown[i], crcs[i]) + dataLens[i];
+  }
+  return len;
+}
+
+/**
+ * Render the number of pictures in the UPLOAD_BATCH_HEADER header, asking for the result manifest.
+ *
+ * @return the new length, above size when the buffer is too small
+ */
+size_t BatchFileUploader::renderExtraHeaders(char *buffer, size_t size, size_t len) {
+  return renderFormat(buffer, size, len, UPLOAD_BATCH_HEADER ": %u\r\n", (unsigned int)fileCount);
+}
+
+/**
+ * Render the head of the part of the first picture, with its CRC-32 part header when known.
+ *
+ * @return the new length, above size when the buffer is too small
+ */
+size_t BatchFileUploader::renderFirstPartHead(char *buffer, size_t size, size_t len) {
+  return fileCount ? renderPartHead(buffer, size, len, false, destFileNames[0].c_str(), crcKnown[0], crcs[0]) : len;
+}
+
+/**
+ * Send the pictures, each one checked against its CRC-32 once sent.
+ * The head of each next part is sent by a single write, with the end of the previous part.
+ * A part head longer than UPLOAD_PART_HEAD_MAX_SIZE would not match the Content-Length: the upload is aborted.
+ *
+ * @return IS_OK when they have been sent, SD_CORRUPTED_DATA_ERROR when a picture doesn't match its CRC-32,
+ *         UPLOAD_PICTURE_ERROR when a part head is too long
+ */
+status_code_t BatchFileUploader::sendParts() {
+  corruptedFile = -1;
+  for (uint8_t i = 0; i < fileCount; i++) {
+    if (i) {
+      char partHead[UPLOAD_PART_HEAD_MAX_SIZE];
+      size_t partHeadLen = renderPartHead(partHead, sizeof(partHead), 0, true, destFileNames[i].c_str(), crcKnown[i], crcs[i]);
+      if (partHeadLen >= sizeof(partHead)) {
+        logError(UPLOAD_LOG, "%s: part head of %u bytes, above UPLOAD_PART_HEAD_MAX_SIZE, upload aborted.", __func__, (unsigned int)partHeadLen);
+        return UPLOAD_PICTURE_ERROR;
+      }
+      client.write((const uint8_t *)partHead, partHeadLen);
+    }
+    uint32_t crc = 0;
+    sendFileData(client, srcFiles[i], dataLens[i], uploadSettings->sendBufferKB, crcKnown[i] ? &crc : NULL, destFileNames[i]);
+    if (crcKnown[i] && crc != crcs[i]) {
+      corruptedFile = i;
+      logError(UPLOAD_LOG, "%s: %s read with CRC-32 %08x instead of %08x, upload aborted.", __func__, destFileNames[i].c_str(),
+               (unsigned int)crc, (unsigned int)crcs[i]);
+      return SD_CORRUPTED_DATA_ERROR;
+    }
   }
+  return IS_OK;
+}
+
+/**
+ * Seek the files back to the beginning of the picture data.
+ *
+ * @return true when all the files have been seeked
+ */
+bool BatchFileUploader::rewindData() {
+  bool rewound = true;
+  for (uint8_t i = 0; i < fileCount; i++) {
+    rewound = srcFiles[i].seek(dataPositions[i]) && rewound;
+  }
+  return rewound;
 }
 
 /**
@@ -156,29 +654,40 @@ void FileUploader::sendData() {
  * It uses FileUploader.
  *
  * @param uploadSettings required to determine the upload destination
+ * @param storage        the storage layout of the pictures on the SD card, see picture_storage_t
  * @param fileIndex
+ * @param record         the catalog record of the picture giving its CRC-32, NULL when it has none
+ * @param connection     the connection kept open across the uploads, NULL to open one for this upload only
+ * @param responseStatusCode the HTTP status code of the server response, 0 when the server could not be reached
  *
- * @return IS_OK when it succeeds or UPLOAD_PICTURE_ERROR if the operation failed
+ * @return IS_OK when it succeeds, SD_READ_ERROR when the picture can't be read,
+ *         SD_CORRUPTED_DATA_ERROR when the data read doesn't match the CRC-32 of the record
+ *         or UPLOAD_PICTURE_ERROR if the upload failed
  *
  * @see uploadPictureFiles()
+ * @see openPictureByIndex()
  * @see FileUploader
  */
-status_code_t uploadPictureFileByIndex(upload_settings_t *uploadSettings, uint16_t i) {
+status_code_t uploadPictureFileByIndex(upload_settings_t *uploadSettings, uint8_t storage, uint32_t i, const catalog_record_t *record,
+                                       UploadConnection *connection, int *responseStatusCode) {
   status_code_t result = IS_OK;
-  // Path where new picture will be saved in SD Card
-  char pictureFilePath[20] = "/";
-  computePictureNameFromIndex(pictureFilePath + 1, i);
-
-  fs::FS &fs = SD_MMC;
-  logInfo(UPLOAD_LOG, "%s: picture file name: %s.", __func__, pictureFilePath);
+  // The server sees the picture file name, whatever the storage layout
+  char pictureName[20];
+  computePictureNameFromIndex(pictureName, i);
+  logInfo(UPLOAD_LOG, "%s: picture file name: %s.", __func__, pictureName);
 
-  File file = fs.open(pictureFilePath, FILE_READ);
-  if (!file) {
-    logError(UPLOAD_LOG, "%s: failed to open file %s in reading mode.", __func__, pictureFilePath);
-    result = UPLOAD_PICTURE_ERROR;
+  File file;
+  size_t pictureLen;
+  *responseStatusCode = 0;
+  if (openPictureByIndex(storage, i, &file, &pictureLen) != IS_OK) {
+    result = SD_READ_ERROR;
   } else {
-    FileUploader fdu(uploadSettings, file);
+    FileUploader fdu(uploadSettings, file, pictureLen, String(pictureName), connection);
+    if (record) {
+      fdu.setDataCrc(record->crc);
+    }
     result = fdu.upload();
+    *responseStatusCode = fdu.getResponseStatusCode();
   }
   file.close();
   return result;
@@ -199,16 +708,204 @@ bool canUploadPictures(uint8_t bunchSize, fileCounters_t *fileCounters) {
   return (fileCounters->pictureCounter - fileCounters->uploadedPictureCounter >= bunchSize);
 }
 
+/**
+ * @brief Send the pictures to upload of a batch in a single request, see BatchFileUploader,
+ *        and give each one its result from the result manifest.
+ *
+ * A picture which can't be opened is not sent: its result is SD_READ_ERROR.
+ * When the server doesn't respond 200 to the request, each picture gets its status code.
+ *
+ * @param uploadSettings required to determine the upload destination
+ * @param storage        the storage layout of the pictures on the SD card, see picture_storage_t
+ * @param batch          the pictures of the batch
+ * @param count          the number of pictures of the batch
+ * @param connection     the connection kept open across the uploads
+ */
+static void sendPictureBatch(upload_settings_t *uploadSettings, uint8_t storage, upload_batch_entry_t *batch, uint8_t count,
+                             UploadConnection *connection) {
+  BatchFileUploader uploader(uploadSettings, connection);
+  File files[UPLOAD_BATCH_MAX_SIZE];
+  upload_batch_entry_t *parts[UPLOAD_BATCH_MAX_SIZE];
+
+  for (uint8_t e = 0; e < count; e++) {
+    upload_batch_entry_t *entry = &(batch[e]);
+    if (entry->skipped) {
+      continue;
+    }
+    char pictureName[20];
+    size_t pictureLen;
+    File *file = &(files[uploader.getFileCount()]);
+    computePictureNameFromIndex(pictureName, entry->index);
+    if (openPictureByIndex(storage, entry->index, file, &pictureLen) != IS_OK) {
+      file->close();
+      entry->result = SD_READ_ERROR;
+      continue;
+    }
+    parts[uploader.getFileCount()] = entry;
+    uploader.addFile(*file, pictureLen, String(pictureName), entry->record->index == entry->index ? entry->record : NULL);
+  }
+  if (!uploader.getFileCount()) {
+    return;
+  }
+
+  status_code_t result = uploader.upload();
+  for (uint8_t i = 0; i < uploader.getFileCount(); i++) {
+    upload_batch_entry_t *entry = parts[i];
+    if (uploader.isFileCorrupted(i)) {
+      entry->result = SD_CORRUPTED_DATA_ERROR;
+    } else {
+      entry->responseStatusCode = result == IS_OK ? uploader.getFileStatusCode(i) : uploader.getResponseStatusCode();
+      entry->result = entry->responseStatusCode == 200 ? IS_OK : UPLOAD_PICTURE_ERROR;
+    }
+    files[i].close();
+  }
+}
+
+/**
+ * @brief Apply the upload result of a picture to its catalog record and to the uploaded picture counter.
+ *
+ * A picture which can't be read, or doesn't match the CRC-32 of its record, CATALOG_READ_ATTEMPT_MAX times,
+ * or rejected by the server CATALOG_UPLOAD_ATTEMPT_MAX times, is abandoned, so it doesn't block the next ones.
+ * A picture not matching its CRC-32 at its last read is flagged as corrupted. Failures to reach the server are not counted.
+ * A picture without catalog record nor file, e.g. lost in the write-behind queue by a restart, is skipped.
+ *
+ * @param storage      the storage layout of the pictures on the SD card, see picture_storage_t
+ * @param entry        the picture
+ * @param counting     true when the previous pictures are all uploaded or abandoned:
+ *                     the uploaded picture counter is incremented for this one too
+ * @param fileCounters the file counters
+ *
+ * @return true when the picture is uploaded, skipped or abandoned: the upload goes on with the next one
+ */
+static bool applyUploadResult(uint8_t storage, upload_batch_entry_t *entry, bool counting, fileCounters_t *fileCounters) {
+  catalog_record_t *record = entry->record;
+  bool cataloged = record->index == entry->index;
+  bool done = entry->skipped || entry->result == IS_OK;
+
+  if (!done && !cataloged && entry->result == SD_READ_ERROR && !pictureExistsByIndex(storage, entry->index)) {
+    logWarn(UPLOAD_LOG, "%s: picture %u missing and not cataloged, skipped.", __func__, (unsigned int)entry->index);
+    done = true;
+  }
+
+  if (entry->result == IS_OK && !entry->skipped && cataloged) {
+    record->flags |= CATALOG_FLAG_UPLOADED;
+    writeCatalogRecord(record);
+  }
+  bool unreadable = entry->result == SD_READ_ERROR || entry->result == SD_CORRUPTED_DATA_ERROR;
+  if (!done && cataloged && (unreadable || entry->responseStatusCode)) {
+    // At most one attempt by wake cycle: a picture is abandoned after failures in distinct cycles
+    if (!entry->attemptCounted) {
+      record->uploadAttempts++;
+    }
+    if (record->uploadAttempts >= (unreadable ? CATALOG_READ_ATTEMPT_MAX : CATALOG_UPLOAD_ATTEMPT_MAX)) {
+      logWarn(UPLOAD_LOG, "%s: picture %u abandoned after %d attempt(s), status code %d, error %d.", __func__, (unsigned int)entry->index,
+              record->uploadAttempts, entry->responseStatusCode, entry->result);
+      if (entry->result == SD_CORRUPTED_DATA_ERROR) {
+        record->flags |= CATALOG_FLAG_CORRUPTED;
+      }
+      record->flags |= CATALOG_FLAG_ABANDONED;
+      done = true;
+    }
+    writeCatalogRecord(record);
+  }
+  if (done && counting) {
+    fileCounters->uploadedPictureCounter++;
+  }
+  return done;
+}
+
+/**
+ * @brief Upload the pictures of a batch, then apply their results in order.
+ *
+ * A batch with a single picture to upload is sent by uploadPictureFileByIndex(), as without batch.
+ * A cataloged picture which can't be read or doesn't match its CRC-32 is read and sent again alone, once:
+ * the error may be transient. The failed read is counted and written in its record before,
+ * and is the only attempt counted in this wake cycle, whatever the result of the second one.
+ * The uploaded picture counter only goes over the pictures uploaded, skipped or abandoned
+ * up to the first failure. The catalog records of the next pictures are updated all the same:
+ * a picture uploaded after a failure is flagged as uploaded, so it is not sent again.
+ *
+ * @param uploadSettings required to determine the upload destination
+ * @param storage        the storage layout of the pictures on the SD card, see picture_storage_t
+ * @param batch          the pictures of the batch
+ * @param count          the number of pictures of the batch
+ * @param connection     the connection kept open across the uploads
+ * @param fileCounters   the file counters
+ * @param stopped        receiving true when a picture failed: the upload stops there
+ *
+ * @return the result of the failed picture, IS_OK when none
+ */
+static status_code_t uploadPictureBatch(upload_settings_t *uploadSettings, uint8_t storage, upload_batch_entry_t *batch, uint8_t count,
+                                        UploadConnection *connection, fileCounters_t *fileCounters, bool *stopped) {
+  status_code_t result = IS_OK;
+  upload_batch_entry_t *single = NULL;
+  uint8_t uploadCount = 0;
+
+  for (uint8_t e = 0; e < count; e++) {
+    batch[e].result = IS_OK;
+    batch[e].responseStatusCode = 0;
+    batch[e].attemptCounted = false;
+    if (!batch[e].skipped) {
+      single = &(batch[e]);
+      uploadCount++;
+    }
+  }
+  if (uploadCount == 1) {
+    bool cataloged = single->record->index == single->index;
+    single->result = uploadPictureFileByIndex(uploadSettings, storage, single->index, cataloged ? single->record : NULL, connection,
+                                              &(single->responseStatusCode));
+  } else if (uploadCount > 1) {
+    sendPictureBatch(uploadSettings, storage, batch, count, connection);
+  }
+  for (uint8_t e = 0; e < count; e++) {
+    upload_batch_entry_t *entry = &(batch[e]);
+    bool cataloged = entry->record->index == entry->index;
+    if (cataloged && (entry->result == SD_READ_ERROR || entry->result == SD_CORRUPTED_DATA_ERROR)) {
+      logWarn(UPLOAD_LOG, "%s: picture %u not read properly, error %d: reading it again.", __func__, (unsigned int)entry->index, entry->result);
+      entry->record->uploadAttempts++;
+      entry->attemptCounted = true;
+      writeCatalogRecord(entry->record);
+      entry->result = uploadPictureFileByIndex(uploadSettings, storage, entry->index, entry->record, connection, &(entry->responseStatusCode));
+    }
+  }
+
+  *stopped = false;
+  for (uint8_t e = 0; e < count; e++) {
+    if (!applyUploadResult(storage, &(batch[e]), !*stopped, fileCounters) && !*stopped) {
+      *stopped = true;
+      result = batch[e].result;
+    }
+  }
+  return result;
+}
+
 /**
  * @brief Upload SD stored picture files that have not yet been uploaded.
+ *        The near-duplicates kept on the SD card only are skipped.
+ *        The upload state of each picture is kept in its catalog record.
  *
- * fileCounters->uploadedPictureCounter is incremented for each succeeded upload.
- * If an error occurs during one file uploading, then the function stops there.
+ * fileCounters->uploadedPictureCounter is incremented for each succeeded upload
+ * and each skipped near-duplicate.
+ * The catalog records are read by chunks of CATALOG_READ_RECORDS, and updated in place after each upload.
+ * After a cold boot, the first chunk is the catalog head read by loadBootMetadata().
+ * A picture which can't be read, or doesn't match the CRC-32 of its record, CATALOG_READ_ATTEMPT_MAX times,
+ * or rejected by the server CATALOG_UPLOAD_ATTEMPT_MAX times, is abandoned, so it doesn't block the next ones.
+ * A picture not matching its CRC-32 at its last read is flagged as corrupted. Failures to reach the server are not counted.
+ * Else, if an error occurs during one file uploading, then the function stops there.
  * Upload will be resumed/retried at the next taken picture.
+ * Pictures without catalog record, e.g. saved by a former version, are uploaded until the first error.
+ * Those without file either, e.g. lost in the write-behind queue by a restart, are skipped.
+ * A picture queued by writePictureBehind() is uploaded once written, and its catalog records read again:
+ * the older pictures are uploaded meanwhile.
+ * The pictures are sent over a single connection kept alive, opened again when the server closes it.
+ * With uploadSettings->batchSize above 1, up to batchSize pictures of a chunk are sent by request,
+ * see uploadPictureBatch().
  *
  * @param wifiSettings   required to establish the WiFi connection
  * @param uploadSettings required to determine the upload destination
+ * @param storage        the storage layout of the pictures on the SD card, see picture_storage_t
  * @param fileCounters   used to determine which file to upload
+ * @param history        used to determine which file must not be uploaded
  *
  * @return IS_OK when it succeeds
  *         or WIFI_INIT_ERROR when the WiFi can not be initialized
@@ -217,18 +914,76 @@ bool canUploadPictures(uint8_t bunchSize, fileCounters_t *fileCounters) {
  * @see uploadPictureFileByIndex()
  * @see canUploadPictures()
  */
-status_code_t uploadPictureFiles(wifi_settings_t *wifi, upload_settings_t *uploadSettings, fileCounters_t *fileCounters) {
+status_code_t uploadPictureFiles(wifi_settings_t *wifi, upload_settings_t *uploadSettings, uint8_t storage, fileCounters_t *fileCounters, const picture_history_t *history) {
   status_code_t result = IS_OK;
   if (canUploadPictures(uploadSettings->bunchSize, fileCounters)) {
     result = initWifi(wifi);
     if (result == IS_OK) {
-      for (uint16_t i = fileCounters->uploadedPictureCounter + 1; i <= fileCounters->pictureCounter; i++) {
-        result = uploadPictureFileByIndex(uploadSettings, i);
-        if (result == IS_OK) {
-          fileCounters->uploadedPictureCounter++;
-        } else {
+      catalog_record_t records[CATALOG_READ_RECORDS];
+      upload_batch_entry_t batch[UPLOAD_BATCH_MAX_SIZE];
+      UploadConnection connection(uploadSettings, true);
+      uint8_t batchSize = uploadSettings->batchSize < UPLOAD_BATCH_MAX_SIZE ? uploadSettings->batchSize : UPLOAD_BATCH_MAX_SIZE;
+      uint8_t batchCount = 0;
+      uint8_t batchUploadCount = 0;
+      bool stopped = false;
+      uint32_t firstIndex = 0;
+      uint32_t chunkEndIndex = 0;
+      uint32_t chunkPendingIndex = 0;
+      for (uint32_t i = fileCounters->uploadedPictureCounter + 1; i <= fileCounters->pictureCounter; i++) {
+        // The batch is sent before waiting for a queued picture, or reading the catalog records its entries point to
+        bool waiting = getPendingPictureIndex() && i >= getPendingPictureIndex();
+        bool reading = !firstIndex || i >= chunkEndIndex || (chunkPendingIndex && i >= chunkPendingIndex);
+        if (batchCount && (waiting || reading)) {
+          result = uploadPictureBatch(uploadSettings, storage, batch, batchCount, &connection, fileCounters, &stopped);
+          batchCount = batchUploadCount = 0;
+          if (stopped) {
+            break;
+          }
+        }
+        if (!waitPictureWritten(i, UPLOAD_PICTURE_WRITE_WAIT_MS)) {
+          logWarn(UPLOAD_LOG, "%s: picture %u still not written on the SD card.", __func__, (unsigned int)i);
           break;
         }
+        // The records from the pending picture were not written when the chunk was read
+        if (reading) {
+          firstIndex = i;
+          chunkPendingIndex = getPendingPictureIndex();
+          // The first chunk after a cold boot has been read with the boot metadata
+          uint8_t count = takeBootCatalogHead(firstIndex, records, CATALOG_READ_RECORDS);
+          if (!count) {
+            readCatalogRecords(firstIndex, records, CATALOG_READ_RECORDS);
+            count = CATALOG_READ_RECORDS;
+          }
+          chunkEndIndex = firstIndex + count;
+        }
+        upload_batch_entry_t *entry = &(batch[batchCount++]);
+        entry->index = i;
+        entry->record = &(records[i - firstIndex]);
+        entry->skipped = false;
+        bool cataloged = entry->record->index == i;
+        if (cataloged && (entry->record->flags & (CATALOG_FLAG_UPLOADED | CATALOG_FLAG_ABANDONED | CATALOG_FLAG_EVICTED))) {
+          entry->skipped = true;
+        } else if (cataloged ? (entry->record->flags & CATALOG_FLAG_SD_ONLY) : isPictureSdOnly(history, i, fileCounters->pictureCounter)) {
+          logInfo(UPLOAD_LOG, "%s: picture %u is a near-duplicate kept on the SD card only.", __func__, (unsigned int)i);
+          entry->skipped = true;
+        } else {
+          batchUploadCount++;
+        }
+        if (batchUploadCount >= batchSize || batchCount == UPLOAD_BATCH_MAX_SIZE) {
+          result = uploadPictureBatch(uploadSettings, storage, batch, batchCount, &connection, fileCounters, &stopped);
+          batchCount = batchUploadCount = 0;
+          if (stopped) {
+            break;
+          }
+        }
+      }
+      if (batchCount) {
+        result = uploadPictureBatch(uploadSettings, storage, batch, batchCount, &connection, fileCounters, &stopped);
+      }
+      connection.close();
+      if (connection.getRequestCount()) {
+        logInfo(UPLOAD_LOG, "%s: %u request(s) over %u connection(s).", __func__, (unsigned int)connection.getRequestCount(),
+                (unsigned int)connection.getConnectCount());
       }
       saveFileCounters(fileCounters);
     }
@@ -2,13 +2,19 @@
 #define UPLOADER_H
 
 #include "Arduino.h"
+#include "catalog.h"
+#include "dedupe.h"
 #include "error.h"
 #include "filename.h"
+#include "httpresponse.h"
 #include "logging.h"
 #include "timemgt.h"
+#include "uploadpipe.h"
 #include "FS.h"
+#include "lwip/sockets.h"
 #include "sd.h"
 #include "wifimgt.h"
+#include "writebehind.h"
 
 // Logger name for this module
 #define UPLOAD_LOG "Upload"
@@ -25,9 +31,35 @@
 #define UPLOAD_BUNCH_SIZE_DEFAULT 10
 // Default file name random size
 #define UPLOAD_FILE_NAME_RANDOM_SIZE 5
+// Default maximum number of pictures sent by request
+#define UPLOAD_BATCH_SIZE_DEFAULT 1
+// Maximum number of pictures sent by request, all within a chunk of catalog records
+#define UPLOAD_BATCH_MAX_SIZE CATALOG_READ_RECORDS
 
 // Size of the upload buffer used by sendData()
 #define UPLOAD_BUFFER_SIZE 1024
+// Maximum time in ms to wait for a picture queued by writePictureBehind() before uploading it
+#define UPLOAD_PICTURE_WRITE_WAIT_MS 5000
+// HTTP header giving the server the CRC-32 of the picture, in 8 hexadecimal digits
+#define UPLOAD_CRC_HEADER "X-Picture-CRC32"
+// Default maximum time in ms to wait for the complete server response
+#define UPLOAD_RESPONSE_TIMEOUT_MS_DEFAULT 10000
+// Size of the buffer receiving the server response from the WiFi client
+#define UPLOAD_RESPONSE_BUFFER_SIZE 256
+// Boundary of the multipart/form-data request body
+#define UPLOAD_MULTIPART_BOUNDARY "EspCamWebUpload"
+// HTTP header giving the server the number of pictures of a batched request, answered by a result manifest
+#define UPLOAD_BATCH_HEADER "X-Picture-Count"
+// Maximum size of the result manifest of a batched request, read from the response body
+#define UPLOAD_MANIFEST_MAX_SIZE 512
+// Maximum size of the request head: request line, headers, auth part and head of the first picture part
+#define UPLOAD_REQUEST_HEAD_MAX_SIZE 768
+// Maximum size of the head of a next picture part of a batched request
+#define UPLOAD_PART_HEAD_MAX_SIZE 256
+// Default size of the writes of a picture in a buffer: 4 TCP segments of the 1436-byte MSS of the ESP32 lwIP
+#define UPLOAD_WRITE_SIZE_DEFAULT (4 * 1436)
+// Default value of upload_settings_t.noDelay
+#define UPLOAD_NO_DELAY_DEFAULT true
 
 /**
  * Upload settings.
@@ -42,19 +74,111 @@ typedef struct {
   uint8_t fileNameRandSize;                           // Used when pictures are not stored on SD card.
                                                       // As no counter is maintained in this case, the file name is randomly generated.
                                                       // This parameter defines the number of random characters composing the uploaded file name.
+  uint8_t batchSize;                                  // Maximum number of pictures stored on SD card sent by request, up to UPLOAD_BATCH_MAX_SIZE.
+                                                      // The server returns a result manifest. 1 sends one picture by request.
+  uint16_t responseTimeoutMs;                         // Maximum time in ms to wait for the complete server response of a request.
+  uint8_t sendBufferKB;                               // Size in KB of each of the two PSRAM buffers reading a picture file from the SD card
+                                                      // while the other one is sent, up to UPLOAD_PIPE_BUFFER_KB_MAX. 0 reads and sends by 1 KB blocks.
+  uint16_t writeSize;                                 // Size in bytes of the writes of a picture in a buffer to the WiFi client, 0 for a single write.
+  bool noDelay;                                       // True to disable the Nagle algorithm, so the last segment of each write is sent without waiting for an ACK.
 } upload_settings_t;
 
+/**
+ * Picture of the batch of pictures being uploaded by uploadPictureFiles().
+ */
+typedef struct {
+  uint32_t index;                                     // Picture index
+  catalog_record_t* record;                           // Catalog record of the picture, its index is 0 when the picture has none
+  bool skipped;                                       // True when the picture is not uploaded: already uploaded, abandoned, evicted or SD only
+  status_code_t result;                               // Upload result of the picture
+  int responseStatusCode;                             // HTTP status code of the picture, 0 when the server could not be reached
+  bool attemptCounted;                                // True when the failed attempt of this wake cycle is already counted in the record
+} upload_batch_entry_t;
+
+/**
+ * Connection to the upload server, kept open across the uploads of a batch
+ * with HTTP/1.1 keep-alive, so each picture doesn't cost a TCP handshake
+ * and a DNS lookup. It is opened again when the server has closed it.
+ *
+ * @see uploadPictureFiles()
+ * @see Uploader
+ */
+class UploadConnection {
+public:
+  /**
+   * Constructor
+   *
+   * @param uploadSettings required to determine the server
+   * @param keepAlive      true to keep the connection open after each request, false to close it
+   */
+  UploadConnection(upload_settings_t* uploadSettings, bool keepAlive);
+
+  /**
+   * Destructor, closing the connection.
+   */
+  ~UploadConnection();
+
+  /**
+   * Connect to the server, unless the connection is still open from a previous request.
+   *
+   * @param reused receiving true when the open connection is reused
+   *
+   * @return true when the connection is open
+   */
+  bool open(bool* reused);
+
+  /**
+   * Close the connection.
+   */
+  void close();
+
+  /**
+   * @return true when the connection is kept open after each request
+   */
+  bool isKeepAlive();
+
+  /**
+   * @return the WiFi client of the connection
+   */
+  WiFiClient* getClient();
+
+  /**
+   * @return the number of connections opened to the server
+   */
+  uint32_t getConnectCount();
+
+  /**
+   * @return the number of requests sent to the server
+   */
+  uint32_t getRequestCount();
+
+private:
+  upload_settings_t* uploadSettings;  // Settings required to connect
+  bool keepAlive;                     // True to keep the connection open after each request
+  WiFiClient client;                  // WiFi client
+  bool opened = false;                // True while the connection is open
+  uint32_t connectCount = 0;          // Number of connections opened
+  uint32_t requestCount = 0;          // Number of requests sent
+};
+
 /**
  * @brief Upload a SD stored picture file identified by its index.
  *
  * @param uploadSettings required to determine the upload destination
+ * @param storage        the storage layout of the pictures on the SD card, see picture_storage_t
  * @param fileIndex
+ * @param record         the catalog record of the picture giving its CRC-32, NULL when it has none
+ * @param connection     the connection kept open across the uploads, NULL to open one for this upload only
+ * @param responseStatusCode the HTTP status code of the server response, 0 when the server could not be reached
  *
- * @return IS_OK when it succeeds or UPLOAD_PICTURE_ERROR if the operation failed
+ * @return IS_OK when it succeeds, SD_READ_ERROR when the picture can't be read,
+ *         SD_CORRUPTED_DATA_ERROR when the data read doesn't match the CRC-32 of the record
+ *         or UPLOAD_PICTURE_ERROR if the upload failed
  *
  * @see uploadPictureFiles()
  */
-status_code_t uploadPictureFileByIndex(upload_settings_t* uploadSettings, uint16_t fileIndex);
+status_code_t uploadPictureFileByIndex(upload_settings_t* uploadSettings, uint8_t storage, uint32_t fileIndex, const catalog_record_t* record,
+                                       UploadConnection* connection, int* responseStatusCode);
 
 /**
  * @brief Determine if there is a new bunch of files to upload.
@@ -70,10 +194,14 @@ bool canUploadPictures(uint8_t bunchSize, fileCounters_t* fileCounters);
 
 /**
  * @brief Upload SD stored picture files that have not yet been uploaded.
+ *        The near-duplicates kept on the SD card only are skipped.
+ *        The upload state of each picture is kept in its catalog record.
  *
  * @param wifiSettings   required to establish the WiFi connection
  * @param uploadSettings required to determine the upload destination
+ * @param storage        the storage layout of the pictures on the SD card, see picture_storage_t
  * @param fileCounters   used to determine which file to upload
+ * @param history        used to determine which file must not be uploaded
  *
  * @return IS_OK when it succeeds
  *         or WIFI_INIT_ERROR when the WiFi can not be initialized
@@ -82,7 +210,7 @@ bool canUploadPictures(uint8_t bunchSize, fileCounters_t* fileCounters);
  * @see uploadPictureFileByIndex()
  * @see canUploadPictures()
  */
-status_code_t uploadPictureFiles(wifi_settings_t* wifiSettings, upload_settings_t* uploadSettings, fileCounters_t* fileCounters);
+status_code_t uploadPictureFiles(wifi_settings_t* wifiSettings, upload_settings_t* uploadSettings, uint8_t storage, fileCounters_t* fileCounters, const picture_history_t* history);
 
 /**
  * @brief Upload a picture contained in a (frame) buffer.
@@ -115,30 +243,136 @@ public:
    * @param uploadSettings required to determine the upload destination
    * @param dataLen        the number of bytes of the payload to upload (i.e the picture size in byte).
    * @param destFileName   the uploaded destination file name that the server will see. 
+   * @param connection     the connection kept open across the uploads, NULL to open one for this upload only
    */
-  Uploader(upload_settings_t* uploadSettings, uint32_t dataLen, String destFileName);
+  Uploader(upload_settings_t* uploadSettings, uint32_t dataLen, String destFileName, UploadConnection* connection = NULL);
+
+  /**
+   * Give the CRC-32 of the data, sent to the server in the UPLOAD_CRC_HEADER header
+   * and checked against the data actually sent.
+   *
+   * @param crc the CRC-32 of the data, as computed by crc32_le(0, ...)
+   */
+  void setDataCrc(uint32_t crc);
 
   /**
    * Launch the data upload.
    *
    * @return IS_OK when it succeeds
    *         or WIFI_INIT_ERROR when the WiFi can not be initialized
+   *         or SD_CORRUPTED_DATA_ERROR when the data sent doesn't match the CRC-32 given by setDataCrc()
    *         or UPLOAD_PICTURE_ERROR if the operation failed.
    */
   status_code_t upload();
 
+  /**
+   * Get the HTTP status code of the server response to the last upload.
+   *
+   * @return the status code, 0 when the server could not be reached or did not respond
+   */
+  int getResponseStatusCode();
+
 protected:
   upload_settings_t* uploadSettings;  // Settings required to upload
   uint32_t dataLen;                   // Length of the data to upload
   String destFileName;                // The uploaded destination file name that the server will see
-  WiFiClient client;                  // WiFi client
+  UploadConnection ownConnection;     // Connection of this upload only, used without a given one
+  UploadConnection* connection;       // Connection to the server, the given one or ownConnection
+  WiFiClient& client;                 // WiFi client of the connection
+  int responseStatusCode = 0;         // HTTP status code of the last response, 0 without response
+  bool dataCrcKnown = false;          // True when setDataCrc() has been called
+  uint32_t dataCrc = 0;               // CRC-32 of the data given by setDataCrc()
+  uint32_t sentCrc = 0;               // CRC-32 of the data sent, computed by sendData() when dataCrcKnown
+  char* responseBody = NULL;          // Buffer receiving the beginning of the response body, NULL to skip the body
+  size_t responseBodySize = 0;        // Size of responseBody
+
+  /**
+   * Render the multipart head of a picture part at the end of a buffer.
+   *
+   * @param buffer    the buffer, NULL to compute the length only
+   * @param size      the size of the buffer
+   * @param len       the length already rendered in the buffer
+   * @param delimited true to end the previous part first
+   * @param fileName  the file name that the server will see
+   * @param crcKnown  true to give the CRC-32 of the picture in a UPLOAD_CRC_HEADER part header
+   * @param crc       the CRC-32 of the picture
+   *
+   * @return the new length, above size when the buffer is too small
+   */
+  size_t renderPartHead(char* buffer, size_t size, size_t len, bool delimited, const char* fileName, bool crcKnown, uint32_t crc);
+
+  /**
+   * Compute the length of the picture parts of the request body, their data included.
+   *
+   * @return the length in bytes
+   */
+  virtual uint32_t computePartsLen();
+
+  /**
+   * Render the headers of the request specific to the uploader at the end of the request head.
+   *
+   * @param buffer the buffer, NULL to compute the length only
+   * @param size   the size of the buffer
+   * @param len    the length already rendered in the buffer
+   *
+   * @return the new length, above size when the buffer is too small
+   */
+  virtual size_t renderExtraHeaders(char* buffer, size_t size, size_t len);
+
+  /**
+   * Render the head of the first picture part at the end of the request head.
+   *
+   * @param buffer the buffer, NULL to compute the length only
+   * @param size   the size of the buffer
+   * @param len    the length already rendered in the buffer
+   *
+   * @return the new length, above size when the buffer is too small
+   */
+  virtual size_t renderFirstPartHead(char* buffer, size_t size, size_t len);
+
+  /**
+   * Send the picture parts of the request body, after the head of the first one sent with the request head.
+   *
+   * @return IS_OK when they have been sent, SD_CORRUPTED_DATA_ERROR when a picture doesn't match its CRC-32,
+   *         UPLOAD_PICTURE_ERROR when a part head can't be rendered. The connection has to be closed after a failure.
+   */
+  virtual status_code_t sendParts();
 
 private:
+  /**
+   * Send the request over the connection, opened when needed, and read the response.
+   *
+   * @param reused receiving true when an open connection has been reused
+   *
+   * @return the upload() result
+   */
+  status_code_t sendRequest(bool* reused);
+
+  /**
+   * Read the server response: status line, headers and body,
+   * until it is complete, the server closes the connection or upload_settings_t.responseTimeoutMs expires.
+   *
+   * @param serverKeepAlive receiving false when the connection can't be reused:
+   *                        closed by the server or the response is incomplete
+   *
+   * @return the status code, 0 without response
+   */
+  int readResponse(bool* serverKeepAlive);
+
+  /**
+   * Called by upload() to send the data again on a new connection,
+   * when the server closed the reused one.
+   *
+   * @return true when the data can be sent again
+   */
+  virtual bool rewindData();
+
   /**
    * Called by upload() to send payload data
    * with the WiFi client.
    * Must be implemented by subclasses, because
    * it depends on the source type: buffer or file.
+   * When dataCrcKnown, it computes sentCrc on the fly.
    *
    * @see BufferUploader::sendData()
    * @see FileUploader::sendData()
@@ -161,23 +395,116 @@ public:
    * @param srcBuffer      buffer containing the picture data.
    * @param dataLen        the number of bytes of the payload to upload (i.e the picture size in byte).
    * @param destFileName   the uploaded destination file name that the server will see. 
+   * @param connection     the connection kept open across the uploads, NULL to open one for this upload only
    */
-  BufferUploader(upload_settings_t* uploadSettings, uint8_t* srcBuffer, size_t len, String destFileName);
+  BufferUploader(upload_settings_t* uploadSettings, uint8_t* srcBuffer, size_t len, String destFileName, UploadConnection* connection = NULL);
 
 private:
   uint8_t* srcBuffer;  // Buffer containing the picture data.
 
+  /**
+   * @see Uploader::rewindData()
+   */
+  bool rewindData();
+
   /**
    * @see Uploader::sendData()
    */
   void sendData();
 };
 
+/**
+ * Upload several pictures contained in files in a single request,
+ * as several fileToUpload parts, each one with its CRC-32 in a UPLOAD_CRC_HEADER part header.
+ * The request gives the number of pictures in the UPLOAD_BATCH_HEADER header,
+ * and the server returns a result manifest in the response body:
+ * one line by picture, with its file name and its HTTP status code. Ex: "pic-00042.jpg 200".
+ */
+class BatchFileUploader : public Uploader {
+public:
+  /**
+   * Constructor
+   *
+   * @param uploadSettings required to determine the upload destination
+   * @param connection     the connection kept open across the uploads, NULL to open one for this upload only
+   */
+  BatchFileUploader(upload_settings_t* uploadSettings, UploadConnection* connection = NULL);
+
+  /**
+   * Add a picture to the request.
+   *
+   * @param srcFile      the file to upload, open at the beginning of the picture data
+   * @param dataLen      the number of bytes of the picture
+   * @param destFileName the uploaded destination file name that the server will see
+   * @param record       the catalog record of the picture giving its CRC-32, NULL when it has none
+   *
+   * @return false when the request already has UPLOAD_BATCH_MAX_SIZE pictures
+   */
+  bool addFile(File srcFile, size_t dataLen, String destFileName, const catalog_record_t* record);
+
+  /**
+   * @return the number of pictures of the request
+   */
+  uint8_t getFileCount();
+
+  /**
+   * Get the HTTP status code of a picture from the result manifest of the last upload.
+   *
+   * @param i the picture number, in the order of addFile()
+   *
+   * @return the status code, 0 when the picture is missing from the manifest
+   */
+  int getFileStatusCode(uint8_t i);
+
+  /**
+   * @param i the picture number, in the order of addFile()
+   *
+   * @return true when the upload has been aborted because the picture doesn't match its CRC-32
+   */
+  bool isFileCorrupted(uint8_t i);
+
+private:
+  File srcFiles[UPLOAD_BATCH_MAX_SIZE];            // Source picture files
+  size_t dataPositions[UPLOAD_BATCH_MAX_SIZE];     // Positions of the picture data in the files
+  size_t dataLens[UPLOAD_BATCH_MAX_SIZE];          // Lengths of the pictures
+  String destFileNames[UPLOAD_BATCH_MAX_SIZE];     // File names that the server will see
+  bool crcKnown[UPLOAD_BATCH_MAX_SIZE];            // True when the CRC-32 of the picture is known
+  uint32_t crcs[UPLOAD_BATCH_MAX_SIZE];            // CRC-32 of the pictures from their catalog records
+  uint8_t fileCount = 0;                           // Number of pictures
+  int corruptedFile = -1;                          // Number of the picture which doesn't match its CRC-32, -1 for none
+  char manifest[UPLOAD_MANIFEST_MAX_SIZE];         // Result manifest read from the response body
+
+  /**
+   * @see Uploader::computePartsLen()
+   */
+  uint32_t computePartsLen();
+
+  /**
+   * @see Uploader::renderExtraHeaders()
+   */
+  size_t renderExtraHeaders(char* buffer, size_t size, size_t len);
+
+  /**
+   * @see Uploader::renderFirstPartHead()
+   */
+  size_t renderFirstPartHead(char* buffer, size_t size, size_t len);
+
+  /**
+   * @see Uploader::sendParts()
+   */
+  status_code_t sendParts();
+
+  /**
+   * @see Uploader::rewindData()
+   */
+  bool rewindData();
+};
+
 /**
  * Upload a picture contained in a file.
  * Useful when the picture is stored in the SD card.
- * It reads the data from the given file.
- * The file name on the server will be the same as the source file.
+ * It reads the data from the current position of the given file,
+ * so the picture may be a part of a segment file.
  */
 class FileUploader : public Uploader {
 public:
@@ -185,12 +512,21 @@ public:
    * Constructor
    * 
    * @param uploadSettings required to determine the upload destination
-   * @param srcFile        the file to upload
+   * @param srcFile        the file to upload, open at the beginning of the picture data
+   * @param dataLen        the number of bytes of the payload to upload (i.e the picture size in byte).
+   * @param destFileName   the uploaded destination file name that the server will see.
+   * @param connection     the connection kept open across the uploads, NULL to open one for this upload only
    */
-  FileUploader(upload_settings_t* uploadSettings, File srcFile);
+  FileUploader(upload_settings_t* uploadSettings, File srcFile, size_t dataLen, String destFileName, UploadConnection* connection = NULL);
 
 private:
-  File srcFile;  // Source picture file
+  File srcFile;           // Source picture file
+  size_t dataPosition;    // Position of the picture data in the file
+
+  /**
+   * @see Uploader::rewindData()
+   */
+  bool rewindData();
 
   /**
    * @see Uploader::sendData()
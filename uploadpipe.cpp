@@ -0,0 +1,132 @@
+#include "uploadpipe.h"
+
+/**
+ * @brief FreeRTOS task filling the free buffers from the file, in order,
+ *        until the expected length, the end of the file or the abort of the sending.
+ *        It ends with an empty block: the pipeline must not be used by the task after it.
+ *
+ * @param param the upload_pipe_t
+ */
+static void readFileTask(void *param) {
+  upload_pipe_t *pipe = (upload_pipe_t *)param;
+  size_t leftLen = pipe->len;
+  upload_pipe_block_t block;
+
+  while (leftLen && !pipe->aborted && xQueueReceive(pipe->freeBuffers, &(block.buffer), portMAX_DELAY) == pdPASS) {
+    uint32_t startUs = getTelemetryTimeUs();
+    uint8_t *buffer = pipe->buffers[block.buffer];
+    size_t blockLen = leftLen < pipe->bufferSize ? leftLen : pipe->bufferSize;
+    int readLen;
+    block.len = 0;
+    while (block.len < blockLen && (readLen = pipe->file->read(buffer + block.len, blockLen - block.len)) > 0) {
+      block.len += readLen;
+    }
+    if (pipe->crc) {
+      *(pipe->crc) = crc32_le(*(pipe->crc), buffer, block.len);
+    }
+    pipe->readUs += getTelemetryTimeUs() - startUs;
+    if (!block.len) {
+      break;
+    }
+    xQueueSend(pipe->filledBlocks, &block, portMAX_DELAY);
+    leftLen -= block.len;
+    if (block.len < blockLen) {
+      // End of the file
+      break;
+    }
+  }
+
+  block.buffer = 0;
+  block.len = 0;
+  xQueueSend(pipe->filledBlocks, &block, portMAX_DELAY);
+  vTaskDelete(NULL);
+}
+
+/**
+ * @brief Release the buffers and the queues of a pipeline.
+ *
+ * @param pipe the pipeline
+ */
+static void releasePipeline(upload_pipe_t *pipe) {
+  for (uint8_t i = 0; i < UPLOAD_PIPE_BUFFER_COUNT; i++) {
+    if (pipe->buffers[i]) {
+      heap_caps_free(pipe->buffers[i]);
+    }
+  }
+  if (pipe->freeBuffers) {
+    vQueueDelete(pipe->freeBuffers);
+  }
+  if (pipe->filledBlocks) {
+    vQueueDelete(pipe->filledBlocks);
+  }
+}
+
+/**
+ * @brief Send data read from a file to a client with two tasks: the read task fills a buffer
+ *        from the SD card while the calling task sends the other one.
+ *
+ * The SD card reads and the network sends overlap, so the sending of a picture takes
+ * the longest of both instead of their sum. The buffers are allocated in PSRAM for the file only.
+ * The buffers are handed over through two queues: the free buffers to the read task,
+ * the filled ones back to the sending task, in order.
+ * When the client fails, the read task stops and the remaining blocks are dropped.
+ *
+ * @param client     the client
+ * @param file       the file, at the beginning of the data
+ * @param len        the number of bytes to send. Sending stops earlier at the end of the file.
+ * @param bufferKB   the size in KB of each buffer, up to UPLOAD_PIPE_BUFFER_KB_MAX
+ * @param crc        the CRC-32 updated with the data read, NULL to skip it
+ * @param stats      the measures receiving the sending
+ *
+ * @return false when the pipeline is disabled by a 0 bufferKB or can't be set up: nothing has been read nor sent
+ */
+bool sendFileByPipeline(WiFiClient *client, File *file, size_t len, uint8_t bufferKB, uint32_t *crc, upload_pipe_stats_t *stats) {
+  upload_pipe_t pipe;
+  memset(&pipe, 0, sizeof(upload_pipe_t));
+  memset(stats, 0, sizeof(upload_pipe_stats_t));
+  pipe.bufferSize = (bufferKB < UPLOAD_PIPE_BUFFER_KB_MAX ? bufferKB : UPLOAD_PIPE_BUFFER_KB_MAX) * 1024;
+  pipe.file = file;
+  pipe.len = len;
+  pipe.crc = crc;
+  if (!pipe.bufferSize) {
+    return false;
+  }
+
+  bool ready = true;
+  for (uint8_t i = 0; ready && i < UPLOAD_PIPE_BUFFER_COUNT; i++) {
+    pipe.buffers[i] = (uint8_t *)heap_caps_malloc(pipe.bufferSize, MALLOC_CAP_SPIRAM);
+    ready = pipe.buffers[i] != NULL;
+  }
+  if (ready) {
+    pipe.freeBuffers = xQueueCreate(UPLOAD_PIPE_BUFFER_COUNT, sizeof(uint8_t));
+    // Room for the end marker after the filled buffers, so the read task never waits for it
+    pipe.filledBlocks = xQueueCreate(UPLOAD_PIPE_BUFFER_COUNT + 1, sizeof(upload_pipe_block_t));
+    ready = pipe.freeBuffers && pipe.filledBlocks;
+  }
+  for (uint8_t i = 0; ready && i < UPLOAD_PIPE_BUFFER_COUNT; i++) {
+    xQueueSend(pipe.freeBuffers, &i, 0);
+  }
+  uint32_t startUs = getTelemetryTimeUs();
+  if (!ready || xTaskCreatePinnedToCore(readFileTask, "upload-read", UPLOAD_PIPE_TASK_STACK_SIZE, &pipe, UPLOAD_PIPE_TASK_PRIORITY, NULL, tskNO_AFFINITY) != pdPASS) {
+    logWarn(UPLOAD_PIPE_LOG, "%s: no pipeline of 2 x %u bytes, sending by small blocks.", __func__, (unsigned int)pipe.bufferSize);
+    releasePipeline(&pipe);
+    return false;
+  }
+
+  upload_pipe_block_t block;
+  while (xQueueReceive(pipe.filledBlocks, &block, portMAX_DELAY) == pdPASS && block.len) {
+    if (!pipe.aborted) {
+      uint32_t sendStartUs = getTelemetryTimeUs();
+      size_t sentLen = client->write(pipe.buffers[block.buffer], block.len);
+      stats->sendUs += getTelemetryTimeUs() - sendStartUs;
+      stats->sentBytes += sentLen;
+      pipe.aborted = sentLen != block.len;
+    }
+    xQueueSend(pipe.freeBuffers, &(block.buffer), portMAX_DELAY);
+  }
+  stats->durationUs = getTelemetryTimeUs() - startUs;
+  stats->readUs = pipe.readUs;
+  stats->pipelined = true;
+  releasePipeline(&pipe);
+  return true;
+}
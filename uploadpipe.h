@@ -0,0 +1,80 @@
+#ifndef UPLOADPIPE_H
+#define UPLOADPIPE_H
+
+#include "Arduino.h"
+#include "logging.h"
+#include "telemetry.h"
+#include "FS.h"
+#include "WiFi.h"
+#include "esp32/rom/crc.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+// Logger name for this module
+#define UPLOAD_PIPE_LOG "UploadPipe"
+
+// Default size in KB of each buffer of the send pipeline, see upload_settings_t.sendBufferKB
+#define UPLOAD_PIPE_BUFFER_KB_DEFAULT 16
+// Maximum size in KB of each buffer of the send pipeline
+#define UPLOAD_PIPE_BUFFER_KB_MAX 32
+// Number of buffers allocated in PSRAM: one is filled from the SD card while the other is sent
+#define UPLOAD_PIPE_BUFFER_COUNT 2
+// Stack size in bytes of the read task
+#define UPLOAD_PIPE_TASK_STACK_SIZE 4096
+// Priority of the read task, the one of the jobs: it reads while the upload job waits for the network
+#define UPLOAD_PIPE_TASK_PRIORITY 1
+
+/**
+ * Buffer of the send pipeline filled by the read task.
+ */
+typedef struct {
+  uint8_t buffer;             // Buffer number, from 0
+  size_t len;                 // Number of bytes read in the buffer, 0 for the end of the file
+} upload_pipe_block_t;
+
+/**
+ * State of the send pipeline of a file, shared by the read task and the sending task.
+ *
+ * @see sendFileByPipeline()
+ */
+typedef struct {
+  QueueHandle_t freeBuffers;                    // Numbers of the buffers ready to be filled
+  QueueHandle_t filledBlocks;                   // upload_pipe_block_t read from the file, in order, up to the end marker
+  uint8_t *buffers[UPLOAD_PIPE_BUFFER_COUNT];   // Buffers in PSRAM
+  size_t bufferSize;                            // Size of each buffer
+  File *file;                                   // File read by the read task, from its current position
+  size_t len;                                   // Number of bytes to read from the file
+  uint32_t *crc;                                // CRC-32 updated by the read task with the data read, NULL to skip it
+  uint32_t readUs;                              // Time spent by the read task reading the file
+  volatile bool aborted;                        // Set by the sending task when the client fails: the read task stops
+} upload_pipe_t;
+
+/**
+ * Measures of the sending of a file, to tell whether it is bound by the SD card or by the network.
+ */
+typedef struct {
+  uint32_t sentBytes;         // Number of bytes sent
+  uint32_t durationUs;        // Duration of the whole sending
+  uint32_t readUs;            // Time spent reading the file, overlapped with the sending by the pipeline
+  uint32_t sendUs;            // Time spent writing to the client
+  bool pipelined;             // True when the file has been sent by the pipeline
+} upload_pipe_stats_t;
+
+/**
+ * @brief Send data read from a file to a client with two tasks: the read task fills a buffer
+ *        from the SD card while the calling task sends the other one.
+ *
+ * @param client     the client
+ * @param file       the file, at the beginning of the data
+ * @param len        the number of bytes to send. Sending stops earlier at the end of the file.
+ * @param bufferKB   the size in KB of each buffer, up to UPLOAD_PIPE_BUFFER_KB_MAX
+ * @param crc        the CRC-32 updated with the data read, NULL to skip it
+ * @param stats      the measures receiving the sending
+ *
+ * @return false when the pipeline is disabled by a 0 bufferKB or can't be set up: nothing has been read nor sent
+ */
+bool sendFileByPipeline(WiFiClient *client, File *file, size_t len, uint8_t bufferKB, uint32_t *crc, upload_pipe_stats_t *stats);
+
+#endif
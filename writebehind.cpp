@@ -0,0 +1,298 @@
+#include "writebehind.h"
+
+// Event group bit set by the flush task each time a picture has been written
+#define WRITE_BEHIND_WRITTEN_BIT (1UL << 0)
+// Event group bit set by the flush task when it stops
+#define WRITE_BEHIND_STOPPED_BIT (1UL << 1)
+
+// Queue started by startWriteBehind(), NULL when none
+static write_behind_t *writeBehind = NULL;
+// Maximum number of bytes of the queued pictures, set by setWriteBehindQueueMaxBytes()
+static size_t writeBehindQueueMaxBytes = WRITE_BEHIND_QUEUE_MAX_BYTES;
+// Protects the counters of the queue, updated by the producer and the flush task
+static portMUX_TYPE writeBehindMux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief FreeRTOS task saving the queued pictures on the SD card, in order, until the NULL end marker.
+ *
+ * A picture which can't be saved is abandoned in the catalog:
+ * the next pictures are saved after it, so the upload must not stop there.
+ *
+ * @param param the write_behind_t
+ */
+static void flushPicturesTask(void *param) {
+  write_behind_t *wb = (write_behind_t *)param;
+  write_behind_picture_t *picture;
+
+  while (xQueueReceive(wb->pictures, &picture, portMAX_DELAY) == pdPASS && picture) {
+    if (savePictureByIndex(picture->storage, picture->index, (uint8_t *)(picture + 1), picture->len, &(picture->record)) != IS_OK) {
+      picture->record.index = picture->index;
+      picture->record.length = picture->len;
+      picture->record.flags |= CATALOG_FLAG_ABANDONED;
+      writeCatalogRecord(&(picture->record));
+      wb->failedCount++;
+    }
+    portENTER_CRITICAL(&writeBehindMux);
+    wb->queuedBytes -= picture->len;
+    wb->pendingIndex = picture->index < wb->lastIndex ? picture->index + 1 : 0;
+    portEXIT_CRITICAL(&writeBehindMux);
+    heap_caps_free(picture);
+    xEventGroupSetBits(wb->events, WRITE_BEHIND_WRITTEN_BIT);
+  }
+
+  // The queue must not be used after this bit: endWriteBehind() may release it.
+  xEventGroupSetBits(wb->events, WRITE_BEHIND_STOPPED_BIT);
+  vTaskDelete(NULL);
+}
+
+/**
+ * @brief Get the index of the first picture of a queue not written yet.
+ *
+ * @param wb the queue
+ *
+ * @return the picture index, 0 when all the queued pictures are written
+ */
+static uint32_t readPendingIndex(write_behind_t *wb) {
+  portENTER_CRITICAL(&writeBehindMux);
+  uint32_t pendingIndex = wb->pendingIndex;
+  portEXIT_CRITICAL(&writeBehindMux);
+  return pendingIndex;
+}
+
+/**
+ * @brief Wait for the queued pictures up to the given index to be written.
+ *
+ * There is a single waiter at a time: the save job spilling a picture over,
+ * then the upload job, then zzzzZZZZ().
+ *
+ * @param wb        the queue
+ * @param index     the picture index
+ * @param timeoutMs the maximum waiting time
+ *
+ * @return true when the picture is written or not queued, false when the timeout expired
+ */
+static bool waitWriteBehind(write_behind_t *wb, uint32_t index, uint32_t timeoutMs) {
+  TickType_t startTicks = xTaskGetTickCount();
+  TickType_t timeoutTicks = pdMS_TO_TICKS(timeoutMs);
+
+  for (;;) {
+    // Cleared before the check, so a picture written after it is not missed
+    xEventGroupClearBits(wb->events, WRITE_BEHIND_WRITTEN_BIT);
+    uint32_t pendingIndex = readPendingIndex(wb);
+    if (!pendingIndex || pendingIndex > index) {
+      return true;
+    }
+    TickType_t elapsedTicks = xTaskGetTickCount() - startTicks;
+    if (elapsedTicks >= timeoutTicks) {
+      return false;
+    }
+    xEventGroupWaitBits(wb->events, WRITE_BEHIND_WRITTEN_BIT, pdFALSE, pdFALSE, timeoutTicks - elapsedTicks);
+  }
+}
+
+/**
+ * @brief Set the maximum number of bytes of the queued pictures, WRITE_BEHIND_QUEUE_MAX_BYTES by default,
+ *        e.g. what the SD card writes before the flush deadline, see selectSdStrategy().
+ *
+ * @param maxBytes the maximum number of bytes
+ */
+void setWriteBehindQueueMaxBytes(size_t maxBytes) {
+  writeBehindQueueMaxBytes = maxBytes;
+}
+
+/**
+ * @brief Start the flush task writing the queued pictures on the SD card in the background.
+ *
+ * The SD card has to be mounted first by calling initSdCard(). It stays mounted until endWriteBehind().
+ * The flush task has a lower priority than the jobs: it writes while they wait for the camera or the network,
+ * so an SD card stalled by its garbage collection doesn't delay them.
+ * Nothing is done when it is already started.
+ *
+ * @param flushDeadlineMs the maximum time to wait for the queue to be flushed before saving a spilled picture
+ *
+ * @return IS_OK when it succeeds or SD_WRITE_ERROR when the queue or the task can't be created
+ */
+status_code_t startWriteBehind(uint16_t flushDeadlineMs) {
+  if (writeBehind) {
+    return IS_OK;
+  }
+  write_behind_t *wb = (write_behind_t *)calloc(1, sizeof(write_behind_t));
+  if (wb) {
+    wb->pictures = xQueueCreate(WRITE_BEHIND_QUEUE_LENGTH, sizeof(write_behind_picture_t *));
+    wb->events = xEventGroupCreate();
+    wb->flushDeadlineMs = flushDeadlineMs;
+  }
+  if (!wb || !wb->pictures || !wb->events) {
+    logError(WRITE_BEHIND_LOG, "%s: failed to create the queue.", __func__);
+  } else {
+    // The flush task updates the catalog while the upload reads it
+    enableCatalogLock();
+    if (xTaskCreatePinnedToCore(flushPicturesTask, "flush", WRITE_BEHIND_TASK_STACK_SIZE, wb, WRITE_BEHIND_TASK_PRIORITY, NULL, tskNO_AFFINITY)
+        == pdPASS) {
+      writeBehind = wb;
+      logInfo(WRITE_BEHIND_LOG, "Write-behind queue of %u bytes started.", (unsigned int)writeBehindQueueMaxBytes);
+      return IS_OK;
+    }
+    logError(WRITE_BEHIND_LOG, "%s: failed to create the flush task.", __func__);
+  }
+  if (wb && wb->pictures) {
+    vQueueDelete(wb->pictures);
+  }
+  if (wb && wb->events) {
+    vEventGroupDelete(wb->events);
+  }
+  free(wb);
+  return SD_WRITE_ERROR;
+}
+
+/**
+ * @brief Queue a picture to be saved on the SD card by the flush task, or save it
+ *        when the queue is full or not started.
+ *
+ * The picture is copied in PSRAM with its catalog record: the caller can return the frame buffer
+ * to the camera as soon as it is queued. It is saved by savePictureByIndex().
+ * When the queue lacks a slot or bytes, see setWriteBehindQueueMaxBytes(), or the PSRAM is exhausted,
+ * the picture spills over: the caller waits for the queue to be flushed, so the pictures
+ * are written in order, then saves it. The spilled pictures are counted and recorded in the telemetry.
+ * Should the queue not be flushed before the deadline given to startWriteBehind(), e.g. by a stalled SD card,
+ * the picture is not saved.
+ *
+ * @param storage       the storage layout, see picture_storage_t
+ * @param index         the picture index, from 1, following the last queued one
+ * @param pictureBuffer the picture data, copied: the frame buffer can be returned once queued
+ * @param pictureLen    the length of the picture data
+ * @param record        the catalog record with its hash, flags and priority
+ *
+ * @return IS_OK when the picture is queued or saved. SD_WRITE_ERROR when it could not be saved
+ */
+status_code_t writePictureBehind(uint8_t storage, uint32_t index, uint8_t *pictureBuffer, size_t pictureLen, catalog_record_t *record) {
+  write_behind_t *wb = writeBehind;
+  write_behind_picture_t *picture = NULL;
+
+  if (!wb) {
+    return savePictureByIndex(storage, index, pictureBuffer, pictureLen, record);
+  }
+
+  portENTER_CRITICAL(&writeBehindMux);
+  size_t queuedBytes = wb->queuedBytes;
+  portEXIT_CRITICAL(&writeBehindMux);
+  // Single producer: a free slot can't be taken before the picture is sent
+  if (uxQueueMessagesWaiting(wb->pictures) < WRITE_BEHIND_QUEUE_LENGTH && queuedBytes + pictureLen <= writeBehindQueueMaxBytes) {
+    picture = (write_behind_picture_t *)heap_caps_malloc(sizeof(write_behind_picture_t) + pictureLen, MALLOC_CAP_SPIRAM);
+  }
+
+  if (!picture) {
+    uint32_t startUs = getTelemetryTimeUs();
+    logWarn(WRITE_BEHIND_LOG, "%s: picture %u of %u bytes spilled over, %u bytes queued.", __func__, (unsigned int)index,
+            (unsigned int)pictureLen, (unsigned int)queuedBytes);
+    status_code_t result = SD_WRITE_ERROR;
+    if (waitWriteBehind(wb, wb->lastIndex, wb->flushDeadlineMs)) {
+      result = savePictureByIndex(storage, index, pictureBuffer, pictureLen, record);
+    } else {
+      logError(WRITE_BEHIND_LOG, "%s: queue not flushed within %u ms, picture %u not saved.", __func__,
+               (unsigned int)wb->flushDeadlineMs, (unsigned int)index);
+    }
+    wb->spilledCount++;
+    wb->spilledBytes += pictureLen;
+    recordTransfer(TELEMETRY_PHASE_SPILL, startUs, pictureLen, result);
+    return result;
+  }
+
+  picture->storage = storage;
+  picture->index = index;
+  picture->len = pictureLen;
+  picture->record = *record;
+  memcpy(picture + 1, pictureBuffer, pictureLen);
+  // Updated before the picture is sent, so the flush task sees it
+  portENTER_CRITICAL(&writeBehindMux);
+  wb->queuedBytes += pictureLen;
+  if (wb->queuedBytes > wb->peakBytes) {
+    wb->peakBytes = wb->queuedBytes;
+  }
+  if (!wb->pendingIndex) {
+    wb->pendingIndex = index;
+  }
+  wb->lastIndex = index;
+  portEXIT_CRITICAL(&writeBehindMux);
+  wb->queuedCount++;
+  xQueueSend(wb->pictures, &picture, portMAX_DELAY);
+  logDebug(WRITE_BEHIND_LOG, "%s: picture %u queued.", __func__, (unsigned int)index);
+  return IS_OK;
+}
+
+/**
+ * @brief Wait for a queued picture to be written on the SD card, e.g. before reading it.
+ *
+ * @param index     the picture index
+ * @param timeoutMs the maximum waiting time
+ *
+ * @return true when the picture is written or not queued, false when the timeout expired
+ */
+bool waitPictureWritten(uint32_t index, uint32_t timeoutMs) {
+  write_behind_t *wb = writeBehind;
+  return !wb || waitWriteBehind(wb, index, timeoutMs);
+}
+
+/**
+ * @brief Get the index of the first queued picture not written yet.
+ *        Its catalog record and the next ones are not written either.
+ *
+ * @return the picture index, 0 when all the queued pictures are written
+ */
+uint32_t getPendingPictureIndex() {
+  write_behind_t *wb = writeBehind;
+  return wb ? readPendingIndex(wb) : 0;
+}
+
+/**
+ * @brief Wait for the queued pictures to be written before the deadline,
+ *        then stop the flush task.
+ *
+ * It is the barrier before the deep sleep. The next writePictureBehind() calls save the pictures directly.
+ * When the deadline expires, e.g. on an SD card stalled for too long, the pictures still queued are lost
+ * and the flush task is left to the deep sleep: the SD card must not be unmounted.
+ * The wait is recorded in the telemetry with the number of bytes queued when it started.
+ *
+ * @param deadlineMs     the maximum waiting time
+ * @param firstLostIndex receiving the index of the first picture not written when the deadline expired, else 0
+ *
+ * @return IS_OK when all the queued pictures have been processed or SD_WRITE_ERROR when the deadline expired
+ */
+status_code_t endWriteBehind(uint32_t deadlineMs, uint32_t *firstLostIndex) {
+  write_behind_t *wb = writeBehind;
+  write_behind_picture_t *endMarker = NULL;
+
+  *firstLostIndex = 0;
+  if (!wb) {
+    return IS_OK;
+  }
+  writeBehind = NULL;
+
+  uint32_t startUs = getTelemetryTimeUs();
+  TickType_t startTicks = xTaskGetTickCount();
+  portENTER_CRITICAL(&writeBehindMux);
+  size_t queuedBytes = wb->queuedBytes;
+  portEXIT_CRITICAL(&writeBehindMux);
+  bool stopped = xQueueSend(wb->pictures, &endMarker, pdMS_TO_TICKS(deadlineMs)) == pdPASS;
+  if (stopped) {
+    TickType_t elapsedTicks = xTaskGetTickCount() - startTicks;
+    TickType_t leftTicks = elapsedTicks < pdMS_TO_TICKS(deadlineMs) ? pdMS_TO_TICKS(deadlineMs) - elapsedTicks : 0;
+    stopped = xEventGroupWaitBits(wb->events, WRITE_BEHIND_STOPPED_BIT, pdFALSE, pdFALSE, leftTicks) & WRITE_BEHIND_STOPPED_BIT;
+  }
+
+  if (!stopped) {
+    *firstLostIndex = readPendingIndex(wb);
+    logError(WRITE_BEHIND_LOG, "%s: deadline of %u ms expired, pictures from %u not written.", __func__, (unsigned int)deadlineMs,
+             (unsigned int)*firstLostIndex);
+    recordTransfer(TELEMETRY_PHASE_FLUSH, startUs, queuedBytes, SD_WRITE_ERROR);
+    return SD_WRITE_ERROR;
+  }
+
+  logInfo(WRITE_BEHIND_LOG, "%u picture(s) written behind, %u failed, peak %u bytes queued. %u picture(s) spilled over (%u bytes).",
+          wb->queuedCount, wb->failedCount, (unsigned int)wb->peakBytes, wb->spilledCount, (unsigned int)wb->spilledBytes);
+  recordTransfer(TELEMETRY_PHASE_FLUSH, startUs, queuedBytes, IS_OK);
+  vQueueDelete(wb->pictures);
+  vEventGroupDelete(wb->events);
+  free(wb);
+  return IS_OK;
+}
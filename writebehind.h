@@ -0,0 +1,120 @@
+#ifndef WRITEBEHIND_H
+#define WRITEBEHIND_H
+
+#include "Arduino.h"
+#include "catalog.h"
+#include "error.h"
+#include "logging.h"
+#include "sd.h"
+#include "telemetry.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+// Logger name for this module
+#define WRITE_BEHIND_LOG "WriteBehind"
+
+// Default value of app_config_t.writeBehind
+#define WRITE_BEHIND_DEFAULT true
+// Default value of app_config_t.flushDeadlineMs
+#define WRITE_BEHIND_FLUSH_DEADLINE_MS_DEFAULT 10000
+// Maximum number of pictures waiting in the queue
+#define WRITE_BEHIND_QUEUE_LENGTH 16
+// Default maximum number of bytes of the pictures waiting in the queue, copied in PSRAM.
+// A picture exceeding it is spilled over, i.e. saved by the caller. See setWriteBehindQueueMaxBytes().
+#define WRITE_BEHIND_QUEUE_MAX_BYTES (1024 * 1024)
+// Stack size in bytes of the flush task
+#define WRITE_BEHIND_TASK_STACK_SIZE 6144
+// Priority of the flush task, below the jobs: it writes while they wait for the camera or the network
+#define WRITE_BEHIND_TASK_PRIORITY 0
+
+/**
+ * Picture waiting in the write-behind queue, allocated in PSRAM with its data following it.
+ */
+typedef struct {
+  uint8_t storage;            // Storage layout of the pictures, see picture_storage_t
+  uint32_t index;             // Picture index, from 1
+  size_t len;                 // Length of the JPEG data
+  catalog_record_t record;    // Catalog record with its hash, flags and priority, see savePictureByIndex()
+} write_behind_picture_t;
+
+/**
+ * State of the write-behind queue, shared by the producer, the flush task and the waiters.
+ *
+ * @see startWriteBehind()
+ */
+typedef struct {
+  QueueHandle_t pictures;     // Queued write_behind_picture_t pointers. NULL stops the flush task.
+  EventGroupHandle_t events;  // Signaled by the flush task at each written picture and when it stops
+  uint32_t pendingIndex;      // Index of the first picture not written yet, 0 when the queue is flushed
+  uint32_t lastIndex;         // Index of the last queued picture
+  size_t queuedBytes;         // Bytes of the pictures waiting in the queue
+  size_t peakBytes;           // Highest value of queuedBytes
+  uint16_t queuedCount;       // Number of pictures queued
+  uint16_t failedCount;       // Number of queued pictures which could not be written, abandoned in the catalog
+  uint16_t spilledCount;      // Number of pictures saved by the caller as they did not fit in the queue
+  uint32_t spilledBytes;      // Bytes of the spilled pictures
+  uint16_t flushDeadlineMs;   // Maximum time in ms to wait for the queue to be flushed before saving a spilled picture
+} write_behind_t;
+
+/**
+ * @brief Set the maximum number of bytes of the queued pictures, WRITE_BEHIND_QUEUE_MAX_BYTES by default.
+ *
+ * @param maxBytes the maximum number of bytes
+ */
+void setWriteBehindQueueMaxBytes(size_t maxBytes);
+
+/**
+ * @brief Start the flush task writing the queued pictures on the SD card in the background.
+ *
+ * @param flushDeadlineMs the maximum time to wait for the queue to be flushed before saving a spilled picture
+ *
+ * @return IS_OK when it succeeds or SD_WRITE_ERROR when the queue or the task can't be created
+ */
+status_code_t startWriteBehind(uint16_t flushDeadlineMs);
+
+/**
+ * @brief Queue a picture to be saved on the SD card by the flush task, or save it
+ *        when the queue is full or not started.
+ *
+ * @param storage       the storage layout, see picture_storage_t
+ * @param index         the picture index, from 1, following the last queued one
+ * @param pictureBuffer the picture data, copied: the frame buffer can be returned once queued
+ * @param pictureLen    the length of the picture data
+ * @param record        the catalog record with its hash, flags and priority
+ *
+ * @return IS_OK when the picture is queued or saved. SD_WRITE_ERROR when it could not be saved
+ */
+status_code_t writePictureBehind(uint8_t storage, uint32_t index, uint8_t *pictureBuffer, size_t pictureLen, catalog_record_t *record);
+
+/**
+ * @brief Wait for a queued picture to be written on the SD card.
+ *
+ * @param index     the picture index
+ * @param timeoutMs the maximum waiting time
+ *
+ * @return true when the picture is written or not queued, false when the timeout expired
+ */
+bool waitPictureWritten(uint32_t index, uint32_t timeoutMs);
+
+/**
+ * @brief Get the index of the first queued picture not written yet.
+ *
+ * @return the picture index, 0 when all the queued pictures are written
+ */
+uint32_t getPendingPictureIndex();
+
+/**
+ * @brief Wait for the queued pictures to be written before the deadline,
+ *        then stop the flush task.
+ *
+ * @param deadlineMs     the maximum waiting time
+ * @param firstLostIndex receiving the index of the first picture not written when the deadline expired, else 0
+ *
+ * @return IS_OK when all the queued pictures have been processed or SD_WRITE_ERROR when the deadline expired
+ */
+status_code_t endWriteBehind(uint32_t deadlineMs, uint32_t *firstLostIndex);
+
+#endif